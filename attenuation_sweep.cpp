@@ -0,0 +1,234 @@
+#include "attenuation_sweep.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+// Освещённость, заметная в 8 битах
+const float VISIBLE_IRRADIANCE = 1.0f / 255.0f;
+
+// Нулевые коэффициенты затухания дают бесконечную освещённость, а не деление на ноль
+const float MIN_DENOMINATOR = 1e-6f;
+
+inline uint32_t greyPixel(float irradiance) {
+    uint32_t v = static_cast<uint32_t>(std::min(irradiance, 1.0f) * 255.0f + 0.5f);
+    return v | v << 8 | v << 16 | 0xFF000000u;
+}
+
+// Суммы одной строки развёртки
+struct RowTotals {
+    float weighted = 0.0f;
+    float max = 0.0f;
+    float lit = 0.0f;
+    float saturated = 0.0f;
+};
+
+RowTotals evaluateRow(const SpotGeometry& geometry, const AttenuationSetting& setting, size_t begin, size_t end,
+                      uint32_t* pixels) {
+    const float* factor = geometry.factor.data();
+    const float* distance = geometry.distance.data();
+    const float* area = geometry.area.data();
+    RowTotals totals;
+    size_t i = begin;
+
+#if defined(__AVX2__)
+    const __m256 kc = _mm256_set1_ps(setting.constant), kl = _mm256_set1_ps(setting.linear);
+    const __m256 kq = _mm256_set1_ps(setting.quadratic), smallest = _mm256_set1_ps(MIN_DENOMINATOR);
+    const __m256 one = _mm256_set1_ps(1.0f), visible = _mm256_set1_ps(VISIBLE_IRRADIANCE);
+    const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+    __m256 weighted = _mm256_setzero_ps(), peak = _mm256_setzero_ps();
+    __m256 lit = _mm256_setzero_ps(), saturated = _mm256_setzero_ps();
+    for (; i + 8 <= end; i += 8) {
+        __m256 d = _mm256_loadu_ps(distance + i), w = _mm256_loadu_ps(area + i);
+        __m256 denominator = _mm256_add_ps(kc, _mm256_mul_ps(d, _mm256_add_ps(kl, _mm256_mul_ps(kq, d))));
+        __m256 e = _mm256_div_ps(_mm256_loadu_ps(factor + i), _mm256_max_ps(denominator, smallest));
+        weighted = _mm256_add_ps(weighted, _mm256_mul_ps(e, w));
+        peak = _mm256_max_ps(peak, e);
+        lit = _mm256_add_ps(lit, _mm256_and_ps(w, _mm256_cmp_ps(e, visible, _CMP_GE_OQ)));
+        saturated = _mm256_add_ps(saturated, _mm256_and_ps(w, _mm256_cmp_ps(e, one, _CMP_GE_OQ)));
+        if (pixels) {
+            __m256i v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(e, one), scale), half));
+            __m256i grey = _mm256_or_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 8)),
+                                           _mm256_or_si256(_mm256_slli_epi32(v, 16), alpha));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + (i - begin)), grey);
+        }
+    }
+    alignas(32) float lanes[4][8];
+    _mm256_store_ps(lanes[0], weighted);
+    _mm256_store_ps(lanes[1], peak);
+    _mm256_store_ps(lanes[2], lit);
+    _mm256_store_ps(lanes[3], saturated);
+    for (int k = 0; k < 8; ++k) {
+        totals.weighted += lanes[0][k];
+        totals.max = std::max(totals.max, lanes[1][k]);
+        totals.lit += lanes[2][k];
+        totals.saturated += lanes[3][k];
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 kc = _mm_set1_ps(setting.constant), kl = _mm_set1_ps(setting.linear);
+    const __m128 kq = _mm_set1_ps(setting.quadratic), smallest = _mm_set1_ps(MIN_DENOMINATOR);
+    const __m128 one = _mm_set1_ps(1.0f), visible = _mm_set1_ps(VISIBLE_IRRADIANCE);
+    const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    __m128 weighted = _mm_setzero_ps(), peak = _mm_setzero_ps();
+    __m128 lit = _mm_setzero_ps(), saturated = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 d = _mm_loadu_ps(distance + i), w = _mm_loadu_ps(area + i);
+        __m128 denominator = _mm_add_ps(kc, _mm_mul_ps(d, _mm_add_ps(kl, _mm_mul_ps(kq, d))));
+        __m128 e = _mm_div_ps(_mm_loadu_ps(factor + i), _mm_max_ps(denominator, smallest));
+        weighted = _mm_add_ps(weighted, _mm_mul_ps(e, w));
+        peak = _mm_max_ps(peak, e);
+        lit = _mm_add_ps(lit, _mm_and_ps(w, _mm_cmpge_ps(e, visible)));
+        saturated = _mm_add_ps(saturated, _mm_and_ps(w, _mm_cmpge_ps(e, one)));
+        if (pixels) {
+            __m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(e, one), scale), half));
+            __m128i grey = _mm_or_si128(_mm_or_si128(v, _mm_slli_epi32(v, 8)),
+                                        _mm_or_si128(_mm_slli_epi32(v, 16), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + (i - begin)), grey);
+        }
+    }
+    alignas(16) float lanes[4][4];
+    _mm_store_ps(lanes[0], weighted);
+    _mm_store_ps(lanes[1], peak);
+    _mm_store_ps(lanes[2], lit);
+    _mm_store_ps(lanes[3], saturated);
+    for (int k = 0; k < 4; ++k) {
+        totals.weighted += lanes[0][k];
+        totals.max = std::max(totals.max, lanes[1][k]);
+        totals.lit += lanes[2][k];
+        totals.saturated += lanes[3][k];
+    }
+#endif
+
+    // Остаток (и вся строка без векторных команд)
+    for (; i < end; ++i) {
+        float d = distance[i];
+        float denominator = setting.constant + d * (setting.linear + setting.quadratic * d);
+        float e = factor[i] / std::max(denominator, MIN_DENOMINATOR);
+        totals.weighted += e * area[i];
+        totals.max = std::max(totals.max, e);
+        if (e >= VISIBLE_IRRADIANCE) totals.lit += area[i];
+        if (e >= 1.0f) totals.saturated += area[i];
+        if (pixels) pixels[i - begin] = greyPixel(e);
+    }
+    return totals;
+}
+
+} // namespace
+
+CylinderSurface makeCylinderSurface(int columns, int rows, float radius, float height) {
+    CylinderSurface surface;
+    surface.columns = std::max(1, columns);
+    surface.rows = std::max(1, rows);
+    size_t count = static_cast<size_t>(surface.columns) * surface.rows;
+    for (std::vector<float>* component : {&surface.px, &surface.py, &surface.pz, &surface.nx, &surface.ny,
+                                          &surface.nz, &surface.area}) {
+        component->resize(count);
+    }
+
+    float path = 2 * radius + height;
+    float step = path / surface.rows;
+    float sector = 2 * PI / surface.columns;
+    for (int row = 0; row < surface.rows; ++row) {
+        float s = (row + 0.5f) * step;
+        float rho, y, normalY;
+        if (s < radius) {
+            rho = s;
+            y = height / 2;
+            normalY = 1.0f;
+        }
+        else if (s < radius + height) {
+            rho = radius;
+            y = height / 2 - (s - radius);
+            normalY = 0.0f;
+        }
+        else {
+            rho = path - s;
+            y = -height / 2;
+            normalY = -1.0f;
+        }
+        for (int column = 0; column < surface.columns; ++column) {
+            float theta = (column + 0.5f) * sector;
+            float c = std::cos(theta), sn = std::sin(theta);
+            size_t i = static_cast<size_t>(row) * surface.columns + column;
+            surface.px[i] = rho * c;
+            surface.py[i] = y;
+            surface.pz[i] = rho * sn;
+            surface.nx[i] = normalY == 0.0f ? c : 0.0f;
+            surface.ny[i] = normalY;
+            surface.nz[i] = normalY == 0.0f ? sn : 0.0f;
+            // На основаниях - кольцо шириной step, на боковой поверхности - полоса
+            surface.area[i] = rho * step * sector;
+        }
+    }
+    return surface;
+}
+
+SpotGeometry makeSpotGeometry(const CylinderSurface& surface, const SpotLightSource& light) {
+    SpotGeometry geometry;
+    geometry.columns = surface.columns;
+    geometry.rows = surface.rows;
+    geometry.factor.resize(surface.size());
+    geometry.distance.resize(surface.size());
+    geometry.area = surface.area;
+    float cosCutoff = std::cos(radians(light.cutoff));
+    for (size_t i = 0; i < surface.size(); ++i) {
+        float l[3] = {light.position[0] - surface.px[i], light.position[1] - surface.py[i],
+                      light.position[2] - surface.pz[i]};
+        float distance = std::sqrt(l[0] * l[0] + l[1] * l[1] + l[2] * l[2]);
+        for (float& c : l) c /= distance;
+        float spot = -(l[0] * light.direction[0] + l[1] * light.direction[1] + l[2] * light.direction[2]);
+        float facing = l[0] * surface.nx[i] + l[1] * surface.ny[i] + l[2] * surface.nz[i];
+        geometry.factor[i] = spot >= cosCutoff && facing > 0.0f ? std::pow(spot, light.exponent) * facing : 0.0f;
+        geometry.distance[i] = distance;
+        geometry.totalArea += surface.area[i];
+    }
+    return geometry;
+}
+
+IrradianceStats evaluateIrradiance(const SpotGeometry& geometry, const AttenuationSetting& setting,
+                                   uint8_t* pixels, size_t stride) {
+    // Строки суммируются в double: при больших развёртках сумма float теряет точность
+    double weighted = 0.0, lit = 0.0, saturated = 0.0;
+    float peak = 0.0f;
+    for (int row = 0; row < geometry.rows; ++row) {
+        size_t begin = static_cast<size_t>(row) * geometry.columns;
+        uint32_t* line = pixels ? reinterpret_cast<uint32_t*>(pixels + row * stride) : nullptr;
+        RowTotals totals = evaluateRow(geometry, setting, begin, begin + geometry.columns, line);
+        weighted += totals.weighted;
+        lit += totals.lit;
+        saturated += totals.saturated;
+        peak = std::max(peak, totals.max);
+    }
+
+    IrradianceStats stats;
+    if (geometry.totalArea > 0.0f) {
+        stats.mean = static_cast<float>(weighted / geometry.totalArea);
+        stats.litArea = static_cast<float>(lit / geometry.totalArea);
+        stats.saturatedArea = static_cast<float>(saturated / geometry.totalArea);
+    }
+    stats.max = peak;
+    return stats;
+}
+
+void sweepAttenuation(const SpotGeometry& geometry, const std::vector<AttenuationSetting>& settings,
+                      std::vector<IrradianceStats>& stats, uint8_t* atlas, int atlasColumns, TaskPool& pool) {
+    stats.resize(settings.size());
+    atlasColumns = std::max(1, atlasColumns);
+    size_t stride = static_cast<size_t>(atlasColumns) * geometry.columns * 4;
+    pool.parallelFor(settings.size(), [&](size_t i) {
+        uint8_t* pixels = nullptr;
+        if (atlas) {
+            size_t x = (i % atlasColumns) * geometry.columns;
+            size_t y = (i / atlasColumns) * geometry.rows;
+            pixels = atlas + y * stride + x * 4;
+        }
+        stats[i] = evaluateIrradiance(geometry, settings[i], pixels, stride);
+    });
+}
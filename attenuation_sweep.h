@@ -0,0 +1,73 @@
+#pragma once
+
+// Освещённость цилиндра прожектором лабораторной работы 4 на процессоре
+// для многих наборов коэффициентов затухания сразу. Поверхность цилиндра
+// развёрнута в прямоугольник точек; то, что от затухания не зависит
+// (конус, косинус падения, расстояние до прожектора), считается для точек
+// один раз, и набор коэффициентов стоит одного деления на точку:
+//   E = spot^exponent * max(N·L, 0) / (constant + linear d + quadratic d^2),
+// как у GL_LIGHT0 в lab4, при единичной яркости прожектора.
+// Точки хранятся по компонентам, так что восемь (AVX2) или четыре (SSE2)
+// точки считаются одной командой; наборы делятся между потоками пула
+
+#include "lab4_scene.h"
+#include "task_pool.h"
+#include <cstdint>
+#include <vector>
+
+struct AttenuationSetting {
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// Освещённость поверхности при одном наборе, доли - по площади
+struct IrradianceStats {
+    float mean = 0.0f;
+    float max = 0.0f;
+    float litArea = 0.0f;       // освещённость не меньше 1/255 (виден хоть какой-то свет)
+    float saturatedArea = 0.0f; // освещённость не меньше 1 (пересвет)
+};
+
+// Развёртка цилиндра с осью Y и центром в начале координат: столбец -
+// угол вокруг оси, строка - путь от центра верхнего основания по радиусу
+// к краю, вниз по боковой поверхности и по нижнему основанию к центру.
+// Строки делят путь поровну; у каждой точки своя доля площади
+struct CylinderSurface {
+    int columns = 0, rows = 0;
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+    std::vector<float> area;
+
+    size_t size() const { return px.size(); }
+};
+
+CylinderSurface makeCylinderSurface(int columns, int rows, float radius, float height);
+
+// Часть освещённости, не зависящая от затухания, и расстояние до
+// прожектора в каждой точке развёртки
+struct SpotGeometry {
+    int columns = 0, rows = 0;
+    std::vector<float> factor;
+    std::vector<float> distance;
+    std::vector<float> area;
+    float totalArea = 0.0f;
+
+    size_t size() const { return factor.size(); }
+};
+
+// light - в системе координат цилиндра
+SpotGeometry makeSpotGeometry(const CylinderSurface& surface, const SpotLightSource& light);
+
+// Освещённость при одном наборе. pixels - развёртка в оттенках серого
+// (RGBA, освещённость 1 - белый), строка за строкой через stride байт;
+// nullptr - только счётчики
+IrradianceStats evaluateIrradiance(const SpotGeometry& geometry, const AttenuationSetting& setting,
+                                   uint8_t* pixels = nullptr, size_t stride = 0);
+
+// Все наборы на потоках пула. Развёртка набора i ложится в атлас
+// (RGBA, atlasColumns развёрток в строке) в столбец i % atlasColumns и
+// строку i / atlasColumns; atlas == nullptr - только счётчики
+void sweepAttenuation(const SpotGeometry& geometry, const std::vector<AttenuationSetting>& settings,
+                      std::vector<IrradianceStats>& stats, uint8_t* atlas = nullptr, int atlasColumns = 1,
+                      TaskPool& pool = TaskPool::shared());
@@ -0,0 +1,370 @@
+#pragma once
+
+// Общая математика лабораторных работ: векторы, матрицы 4x4 по столбцам
+// (как в OpenGL), кватернионы и пакетное преобразование точек, хранящихся
+// по компонентам. Произведения матриц, матрица на вектор, пакеты точек и
+// обратный корень при нормировании считаются командами SSE (x86-64) или
+// NEON (ARM), без них - обычным кодом. Всё, что не требует
+// тригонометрии и корней, - constexpr
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define CG_MATH_SSE
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define CG_MATH_NEON
+#endif
+
+constexpr float PI = 3.14159265359f;
+
+constexpr float radians(float degrees) { return degrees * PI / 180.0f; }
+constexpr float degrees(float radians) { return radians * 180.0f / PI; }
+
+// 1/sqrt(x): приближение команды процессора и шаг Ньютона, без деления
+// и извлечения корня; точность - почти полная точность float
+inline float inverseSqrt(float x) {
+#if defined(CG_MATH_SSE)
+    float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return r * (1.5f - 0.5f * x * r * r);
+#elif defined(CG_MATH_NEON)
+    // Приближение NEON грубее (8 бит), нужны два шага
+    float32x2_t v = vdup_n_f32(x);
+    float32x2_t r = vrsqrte_f32(v);
+    r = vmul_f32(r, vrsqrts_f32(vmul_f32(v, r), r));
+    r = vmul_f32(r, vrsqrts_f32(vmul_f32(v, r), r));
+    return vget_lane_f32(r, 0);
+#else
+    return 1.0f / std::sqrt(x);
+#endif
+}
+
+struct Vec3 {
+    float x, y, z;
+
+    constexpr Vec3(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
+
+    constexpr Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
+    constexpr Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
+    constexpr Vec3 operator*(float f) const { return Vec3(x * f, y * f, z * f); }
+    constexpr Vec3 operator*(const Vec3& v) const { return Vec3(x * v.x, y * v.y, z * v.z); }
+    constexpr Vec3 operator/(float f) const { return Vec3(x / f, y / f, z / f); }
+    constexpr Vec3 operator-() const { return Vec3(-x, -y, -z); }
+    constexpr Vec3& operator+=(const Vec3& v) { return *this = *this + v; }
+    constexpr Vec3& operator-=(const Vec3& v) { return *this = *this - v; }
+    constexpr Vec3& operator*=(float f) { return *this = *this * f; }
+
+    constexpr float dot(const Vec3& v) const { return x * v.x + y * v.y + z * v.z; }
+    constexpr Vec3 cross(const Vec3& v) const { return Vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+
+    float length() const { return std::sqrt(dot(*this)); }
+    Vec3 normalize() const { return *this * inverseSqrt(dot(*this)); }
+};
+
+constexpr Vec3 operator*(float f, const Vec3& v) { return v * f; }
+constexpr float dot(const Vec3& a, const Vec3& b) { return a.dot(b); }
+constexpr Vec3 cross(const Vec3& a, const Vec3& b) { return a.cross(b); }
+inline float length(const Vec3& a) { return a.length(); }
+inline Vec3 normalize(const Vec3& a) { return a.normalize(); }
+constexpr Vec3 lerp(const Vec3& a, const Vec3& b, float t) { return a + (b - a) * t; }
+
+struct alignas(16) Vec4 {
+    float x, y, z, w;
+
+    constexpr Vec4(float x = 0, float y = 0, float z = 0, float w = 0) : x(x), y(y), z(z), w(w) {}
+    constexpr Vec4(const Vec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+    constexpr Vec4 operator+(const Vec4& v) const { return Vec4(x + v.x, y + v.y, z + v.z, w + v.w); }
+    constexpr Vec4 operator-(const Vec4& v) const { return Vec4(x - v.x, y - v.y, z - v.z, w - v.w); }
+    constexpr Vec4 operator*(float f) const { return Vec4(x * f, y * f, z * f, w * f); }
+
+    constexpr Vec3 xyz() const { return Vec3(x, y, z); }
+};
+
+constexpr float dot(const Vec4& a, const Vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+// Матрица по столбцам: m[col * 4 + row], загружается glLoadMatrixf(m)
+struct alignas(16) Mat4 {
+    float m[16];
+
+    static constexpr Mat4 identity() { return {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}}; }
+
+    constexpr Vec4 column(int col) const { return Vec4(m[col * 4], m[col * 4 + 1], m[col * 4 + 2], m[col * 4 + 3]); }
+};
+
+// out = a * b для матриц в массивах (по столбцам). out может совпадать
+// с a или b: все столбцы считаются до записи
+inline void multiplyMatrices(const float a[16], const float b[16], float out[16]) {
+#if defined(CG_MATH_SSE)
+    const __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    __m128 result[4];
+    for (int col = 0; col < 4; ++col) {
+        const float* c = b + col * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(c[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+        result[col] = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+    }
+    for (int col = 0; col < 4; ++col) _mm_storeu_ps(out + col * 4, result[col]);
+#elif defined(CG_MATH_NEON)
+    const float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+    float32x4_t result[4];
+    for (int col = 0; col < 4; ++col) {
+        const float* c = b + col * 4;
+        float32x4_t r = vmulq_n_f32(a0, c[0]);
+        r = vmlaq_n_f32(r, a1, c[1]);
+        r = vmlaq_n_f32(r, a2, c[2]);
+        result[col] = vmlaq_n_f32(r, a3, c[3]);
+    }
+    for (int col = 0; col < 4; ++col) vst1q_f32(out + col * 4, result[col]);
+#else
+    float result[16];
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) sum += a[k * 4 + row] * b[col * 4 + k];
+            result[col * 4 + row] = sum;
+        }
+    }
+    std::copy(result, result + 16, out);
+#endif
+}
+
+// Обратная к матрице поворота со сдвигом (видовой матрице камеры без масштаба)
+inline void invertRigidMatrix(const float m[16], float out[16]) {
+    float result[16];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) result[j * 4 + i] = m[i * 4 + j];
+        result[i * 4 + 3] = 0.0f;
+        result[12 + i] = -(m[i * 4] * m[12] + m[i * 4 + 1] * m[13] + m[i * 4 + 2] * m[14]);
+    }
+    result[15] = 1.0f;
+    std::copy(result, result + 16, out);
+}
+
+inline Mat4 multiply(const Mat4& a, const Mat4& b) {
+    Mat4 r;
+    multiplyMatrices(a.m, b.m, r.m);
+    return r;
+}
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b) { return multiply(a, b); }
+
+inline Vec4 operator*(const Mat4& a, const Vec4& v) {
+#if defined(CG_MATH_SSE)
+    __m128 r = _mm_mul_ps(_mm_load_ps(a.m), _mm_set1_ps(v.x));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a.m + 4), _mm_set1_ps(v.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a.m + 8), _mm_set1_ps(v.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a.m + 12), _mm_set1_ps(v.w)));
+    Vec4 out;
+    _mm_store_ps(&out.x, r);
+    return out;
+#elif defined(CG_MATH_NEON)
+    float32x4_t r = vmulq_n_f32(vld1q_f32(a.m), v.x);
+    r = vmlaq_n_f32(r, vld1q_f32(a.m + 4), v.y);
+    r = vmlaq_n_f32(r, vld1q_f32(a.m + 8), v.z);
+    r = vmlaq_n_f32(r, vld1q_f32(a.m + 12), v.w);
+    Vec4 out;
+    vst1q_f32(&out.x, r);
+    return out;
+#else
+    const float* m = a.m;
+    return Vec4(m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w, m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w,
+                m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w, m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w);
+#endif
+}
+
+// Точка (w = 1) и вектор (w = 0) без деления на w
+inline Vec3 transformPoint(const Mat4& a, const Vec3& p) { return (a * Vec4(p, 1.0f)).xyz(); }
+inline Vec3 transformVector(const Mat4& a, const Vec3& v) { return (a * Vec4(v, 0.0f)).xyz(); }
+
+inline Mat4 invertRigid(const Mat4& a) {
+    Mat4 r;
+    invertRigidMatrix(a.m, r.m);
+    return r;
+}
+
+constexpr Mat4 transpose(const Mat4& a) {
+    Mat4 r = {};
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) r.m[row * 4 + col] = a.m[col * 4 + row];
+    }
+    return r;
+}
+
+constexpr Mat4 translation(float x, float y, float z) {
+    return {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, y, z, 1}};
+}
+
+constexpr Mat4 translation(const Vec3& v) { return translation(v.x, v.y, v.z); }
+
+constexpr Mat4 scaling(float x, float y, float z) {
+    return {{x, 0, 0, 0, 0, y, 0, 0, 0, 0, z, 0, 0, 0, 0, 1}};
+}
+
+// Повороты на угол в градусах, как glRotatef вокруг осей X, Y и Z
+inline Mat4 rotationX(float degrees) {
+    float c = std::cos(radians(degrees)), s = std::sin(radians(degrees));
+    return {{1, 0, 0, 0, 0, c, s, 0, 0, -s, c, 0, 0, 0, 0, 1}};
+}
+
+inline Mat4 rotationY(float degrees) {
+    float c = std::cos(radians(degrees)), s = std::sin(radians(degrees));
+    return {{c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1}};
+}
+
+inline Mat4 rotationZ(float degrees) {
+    float c = std::cos(radians(degrees)), s = std::sin(radians(degrees));
+    return {{c, s, 0, 0, -s, c, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+}
+
+// Видовая матрица, как gluLookAt
+inline Mat4 lookAt(const Vec3& eye, const Vec3& target, const Vec3& up) {
+    Vec3 f = normalize(target - eye);
+    Vec3 s = normalize(cross(f, up));
+    Vec3 u = cross(s, f);
+    return {{s.x, u.x, -f.x, 0, s.y, u.y, -f.y, 0, s.z, u.z, -f.z, 0,
+             -dot(s, eye), -dot(u, eye), dot(f, eye), 1}};
+}
+
+// Перспективная проекция, как glFrustum
+constexpr Mat4 frustum(float left, float right, float bottom, float top, float zNear, float zFar) {
+    return {{2 * zNear / (right - left), 0, 0, 0,
+             0, 2 * zNear / (top - bottom), 0, 0,
+             (right + left) / (right - left), (top + bottom) / (top - bottom), (zFar + zNear) / (zNear - zFar), -1,
+             0, 0, 2 * zFar * zNear / (zNear - zFar), 0}};
+}
+
+// Перспективная проекция, как gluPerspective (fovY - по вертикали, в градусах)
+inline Mat4 perspective(float fovY, float aspect, float zNear, float zFar) {
+    float f = 1.0f / std::tan(radians(fovY) / 2);
+    return {{f / aspect, 0, 0, 0, 0, f, 0, 0, 0, 0, (zFar + zNear) / (zNear - zFar), -1,
+             0, 0, 2 * zFar * zNear / (zNear - zFar), 0}};
+}
+
+// Единичный кватернион поворота: (x, y, z) - ось, умноженная на синус
+// половины угла, w - косинус половины угла
+struct alignas(16) Quat {
+    float x, y, z, w;
+
+    constexpr Quat(float x = 0, float y = 0, float z = 0, float w = 1) : x(x), y(y), z(z), w(w) {}
+};
+
+// Поворот на угол в градусах вокруг единичной оси axis
+inline Quat axisAngle(const Vec3& axis, float degrees) {
+    float half = radians(degrees) / 2;
+    float s = std::sin(half);
+    return Quat(axis.x * s, axis.y * s, axis.z * s, std::cos(half));
+}
+
+// a * b - сначала поворот b, затем a, как у матриц
+constexpr Quat operator*(const Quat& a, const Quat& b) {
+    return Quat(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+constexpr Quat conjugate(const Quat& q) { return Quat(-q.x, -q.y, -q.z, q.w); }
+
+inline Quat normalize(const Quat& q) {
+    float k = inverseSqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    return Quat(q.x * k, q.y * k, q.z * k, q.w * k);
+}
+
+// Поворот вектора единичным кватернионом: v + 2w (q x v) + 2 q x (q x v)
+constexpr Vec3 rotate(const Quat& q, const Vec3& v) {
+    Vec3 axis(q.x, q.y, q.z);
+    Vec3 t = cross(axis, v) * 2.0f;
+    return v + t * q.w + cross(axis, t);
+}
+
+constexpr Mat4 rotation(const Quat& q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    return {{1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0,
+             2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0,
+             2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0,
+             0, 0, 0, 1}};
+}
+
+// Сферическая интерполяция по кратчайшей дуге; при почти одинаковых
+// поворотах - линейная с нормированием
+inline Quat slerp(const Quat& a, Quat b, float t) {
+    float cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    if (cosine < 0.0f) {
+        b = Quat(-b.x, -b.y, -b.z, -b.w);
+        cosine = -cosine;
+    }
+    float ka = 1.0f - t, kb = t;
+    if (cosine < 0.9995f) {
+        float angle = std::acos(cosine);
+        float inverseSine = 1.0f / std::sin(angle);
+        ka = std::sin(ka * angle) * inverseSine;
+        kb = std::sin(kb * angle) * inverseSine;
+    }
+    return normalize(Quat(a.x * ka + b.x * kb, a.y * ka + b.y * kb, a.z * ka + b.z * kb, a.w * ka + b.w * kb));
+}
+
+// Пакет точек (x, y, z, 1), хранящихся по компонентам: out = a * p без
+// деления на w. Выходные массивы могут совпадать со входными
+inline void transformPoints(const Mat4& a, const float* x, const float* y, const float* z,
+                            float* outX, float* outY, float* outZ, size_t count) {
+    const float* m = a.m;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    __m256 matrix[12];
+    for (int k = 0; k < 12; ++k) matrix[k] = _mm256_set1_ps(m[k + k / 3]);
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        __m256 r[3];
+        // matrix[k] - элемент (k % 3, k / 3), четвёртый столбец - сдвиг
+        for (int row = 0; row < 3; ++row) {
+            r[row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(matrix[row], px), _mm256_mul_ps(matrix[3 + row], py)),
+                                   _mm256_add_ps(_mm256_mul_ps(matrix[6 + row], pz), matrix[9 + row]));
+        }
+        _mm256_storeu_ps(outX + i, r[0]);
+        _mm256_storeu_ps(outY + i, r[1]);
+        _mm256_storeu_ps(outZ + i, r[2]);
+    }
+#elif defined(CG_MATH_SSE)
+    __m128 matrix[12];
+    for (int k = 0; k < 12; ++k) matrix[k] = _mm_set1_ps(m[k + k / 3]);
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        __m128 r[3];
+        for (int row = 0; row < 3; ++row) {
+            r[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(matrix[row], px), _mm_mul_ps(matrix[3 + row], py)),
+                                _mm_add_ps(_mm_mul_ps(matrix[6 + row], pz), matrix[9 + row]));
+        }
+        _mm_storeu_ps(outX + i, r[0]);
+        _mm_storeu_ps(outY + i, r[1]);
+        _mm_storeu_ps(outZ + i, r[2]);
+    }
+#elif defined(CG_MATH_NEON)
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t px = vld1q_f32(x + i), py = vld1q_f32(y + i), pz = vld1q_f32(z + i);
+        float32x4_t r[3];
+        for (int row = 0; row < 3; ++row) {
+            r[row] = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m[12 + row]), px, m[row]), py, m[4 + row]),
+                                 pz, m[8 + row]);
+        }
+        vst1q_f32(outX + i, r[0]);
+        vst1q_f32(outY + i, r[1]);
+        vst1q_f32(outZ + i, r[2]);
+    }
+#endif
+
+    // Остаток (и весь пакет без векторных команд)
+    for (; i < count; ++i) {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+        outY[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+        outZ[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+    }
+}
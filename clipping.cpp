@@ -0,0 +1,885 @@
+#include "clipping.h"
+#include "cg_math.h"
+
+#include <cstdint>
+#include <cmath>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
+
+bool clipCohenSutherland(const ClipRect& rect, float& x1, float& y1, float& x2, float& y2) {
+    int code1 = pointCode(rect, x1, y1);
+    int code2 = pointCode(rect, x2, y2);
+    
+    // Каждая итерация переносит один конец на границу окна; из-за округления
+    // может понадобиться ещё одна итерация на конец, поэтому 4 достаточно
+    for (int iteration = 0; iteration <= 4; ++iteration) {
+        // Если оба конца внутри окна
+        if (!(code1 | code2)) return true;
+        // Если линия полностью снаружи
+        if (code1 & code2) return false;
+        
+        float x = 0, y = 0;
+        int codeOut = code1 ? code1 : code2;
+        
+        // Находим точку пересечения с границей
+        if (codeOut & TOP) {
+            x = x1 + (x2 - x1) * (rect.top - y1) / (y2 - y1);
+            y = rect.top;
+        }
+        else if (codeOut & BOTTOM) {
+            x = x1 + (x2 - x1) * (rect.bottom - y1) / (y2 - y1);
+            y = rect.bottom;
+        }
+        else if (codeOut & RIGHT) {
+            y = y1 + (y2 - y1) * (rect.right - x1) / (x2 - x1);
+            x = rect.right;
+        }
+        else {
+            y = y1 + (y2 - y1) * (rect.left - x1) / (x2 - x1);
+            x = rect.left;
+        }
+        
+        // Обновляем конечную точку
+        if (codeOut == code1) {
+            x1 = x;
+            y1 = y;
+            code1 = pointCode(rect, x1, y1);
+        }
+        else {
+            x2 = x;
+            y2 = y;
+            code2 = pointCode(rect, x2, y2);
+        }
+    }
+    return false;
+}
+
+bool clipLiangBarsky(const ClipRect& rect, float& x1, float& y1, float& x2, float& y2) {
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float t0 = 0.0f, t1 = 1.0f;
+    const float p[4] = {-dx, dx, -dy, dy};
+    const float q[4] = {x1 - rect.left, rect.right - x1, y1 - rect.top, rect.bottom - y1};
+    
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0.0f) {
+            // Отрезок параллелен границе и лежит снаружи
+            if (q[i] < 0.0f) return false;
+            continue;
+        }
+        float t = q[i] / p[i];
+        if (p[i] < 0.0f) {
+            if (t > t1) return false;
+            if (t > t0) t0 = t;
+        } else {
+            if (t < t0) return false;
+            if (t < t1) t1 = t;
+        }
+    }
+    
+    if (t1 < 1.0f) {
+        x2 = x1 + t1 * dx;
+        y2 = y1 + t1 * dy;
+    }
+    if (t0 > 0.0f) {
+        x1 = x1 + t0 * dx;
+        y1 = y1 + t0 * dy;
+    }
+    return true;
+}
+
+namespace {
+
+// Симметрия окна: отражения по осям и перестановка x/y. Позволяет свести
+// все положения первой точки к трём случаям алгоритма Николла-Ли-Николла
+struct Symmetry {
+    bool flipX = false;
+    bool flipY = false;
+    bool swapXY = false;
+    
+    void forward(float& x, float& y) const {
+        if (flipX) x = -x;
+        if (flipY) y = -y;
+        if (swapXY) std::swap(x, y);
+    }
+    
+    void inverse(float& x, float& y) const {
+        if (swapXY) std::swap(x, y);
+        if (flipX) x = -x;
+        if (flipY) y = -y;
+    }
+    
+    ClipRect apply(const ClipRect& r) const {
+        ClipRect out = r;
+        if (flipX) {
+            out.left = -r.right;
+            out.right = -r.left;
+        }
+        if (flipY) {
+            out.top = -r.bottom;
+            out.bottom = -r.top;
+        }
+        if (swapXY) {
+            std::swap(out.left, out.top);
+            std::swap(out.right, out.bottom);
+        }
+        return out;
+    }
+};
+
+// Векторное произведение: знак показывает, с какой стороны от луча (ax, ay)
+// проходит направление (bx, by)
+inline float cross(float ax, float ay, float bx, float by) {
+    return ax * by - ay * bx;
+}
+
+// Выход из окна для отрезка, начинающегося внутри. Если второй конец в
+// угловой области, граница выбирается сравнением с лучом в этот угол
+void nlnExit(const ClipRect& r, float x1, float y1, float& x2, float& y2, int code2) {
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    int horizontal = code2 & (LEFT | RIGHT);
+    int vertical = code2 & (TOP | BOTTOM);
+    
+    if (horizontal && vertical) {
+        float cornerX = (horizontal == LEFT ? r.left : r.right) - x1;
+        float cornerY = (vertical == TOP ? r.top : r.bottom) - y1;
+        // |dy / dx| < |cornerY / cornerX| - отрезок уходит через вертикальную границу
+        if (std::abs(dy * cornerX) < std::abs(cornerY * dx)) {
+            vertical = 0;
+        } else {
+            horizontal = 0;
+        }
+    }
+    
+    if (horizontal) {
+        float x = horizontal == LEFT ? r.left : r.right;
+        y2 = y1 + dy * (x - x1) / dx;
+        x2 = x;
+    } else {
+        float y = vertical == TOP ? r.top : r.bottom;
+        x2 = x1 + dx * (y - y1) / dy;
+        y2 = y;
+    }
+}
+
+// Первая точка слева от окна (x1 < left, top <= y1 <= bottom)
+bool nlnLeftEdge(const ClipRect& r, float& x1, float& y1, float& x2, float& y2) {
+    if (x2 < r.left) return false;
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    
+    // Направление должно лежать между лучами в левые углы
+    if (cross(r.left - x1, r.top - y1, dx, dy) < 0.0f) return false;
+    if (cross(r.left - x1, r.bottom - y1, dx, dy) > 0.0f) return false;
+    
+    float ex = r.left;
+    float ey = y1 + dy * (r.left - x1) / dx;
+    
+    // Выход: выше луча в правый верхний угол - через верх,
+    // ниже луча в правый нижний - через низ, между ними - через правую границу
+    if (cross(r.right - x1, r.top - y1, dx, dy) < 0.0f) {
+        if (y2 < r.top) {
+            x2 = x1 + dx * (r.top - y1) / dy;
+            y2 = r.top;
+        }
+    } else if (cross(r.right - x1, r.bottom - y1, dx, dy) > 0.0f) {
+        if (y2 > r.bottom) {
+            x2 = x1 + dx * (r.bottom - y1) / dy;
+            y2 = r.bottom;
+        }
+    } else if (x2 > r.right) {
+        y2 = y1 + dy * (r.right - x1) / dx;
+        x2 = r.right;
+    }
+    
+    x1 = ex;
+    y1 = ey;
+    return true;
+}
+
+// Первая точка в левой верхней угловой области (x1 < left, y1 < top)
+bool nlnCorner(const ClipRect& r, float& x1, float& y1, float& x2, float& y2) {
+    if (x2 < r.left || y2 < r.top) return false;
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float ex, ey;
+    
+    if (cross(r.left - x1, r.top - y1, dx, dy) > 0.0f) {
+        // Круче луча в левый верхний угол - вход через левую границу
+        if (cross(r.left - x1, r.bottom - y1, dx, dy) > 0.0f) return false;
+        ex = r.left;
+        ey = y1 + dy * (r.left - x1) / dx;
+    } else {
+        // Иначе - через верхнюю
+        if (cross(r.right - x1, r.top - y1, dx, dy) < 0.0f) return false;
+        ex = x1 + dx * (r.top - y1) / dy;
+        ey = r.top;
+    }
+    
+    // Выход только через правую или нижнюю границу
+    if (cross(r.right - x1, r.bottom - y1, dx, dy) < 0.0f) {
+        if (x2 > r.right) {
+            y2 = y1 + dy * (r.right - x1) / dx;
+            x2 = r.right;
+        }
+    } else if (y2 > r.bottom) {
+        x2 = x1 + dx * (r.bottom - y1) / dy;
+        y2 = r.bottom;
+    }
+    
+    x1 = ex;
+    y1 = ey;
+    return true;
+}
+
+} // namespace
+
+bool clipNichollLeeNicholl(const ClipRect& rect, float& x1, float& y1, float& x2, float& y2) {
+    int code1 = pointCode(rect, x1, y1);
+    int code2 = pointCode(rect, x2, y2);
+    if (code1 & code2) return false;
+    
+    if (code1 == INSIDE) {
+        if (code2 != INSIDE) nlnExit(rect, x1, y1, x2, y2, code2);
+        return true;
+    }
+    
+    // Приводим первую точку к левой или левой верхней области
+    Symmetry sym;
+    sym.flipX = (code1 & RIGHT) != 0;
+    sym.flipY = (code1 & BOTTOM) != 0;
+    sym.swapXY = !(code1 & (LEFT | RIGHT));
+    
+    ClipRect r = sym.apply(rect);
+    sym.forward(x1, y1);
+    sym.forward(x2, y2);
+    bool corner = (code1 & (LEFT | RIGHT)) && (code1 & (TOP | BOTTOM));
+    bool visible = corner ? nlnCorner(r, x1, y1, x2, y2) : nlnLeftEdge(r, x1, y1, x2, y2);
+    sym.inverse(x1, y1);
+    sym.inverse(x2, y2);
+    return visible;
+}
+
+const char* clipAlgorithmName(ClipAlgorithm algorithm) {
+    switch (algorithm) {
+        case ClipAlgorithm::CohenSutherland: return "Cohen-Sutherland";
+        case ClipAlgorithm::LiangBarsky: return "Liang-Barsky";
+        case ClipAlgorithm::NichollLeeNicholl: return "Nicholl-Lee-Nicholl";
+    }
+    return "?";
+}
+
+bool clipSegment(ClipAlgorithm algorithm, const ClipRect& rect,
+                 float& x1, float& y1, float& x2, float& y2) {
+    switch (algorithm) {
+        case ClipAlgorithm::CohenSutherland: return clipCohenSutherland(rect, x1, y1, x2, y2);
+        case ClipAlgorithm::LiangBarsky: return clipLiangBarsky(rect, x1, y1, x2, y2);
+        case ClipAlgorithm::NichollLeeNicholl: return clipNichollLeeNicholl(rect, x1, y1, x2, y2);
+    }
+    return false;
+}
+
+namespace {
+
+const size_t BLOCK = 8;
+
+enum BlockClass {
+    BLOCK_MIXED,     // коды записаны в codes1/codes2, разбор по отрезкам
+    BLOCK_ACCEPTED,  // все отрезки целиком внутри
+    BLOCK_REJECTED   // все отрезки по одну сторону от окна
+};
+
+#if defined(__AVX2__)
+
+inline __m256i outcodes(__m256 x, __m256 y, const ClipRect& rect) {
+    const __m256i left = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_set1_ps(rect.left), _CMP_LT_OQ));
+    const __m256i right = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_set1_ps(rect.right), _CMP_GT_OQ));
+    const __m256i top = _mm256_castps_si256(_mm256_cmp_ps(y, _mm256_set1_ps(rect.top), _CMP_LT_OQ));
+    const __m256i bottom = _mm256_castps_si256(_mm256_cmp_ps(y, _mm256_set1_ps(rect.bottom), _CMP_GT_OQ));
+    __m256i code = _mm256_and_si256(left, _mm256_set1_epi32(LEFT));
+    code = _mm256_or_si256(code, _mm256_and_si256(right, _mm256_set1_epi32(RIGHT)));
+    code = _mm256_or_si256(code, _mm256_and_si256(top, _mm256_set1_epi32(TOP)));
+    return _mm256_or_si256(code, _mm256_and_si256(bottom, _mm256_set1_epi32(BOTTOM)));
+}
+
+BlockClass classifyBlock(const SegmentView& s, size_t i, const ClipRect& rect,
+                         int32_t* codes1, int32_t* codes2) {
+    __m256i c1 = outcodes(_mm256_loadu_ps(s.x1 + i), _mm256_loadu_ps(s.y1 + i), rect);
+    __m256i c2 = outcodes(_mm256_loadu_ps(s.x2 + i), _mm256_loadu_ps(s.y2 + i), rect);
+    __m256i any = _mm256_or_si256(c1, c2);
+    if (_mm256_testz_si256(any, any)) return BLOCK_ACCEPTED;
+    __m256i both = _mm256_and_si256(c1, c2);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(both, _mm256_setzero_si256())) == 0) return BLOCK_REJECTED;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(codes1), c1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(codes2), c2);
+    return BLOCK_MIXED;
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+inline __m128i outcodes(__m128 x, __m128 y, const ClipRect& rect) {
+    const __m128i left = _mm_castps_si128(_mm_cmplt_ps(x, _mm_set1_ps(rect.left)));
+    const __m128i right = _mm_castps_si128(_mm_cmpgt_ps(x, _mm_set1_ps(rect.right)));
+    const __m128i top = _mm_castps_si128(_mm_cmplt_ps(y, _mm_set1_ps(rect.top)));
+    const __m128i bottom = _mm_castps_si128(_mm_cmpgt_ps(y, _mm_set1_ps(rect.bottom)));
+    __m128i code = _mm_and_si128(left, _mm_set1_epi32(LEFT));
+    code = _mm_or_si128(code, _mm_and_si128(right, _mm_set1_epi32(RIGHT)));
+    code = _mm_or_si128(code, _mm_and_si128(top, _mm_set1_epi32(TOP)));
+    return _mm_or_si128(code, _mm_and_si128(bottom, _mm_set1_epi32(BOTTOM)));
+}
+
+// Блок из 8 отрезков обрабатывается двумя половинами по 4
+BlockClass classifyBlock(const SegmentView& s, size_t i, const ClipRect& rect,
+                         int32_t* codes1, int32_t* codes2) {
+    __m128i a1 = outcodes(_mm_loadu_ps(s.x1 + i), _mm_loadu_ps(s.y1 + i), rect);
+    __m128i a2 = outcodes(_mm_loadu_ps(s.x2 + i), _mm_loadu_ps(s.y2 + i), rect);
+    __m128i b1 = outcodes(_mm_loadu_ps(s.x1 + i + 4), _mm_loadu_ps(s.y1 + i + 4), rect);
+    __m128i b2 = outcodes(_mm_loadu_ps(s.x2 + i + 4), _mm_loadu_ps(s.y2 + i + 4), rect);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i any = _mm_or_si128(_mm_or_si128(a1, a2), _mm_or_si128(b1, b2));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(any, zero)) == 0xFFFF) return BLOCK_ACCEPTED;
+    __m128i bothA = _mm_cmpeq_epi32(_mm_and_si128(a1, a2), zero);
+    __m128i bothB = _mm_cmpeq_epi32(_mm_and_si128(b1, b2), zero);
+    if (_mm_movemask_epi8(_mm_or_si128(bothA, bothB)) == 0) return BLOCK_REJECTED;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(codes1), a1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(codes1 + 4), b1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(codes2), a2);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(codes2 + 4), b2);
+    return BLOCK_MIXED;
+}
+
+#else
+
+// Переносимый вариант без SIMD
+BlockClass classifyBlock(const SegmentView& s, size_t i, const ClipRect& rect,
+                         int32_t* codes1, int32_t* codes2) {
+    int any = 0;
+    bool allRejected = true;
+    for (size_t k = 0; k < BLOCK; ++k) {
+        codes1[k] = pointCode(rect, s.x1[i + k], s.y1[i + k]);
+        codes2[k] = pointCode(rect, s.x2[i + k], s.y2[i + k]);
+        any |= codes1[k] | codes2[k];
+        allRejected = allRejected && (codes1[k] & codes2[k]);
+    }
+    if (!any) return BLOCK_ACCEPTED;
+    if (allRejected) return BLOCK_REJECTED;
+    return BLOCK_MIXED;
+}
+
+#endif
+
+inline void emit(std::vector<sf::Vertex>& out, float x1, float y1, float x2, float y2, sf::Color color) {
+    out.emplace_back(sf::Vector2f(x1, y1), color);
+    out.emplace_back(sf::Vector2f(x2, y2), color);
+}
+
+// Разбор одного отрезка по уже посчитанным кодам концов
+template <bool (*Clip)(const ClipRect&, float&, float&, float&, float&)>
+inline void clipOne(const SegmentView& s, size_t i, int code1, int code2, const ClipRect& rect,
+                    std::vector<sf::Vertex>& out, sf::Color color, ClipStats& stats) {
+    if (!(code1 | code2)) {
+        emit(out, s.x1[i], s.y1[i], s.x2[i], s.y2[i], color);
+        stats.accepted++;
+        return;
+    }
+    if (code1 & code2) {
+        stats.rejected++;
+        return;
+    }
+    float x1 = s.x1[i], y1 = s.y1[i], x2 = s.x2[i], y2 = s.y2[i];
+    if (Clip(rect, x1, y1, x2, y2)) {
+        emit(out, x1, y1, x2, y2, color);
+        stats.clipped++;
+    } else {
+        stats.rejected++;
+    }
+}
+
+// Алгоритм подставляется как параметр шаблона, чтобы не ветвиться
+// на каждом отрезке
+template <bool (*Clip)(const ClipRect&, float&, float&, float&, float&)>
+ClipStats clipBatchWith(const SegmentView& segments, const ClipRect& rect,
+                        std::vector<sf::Vertex>& out, sf::Color color) {
+    ClipStats stats;
+    out.reserve(out.size() + 2 * segments.count);
+    
+    alignas(32) int32_t codes1[BLOCK];
+    alignas(32) int32_t codes2[BLOCK];
+    size_t i = 0;
+    for (; i + BLOCK <= segments.count; i += BLOCK) {
+        switch (classifyBlock(segments, i, rect, codes1, codes2)) {
+            case BLOCK_ACCEPTED:
+                for (size_t k = i; k < i + BLOCK; ++k) {
+                    emit(out, segments.x1[k], segments.y1[k], segments.x2[k], segments.y2[k], color);
+                }
+                stats.accepted += BLOCK;
+                break;
+            case BLOCK_REJECTED:
+                stats.rejected += BLOCK;
+                break;
+            case BLOCK_MIXED:
+                for (size_t k = 0; k < BLOCK; ++k) {
+                    clipOne<Clip>(segments, i + k, codes1[k], codes2[k], rect, out, color, stats);
+                }
+                break;
+        }
+    }
+    
+    // Остаток, не кратный размеру блока
+    for (; i < segments.count; ++i) {
+        clipOne<Clip>(segments, i,
+                      pointCode(rect, segments.x1[i], segments.y1[i]),
+                      pointCode(rect, segments.x2[i], segments.y2[i]),
+                      rect, out, color, stats);
+    }
+    return stats;
+}
+
+} // namespace
+
+ClipStats clipBatch(const SegmentView& segments, const ClipRect& rect,
+                    std::vector<sf::Vertex>& out, sf::Color color, ClipAlgorithm algorithm) {
+    switch (algorithm) {
+        case ClipAlgorithm::LiangBarsky:
+            return clipBatchWith<clipLiangBarsky>(segments, rect, out, color);
+        case ClipAlgorithm::NichollLeeNicholl:
+            return clipBatchWith<clipNichollLeeNicholl>(segments, rect, out, color);
+        default:
+            return clipBatchWith<clipCohenSutherland>(segments, rect, out, color);
+    }
+}
+
+namespace {
+
+SegmentView subView(const SegmentView& s, size_t begin, size_t end) {
+    return {s.x1 + begin, s.y1 + begin, s.x2 + begin, s.y2 + begin, end - begin};
+}
+
+inline void clipConvexOne(const SegmentView& s, size_t i, const ConvexWindow& window,
+                          std::vector<sf::Vertex>& out, sf::Color color, ClipStats& stats) {
+    float x1 = s.x1[i], y1 = s.y1[i], x2 = s.x2[i], y2 = s.y2[i];
+    if ((pointCode(window.bounds, x1, y1) & pointCode(window.bounds, x2, y2)) ||
+        !clipCyrusBeck(window, x1, y1, x2, y2)) {
+        stats.rejected++;
+        return;
+    }
+    emit(out, x1, y1, x2, y2, color);
+    if (x1 == s.x1[i] && y1 == s.y1[i] && x2 == s.x2[i] && y2 == s.y2[i])
+        stats.accepted++;
+    else
+        stats.clipped++;
+}
+
+} // namespace
+
+ConvexWindow ConvexWindow::fromPolygon(const std::vector<sf::Vector2f>& points) {
+    ConvexWindow window;
+    window.points = points;
+    if (points.empty()) {
+        window.bounds = {0, 0, 0, 0};
+        return window;
+    }
+    
+    // Знак площади задаёт направление обхода, а с ним и сторону внутренней нормали
+    float area = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        const sf::Vector2f& a = points[i];
+        const sf::Vector2f& b = points[(i + 1) % points.size()];
+        area += a.x * b.y - b.x * a.y;
+    }
+    float sign = area >= 0 ? 1.0f : -1.0f;
+    
+    window.bounds = {points[0].x, points[0].y, points[0].x, points[0].y};
+    for (size_t i = 0; i < points.size(); ++i) {
+        const sf::Vector2f& a = points[i];
+        const sf::Vector2f& b = points[(i + 1) % points.size()];
+        window.bounds.left = std::min(window.bounds.left, a.x);
+        window.bounds.top = std::min(window.bounds.top, a.y);
+        window.bounds.right = std::max(window.bounds.right, a.x);
+        window.bounds.bottom = std::max(window.bounds.bottom, a.y);
+        
+        float ex = b.x - a.x, ey = b.y - a.y;
+        if (ex == 0 && ey == 0) continue;  // повторяющаяся вершина
+        float nx = -ey * sign, ny = ex * sign;
+        window.nx.push_back(nx);
+        window.ny.push_back(ny);
+        window.d.push_back(-(nx * a.x + ny * a.y));
+    }
+    return window;
+}
+
+ConvexWindow ConvexWindow::fromRect(const ClipRect& rect, float angle) {
+    float cx = (rect.left + rect.right) / 2, cy = (rect.top + rect.bottom) / 2;
+    float hw = (rect.right - rect.left) / 2, hh = (rect.bottom - rect.top) / 2;
+    float c = std::cos(radians(angle)), s = std::sin(radians(angle));
+    
+    std::vector<sf::Vector2f> corners;
+    const float local[4][2] = {{-hw, -hh}, {hw, -hh}, {hw, hh}, {-hw, hh}};
+    for (const auto& p : local) {
+        corners.emplace_back(cx + p[0] * c - p[1] * s, cy + p[0] * s + p[1] * c);
+    }
+    return fromPolygon(corners);
+}
+
+bool clipCyrusBeck(const ConvexWindow& window, float& x1, float& y1, float& x2, float& y2) {
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float t0 = 0.0f, t1 = 1.0f;
+    
+    for (size_t e = 0; e < window.edgeCount(); ++e) {
+        // Расстояние (со знаком) от начала до ребра и его скорость изменения вдоль отрезка
+        float num = window.nx[e] * x1 + window.ny[e] * y1 + window.d[e];
+        float den = window.nx[e] * dx + window.ny[e] * dy;
+        if (den == 0.0f) {
+            // Параллельно ребру: виден целиком или не виден вовсе
+            if (num < 0.0f) return false;
+            continue;
+        }
+        float t = -num / den;
+        if (den > 0.0f) {
+            if (t > t0) t0 = t;  // вход в полуплоскость
+        } else {
+            if (t < t1) t1 = t;  // выход из полуплоскости
+        }
+        if (t0 > t1) return false;
+    }
+    
+    float sx = x1, sy = y1;
+    if (t1 < 1.0f) {
+        x2 = sx + t1 * dx;
+        y2 = sy + t1 * dy;
+    }
+    if (t0 > 0.0f) {
+        x1 = sx + t0 * dx;
+        y1 = sy + t0 * dy;
+    }
+    return true;
+}
+
+ClipStats clipBatch(const SegmentView& segments, const ConvexWindow& window,
+                    std::vector<sf::Vertex>& out, sf::Color color) {
+    ClipStats stats;
+    alignas(32) int32_t codes1[BLOCK];
+    alignas(32) int32_t codes2[BLOCK];
+    size_t i = 0;
+    for (; i + BLOCK <= segments.count; i += BLOCK) {
+        // Блоки целиком вне описанного прямоугольника отбрасываются сразу
+        if (classifyBlock(segments, i, window.bounds, codes1, codes2) == BLOCK_REJECTED) {
+            stats.rejected += BLOCK;
+            continue;
+        }
+        for (size_t k = i; k < i + BLOCK; ++k) {
+            clipConvexOne(segments, k, window, out, color, stats);
+        }
+    }
+    for (; i < segments.count; ++i) {
+        clipConvexOne(segments, i, window, out, color, stats);
+    }
+    return stats;
+}
+
+void clipPolygon(const ConvexWindow& window, const sf::Vector2f* polygon, size_t count,
+                 std::vector<sf::Vector2f>& out, std::vector<sf::Vector2f>& scratch) {
+    out.assign(polygon, polygon + count);
+    for (size_t e = 0; e < window.edgeCount() && !out.empty(); ++e) {
+        const float nx = window.nx[e], ny = window.ny[e], d = window.d[e];
+        scratch.clear();
+        sf::Vector2f prev = out.back();
+        float prevDist = nx * prev.x + ny * prev.y + d;
+        for (const sf::Vector2f& cur : out) {
+            float curDist = nx * cur.x + ny * cur.y + d;
+            // Ребро многоугольника пересекает границу: добавляется точка пересечения
+            if ((curDist >= 0) != (prevDist >= 0)) {
+                float t = prevDist / (prevDist - curDist);
+                scratch.emplace_back(prev.x + (cur.x - prev.x) * t, prev.y + (cur.y - prev.y) * t);
+            }
+            if (curDist >= 0) {
+                scratch.push_back(cur);
+            }
+            prev = cur;
+            prevDist = curDist;
+        }
+        out.swap(scratch);
+    }
+}
+
+void clipPolygons(const PolygonSet& polygons, const ConvexWindow& window, PolygonSet& out) {
+    out.clear();
+    std::vector<sf::Vector2f> clipped, scratch;
+    for (size_t i = 0; i < polygons.size(); ++i) {
+        clipPolygon(window, polygons.polygon(i), polygons.polygonSize(i), clipped, scratch);
+        out.add(clipped.data(), clipped.size());
+    }
+}
+
+ClipPool::ClipPool(TaskPool& tasks) : tasks(tasks) {}
+
+ClipPool& ClipPool::shared() {
+    static ClipPool pool;
+    return pool;
+}
+
+template <typename Clip>
+ClipStats ClipPool::clipChunks(const SegmentView& segments, std::vector<sf::Vertex>& out, Clip clip) {
+    std::lock_guard<std::mutex> call(callMtx);
+    size_t chunk = std::max<size_t>(1, chunkSize);
+    size_t chunks = (segments.count + chunk - 1) / chunk;
+    if (chunks <= 1 || tasks.threadCount() == 1) return clip(segments, out);
+    
+    if (chunkOut.size() < chunks) chunkOut.resize(chunks);
+    std::vector<ClipStats> partStats(chunks);
+    tasks.parallelFor(chunks, [&](size_t part) {
+        size_t begin = part * chunk;
+        chunkOut[part].clear();
+        partStats[part] = clip(subView(segments, begin, std::min(segments.count, begin + chunk)),
+                               chunkOut[part]);
+    });
+    
+    ClipStats stats;
+    size_t total = out.size();
+    for (size_t part = 0; part < chunks; ++part) total += chunkOut[part].size();
+    out.reserve(total);
+    for (size_t part = 0; part < chunks; ++part) {
+        out.insert(out.end(), chunkOut[part].begin(), chunkOut[part].end());
+        stats.accepted += partStats[part].accepted;
+        stats.clipped += partStats[part].clipped;
+        stats.rejected += partStats[part].rejected;
+    }
+    return stats;
+}
+
+ClipStats ClipPool::clip(const SegmentView& segments, const ClipRect& rect,
+                         std::vector<sf::Vertex>& out, sf::Color color, ClipAlgorithm algorithm) {
+    return clipChunks(segments, out, [&](const SegmentView& part, std::vector<sf::Vertex>& partOut) {
+        return clipBatch(part, rect, partOut, color, algorithm);
+    });
+}
+
+ClipStats ClipPool::clip(const SegmentView& segments, const ConvexWindow& window,
+                         std::vector<sf::Vertex>& out, sf::Color color) {
+    return clipChunks(segments, out, [&](const SegmentView& part, std::vector<sf::Vertex>& partOut) {
+        return clipBatch(part, window, partOut, color);
+    });
+}
+
+void ClipPool::clipPolygons(const PolygonSet& polygons, const ConvexWindow& window, PolygonSet& out) {
+    std::lock_guard<std::mutex> call(callMtx);
+    // Части делятся по многоугольникам, примерно по chunkSize вершин
+    size_t perChunk = std::max<size_t>(1, chunkSize / 8);
+    size_t chunks = (polygons.size() + perChunk - 1) / perChunk;
+    if (chunks <= 1 || tasks.threadCount() == 1) {
+        ::clipPolygons(polygons, window, out);
+        return;
+    }
+    
+    std::vector<PolygonSet> parts(chunks);
+    tasks.parallelFor(chunks, [&](size_t part) {
+        std::vector<sf::Vector2f> clipped, scratch;
+        size_t end = std::min(polygons.size(), (part + 1) * perChunk);
+        for (size_t i = part * perChunk; i < end; ++i) {
+            clipPolygon(window, polygons.polygon(i), polygons.polygonSize(i), clipped, scratch);
+            parts[part].add(clipped.data(), clipped.size());
+        }
+    });
+    out.clear();
+    for (const PolygonSet& part : parts) {
+        uint32_t base = static_cast<uint32_t>(out.points.size());
+        out.points.insert(out.points.end(), part.points.begin(), part.points.end());
+        for (size_t i = 1; i < part.offsets.size(); ++i) {
+            out.offsets.push_back(base + part.offsets[i]);
+        }
+    }
+}
+
+namespace {
+
+// Ячеек по одной оси не больше этого числа
+const int MAX_GRID_SIDE = 1024;
+
+struct Bounds {
+    float left, top, right, bottom;
+};
+
+inline Bounds segmentBounds(const SegmentView& s, size_t i) {
+    return {std::min(s.x1[i], s.x2[i]), std::min(s.y1[i], s.y2[i]),
+            std::max(s.x1[i], s.x2[i]), std::max(s.y1[i], s.y2[i])};
+}
+
+inline bool containsBounds(const ClipRect& r, const Bounds& b) {
+    return b.left >= r.left && b.right <= r.right && b.top >= r.top && b.bottom <= r.bottom;
+}
+
+inline bool touchesBounds(const ClipRect& r, const Bounds& b) {
+    return b.left <= r.right && b.right >= r.left && b.top <= r.bottom && b.bottom >= r.top;
+}
+
+} // namespace
+
+int SegmentGrid::cellX(float x) const {
+    float f = (x - originX) * invCellSize;
+    if (!(f > 0)) return 0;
+    if (f >= cols - 1) return cols - 1;
+    return static_cast<int>(f);
+}
+
+int SegmentGrid::cellY(float y) const {
+    float f = (y - originY) * invCellSize;
+    if (!(f > 0)) return 0;
+    if (f >= rows - 1) return rows - 1;
+    return static_cast<int>(f);
+}
+
+void SegmentGrid::build(const SegmentView& source) {
+    cols = rows = 0;
+    segments = SegmentSoA();
+    original.clear();
+    cellStart.assign(1, 0);
+    if (source.count == 0) return;
+    
+    // Размер ячейки - 90-й перцентиль размеров отрезков
+    Bounds all = segmentBounds(source, 0);
+    std::vector<float> extent(source.count);
+    for (size_t i = 0; i < source.count; ++i) {
+        Bounds b = segmentBounds(source, i);
+        all.left = std::min(all.left, b.left);
+        all.top = std::min(all.top, b.top);
+        all.right = std::max(all.right, b.right);
+        all.bottom = std::max(all.bottom, b.bottom);
+        extent[i] = std::max(b.right - b.left, b.bottom - b.top);
+    }
+    auto percentile = extent.begin() + extent.size() * 9 / 10;
+    std::nth_element(extent.begin(), percentile, extent.end());
+    float width = all.right - all.left;
+    float height = all.bottom - all.top;
+    cellSize = std::max({*percentile, width / MAX_GRID_SIDE, height / MAX_GRID_SIDE, 1e-3f});
+    invCellSize = 1.0f / cellSize;
+    originX = all.left;
+    originY = all.top;
+    cols = std::min(MAX_GRID_SIDE, static_cast<int>(width * invCellSize) + 1);
+    rows = std::min(MAX_GRID_SIDE, static_cast<int>(height * invCellSize) + 1);
+    
+    // Ячейка каждого отрезка; не поместившиеся получают номер после последней
+    const size_t cells = cellCount();
+    std::vector<uint32_t> cellOf(source.count);
+    std::vector<uint32_t> counts(cells + 2, 0);
+    for (size_t i = 0; i < source.count; ++i) {
+        Bounds b = segmentBounds(source, i);
+        int cx = cellX(b.left), cy = cellY(b.top);
+        bool fits = cellX(b.right) <= cx + 1 && cellY(b.bottom) <= cy + 1;
+        cellOf[i] = fits ? static_cast<uint32_t>(cy * cols + cx) : static_cast<uint32_t>(cells);
+        counts[cellOf[i] + 1]++;
+    }
+    for (size_t cell = 0; cell <= cells; ++cell) {
+        counts[cell + 1] += counts[cell];
+    }
+    cellStart.assign(counts.begin(), counts.begin() + cells + 1);
+    
+    // Раскладка копий отрезков по ячейкам
+    segments.x1.resize(source.count);
+    segments.y1.resize(source.count);
+    segments.x2.resize(source.count);
+    segments.y2.resize(source.count);
+    original.resize(source.count);
+    for (size_t i = 0; i < source.count; ++i) {
+        uint32_t k = counts[cellOf[i]]++;
+        segments.x1[k] = source.x1[i];
+        segments.y1[k] = source.y1[i];
+        segments.x2[k] = source.x2[i];
+        segments.y2[k] = source.y2[i];
+        original[k] = static_cast<uint32_t>(i);
+    }
+}
+
+void ClipCache::reset(const SegmentView& segments, sf::Color color) {
+    this->color = color;
+    index.build(segments);
+    visible.clear();
+    slotOwner.clear();
+    slotOf.assign(segments.count, NO_SLOT);
+    valid = false;
+}
+
+size_t ClipCache::update(const ClipRect& rect, ClipAlgorithm algorithm) {
+    const SegmentView segments = index.sorted().view();
+    if (!valid || algorithm != currentAlgorithm) {
+        current = rect;
+        currentAlgorithm = algorithm;
+        visible.clear();
+        slotOwner.clear();
+        std::fill(slotOf.begin(), slotOf.end(), NO_SLOT);
+        for (size_t i = 0; i < segments.count; ++i) {
+            reclip(static_cast<uint32_t>(i));
+        }
+        valid = true;
+        return segments.count;
+    }
+    if (rect == current) return 0;
+    
+    const ClipRect previous = current;
+    current = rect;
+    
+    // Не меняются отрезки, целиком лежащие внутри обоих окон, и отрезки,
+    // не задевающие ни одно из них
+    size_t reclipped = 0;
+    index.visitChanged(previous, rect, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Bounds b = segmentBounds(segments, i);
+            if (containsBounds(previous, b) && containsBounds(rect, b)) continue;
+            if (!touchesBounds(previous, b) && !touchesBounds(rect, b)) continue;
+            reclip(static_cast<uint32_t>(i));
+            reclipped++;
+        }
+    });
+    return reclipped;
+}
+
+void ClipCache::reclip(uint32_t i) {
+    const SegmentSoA& segments = index.sorted();
+    float x1 = segments.x1[i], y1 = segments.y1[i], x2 = segments.x2[i], y2 = segments.y2[i];
+    int code1 = pointCode(current, x1, y1);
+    int code2 = pointCode(current, x2, y2);
+    bool shown = !(code1 | code2) ||
+                 (!(code1 & code2) && clipSegment(currentAlgorithm, current, x1, y1, x2, y2));
+    
+    uint32_t slot = slotOf[i];
+    if (shown) {
+        if (slot == NO_SLOT) {
+            slot = static_cast<uint32_t>(slotOwner.size());
+            slotOwner.push_back(i);
+            visible.resize(visible.size() + 2);
+            slotOf[i] = slot;
+        }
+        visible[2 * slot] = sf::Vertex(sf::Vector2f(x1, y1), color);
+        visible[2 * slot + 1] = sf::Vertex(sf::Vector2f(x2, y2), color);
+        markDirty(slot);
+    } else if (slot != NO_SLOT) {
+        // Последняя пара переносится на место удаляемой
+        uint32_t last = static_cast<uint32_t>(slotOwner.size() - 1);
+        if (slot != last) {
+            visible[2 * slot] = visible[2 * last];
+            visible[2 * slot + 1] = visible[2 * last + 1];
+            slotOwner[slot] = slotOwner[last];
+            slotOf[slotOwner[slot]] = slot;
+            markDirty(slot);
+        }
+        visible.resize(2 * last);
+        slotOwner.pop_back();
+        slotOf[i] = NO_SLOT;
+    }
+}
+
+ClipCache::VertexRange ClipCache::takeDirty() {
+    // Удалённые с конца пары не нужно обновлять: они просто не рисуются
+    size_t end = std::min(dirtyEnd, slotOwner.size());
+    VertexRange range = {0, 0};
+    if (dirtyBegin < end) {
+        range = {2 * dirtyBegin, 2 * (end - dirtyBegin)};
+    }
+    dirtyBegin = SIZE_MAX;
+    dirtyEnd = 0;
+    return range;
+}
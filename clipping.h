@@ -0,0 +1,357 @@
+#pragma once
+
+// Пакетное отсечение отрезков прямоугольным окном (лабораторная работа 1).
+// Отрезки хранятся в виде структуры массивов (SoA), коды Коэна-Сазерленда
+// считаются векторно по 8 отрезков за раз; блоки, целиком лежащие внутри
+// или целиком снаружи окна, принимаются или отбрасываются без разбора
+// по отдельным отрезкам
+
+#include "task_pool.h"
+#include <SFML/Graphics/Vertex.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Коды для алгоритма Коэна-Сазерленда
+const int INSIDE = 0;  // 0000
+const int LEFT = 1;    // 0001
+const int RIGHT = 2;   // 0010
+const int BOTTOM = 4;  // 0100
+const int TOP = 8;     // 1000
+
+// Окно отсечения в экранных координатах (ось y направлена вниз)
+struct ClipRect {
+    float left, top, right, bottom;
+};
+
+inline bool operator==(const ClipRect& a, const ClipRect& b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+inline bool operator!=(const ClipRect& a, const ClipRect& b) {
+    return !(a == b);
+}
+
+// Прямоугольник с отношением сторон aspect (ширина к высоте) и тем же
+// центром, вмещающий bounds; используется, чтобы показать набор целиком
+inline ClipRect fitRect(const ClipRect& bounds, float aspect) {
+    float width = std::max(bounds.right - bounds.left, 1e-6f);
+    float height = std::max(bounds.bottom - bounds.top, 1e-6f);
+    width = std::max(width, height * aspect);
+    height = width / aspect;
+    float cx = (bounds.left + bounds.right) / 2, cy = (bounds.top + bounds.bottom) / 2;
+    return {cx - width / 2, cy - height / 2, cx + width / 2, cy + height / 2};
+}
+
+// Получение кода точки для алгоритма Коэна-Сазерленда
+inline int pointCode(const ClipRect& rect, float x, float y) {
+    int code = INSIDE;
+    if (x < rect.left)
+        code |= LEFT;
+    else if (x > rect.right)
+        code |= RIGHT;
+    if (y < rect.top)
+        code |= TOP;
+    else if (y > rect.bottom)
+        code |= BOTTOM;
+    return code;
+}
+
+// Невладеющее представление набора отрезков: четыре массива координат
+struct SegmentView {
+    const float* x1;
+    const float* y1;
+    const float* x2;
+    const float* y2;
+    size_t count;
+};
+
+// Набор отрезков в памяти
+struct SegmentSoA {
+    std::vector<float> x1, y1, x2, y2;
+    
+    void add(float ax, float ay, float bx, float by) {
+        x1.push_back(ax);
+        y1.push_back(ay);
+        x2.push_back(bx);
+        y2.push_back(by);
+    }
+    
+    void reserve(size_t n) {
+        x1.reserve(n);
+        y1.reserve(n);
+        x2.reserve(n);
+        y2.reserve(n);
+    }
+    
+    size_t size() const { return x1.size(); }
+    
+    SegmentView view() const {
+        return {x1.data(), y1.data(), x2.data(), y2.data(), x1.size()};
+    }
+};
+
+// Алгоритмы отсечения одного отрезка. Все возвращают false, если отрезок
+// не виден; иначе концы заменяются отсечёнными (x1, y1 остаётся началом)
+enum class ClipAlgorithm {
+    CohenSutherland,
+    LiangBarsky,
+    NichollLeeNicholl
+};
+
+const ClipAlgorithm CLIP_ALGORITHMS[] = {
+    ClipAlgorithm::CohenSutherland,
+    ClipAlgorithm::LiangBarsky,
+    ClipAlgorithm::NichollLeeNicholl
+};
+
+const char* clipAlgorithmName(ClipAlgorithm algorithm);
+
+// Полный итеративный алгоритм Коэна-Сазерленда
+bool clipCohenSutherland(const ClipRect& rect, float& x1, float& y1, float& x2, float& y2);
+
+// Параметрический алгоритм Лианга-Барски
+bool clipLiangBarsky(const ClipRect& rect, float& x1, float& y1, float& x2, float& y2);
+
+// Алгоритм Николла-Ли-Николла: положение второго конца определяется
+// сравнением наклонов с лучами в углы окна, поэтому точка пересечения
+// вычисляется только для той границы, через которую отрезок реально проходит
+bool clipNichollLeeNicholl(const ClipRect& rect, float& x1, float& y1, float& x2, float& y2);
+
+bool clipSegment(ClipAlgorithm algorithm, const ClipRect& rect,
+                 float& x1, float& y1, float& x2, float& y2);
+
+struct ClipStats {
+    size_t accepted = 0;  // целиком внутри окна
+    size_t clipped = 0;   // пересекают границу окна
+    size_t rejected = 0;  // не видны
+};
+
+// Отсечение всех отрезков; видимые части дописываются в out парами вершин
+// (для отрисовки одним вызовом с sf::Lines). out не очищается, исходные
+// отрезки не изменяются. algorithm используется для отрезков, пересекающих
+// границу окна
+ClipStats clipBatch(const SegmentView& segments, const ClipRect& rect,
+                    std::vector<sf::Vertex>& out, sf::Color color,
+                    ClipAlgorithm algorithm = ClipAlgorithm::CohenSutherland);
+
+
+// Выпуклое окно произвольной формы. Каждое ребро хранится как полуплоскость
+// nx * x + ny * y + d >= 0 с нормалью, направленной внутрь окна
+struct ConvexWindow {
+    std::vector<sf::Vector2f> points;
+    std::vector<float> nx, ny, d;
+    ClipRect bounds;  // описанный прямоугольник для быстрого отбрасывания
+    
+    // Вершины выпуклого многоугольника в любом порядке обхода
+    static ConvexWindow fromPolygon(const std::vector<sf::Vector2f>& points);
+    // Прямоугольник, повёрнутый на angle градусов вокруг своего центра
+    static ConvexWindow fromRect(const ClipRect& rect, float angle);
+    
+    size_t edgeCount() const { return nx.size(); }
+    
+    bool contains(float x, float y) const {
+        for (size_t e = 0; e < edgeCount(); ++e) {
+            if (nx[e] * x + ny[e] * y + d[e] < 0) return false;
+        }
+        return true;
+    }
+};
+
+// Параметрический алгоритм Кируса-Бека для выпуклого окна
+bool clipCyrusBeck(const ConvexWindow& window, float& x1, float& y1, float& x2, float& y2);
+
+ClipStats clipBatch(const SegmentView& segments, const ConvexWindow& window,
+                    std::vector<sf::Vertex>& out, sf::Color color);
+
+// Набор многоугольников: вершины всех многоугольников подряд,
+// i-й многоугольник - points[offsets[i]] .. points[offsets[i + 1] - 1]
+struct PolygonSet {
+    std::vector<sf::Vector2f> points;
+    std::vector<uint32_t> offsets = {0};
+    
+    void add(const sf::Vector2f* polygon, size_t count) {
+        points.insert(points.end(), polygon, polygon + count);
+        offsets.push_back(static_cast<uint32_t>(points.size()));
+    }
+    
+    void clear() {
+        points.clear();
+        offsets.assign(1, 0);
+    }
+    
+    size_t size() const { return offsets.size() - 1; }
+    const sf::Vector2f* polygon(size_t i) const { return points.data() + offsets[i]; }
+    size_t polygonSize(size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+// Алгоритм Сазерленда-Ходжмена: многоугольник (в том числе невыпуклый)
+// последовательно отсекается полуплоскостями рёбер окна. Каждая стадия
+// читает один буфер и пишет в другой; out и scratch переиспользуются между
+// вызовами, так что память выделяется только при их росте
+void clipPolygon(const ConvexWindow& window, const sf::Vector2f* polygon, size_t count,
+                 std::vector<sf::Vector2f>& out, std::vector<sf::Vector2f>& scratch);
+
+// Отсечение всех многоугольников набора; i-й многоугольник out соответствует
+// i-му исходному (пустой, если он целиком снаружи)
+void clipPolygons(const PolygonSet& polygons, const ConvexWindow& window, PolygonSet& out);
+
+// Отсечение больших наборов на потоках пула TaskPool. Набор делится на части
+// по chunkSize отрезков, потоки (и вызывающий поток) разбирают их по очереди,
+// так что отображённый в память файл читается последовательно. Каждая часть
+// пишет видимые отрезки в свой буфер, затем буферы склеиваются по порядку -
+// результат совпадает с однопоточным clipBatch. Вызовы из разных потоков
+// выполняются по одному
+class ClipPool {
+public:
+    explicit ClipPool(TaskPool& tasks = TaskPool::shared());
+    
+    ClipPool(const ClipPool&) = delete;
+    ClipPool& operator=(const ClipPool&) = delete;
+    
+    // Отсечение на общем пуле потоков
+    static ClipPool& shared();
+    
+    int threadCount() const { return tasks.threadCount(); }
+    
+    ClipStats clip(const SegmentView& segments, const ClipRect& rect,
+                   std::vector<sf::Vertex>& out, sf::Color color,
+                   ClipAlgorithm algorithm = ClipAlgorithm::CohenSutherland);
+    ClipStats clip(const SegmentView& segments, const ConvexWindow& window,
+                   std::vector<sf::Vertex>& out, sf::Color color);
+    void clipPolygons(const PolygonSet& polygons, const ConvexWindow& window, PolygonSet& out);
+    
+    size_t chunkSize = 1 << 18;  // отрезков в одной части
+    
+private:
+    TaskPool& tasks;
+    std::mutex callMtx;
+    
+    std::vector<std::vector<sf::Vertex>> chunkOut;  // буферы частей, переиспользуются
+    
+    template <typename Clip>
+    ClipStats clipChunks(const SegmentView& segments, std::vector<sf::Vertex>& out, Clip clip);
+};
+
+// Равномерная сетка по отрезкам. Каждый отрезок относится к ячейке, в которой
+// лежит левый верхний угол его прямоугольника; копии отрезков хранятся
+// в одном массиве, упорядоченном по ячейкам. Размер ячейки подбирается так,
+// чтобы почти все отрезки не выходили за свою ячейку и соседние справа
+// и снизу; остальные лежат в конце массива и проверяются всегда
+class SegmentGrid {
+public:
+    void build(const SegmentView& segments);
+    
+    // Вызывает visit(begin, end) для диапазонов отрезков (в порядке сетки),
+    // которые могут задевать a или b. Пропускаются ячейки, все отрезки которых
+    // лежат строго внутри пересечения a и b
+    template <typename F>
+    void visitChanged(const ClipRect& a, const ClipRect& b, F visit) const;
+    
+    // Отрезки в порядке сетки и их индексы в исходном наборе
+    const SegmentSoA& sorted() const { return segments; }
+    uint32_t originalIndex(size_t i) const { return original[i]; }
+    
+    size_t cellCount() const { return static_cast<size_t>(cols) * rows; }
+    size_t largeCount() const { return segments.size() - cellStart[cellCount()]; }
+    float getCellSize() const { return cellSize; }
+    
+private:
+    float originX = 0, originY = 0;
+    float cellSize = 1, invCellSize = 1;
+    int cols = 0, rows = 0;
+    SegmentSoA segments;
+    std::vector<uint32_t> original;
+    std::vector<uint32_t> cellStart = {0};  // cols * rows + 1 смещений в segments
+    
+    int cellX(float x) const;
+    int cellY(float y) const;
+};
+
+template <typename F>
+void SegmentGrid::visitChanged(const ClipRect& a, const ClipRect& b, F visit) const {
+    const size_t cells = cellCount();
+    if (cellStart[cells] < segments.size()) visit(cellStart[cells], segments.size());
+    if (cols == 0) return;
+    
+    // Пересечение окон; отрезки строго внутри него не меняются
+    const ClipRect inner = {std::max(a.left, b.left), std::max(a.top, b.top),
+                            std::min(a.right, b.right), std::min(a.bottom, b.bottom)};
+    auto touches = [](const ClipRect& r, float x0, float y0, float x1, float y1) {
+        return x0 <= r.right && x1 >= r.left && y0 <= r.bottom && y1 >= r.top;
+    };
+    
+    // Отрезки ячейки занимают её и соседние справа и снизу, поэтому
+    // обход начинается на ячейку левее и выше
+    int cx0 = std::max(0, cellX(std::min(a.left, b.left)) - 1);
+    int cy0 = std::max(0, cellY(std::min(a.top, b.top)) - 1);
+    int cx1 = cellX(std::max(a.right, b.right));
+    int cy1 = cellY(std::max(a.bottom, b.bottom));
+    for (int cy = cy0; cy <= cy1; ++cy) {
+        float y0 = originY + cy * cellSize, y1 = y0 + 2 * cellSize;
+        // Соседние ячейки строки лежат в массиве подряд и передаются одним диапазоном
+        size_t rangeBegin = 0, rangeEnd = 0;
+        for (int cx = cx0; cx <= cx1; ++cx) {
+            float x0 = originX + cx * cellSize, x1 = x0 + 2 * cellSize;
+            bool skip = (!touches(a, x0, y0, x1, y1) && !touches(b, x0, y0, x1, y1)) ||
+                        (x0 > inner.left && x1 < inner.right && y0 > inner.top && y1 < inner.bottom);
+            size_t cell = static_cast<size_t>(cy) * cols + cx;
+            if (skip) continue;
+            if (cellStart[cell] != rangeEnd) {
+                if (rangeBegin != rangeEnd) visit(rangeBegin, rangeEnd);
+                rangeBegin = cellStart[cell];
+            }
+            rangeEnd = cellStart[cell + 1];
+        }
+        if (rangeBegin != rangeEnd) visit(rangeBegin, rangeEnd);
+    }
+}
+
+// Кэш результатов отсечения для интерактивного перемещения окна.
+// При сдвиге или масштабировании окна пересчитываются только отрезки,
+// задевающие полосы между старыми и новыми границами; видимые части
+// хранятся плотным массивом пар вершин для отрисовки одним вызовом
+class ClipCache {
+public:
+    // Копирует отрезки и строит по ним сетку
+    void reset(const SegmentView& segments, sf::Color color);
+    
+    // Приводит кэш к окну rect. Если окно и алгоритм не менялись, ничего
+    // не делает. Возвращает число заново отсечённых отрезков
+    size_t update(const ClipRect& rect, ClipAlgorithm algorithm);
+    
+    // Следующий update пересчитает все отрезки
+    void invalidate() { valid = false; }
+    
+    const std::vector<sf::Vertex>& vertices() const { return visible; }
+    const SegmentGrid& grid() const { return index; }
+    
+    // Вершины [first, first + count) в vertices(), изменившиеся после
+    // предыдущего вызова (например, для дозагрузки в видеопамять)
+    struct VertexRange {
+        size_t first, count;
+    };
+    VertexRange takeDirty();
+    
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    
+    sf::Color color;
+    SegmentGrid index;
+    bool valid = false;
+    ClipRect current = {};
+    ClipAlgorithm currentAlgorithm = ClipAlgorithm::CohenSutherland;
+    
+    std::vector<sf::Vertex> visible;  // пары вершин видимых частей
+    std::vector<uint32_t> slotOwner;  // отрезок (в порядке сетки) для каждой пары в visible
+    std::vector<uint32_t> slotOf;     // пара в visible для каждого отрезка
+    size_t dirtyBegin = SIZE_MAX, dirtyEnd = 0;  // изменённые пары
+    
+    void reclip(uint32_t i);
+    void markDirty(size_t slot) {
+        dirtyBegin = std::min(dirtyBegin, slot);
+        dirtyEnd = std::max(dirtyEnd, slot + 1);
+    }
+};
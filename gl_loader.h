@@ -0,0 +1,340 @@
+#pragma once
+
+// Функции OpenGL новее 1.1 (буферы вершин, шейдеры, отрисовка экземпляров,
+// буферы кадра, замер времени на видеокарте, буферы однородных переменных,
+// текстуры из буферов).
+// Заголовки системы объявляют только OpenGL 1.1 (Windows) или не гарантируют
+// остальное, поэтому указатели запрашиваются у текущего контекста через
+// sf::Context::getFunction. Если функция ядра не найдена, пробуется вариант
+// расширения ARB. gl::load() вызывается после создания окна
+
+#include <SFML/OpenGL.hpp>
+#include <SFML/Window.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+    #define CG_GL_API __stdcall
+#else
+    #define CG_GL_API
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+    #define GL_ARRAY_BUFFER 0x8892
+    #define GL_ELEMENT_ARRAY_BUFFER 0x8893
+    #define GL_STREAM_DRAW 0x88E0
+    #define GL_STATIC_DRAW 0x88E4
+    #define GL_DYNAMIC_DRAW 0x88E8
+#endif
+#ifndef GL_FRAMEBUFFER
+    #define GL_FRAMEBUFFER 0x8D40
+    #define GL_DEPTH_ATTACHMENT 0x8D00
+    #define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+    #define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+    #define GL_READ_FRAMEBUFFER 0x8CA8
+    #define GL_DRAW_FRAMEBUFFER 0x8CA9
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+    #define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_CLAMP_TO_BORDER
+    #define GL_CLAMP_TO_BORDER 0x812D
+#endif
+#ifndef GL_TEXTURE_COMPARE_MODE
+    #define GL_DEPTH_TEXTURE_MODE 0x884B
+    #define GL_TEXTURE_COMPARE_MODE 0x884C
+    #define GL_TEXTURE_COMPARE_FUNC 0x884D
+    #define GL_COMPARE_R_TO_TEXTURE 0x884E
+#endif
+#ifndef GL_QUERY_RESULT
+    #define GL_SAMPLES_PASSED 0x8914
+    #define GL_QUERY_RESULT 0x8866
+    #define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_TIME_ELAPSED
+    #define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_UNIFORM_BUFFER
+    #define GL_UNIFORM_BUFFER 0x8A11
+    #define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+#ifndef GL_TEXTURE_BUFFER
+    #define GL_TEXTURE_BUFFER 0x8C2A
+#endif
+#ifndef GL_RGBA32F
+    #define GL_RGBA32F 0x8814
+    #define GL_RGBA16F 0x881A
+#endif
+#ifndef GL_R32UI
+    #define GL_R32UI 0x8236
+    #define GL_RG32UI 0x823C
+#endif
+#ifndef GL_TEXTURE0
+    #define GL_TEXTURE0 0x84C0
+#endif
+#ifndef GL_VERTEX_SHADER
+    #define GL_FRAGMENT_SHADER 0x8B30
+    #define GL_VERTEX_SHADER 0x8B31
+    #define GL_COMPILE_STATUS 0x8B81
+    #define GL_LINK_STATUS 0x8B82
+    #define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+namespace gl {
+
+using GlSizeiPtr = std::ptrdiff_t;
+using GlIntPtr = std::ptrdiff_t;
+
+// Буферы (OpenGL 1.5)
+inline void (CG_GL_API* GenBuffers)(GLsizei, GLuint*) = nullptr;
+inline void (CG_GL_API* DeleteBuffers)(GLsizei, const GLuint*) = nullptr;
+inline void (CG_GL_API* BindBuffer)(GLenum, GLuint) = nullptr;
+inline void (CG_GL_API* BufferData)(GLenum, GlSizeiPtr, const void*, GLenum) = nullptr;
+inline void (CG_GL_API* BufferSubData)(GLenum, GlIntPtr, GlSizeiPtr, const void*) = nullptr;
+
+// Объекты массивов вершин (OpenGL 3.0, ARB_vertex_array_object)
+inline void (CG_GL_API* GenVertexArrays)(GLsizei, GLuint*) = nullptr;
+inline void (CG_GL_API* DeleteVertexArrays)(GLsizei, const GLuint*) = nullptr;
+inline void (CG_GL_API* BindVertexArray)(GLuint) = nullptr;
+
+// Шейдеры (OpenGL 2.0)
+inline GLuint (CG_GL_API* CreateShader)(GLenum) = nullptr;
+inline void (CG_GL_API* ShaderSource)(GLuint, GLsizei, const char* const*, const GLint*) = nullptr;
+inline void (CG_GL_API* CompileShader)(GLuint) = nullptr;
+inline void (CG_GL_API* GetShaderiv)(GLuint, GLenum, GLint*) = nullptr;
+inline void (CG_GL_API* GetShaderInfoLog)(GLuint, GLsizei, GLsizei*, char*) = nullptr;
+inline void (CG_GL_API* DeleteShader)(GLuint) = nullptr;
+inline GLuint (CG_GL_API* CreateProgram)() = nullptr;
+inline void (CG_GL_API* AttachShader)(GLuint, GLuint) = nullptr;
+inline void (CG_GL_API* BindAttribLocation)(GLuint, GLuint, const char*) = nullptr;
+inline void (CG_GL_API* LinkProgram)(GLuint) = nullptr;
+inline void (CG_GL_API* GetProgramiv)(GLuint, GLenum, GLint*) = nullptr;
+inline void (CG_GL_API* GetProgramInfoLog)(GLuint, GLsizei, GLsizei*, char*) = nullptr;
+inline void (CG_GL_API* DeleteProgram)(GLuint) = nullptr;
+inline void (CG_GL_API* UseProgram)(GLuint) = nullptr;
+inline GLint (CG_GL_API* GetUniformLocation)(GLuint, const char*) = nullptr;
+inline void (CG_GL_API* Uniform1i)(GLint, GLint) = nullptr;
+inline void (CG_GL_API* Uniform1f)(GLint, GLfloat) = nullptr;
+inline void (CG_GL_API* VertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) = nullptr;
+inline void (CG_GL_API* EnableVertexAttribArray)(GLuint) = nullptr;
+inline void (CG_GL_API* DisableVertexAttribArray)(GLuint) = nullptr;
+
+// Отрисовка экземпляров (OpenGL 3.3, ARB_draw_instanced + ARB_instanced_arrays)
+inline void (CG_GL_API* VertexAttribDivisor)(GLuint, GLuint) = nullptr;
+inline void (CG_GL_API* DrawElementsInstanced)(GLenum, GLsizei, GLenum, const void*, GLsizei) = nullptr;
+
+// Буферы кадра (OpenGL 3.0, ARB/EXT_framebuffer_object) и копирование
+// между ними (EXT_framebuffer_blit)
+inline void (CG_GL_API* GenFramebuffers)(GLsizei, GLuint*) = nullptr;
+inline void (CG_GL_API* DeleteFramebuffers)(GLsizei, const GLuint*) = nullptr;
+inline void (CG_GL_API* BindFramebuffer)(GLenum, GLuint) = nullptr;
+inline void (CG_GL_API* FramebufferTexture2D)(GLenum, GLenum, GLenum, GLuint, GLint) = nullptr;
+inline GLenum (CG_GL_API* CheckFramebufferStatus)(GLenum) = nullptr;
+inline void (CG_GL_API* BlitFramebuffer)(GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield,
+                                         GLenum) = nullptr;
+
+// Запись в несколько целей буфера кадра (OpenGL 2.0, ARB_draw_buffers)
+inline void (CG_GL_API* DrawBuffers)(GLsizei, const GLenum*) = nullptr;
+
+// Запросы: число прошедших проверку глубины фрагментов (OpenGL 1.5) и
+// время выполнения команд (OpenGL 3.3, ARB_timer_query или
+// EXT_timer_query), в наносекундах
+inline void (CG_GL_API* GenQueries)(GLsizei, GLuint*) = nullptr;
+inline void (CG_GL_API* DeleteQueries)(GLsizei, const GLuint*) = nullptr;
+inline void (CG_GL_API* BeginQuery)(GLenum, GLuint) = nullptr;
+inline void (CG_GL_API* EndQuery)(GLenum) = nullptr;
+inline void (CG_GL_API* GetQueryObjectiv)(GLuint, GLenum, GLint*) = nullptr;
+inline void (CG_GL_API* GetQueryObjectui64v)(GLuint, GLenum, std::uint64_t*) = nullptr;
+
+// Буферы однородных переменных (OpenGL 3.1, ARB_uniform_buffer_object)
+inline GLuint (CG_GL_API* GetUniformBlockIndex)(GLuint, const char*) = nullptr;
+inline void (CG_GL_API* UniformBlockBinding)(GLuint, GLuint, GLuint) = nullptr;
+inline void (CG_GL_API* BindBufferBase)(GLenum, GLuint, GLuint) = nullptr;
+
+// Несколько текстур сразу (OpenGL 1.3) и текстуры, читающие буфер
+// (OpenGL 3.1, ARB_texture_buffer_object)
+inline void (CG_GL_API* ActiveTexture)(GLenum) = nullptr;
+inline void (CG_GL_API* TexBuffer)(GLenum, GLenum, GLuint) = nullptr;
+
+template <typename Function>
+void loadFunction(Function& function, const char* name, const char* arbName = nullptr) {
+    function = reinterpret_cast<Function>(sf::Context::getFunction(name));
+    if (!function && arbName) {
+        function = reinterpret_cast<Function>(sf::Context::getFunction(arbName));
+    }
+}
+
+// Загрузка всех функций; возвращает false, если нет даже буферов вершин
+inline bool load() {
+    loadFunction(GenBuffers, "glGenBuffers", "glGenBuffersARB");
+    loadFunction(DeleteBuffers, "glDeleteBuffers", "glDeleteBuffersARB");
+    loadFunction(BindBuffer, "glBindBuffer", "glBindBufferARB");
+    loadFunction(BufferData, "glBufferData", "glBufferDataARB");
+    loadFunction(BufferSubData, "glBufferSubData", "glBufferSubDataARB");
+
+    loadFunction(GenVertexArrays, "glGenVertexArrays");
+    loadFunction(DeleteVertexArrays, "glDeleteVertexArrays");
+    loadFunction(BindVertexArray, "glBindVertexArray");
+
+    loadFunction(CreateShader, "glCreateShader");
+    loadFunction(ShaderSource, "glShaderSource");
+    loadFunction(CompileShader, "glCompileShader");
+    loadFunction(GetShaderiv, "glGetShaderiv");
+    loadFunction(GetShaderInfoLog, "glGetShaderInfoLog");
+    loadFunction(DeleteShader, "glDeleteShader");
+    loadFunction(CreateProgram, "glCreateProgram");
+    loadFunction(AttachShader, "glAttachShader");
+    loadFunction(BindAttribLocation, "glBindAttribLocation");
+    loadFunction(LinkProgram, "glLinkProgram");
+    loadFunction(GetProgramiv, "glGetProgramiv");
+    loadFunction(GetProgramInfoLog, "glGetProgramInfoLog");
+    loadFunction(DeleteProgram, "glDeleteProgram");
+    loadFunction(UseProgram, "glUseProgram");
+    loadFunction(GetUniformLocation, "glGetUniformLocation");
+    loadFunction(Uniform1i, "glUniform1i");
+    loadFunction(Uniform1f, "glUniform1f");
+    loadFunction(VertexAttribPointer, "glVertexAttribPointer", "glVertexAttribPointerARB");
+    loadFunction(EnableVertexAttribArray, "glEnableVertexAttribArray", "glEnableVertexAttribArrayARB");
+    loadFunction(DisableVertexAttribArray, "glDisableVertexAttribArray", "glDisableVertexAttribArrayARB");
+
+    loadFunction(VertexAttribDivisor, "glVertexAttribDivisor", "glVertexAttribDivisorARB");
+    loadFunction(DrawElementsInstanced, "glDrawElementsInstanced", "glDrawElementsInstancedARB");
+
+    loadFunction(GenFramebuffers, "glGenFramebuffers", "glGenFramebuffersEXT");
+    loadFunction(DeleteFramebuffers, "glDeleteFramebuffers", "glDeleteFramebuffersEXT");
+    loadFunction(BindFramebuffer, "glBindFramebuffer", "glBindFramebufferEXT");
+    loadFunction(FramebufferTexture2D, "glFramebufferTexture2D", "glFramebufferTexture2DEXT");
+    loadFunction(CheckFramebufferStatus, "glCheckFramebufferStatus", "glCheckFramebufferStatusEXT");
+    loadFunction(BlitFramebuffer, "glBlitFramebuffer", "glBlitFramebufferEXT");
+    loadFunction(DrawBuffers, "glDrawBuffers", "glDrawBuffersARB");
+
+    loadFunction(GenQueries, "glGenQueries", "glGenQueriesARB");
+    loadFunction(DeleteQueries, "glDeleteQueries", "glDeleteQueriesARB");
+    loadFunction(BeginQuery, "glBeginQuery", "glBeginQueryARB");
+    loadFunction(EndQuery, "glEndQuery", "glEndQueryARB");
+    loadFunction(GetQueryObjectiv, "glGetQueryObjectiv", "glGetQueryObjectivARB");
+    loadFunction(GetQueryObjectui64v, "glGetQueryObjectui64v", "glGetQueryObjectui64vEXT");
+
+    loadFunction(GetUniformBlockIndex, "glGetUniformBlockIndex");
+    loadFunction(UniformBlockBinding, "glUniformBlockBinding");
+    loadFunction(BindBufferBase, "glBindBufferBase", "glBindBufferBaseEXT");
+
+    loadFunction(ActiveTexture, "glActiveTexture", "glActiveTextureARB");
+    loadFunction(TexBuffer, "glTexBuffer", "glTexBufferARB");
+
+    return GenBuffers && DeleteBuffers && BindBuffer && BufferData && BufferSubData;
+}
+
+inline bool hasVertexArrays() {
+    return GenVertexArrays && DeleteVertexArrays && BindVertexArray;
+}
+
+inline bool hasShaders() {
+    return CreateShader && ShaderSource && CompileShader && GetShaderiv && GetShaderInfoLog &&
+           DeleteShader && CreateProgram && AttachShader && BindAttribLocation && LinkProgram &&
+           GetProgramiv && GetProgramInfoLog && DeleteProgram && UseProgram && GetUniformLocation &&
+           Uniform1i && Uniform1f && VertexAttribPointer && EnableVertexAttribArray &&
+           DisableVertexAttribArray;
+}
+
+inline bool hasInstancing() {
+    return hasShaders() && VertexAttribDivisor && DrawElementsInstanced;
+}
+
+inline bool hasFramebuffers() {
+    return GenFramebuffers && DeleteFramebuffers && BindFramebuffer && FramebufferTexture2D &&
+           CheckFramebufferStatus;
+}
+
+inline bool hasFramebufferBlit() {
+    return hasFramebuffers() && BlitFramebuffer;
+}
+
+inline bool hasDrawBuffers() {
+    return DrawBuffers != nullptr;
+}
+
+inline bool hasQueries() {
+    return GenQueries && DeleteQueries && BeginQuery && EndQuery && GetQueryObjectiv;
+}
+
+inline bool hasTimerQueries() {
+    return hasQueries() && GetQueryObjectui64v;
+}
+
+inline bool hasUniformBuffers() {
+    return hasShaders() && GetUniformBlockIndex && UniformBlockBinding && BindBufferBase;
+}
+
+inline bool hasTextureBuffers() {
+    return ActiveTexture && TexBuffer;
+}
+
+inline bool compileShader(GLenum type, const char* source, GLuint& shader, std::string& error) {
+    shader = CreateShader(type);
+    ShaderSource(shader, 1, &source, nullptr);
+    CompileShader(shader);
+    GLint status = GL_FALSE;
+    GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_TRUE) return true;
+
+    GLint length = 0;
+    GetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(static_cast<size_t>(std::max(length, 1)), '\0');
+    GetShaderInfoLog(shader, length, nullptr, &log[0]);
+    error = (type == GL_VERTEX_SHADER ? "вершинный шейдер: " : "фрагментный шейдер: ") + log;
+    DeleteShader(shader);
+    shader = 0;
+    return false;
+}
+
+// Сборка программы из вершинного и фрагментного шейдеров. attributes задаёт
+// номера входов вершинного шейдера до компоновки
+inline bool buildProgram(const char* vertexSource, const char* fragmentSource,
+                         const std::vector<std::pair<GLuint, const char*>>& attributes,
+                         GLuint& program, std::string& error) {
+    program = 0;
+    if (!hasShaders()) {
+        error = "шейдеры не поддерживаются";
+        return false;
+    }
+    GLuint vertex, fragment;
+    if (!compileShader(GL_VERTEX_SHADER, vertexSource, vertex, error)) return false;
+    if (!compileShader(GL_FRAGMENT_SHADER, fragmentSource, fragment, error)) {
+        DeleteShader(vertex);
+        return false;
+    }
+
+    program = CreateProgram();
+    AttachShader(program, vertex);
+    AttachShader(program, fragment);
+    for (const auto& attribute : attributes) {
+        BindAttribLocation(program, attribute.first, attribute.second);
+    }
+    LinkProgram(program);
+    DeleteShader(vertex);
+    DeleteShader(fragment);
+
+    GLint status = GL_FALSE;
+    GetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_TRUE) return true;
+
+    GLint length = 0;
+    GetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(static_cast<size_t>(std::max(length, 1)), '\0');
+    GetProgramInfoLog(program, length, nullptr, &log[0]);
+    error = "компоновка: " + log;
+    DeleteProgram(program);
+    program = 0;
+    return false;
+}
+
+} // namespace gl
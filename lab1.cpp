@@ -1,14 +1,16 @@
 #include <SFML/Graphics.hpp>
+#include "cg_math.h"
+#include "clipping.h"
+#include "segment_file.h"
 #include <vector>
 #include <iostream>
 #include <chrono>
-
-// Коды для алгоритма Коэна-Сазерленда
-const int INSIDE = 0;  // 0000
-const int LEFT = 1;    // 0001
-const int RIGHT = 2;   // 0010
-const int BOTTOM = 4;  // 0100
-const int TOP = 8;     // 1000
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include <thread>
+#include <algorithm>
+#include <cmath>
 
 class ClippingWindow {
 private:
@@ -16,43 +18,40 @@ private:
     bool isDragging;
     sf::Vector2f dragOffset;
     float scale;
+    float angle;  // поворот в градусах, 0 - окно со сторонами вдоль осей
     sf::Vector2f originalSize;
 
+    // Начало координат прямоугольника в его центре: поворот и масштаб
+    // выполняются вокруг центра
+    void resize() {
+        sf::Vector2f size(originalSize.x * scale, originalSize.y * scale);
+        rectangle.setSize(size);
+        rectangle.setOrigin(size.x / 2, size.y / 2);
+    }
+
+    void rotate(float degrees) {
+        angle = std::fmod(angle + degrees + 360.0f, 360.0f);
+        rectangle.setRotation(angle);
+        std::cout << "Поворот: " << angle << std::endl;
+    }
+
 public:
     ClippingWindow(float x, float y, float width, float height) 
-        : isDragging(false), scale(1.0f), originalSize(width, height) {
-        rectangle.setPosition(x, y);
-        rectangle.setSize(sf::Vector2f(width, height));
+        : isDragging(false), scale(1.0f), angle(0.0f), originalSize(width, height) {
+        resize();
+        rectangle.setPosition(x + width / 2, y + height / 2);
         rectangle.setFillColor(sf::Color::Transparent);
         rectangle.setOutlineColor(sf::Color::White);
         rectangle.setOutlineThickness(2.0f);
     }
 
-    // Получение кода точки для алгоритма Коэна-Сазерленда
-    int getPointCode(float x, float y) const {
-        int code = INSIDE;
-        sf::Vector2f pos = rectangle.getPosition();
-        sf::Vector2f size = rectangle.getSize();
-
-        if (x < pos.x)
-            code |= LEFT;
-        else if (x > pos.x + size.x)
-            code |= RIGHT;
-        if (y < pos.y)
-            code |= TOP;
-        else if (y > pos.y + size.y)
-            code |= BOTTOM;
-
-        return code;
-    }
-
     void handleEvent(const sf::Event& event, const sf::RenderWindow& window) {
         if (event.type == sf::Event::MouseButtonPressed) {
             if (event.mouseButton.button == sf::Mouse::Left) {
                 sf::Vector2i mousePos = sf::Mouse::getPosition(window);
                 sf::Vector2f worldPos = window.mapPixelToCoords(mousePos);
                 
-                if (rectangle.getGlobalBounds().contains(worldPos)) {
+                if (getConvexWindow().contains(worldPos.x, worldPos.y)) {
                     isDragging = true;
                     dragOffset = worldPos - rectangle.getPosition();
                 }
@@ -67,15 +66,22 @@ public:
             // Увеличение размера: клавиша '+'
             if (event.key.code == sf::Keyboard::Equal) {  // '+' на той же клавише что и '='
                 scale *= 1.1f;
-                rectangle.setSize(sf::Vector2f(originalSize.x * scale, originalSize.y * scale));
+                resize();
                 std::cout << "Увеличение. Масштаб: " << scale << std::endl;
             }
             // Уменьшение размера: клавиша '-'
             else if (event.key.code == sf::Keyboard::Dash) {  // '-'
                 scale *= 0.9f;
-                rectangle.setSize(sf::Vector2f(originalSize.x * scale, originalSize.y * scale));
+                resize();
                 std::cout << "Уменьшение. Масштаб: " << scale << std::endl;
             }
+            // Поворот окна: Q - против часовой стрелки, E - по часовой
+            else if (event.key.code == sf::Keyboard::Q) {
+                rotate(-15.0f);
+            }
+            else if (event.key.code == sf::Keyboard::E) {
+                rotate(15.0f);
+            }
         }
     }
 
@@ -94,91 +100,135 @@ public:
     sf::FloatRect getBounds() const {
         return rectangle.getGlobalBounds();
     }
+    
+    // Границы окна до поворота (без учёта толщины контура)
+    ClipRect getClipRect() const {
+        sf::Vector2f pos = rectangle.getPosition() - rectangle.getOrigin();
+        sf::Vector2f size = rectangle.getSize();
+        return {pos.x, pos.y, pos.x + size.x, pos.y + size.y};
+    }
+    
+    float getAngle() const {
+        return angle;
+    }
+    
+    void setOutlineThickness(float thickness) {
+        rectangle.setOutlineThickness(thickness);
+    }
+    
+    // Окно с учётом поворота
+    ConvexWindow getConvexWindow() const {
+        return ConvexWindow::fromRect(getClipRect(), angle);
+    }
 };
 
-class Line {
+// Отрезки в видеопамяти (sf::VertexBuffer): рисуются одним вызовом,
+// при изменениях дозагружается только изменившийся диапазон вершин.
+// Если буферы вершин не поддерживаются, вершины передаются каждый кадр
+class LineBuffer {
 private:
-    sf::Vertex vertices[2];
+    sf::VertexBuffer buffer;
+    const std::vector<sf::Vertex>* source = nullptr;
+    size_t count = 0;
 
 public:
-    Line(float x1, float y1, float x2, float y2) {
-        vertices[0].position = sf::Vector2f(x1, y1);
-        vertices[1].position = sf::Vector2f(x2, y2);
-        vertices[0].color = sf::Color::Green;
-        vertices[1].color = sf::Color::Green;
-    }
-
-    bool clipLine(const ClippingWindow& window) {
-        sf::FloatRect bounds = window.getBounds();
-        float x1 = vertices[0].position.x;
-        float y1 = vertices[0].position.y;
-        float x2 = vertices[1].position.x;
-        float y2 = vertices[1].position.y;
-
-        int code1 = window.getPointCode(x1, y1);
-        int code2 = window.getPointCode(x2, y2);
+    explicit LineBuffer(sf::VertexBuffer::Usage usage) : buffer(sf::Lines, usage) {}
+
+    // first и changed - изменившийся диапазон вершин в vertices
+    void upload(const std::vector<sf::Vertex>& vertices, size_t first, size_t changed) {
+        source = &vertices;
+        count = vertices.size();
+        if (!sf::VertexBuffer::isAvailable()) return;
         
-        // Если оба конца внутри окна
-        if (!(code1 | code2)) {
-            vertices[0].color = sf::Color::Red;
-            vertices[1].color = sf::Color::Red;
-            return true;
+        if (count > buffer.getVertexCount()) {
+            // Запас по размеру, чтобы не пересоздавать буфер при каждом росте
+            if (!buffer.create(std::max(count, 2 * buffer.getVertexCount()))) return;
+            first = 0;
+            changed = count;
         }
-        
-        // Если линия полностью снаружи
-        if (code1 & code2) {
-            vertices[0].color = sf::Color::Green;
-            vertices[1].color = sf::Color::Green;
-            return false;
+        if (changed > 0) {
+            buffer.update(vertices.data() + first, changed, static_cast<unsigned>(first));
         }
+    }
 
-        // Отсечение по каждой границе
-        float x = 0, y = 0;
-        int codeOut = code1 ? code1 : code2;
+    void draw(sf::RenderTarget& target) const {
+        if (count == 0) return;
+        if (sf::VertexBuffer::isAvailable() && buffer.getVertexCount() >= count)
+            target.draw(buffer, 0, count);
+        else
+            target.draw(source->data(), count, sf::Lines);
+    }
+};
 
-        // Находим точку пересечения с границей
-        if (codeOut & TOP) {
-            x = x1 + (x2 - x1) * (bounds.top - y1) / (y2 - y1);
-            y = bounds.top;
-        }
-        else if (codeOut & BOTTOM) {
-            x = x1 + (x2 - x1) * (bounds.top + bounds.height - y1) / (y2 - y1);
-            y = bounds.top + bounds.height;
+// Ожидание до начала следующего кадра по абсолютным отметкам времени, чтобы
+// погрешность sleep не накапливалась. sleep будит поток с опозданием, поэтому
+// последнюю миллисекунду поток ждёт активно. Если кадр не уложился в период,
+// расписание сдвигается, а не догоняется серией кадров без ожидания
+class FramePacer {
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::duration period;
+    Clock::time_point next;
+
+public:
+    explicit FramePacer(int fps)
+        : period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))),
+          next(Clock::now() + period) {}
+
+    void wait() {
+        const auto spin = std::chrono::milliseconds(1);
+        auto now = Clock::now();
+        if (next - now > spin) {
+            std::this_thread::sleep_for(next - now - spin);
         }
-        else if (codeOut & RIGHT) {
-            y = y1 + (y2 - y1) * (bounds.left + bounds.width - x1) / (x2 - x1);
-            x = bounds.left + bounds.width;
+        while (Clock::now() < next) {
         }
-        else if (codeOut & LEFT) {
-            y = y1 + (y2 - y1) * (bounds.left - x1) / (x2 - x1);
-            x = bounds.left;
+        now = Clock::now();
+        next += period;
+        if (next < now) {
+            next = now + period;
         }
+    }
+};
 
-        // Обновляем конечную точку
-        if (codeOut == code1) {
-            x1 = x;
-            y1 = y;
-        }
-        else {
-            x2 = x;
-            y2 = y;
-        }
+// Наборы больше этого размера не кэшируются и не рисуются целиком
+const size_t LARGE_DATASET = 4000000;
 
-        // Обновляем координаты и цвет
-        vertices[0].position = sf::Vector2f(x1, y1);
-        vertices[1].position = sf::Vector2f(x2, y2);
-        vertices[0].color = sf::Color::Red;
-        vertices[1].color = sf::Color::Red;
-        
-        return true;
+// Многоугольники для демонстрации алгоритма Сазерленда-Ходжмена:
+// невыпуклая звезда, шестиугольник и треугольник
+void addDemoPolygons(PolygonSet& polygons) {
+    std::vector<sf::Vector2f> points;
+    for (int k = 0; k < 10; ++k) {
+        float radius = k % 2 ? 70.0f : 170.0f;
+        float a = k * PI / 5;
+        points.emplace_back(400 + radius * std::cos(a), 300 + radius * std::sin(a));
+    }
+    polygons.add(points.data(), points.size());
+    
+    points.clear();
+    for (int k = 0; k < 6; ++k) {
+        float a = k * PI / 3;
+        points.emplace_back(150 + 90 * std::cos(a), 420 + 90 * std::sin(a));
     }
+    polygons.add(points.data(), points.size());
+    
+    const sf::Vector2f triangle[] = {{520, 60}, {760, 200}, {560, 260}};
+    polygons.add(triangle, 3);
+}
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(vertices, 2, sf::Lines);
+// Контуры многоугольников парами вершин для sf::Lines
+void appendOutlines(const PolygonSet& polygons, sf::Color color, std::vector<sf::Vertex>& out) {
+    for (size_t i = 0; i < polygons.size(); ++i) {
+        const sf::Vector2f* p = polygons.polygon(i);
+        size_t n = polygons.polygonSize(i);
+        for (size_t k = 0; k < n; ++k) {
+            out.emplace_back(p[k], color);
+            out.emplace_back(p[(k + 1) % n], color);
+        }
     }
-};
+}
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "Запуск программы..." << std::endl;
     
     sf::ContextSettings settings;
@@ -192,16 +242,94 @@ int main() {
         return -1;
     }
     
-    window.setFramerateLimit(60);
+    int targetFps = 60;
     
     ClippingWindow clipWindow(200, 150, 400, 300);
-    std::vector<Line> lines = {
-        Line(100, 100, 700, 500),
-        Line(100, 500, 700, 100),
-        Line(400, 50, 400, 550),
-        Line(50, 300, 750, 300),
-        Line(150, 150, 650, 450)
-    };
+    SegmentSoA segments;
+    segments.add(100, 100, 700, 500);
+    segments.add(100, 500, 700, 100);
+    segments.add(400, 50, 400, 550);
+    segments.add(50, 300, 750, 300);
+    segments.add(150, 150, 650, 450);
+    MappedSegments mapped;
+    
+    // lab1 --random N: добавить N случайных коротких отрезков
+    // lab1 --load file.seg: отрезки из файла (см. lab1_import) вместо встроенных
+    // lab1 --fps N: частота кадров (по умолчанию 60)
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--random") == 0) {
+            size_t count = std::strtoul(argv[i + 1], nullptr, 10);
+            segments.reserve(segments.size() + count);
+            addRandomSegments(segments, count, 800, 600);
+            std::cout << "Отрезков: " << segments.size() << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--load") == 0) {
+            std::string error;
+            if (!mapped.open(argv[i + 1], error)) {
+                std::cerr << "Ошибка загрузки: " << error << std::endl;
+                return -1;
+            }
+            std::cout << "Загружено отрезков: " << mapped.size() << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--fps") == 0) {
+            targetFps = std::max(1, std::atoi(argv[i + 1]));
+        }
+    }
+    const SegmentView data = mapped.isOpen() ? mapped.view() : segments.view();
+    
+    // Вид подгоняется под набор из файла с сохранением пропорций,
+    // окно отсечения ставится в центр
+    if (mapped.isOpen() && mapped.size() > 0) {
+        ClipRect view = fitRect(mapped.bounds(), 800.0f / 600.0f);
+        float width = view.right - view.left, height = view.bottom - view.top;
+        window.setView(sf::View(sf::FloatRect(view.left, view.top, width, height)));
+        clipWindow = ClippingWindow(view.left + width / 4, view.top + height / 4, width / 2, height / 2);
+        clipWindow.setOutlineThickness(2.0f * width / 800);
+    }
+    
+    // Большие наборы не копируются: каждый раз отсекаются потоком по частям
+    // на всех ядрах, в видеопамять попадают только видимые части
+    const bool streamAlways = data.count > LARGE_DATASET;
+    
+    // Исходные отрезки не меняются: загружаются в видеопамять один раз
+    std::vector<sf::Vertex> sourceVertices;
+    if (!streamAlways) {
+        sourceVertices.reserve(2 * data.count);
+        for (size_t i = 0; i < data.count; ++i) {
+            sourceVertices.emplace_back(sf::Vector2f(data.x1[i], data.y1[i]), sf::Color::Green);
+            sourceVertices.emplace_back(sf::Vector2f(data.x2[i], data.y2[i]), sf::Color::Green);
+        }
+    }
+    else {
+        std::cout << "Исходные отрезки не показываются: их больше " << LARGE_DATASET << std::endl;
+    }
+    LineBuffer sourceBuffer(sf::VertexBuffer::Static);
+    sourceBuffer.upload(sourceVertices, 0, sourceVertices.size());
+    // Видимые части кэшируются и пересчитываются только при изменении окна
+    ClipCache clipCache;
+    if (!streamAlways) {
+        clipCache.reset(data, sf::Color::Red);
+    }
+    size_t reclipped = 0;
+    LineBuffer clippedBuffer(sf::VertexBuffer::Stream);
+    FramePacer pacer(targetFps);
+    bool showSources = true;
+    size_t algorithmIndex = 0;  // индекс в CLIP_ALGORITHMS
+    
+    // Повёрнутое окно (алгоритм Кируса-Бека) и большие наборы отсекаются
+    // пулом потоков; результат пересчитывается, только когда окно сдвинулось,
+    // повернулось или сменился алгоритм
+    std::vector<sf::Vertex> streamedVertices;
+    bool streamedValid = false;
+    bool wasStreamed = false;
+    ClipRect streamedRect = {};
+    float streamedAngle = 0;
+    size_t streamedAlgorithm = 0;
+    
+    PolygonSet polygons, clippedPolygons;
+    addDemoPolygons(polygons);
+    std::vector<sf::Vertex> polygonVertices;
+    bool showPolygons = false;
 
     auto frameCount = 0;
     auto startTime = std::chrono::steady_clock::now();
@@ -210,6 +338,10 @@ int main() {
     std::cout << "- Перетаскивание окна: левая кнопка мыши" << std::endl;
     std::cout << "- Увеличение окна: клавиша '+'" << std::endl;
     std::cout << "- Уменьшение окна: клавиша '-'" << std::endl;
+    std::cout << "- Показать/скрыть исходные отрезки: H" << std::endl;
+    std::cout << "- Смена алгоритма отсечения: C" << std::endl;
+    std::cout << "- Поворот окна: Q / E" << std::endl;
+    std::cout << "- Показать/скрыть многоугольники: P" << std::endl;
     std::cout << "- Выход: Escape" << std::endl;
 
     while (window.isOpen()) {
@@ -217,8 +349,9 @@ int main() {
         auto elapsedTime = std::chrono::duration_cast<std::chrono::seconds>(currentTime - startTime).count();
         
         if (elapsedTime >= 1) {
-            std::cout << "FPS: " << frameCount << std::endl;
+            std::cout << "FPS: " << frameCount << ", пересчитано отрезков: " << reclipped << std::endl;
             frameCount = 0;
+            reclipped = 0;
             startTime = currentTime;
         }
 
@@ -228,6 +361,16 @@ int main() {
                 (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)) {
                 window.close();
             }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::H) {
+                showSources = !showSources;
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::C) {
+                algorithmIndex = (algorithmIndex + 1) % std::size(CLIP_ALGORITHMS);
+                std::cout << "Алгоритм: " << clipAlgorithmName(CLIP_ALGORITHMS[algorithmIndex]) << std::endl;
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::P) {
+                showPolygons = !showPolygons;
+            }
             clipWindow.handleEvent(event, window);
         }
 
@@ -235,15 +378,55 @@ int main() {
         window.clear(sf::Color::Black);
         clipWindow.draw(window);
         
-        for (auto& line : lines) {
-            line.clipLine(clipWindow);
-            line.draw(window);
+        if (showSources && !streamAlways) {
+            sourceBuffer.draw(window);
+        }
+        
+        ClipRect clipRect = clipWindow.getClipRect();
+        float angle = clipWindow.getAngle();
+        if (angle != 0 || streamAlways) {
+            if (!streamedValid || clipRect != streamedRect || angle != streamedAngle ||
+                algorithmIndex != streamedAlgorithm) {
+                streamedVertices.clear();
+                if (angle != 0)
+                    ClipPool::shared().clip(data, clipWindow.getConvexWindow(), streamedVertices, sf::Color::Red);
+                else
+                    ClipPool::shared().clip(data, clipRect, streamedVertices, sf::Color::Red,
+                                            CLIP_ALGORITHMS[algorithmIndex]);
+                clippedBuffer.upload(streamedVertices, 0, streamedVertices.size());
+                reclipped += data.count;
+                streamedValid = true;
+                streamedRect = clipRect;
+                streamedAngle = angle;
+                streamedAlgorithm = algorithmIndex;
+            }
+            wasStreamed = true;
+        }
+        else {
+            reclipped += clipCache.update(clipRect, CLIP_ALGORITHMS[algorithmIndex]);
+            ClipCache::VertexRange dirty = clipCache.takeDirty();
+            if (wasStreamed) {
+                // В буфере остался результат отсечения пулом потоков
+                dirty = {0, clipCache.vertices().size()};
+                wasStreamed = false;
+                streamedValid = false;
+            }
+            clippedBuffer.upload(clipCache.vertices(), dirty.first, dirty.count);
+        }
+        clippedBuffer.draw(window);
+        
+        if (showPolygons) {
+            clipPolygons(polygons, clipWindow.getConvexWindow(), clippedPolygons);
+            polygonVertices.clear();
+            appendOutlines(polygons, sf::Color::Green, polygonVertices);
+            appendOutlines(clippedPolygons, sf::Color::Red, polygonVertices);
+            window.draw(polygonVertices.data(), polygonVertices.size(), sf::Lines);
         }
 
         window.display();
         frameCount++;
         
-        sf::sleep(sf::milliseconds(16));
+        pacer.wait();
     }
 
     std::cout << "Программа завершена" << std::endl;
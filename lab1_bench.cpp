@@ -0,0 +1,185 @@
+#include "clipping.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Тест производительности алгоритмов отсечения без окна:
+//   lab1_bench [число отрезков] [повторов]
+// Для каждого набора случайных отрезков и каждого алгоритма выводится
+// скорость в отрезках в секунду для пакетного отсечения (clipBatch) и
+// для поотрезочного вызова clipSegment. Затем сравнивается полный пересчёт
+// с инкрементальным (ClipCache) при перетаскивании окна, а также отсечение
+// повёрнутым окном и многоугольников на одном и на всех ядрах
+
+struct Dataset {
+    std::string name;
+    SegmentSoA segments;
+};
+
+// Отрезки с началом в области [0, areaW] x [0, areaH] и длиной до maxLength
+Dataset makeDataset(const std::string& name, size_t count, float areaW, float areaH,
+                    float maxLength, unsigned seed) {
+    Dataset data;
+    data.name = name;
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> x(0, areaW);
+    std::uniform_real_distribution<float> y(0, areaH);
+    std::uniform_real_distribution<float> offset(-maxLength, maxLength);
+    data.segments.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        float ax = x(gen);
+        float ay = y(gen);
+        data.segments.add(ax, ay, ax + offset(gen), ay + offset(gen));
+    }
+    return data;
+}
+
+template <typename F>
+double measure(int repeats, F run) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    int repeats = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+    
+    // Окно как в lab1: 400x300 в области 800x600
+    const ClipRect rect = {200, 150, 600, 450};
+    std::vector<Dataset> datasets;
+    datasets.push_back(makeDataset("short", count, 800, 600, 20, 1));
+    datasets.push_back(makeDataset("long", count, 800, 600, 600, 2));
+    datasets.push_back(makeDataset("sparse", count, 8000, 6000, 20, 3));
+    
+    std::cout << "Отрезков: " << count << ", повторов: " << repeats << " (лучшее время)\n\n";
+    // Заголовок выровнен вручную: printf считает ширину в байтах, а не в символах
+    std::cout << "набор    алгоритм              batch, Мотр/с scalar, Мотр/с    видимых\n";
+    
+    std::vector<sf::Vertex> out;
+    for (const auto& data : datasets) {
+        SegmentView view = data.segments.view();
+        for (ClipAlgorithm algorithm : CLIP_ALGORITHMS) {
+            ClipStats stats;
+            double batch = measure(repeats, [&] {
+                out.clear();
+                stats = clipBatch(view, rect, out, sf::Color::Red, algorithm);
+            });
+            
+            size_t visible = 0;
+            double scalar = measure(repeats, [&] {
+                visible = 0;
+                for (size_t i = 0; i < view.count; ++i) {
+                    float x1 = view.x1[i], y1 = view.y1[i], x2 = view.x2[i], y2 = view.y2[i];
+                    visible += clipSegment(algorithm, rect, x1, y1, x2, y2);
+                }
+            });
+            
+            std::printf("%-8s %-20s %14.1f %14.1f %10zu\n", data.name.c_str(), clipAlgorithmName(algorithm),
+                        count / batch / 1e6, count / scalar / 1e6, stats.accepted + stats.clipped);
+            if (visible != stats.accepted + stats.clipped) {
+                std::printf("         расхождение: поотрезочно видимых %zu\n", visible);
+            }
+        }
+    }
+    
+    // Перетаскивание: окно сдвигается на несколько пикселей за кадр,
+    // время - среднее на кадр
+    const int frames = 120;
+    std::cout << "\nперетаскивание, " << frames << " кадров (мс на кадр)\n";
+    std::cout << "набор        полный пересчёт   ClipCache  пересчитано/кадр\n";
+    for (const auto& data : datasets) {
+        SegmentView view = data.segments.view();
+        auto frameRect = [&](int frame) {
+            float dx = 3.0f * frame, dy = 1.5f * frame;
+            float grow = 1.0f + 0.002f * frame;
+            return ClipRect{rect.left + dx, rect.top + dy,
+                            rect.left + dx + 400 * grow, rect.top + dy + 300 * grow};
+        };
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 1; frame <= frames; ++frame) {
+            out.clear();
+            clipBatch(view, frameRect(frame), out, sf::Color::Red);
+        }
+        double full = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        ClipCache cache;
+        cache.reset(view, sf::Color::Red);
+        cache.update(frameRect(0), ClipAlgorithm::CohenSutherland);
+        size_t reclipped = 0;
+        start = std::chrono::steady_clock::now();
+        for (int frame = 1; frame <= frames; ++frame) {
+            reclipped += cache.update(frameRect(frame), ClipAlgorithm::CohenSutherland);
+        }
+        double incremental = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::printf("%-8s %19.3f %11.3f %17zu\n", data.name.c_str(), full * 1e3 / frames,
+                    incremental * 1e3 / frames, reclipped / frames);
+        
+        // Результат должен совпадать с полным пересчётом для последнего окна
+        auto key = [](const sf::Vertex& a, const sf::Vertex& b) {
+            return a.position.x != b.position.x ? a.position.x < b.position.x : a.position.y < b.position.y;
+        };
+        std::vector<sf::Vertex> cached = cache.vertices();
+        std::sort(cached.begin(), cached.end(), key);
+        std::sort(out.begin(), out.end(), key);
+        bool same = cached.size() == out.size() &&
+                    std::equal(cached.begin(), cached.end(), out.begin(), [](const sf::Vertex& a, const sf::Vertex& b) {
+                        return a.position == b.position;
+                    });
+        if (!same) {
+            std::printf("         расхождение с полным пересчётом: %zu и %zu вершин\n", cached.size(), out.size());
+        }
+    }
+    
+    // Повёрнутое окно (Кирус-Бек) и многоугольники (Сазерленд-Ходжмен)
+    const ConvexWindow rotated = ConvexWindow::fromRect(rect, 30);
+    std::cout << "\nокно, повёрнутое на 30 градусов (Мотр/с)\n";
+    std::cout << "набор      1 поток  все потоки    видимых\n";
+    for (const auto& data : datasets) {
+        SegmentView view = data.segments.view();
+        ClipStats stats;
+        double single = measure(repeats, [&] {
+            out.clear();
+            stats = clipBatch(view, rotated, out, sf::Color::Red);
+        });
+        double parallel = measure(repeats, [&] {
+            out.clear();
+            ClipPool::shared().clip(view, rotated, out, sf::Color::Red);
+        });
+        std::printf("%-8s %9.1f %11.1f %10zu\n", data.name.c_str(), count / single / 1e6,
+                    count / parallel / 1e6, stats.accepted + stats.clipped);
+    }
+    
+    // Случайные шестиугольники
+    PolygonSet polygons;
+    {
+        std::mt19937 gen(4);
+        std::uniform_real_distribution<float> x(0, 800), y(0, 600), radius(5, 40);
+        sf::Vector2f hexagon[6];
+        for (size_t i = 0; i < count / 6; ++i) {
+            float cx = x(gen), cy = y(gen), r = radius(gen);
+            for (int k = 0; k < 6; ++k) {
+                hexagon[k] = sf::Vector2f(cx + r * std::cos(k * 1.0472f), cy + r * std::sin(k * 1.0472f));
+            }
+            polygons.add(hexagon, 6);
+        }
+    }
+    PolygonSet clipped;
+    double single = measure(repeats, [&] { clipPolygons(polygons, rotated, clipped); });
+    double parallel = measure(repeats, [&] { ClipPool::shared().clipPolygons(polygons, rotated, clipped); });
+    std::printf("\nмногоугольников: %zu, Мвершин/с: 1 поток %.1f, все потоки %.1f\n", polygons.size(),
+                polygons.points.size() / single / 1e6, polygons.points.size() / parallel / 1e6);
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "segment_file.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Подготовка наборов отрезков для lab1:
+//   lab1_import input.csv output.seg   - импорт CSV (x1,y1,x2,y2 в строке)
+//   lab1_import --random N output.seg  - N случайных коротких отрезков в области 800x600
+// Полученный файл открывается командой lab1 --load output.seg
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || (std::strcmp(argv[1], "--random") == 0 && argc < 4)) {
+        std::cerr << "Использование: " << argv[0] << " input.csv output.seg\n"
+                  << "               " << argv[0] << " --random N output.seg" << std::endl;
+        return 1;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::string error;
+    uint64_t count = 0;
+    std::string output;
+    
+    if (std::strcmp(argv[1], "--random") == 0) {
+        count = std::strtoull(argv[2], nullptr, 10);
+        output = argv[3];
+        
+        // Те же отрезки, что и lab1 --random N
+        SegmentFileWriter writer;
+        if (!writer.open(output, count, error)) {
+            std::cerr << "Ошибка: " << error << std::endl;
+            return 1;
+        }
+        addRandomSegments(writer, count, 800, 600);
+        if (!writer.close(error)) {
+            std::cerr << "Ошибка: " << error << std::endl;
+            return 1;
+        }
+    }
+    else {
+        output = argv[2];
+        if (!importSegmentCsv(argv[1], output, count, error)) {
+            std::cerr << "Ошибка: " << error << std::endl;
+            return 1;
+        }
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Записано отрезков: " << count << " в " << output << " за " << seconds << " с" << std::endl;
+    return 0;
+}
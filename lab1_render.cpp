@@ -0,0 +1,192 @@
+#include "line_raster.h"
+#include "segment_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Отсечение и отрисовка набора отрезков в файл без окна и без OpenGL:
+//   lab1_render (--load file.seg | --random N) [параметры] output.png
+// Параметры:
+//   --size WxH            размер изображения (800x600)
+//   --window l,t,r,b      окно отсечения в мировых координатах
+//   --angle A             поворот окна в градусах
+//   --algorithm cs|lb|nln алгоритм отсечения прямоугольником
+//   --style wu|bresenham  растеризация со сглаживанием или без
+//   --threads N           число потоков (по умолчанию по числу ядер)
+//   --sources             нарисовать исходные отрезки зелёным, как в lab1
+// Выводит время отсечения и растеризации и контрольную сумму кадра:
+// при любом числе потоков она одна и та же
+
+namespace {
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void usage(const char* program) {
+    std::cerr << "Использование: " << program << " (--load file.seg | --random N) [--size WxH]\n"
+              << "       [--window l,t,r,b] [--angle A] [--algorithm cs|lb|nln]\n"
+              << "       [--style wu|bresenham] [--threads N] [--sources] output.png" << std::endl;
+}
+
+// Исходные отрезки рисуются частями, чтобы не держать вершины всего набора
+void drawSources(LineCanvas& canvas, const SegmentView& data, const ClipRect& view,
+                 LineStyle style, TaskPool& pool) {
+    const size_t part = 1 << 20;
+    std::vector<sf::Vertex> vertices;
+    for (size_t begin = 0; begin < data.count; begin += part) {
+        size_t end = std::min(data.count, begin + part);
+        vertices.clear();
+        for (size_t i = begin; i < end; ++i) {
+            vertices.emplace_back(sf::Vector2f(data.x1[i], data.y1[i]), sf::Color::Green);
+            vertices.emplace_back(sf::Vector2f(data.x2[i], data.y2[i]), sf::Color::Green);
+        }
+        canvas.drawLines(vertices.data(), vertices.size(), view, style, pool);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    SegmentSoA segments;
+    MappedSegments mapped;
+    size_t randomCount = 0;
+    std::string loadPath, output;
+    int width = 800, height = 600;
+    ClipRect rect = {200, 150, 600, 450};
+    bool hasRect = false;
+    float angle = 0;
+    ClipAlgorithm algorithm = ClipAlgorithm::CohenSutherland;
+    LineStyle style = LineStyle::Wu;
+    int threads = 0;
+    bool sources = false;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--random") == 0 && hasValue) {
+            randomCount = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--load") == 0 && hasValue) {
+            loadPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--size") == 0 && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                std::cerr << "Ошибка: неверный размер " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--window") == 0 && hasValue) {
+            if (std::sscanf(argv[++i], "%f,%f,%f,%f", &rect.left, &rect.top, &rect.right, &rect.bottom) != 4) {
+                std::cerr << "Ошибка: неверное окно " << argv[i] << std::endl;
+                return 1;
+            }
+            hasRect = true;
+        }
+        else if (std::strcmp(argv[i], "--angle") == 0 && hasValue) {
+            angle = std::strtof(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--algorithm") == 0 && hasValue) {
+            std::string name = argv[++i];
+            if (name == "cs") algorithm = ClipAlgorithm::CohenSutherland;
+            else if (name == "lb") algorithm = ClipAlgorithm::LiangBarsky;
+            else if (name == "nln") algorithm = ClipAlgorithm::NichollLeeNicholl;
+            else {
+                std::cerr << "Ошибка: неизвестный алгоритм " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--style") == 0 && hasValue) {
+            std::string name = argv[++i];
+            if (name == "wu") style = LineStyle::Wu;
+            else if (name == "bresenham") style = LineStyle::Bresenham;
+            else {
+                std::cerr << "Ошибка: неизвестный способ растеризации " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--sources") == 0) {
+            sources = true;
+        }
+        else if (argv[i][0] != '-' && output.empty()) {
+            output = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (output.empty() || (loadPath.empty() && randomCount == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Мировая область кадра: 800x600, как в lab1, или весь набор из файла
+    ClipRect view = {0, 0, 800, 600};
+    if (!loadPath.empty()) {
+        std::string error;
+        if (!mapped.open(loadPath, error)) {
+            std::cerr << "Ошибка загрузки: " << error << std::endl;
+            return 1;
+        }
+        view = fitRect(mapped.bounds(), static_cast<float>(width) / height);
+        if (!hasRect) {
+            float w = view.right - view.left, h = view.bottom - view.top;
+            rect = {view.left + w / 4, view.top + h / 4, view.right - w / 4, view.bottom - h / 4};
+        }
+    }
+    else {
+        segments.reserve(randomCount);
+        addRandomSegments(segments, randomCount, 800, 600);
+        view = fitRect(view, static_cast<float>(width) / height);
+    }
+    const SegmentView data = mapped.isOpen() ? mapped.view() : segments.view();
+    std::cout << "Отрезков: " << data.count << std::endl;
+
+    std::unique_ptr<TaskPool> ownPool;
+    if (threads > 0) ownPool.reset(new TaskPool(threads));
+    TaskPool& pool = ownPool ? *ownPool : TaskPool::shared();
+    ClipPool clipPool(pool);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<sf::Vertex> clipped;
+    ConvexWindow window = ConvexWindow::fromRect(rect, angle);
+    ClipStats stats = angle != 0
+        ? clipPool.clip(data, window, clipped, sf::Color::Red)
+        : clipPool.clip(data, rect, clipped, sf::Color::Red, algorithm);
+    double clipMs = millisecondsSince(start);
+
+    // Контур окна отсечения
+    std::vector<sf::Vertex> outline;
+    for (size_t k = 0; k < window.points.size(); ++k) {
+        outline.emplace_back(window.points[k], sf::Color::White);
+        outline.emplace_back(window.points[(k + 1) % window.points.size()], sf::Color::White);
+    }
+
+    start = std::chrono::steady_clock::now();
+    LineCanvas canvas(width, height);
+    if (sources) drawSources(canvas, data, view, style, pool);
+    canvas.drawLines(clipped.data(), clipped.size(), view, style, pool);
+    canvas.drawLines(outline.data(), outline.size(), view, style, pool);
+    double rasterMs = millisecondsSince(start);
+
+    if (!canvas.saveToFile(output)) {
+        std::cerr << "Ошибка: не удалось сохранить " << output << std::endl;
+        return 1;
+    }
+
+    std::cout << "Потоков: " << pool.threadCount()
+              << ", алгоритм: " << (angle != 0 ? "Cyrus-Beck" : clipAlgorithmName(algorithm)) << '\n'
+              << "Видимых отрезков: " << stats.accepted + stats.clipped << '\n'
+              << "Отсечение: " << clipMs << " мс, растеризация: " << rasterMs << " мс\n"
+              << "Контрольная сумма: " << std::hex << canvas.checksum() << std::dec << '\n'
+              << "Сохранено в " << output << std::endl;
+    return 0;
+}
@@ -1,123 +1,1028 @@
+#include "gl_loader.h"
+#include "lab2_scene.h"
+#include "vertex_lighting.h"
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <SFML/Window.hpp>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
-// Параметры вращения куба
+// Параметры вращения куба в показываемом кадре: между двумя последними
+// шагами обновления (см. interpolate)
 float angleX = 0.0f;
 float angleY = 0.0f;
 
-// Позиции источников света
-GLfloat light0_position[] = { 5.0f, 5.0f, 5.0f, 1.0f };
-GLfloat light1_position[] = { -5.0f, -5.0f, 5.0f, 1.0f };
+// Состояние меняется шагами фиксированной длины, независимо от частоты кадров
+const float UPDATE_STEP = 1.0f / 60.0f;
+struct Rotation {
+    float x = 0.0f, y = 0.0f;
+};
+Rotation previousStep, currentStep;
 
-// Характеристики материала
-GLfloat material_ambient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-GLfloat material_diffuse[] = { 0.8f, 0.8f, 0.8f, 1.0f };
-GLfloat material_specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-GLfloat material_shininess[] = { 50.0f };
+// Источники света; позицию первого можно поворачивать стрелками
+LightSource lights[2] = {LIGHT0, LIGHT1};
+
+// Дальняя плоскость отсечения; в режиме нагрузки отодвигается за поле кубов
+float farPlane = 100.0f;
+
+// Размер окна для восстановления viewport после отрисовки карт теней
+unsigned windowWidth = 800;
+unsigned windowHeight = 600;
+
+void setMaterial(const Material& material) {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, material.shininess);
+}
 
 void init() {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_LIGHTING);
     glEnable(GL_LIGHT0);
     glEnable(GL_LIGHT1);
+    // Столбы сцены с тенями - растянутые кубы, их нормали нужно нормировать
+    glEnable(GL_NORMALIZE);
 
-    // Настройка первого источника света
-    GLfloat light0_ambient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-    GLfloat light0_diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    GLfloat light0_specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    // Настройка источников света
+    for (int light = 0; light < 2; ++light) {
+        GLenum id = light == 0 ? GL_LIGHT0 : GL_LIGHT1;
+        glLightfv(id, GL_POSITION, lights[light].position);
+        glLightfv(id, GL_AMBIENT, lights[light].ambient);
+        glLightfv(id, GL_DIFFUSE, lights[light].diffuse);
+        glLightfv(id, GL_SPECULAR, lights[light].specular);
+    }
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, SCENE_AMBIENT);
+
+    // Настройка материала
+    setMaterial(CUBE_MATERIAL);
+}
+
+// Цвета вершин, посчитанные на процессоре. Каждый кадр загружаются в
+// буфер заново, старое содержимое отбрасывается, чтобы не ждать
+// предыдущий кадр. Без буферов цвета передаются из памяти процесса
+class VertexColors {
+public:
+    void upload(const std::vector<uint32_t>& newColors) {
+        colors = &newColors;
+        if (!gl::GenBuffers) return;
+        if (!buffer) gl::GenBuffers(1, &buffer);
+        size_t size = newColors.size() * sizeof(uint32_t);
+        gl::BindBuffer(GL_ARRAY_BUFFER, buffer);
+        gl::BufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        gl::BufferSubData(GL_ARRAY_BUFFER, 0, size, newColors.data());
+        gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     
-    glLightfv(GL_LIGHT0, GL_POSITION, light0_position);
-    glLightfv(GL_LIGHT0, GL_AMBIENT, light0_ambient);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light0_diffuse);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light0_specular);
+    void destroy() {
+        if (buffer) gl::DeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    
+    void bind() const {
+        glEnableClientState(GL_COLOR_ARRAY);
+        if (buffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, buffer);
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, nullptr);
+        }
+        else {
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors->data());
+        }
+    }
+    
+    void unbind() const {
+        glDisableClientState(GL_COLOR_ARRAY);
+        if (buffer) gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    
+private:
+    const std::vector<uint32_t>* colors = nullptr;
+    GLuint buffer = 0;
+};
 
-    // Настройка второго источника света
-    GLfloat light1_ambient[] = { 0.1f, 0.1f, 0.1f, 1.0f };
-    GLfloat light1_diffuse[] = { 0.5f, 0.5f, 0.5f, 1.0f };
-    GLfloat light1_specular[] = { 0.5f, 0.5f, 0.5f, 1.0f };
+// Треугольная сетка в буферах видеопамяти. Буферы заполняются один раз,
+// дальше сетка рисуется одним glDrawElements без передачи вершин. Без буферов
+// (OpenGL 1.1) те же массивы передаются из памяти процесса
+class Mesh {
+public:
+    // Геометрия из lab2_scene.h (makeCube, makePlane, makeTorus)
+    void create(MeshData data) {
+        vertices = std::move(data.vertices);
+        indices = std::move(data.indices);
+        upload();
+    }
+    
+    void destroy() {
+        if (vertexArray) gl::DeleteVertexArrays(1, &vertexArray);
+        if (vertexBuffer) gl::DeleteBuffers(1, &vertexBuffer);
+        if (indexBuffer) gl::DeleteBuffers(1, &indexBuffer);
+        vertexArray = vertexBuffer = indexBuffer = 0;
+    }
+    
+    // Массивы вершин и нормалей для текущего объекта массивов
+    void bindArrays() const {
+        const char* base = reinterpret_cast<const char*>(vertices.data());
+        if (vertexBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            base = nullptr;
+        }
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, position));
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, normal));
+    }
+    
+    void unbindArrays() const {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        if (vertexBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    }
+    
+    // glDrawElements для уже привязанных массивов; instances > 0 - отрисовка экземпляров
+    void drawElements(GLsizei instances = 0) const {
+        const void* first = indexBuffer ? nullptr : indices.data();
+        GLsizei count = static_cast<GLsizei>(indices.size());
+        if (instances > 0)
+            gl::DrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, first, instances);
+        else
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, first);
+    }
+    
+    // colors - цвета вершин для отрисовки без освещения OpenGL
+    void draw(const VertexColors* colors = nullptr) const {
+        if (vertexArray) {
+            gl::BindVertexArray(vertexArray);
+            if (colors) colors->bind();
+            drawElements();
+            if (colors) colors->unbind();
+            gl::BindVertexArray(0);
+        }
+        else {
+            bindArrays();
+            if (colors) colors->bind();
+            drawElements();
+            if (colors) colors->unbind();
+            unbindArrays();
+        }
+    }
+    
+    bool hasBuffers() const { return vertexBuffer != 0; }
+    
+private:
+    void upload() {
+        destroy();
+        if (gl::GenBuffers) {
+            gl::GenBuffers(1, &vertexBuffer);
+            gl::BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            gl::BufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
+            gl::GenBuffers(1, &indexBuffer);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            gl::BufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+        
+        // Объект массивов запоминает указатели и буфер индексов
+        if (gl::hasVertexArrays()) {
+            gl::GenVertexArrays(1, &vertexArray);
+            gl::BindVertexArray(vertexArray);
+            bindArrays();
+            gl::BindVertexArray(0);
+            if (gl::BindBuffer) gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
     
-    glLightfv(GL_LIGHT1, GL_POSITION, light1_position);
-    glLightfv(GL_LIGHT1, GL_AMBIENT, light1_ambient);
-    glLightfv(GL_LIGHT1, GL_DIFFUSE, light1_diffuse);
-    glLightfv(GL_LIGHT1, GL_SPECULAR, light1_specular);
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint vertexArray = 0;
+};
 
-    // Настройка материала
-    glMaterialfv(GL_FRONT, GL_AMBIENT, material_ambient);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, material_diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, material_specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, material_shininess);
+// Освещение по вершинам, повторяющее фиксированный конвейер для двух
+// источников: свет и материал берутся из состояния glLightfv/glMaterialfv,
+// а матрица куба приходит атрибутом экземпляра
+const char* INSTANCED_VERTEX_SHADER = R"(
+#version 120
+attribute vec4 instanceColumn0;
+attribute vec4 instanceColumn1;
+attribute vec4 instanceColumn2;
+attribute vec4 instanceColumn3;
+varying vec4 color;
+
+void main() {
+    mat4 model = mat4(instanceColumn0, instanceColumn1, instanceColumn2, instanceColumn3);
+    vec4 eyePosition = gl_ModelViewMatrix * (model * gl_Vertex);
+    vec3 normal = normalize(gl_NormalMatrix * (mat3(model) * gl_Normal));
+    vec4 result = gl_FrontLightModelProduct.sceneColor;
+    for (int i = 0; i < 2; ++i) {
+        vec3 light = normalize(gl_LightSource[i].position.xyz - eyePosition.xyz * gl_LightSource[i].position.w);
+        float diffuse = max(dot(normal, light), 0.0);
+        result += gl_FrontLightProduct[i].ambient + gl_FrontLightProduct[i].diffuse * diffuse;
+        if (diffuse > 0.0) {
+            vec3 halfway = normalize(light + vec3(0.0, 0.0, 1.0));
+            result += gl_FrontLightProduct[i].specular *
+                      pow(max(dot(normal, halfway), 0.0), gl_FrontMaterial.shininess);
+        }
+    }
+    color = clamp(result, 0.0, 1.0);
+    gl_Position = gl_ProjectionMatrix * eyePosition;
 }
+)";
+
+const char* INSTANCED_FRAGMENT_SHADER = R"(
+#version 120
+varying vec4 color;
 
-void drawCube() {
-    glBegin(GL_QUADS);
-    
-    // Передняя грань
-    glNormal3f(0.0f, 0.0f, 1.0f);
-    glVertex3f(-1.0f, -1.0f, 1.0f);
-    glVertex3f(1.0f, -1.0f, 1.0f);
-    glVertex3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(-1.0f, 1.0f, 1.0f);
-
-    // Задняя грань
-    glNormal3f(0.0f, 0.0f, -1.0f);
-    glVertex3f(-1.0f, -1.0f, -1.0f);
-    glVertex3f(-1.0f, 1.0f, -1.0f);
-    glVertex3f(1.0f, 1.0f, -1.0f);
-    glVertex3f(1.0f, -1.0f, -1.0f);
-
-    // Верхняя грань
-    glNormal3f(0.0f, 1.0f, 0.0f);
-    glVertex3f(-1.0f, 1.0f, -1.0f);
-    glVertex3f(-1.0f, 1.0f, 1.0f);
-    glVertex3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(1.0f, 1.0f, -1.0f);
-
-    // Нижняя грань
-    glNormal3f(0.0f, -1.0f, 0.0f);
-    glVertex3f(-1.0f, -1.0f, -1.0f);
-    glVertex3f(1.0f, -1.0f, -1.0f);
-    glVertex3f(1.0f, -1.0f, 1.0f);
-    glVertex3f(-1.0f, -1.0f, 1.0f);
-
-    // Правая грань
-    glNormal3f(1.0f, 0.0f, 0.0f);
-    glVertex3f(1.0f, -1.0f, -1.0f);
-    glVertex3f(1.0f, 1.0f, -1.0f);
-    glVertex3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(1.0f, -1.0f, 1.0f);
-
-    // Левая грань
-    glNormal3f(-1.0f, 0.0f, 0.0f);
-    glVertex3f(-1.0f, -1.0f, -1.0f);
-    glVertex3f(-1.0f, -1.0f, 1.0f);
-    glVertex3f(-1.0f, 1.0f, 1.0f);
-    glVertex3f(-1.0f, 1.0f, -1.0f);
-
-    glEnd();
+void main() {
+    gl_FragColor = color;
+}
+)";
+
+// Первый номер атрибута матрицы экземпляра. Младшие номера в профиле
+// совместимости могут совпадать со встроенными gl_Vertex и gl_Normal
+const GLuint INSTANCE_ATTRIBUTE = 12;
+
+// Поле из многих кубов для проверки производительности. Матрицы кубов
+// пересчитываются на процессоре раз в кадр и загружаются в буфер экземпляров
+// одним вызовом; всё поле рисуется одним glDrawElementsInstanced. Без
+// поддержки экземпляров кубы рисуются по одному из тех же буферов геометрии
+class CubeField {
+public:
+    void create(const Mesh& cubeMesh, size_t count) {
+        mesh = &cubeMesh;
+        matrices.assign(count * 16, 0.0f);
+        offsets.resize(count * 3);
+        phases.resize(count);
+        
+        // Кубы стоят в узлах решётки side x side x side с шагом SPACING
+        side = 1;
+        while (static_cast<size_t>(side) * side * side < count) side++;
+        for (size_t i = 0; i < count; ++i) {
+            size_t x = i % side, y = (i / side) % side, z = i / (static_cast<size_t>(side) * side);
+            offsets[3 * i] = (x - (side - 1) / 2.0f) * SPACING;
+            offsets[3 * i + 1] = (y - (side - 1) / 2.0f) * SPACING;
+            offsets[3 * i + 2] = (z - (side - 1) / 2.0f) * SPACING;
+            phases[i] = static_cast<float>((i * 37) % 360);
+        }
+        
+        std::string error;
+        if (!gl::hasInstancing() || !mesh->hasBuffers()) {
+            std::cout << "Отрисовка экземпляров не поддерживается, кубы рисуются по одному" << std::endl;
+            return;
+        }
+        if (!gl::buildProgram(INSTANCED_VERTEX_SHADER, INSTANCED_FRAGMENT_SHADER,
+                              {{INSTANCE_ATTRIBUTE, "instanceColumn0"}, {INSTANCE_ATTRIBUTE + 1, "instanceColumn1"},
+                               {INSTANCE_ATTRIBUTE + 2, "instanceColumn2"}, {INSTANCE_ATTRIBUTE + 3, "instanceColumn3"}},
+                              program, error)) {
+            std::cerr << "Ошибка шейдера: " << error << std::endl;
+            return;
+        }
+        gl::GenBuffers(1, &instanceBuffer);
+        gl::BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        gl::BufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(GLfloat), nullptr, GL_STREAM_DRAW);
+        gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+        
+        if (gl::hasVertexArrays()) {
+            gl::GenVertexArrays(1, &vertexArray);
+            gl::BindVertexArray(vertexArray);
+            bindArrays();
+            gl::BindVertexArray(0);
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+    
+    void destroy() {
+        if (vertexArray) gl::DeleteVertexArrays(1, &vertexArray);
+        if (instanceBuffer) gl::DeleteBuffers(1, &instanceBuffer);
+        if (program) gl::DeleteProgram(program);
+        vertexArray = instanceBuffer = program = 0;
+    }
+    
+    // Каждый куб вращается так же, как одиночный, со своим сдвигом фазы
+    void update(float angleX, float angleY, bool upload) {
+        for (size_t i = 0; i < phases.size(); ++i) {
+            float a = radians(angleX + phases[i]);
+            float b = radians(angleY + phases[i]);
+            float ca = std::cos(a), sa = std::sin(a), cb = std::cos(b), sb = std::sin(b);
+            
+            // Поворот вокруг X, затем вокруг Y, по столбцам, как в glRotatef
+            GLfloat* m = &matrices[16 * i];
+            m[0] = cb;       m[1] = sa * sb;   m[2] = -ca * sb;  m[3] = 0;
+            m[4] = 0;        m[5] = ca;        m[6] = sa;        m[7] = 0;
+            m[8] = sb;       m[9] = -sa * cb;  m[10] = ca * cb;  m[11] = 0;
+            m[12] = offsets[3 * i];
+            m[13] = offsets[3 * i + 1];
+            m[14] = offsets[3 * i + 2];
+            m[15] = 1;
+        }
+        
+        // Старое содержимое буфера отбрасывается, чтобы не ждать предыдущий кадр
+        if (upload && instanceBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            gl::BufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(GLfloat), nullptr, GL_STREAM_DRAW);
+            gl::BufferSubData(GL_ARRAY_BUFFER, 0, matrices.size() * sizeof(GLfloat), matrices.data());
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+    
+    // view - видовая матрица камеры, она же загружена в OpenGL
+    void draw(bool instanced, const Mat4& view) const {
+        if (instanced && program) {
+            gl::UseProgram(program);
+            if (vertexArray) {
+                gl::BindVertexArray(vertexArray);
+                mesh->drawElements(static_cast<GLsizei>(size()));
+                gl::BindVertexArray(0);
+            }
+            else {
+                bindArrays();
+                mesh->drawElements(static_cast<GLsizei>(size()));
+                for (GLuint k = 0; k < 4; ++k) {
+                    gl::VertexAttribDivisor(INSTANCE_ATTRIBUTE + k, 0);
+                    gl::DisableVertexAttribArray(INSTANCE_ATTRIBUTE + k);
+                }
+                mesh->unbindArrays();
+            }
+            gl::UseProgram(0);
+            return;
+        }
+        
+        // По одному вызову на куб: та же геометрия, модель-вид считается
+        // на процессоре и загружается целиком
+        mesh->bindArrays();
+        GLfloat modelView[16];
+        for (size_t i = 0; i < size(); ++i) {
+            multiplyMatrices(view.m, &matrices[16 * i], modelView);
+            glLoadMatrixf(modelView);
+            mesh->drawElements();
+        }
+        glLoadMatrixf(view.m);
+        mesh->unbindArrays();
+    }
+    
+    bool canInstance() const { return program != 0; }
+    size_t size() const { return phases.size(); }
+    
+    // Радиус сферы, описанной вокруг поля
+    float radius() const { return (side * SPACING) * 0.5f * std::sqrt(3.0f); }
+    
+private:
+    static constexpr float SPACING = 3.0f;
+    
+    const Mesh* mesh = nullptr;
+    int side = 1;
+    std::vector<GLfloat> matrices;  // по 16 чисел на куб, по столбцам
+    std::vector<float> offsets;
+    std::vector<float> phases;
+    GLuint program = 0;
+    GLuint instanceBuffer = 0;
+    GLuint vertexArray = 0;
+    
+    void bindArrays() const {
+        mesh->bindArrays();
+        gl::BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint k = 0; k < 4; ++k) {
+            gl::EnableVertexAttribArray(INSTANCE_ATTRIBUTE + k);
+            gl::VertexAttribPointer(INSTANCE_ATTRIBUTE + k, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                                    reinterpret_cast<const void*>(4 * k * sizeof(GLfloat)));
+            gl::VertexAttribDivisor(INSTANCE_ATTRIBUTE + k, 1);
+        }
+    }
+};
+
+const int MAX_CASCADES = 4;
+
+// Функция, рисующая объекты сцены в текущей системе координат
+using DrawFunction = void (*)();
+
+// Карты теней для двух точечных источников. Каждая карта - текстура глубины,
+// отрисованная из источника в буфер кадра без буфера цвета; при отрисовке
+// сцены сравнение с ней делает сам OpenGL (ARB_shadow), так что освещение
+// остаётся фиксированным конвейером без шейдеров.
+// Сцена рисуется за несколько проходов: сначала фоновое освещение, затем
+// для каждого источника - проход с одним включённым источником, умноженный на
+// результат сравнения и сложенный с кадром. Для больших сцен пирамида
+// видимости камеры делится по глубине на каскады, у каждого своя карта;
+// пиксели каскадов размечаются в буфере трафарета.
+// Карта перерисовывается, только если сдвинулся её источник или были вызваны
+// invalidate() (сдвинулись объекты, изменилась камера или параметры)
+class ShadowMaps {
+public:
+    int size = 2048;    // сторона карты в текселях
+    int cascades = 1;   // число каскадов, 1..MAX_CASCADES
+    int pcfTaps = 4;    // выборок на пиксель: 1 или 4 со сдвигом на полтекселя
+    
+    // Сфера, в которой лежат все объекты, отбрасывающие тень
+    Vec3 sceneCenter = {0.0f, 0.0f, 0.0f};
+    float sceneRadius = 1.0f;
+    
+    bool create(std::string& error) {
+        destroy();
+        if (!gl::hasFramebuffers()) {
+            error = "буферы кадра не поддерживаются";
+            return false;
+        }
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        size = std::min(size, static_cast<int>(maxSize));
+        cascades = std::max(1, std::min(cascades, MAX_CASCADES));
+        // Каскады размечаются в буфере трафарета
+        GLint stencilBits = 0;
+        glGetIntegerv(GL_STENCIL_BITS, &stencilBits);
+        if (stencilBits == 0) cascades = 1;
+        
+        gl::GenFramebuffers(1, &framebuffer);
+        glGenTextures(2 * MAX_CASCADES, &textures[0][0]);
+        const GLfloat border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (int light = 0; light < 2; ++light) {
+            for (int cascade = 0; cascade < cascades; ++cascade) {
+                glBindTexture(GL_TEXTURE_2D, textures[light][cascade]);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+                             GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+                // Линейная фильтрация при сравнении даёт аппаратный PCF 2x2
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                // За пределами карты тени нет
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+                glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+                glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_TEXTURE_MODE, GL_LUMINANCE);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        
+        gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[0][0], 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        GLenum status = gl::CheckFramebufferStatus(GL_FRAMEBUFFER);
+        gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            destroy();
+            error = "буфер кадра для карты теней неполон";
+            return false;
+        }
+        invalidate();
+        return true;
+    }
+    
+    void destroy() {
+        if (framebuffer) {
+            gl::DeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(2 * MAX_CASCADES, &textures[0][0]);
+        }
+        framebuffer = 0;
+    }
+    
+    bool isReady() const { return framebuffer != 0; }
+    
+    void invalidate() {
+        dirty[0] = dirty[1] = true;
+    }
+    
+    // Перерисовка устаревших карт. drawCasters рисует объекты, отбрасывающие
+    // тень. Возвращает число перерисованных карт
+    int update(const SceneCamera& camera, float aspect, const Vec3 lights[2], DrawFunction drawCasters) {
+        for (int light = 0; light < 2; ++light) {
+            Vec3 moved = lights[light] - renderedLights[light];
+            if (dot(moved, moved) > 0.0f) dirty[light] = true;
+        }
+        if (!framebuffer || (!dirty[0] && !dirty[1])) return 0;
+        
+        computeSplits(camera);
+        
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, size, size);
+        glDisable(GL_LIGHTING);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        // Смещение глубины и отбрасывание лицевых граней убирают
+        // самозатенение освещённых граней
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        
+        int rendered = 0;
+        for (int light = 0; light < 2; ++light) {
+            if (!dirty[light]) continue;
+            for (int cascade = 0; cascade < cascades; ++cascade) {
+                Mat4 lightView, lightProjection;
+                fitLight(camera, aspect, lights[light], cascade, lightView, lightProjection);
+                
+                // Мировые координаты -> [0, 1] в текстуре карты
+                const Mat4 bias = {{0.5f, 0, 0, 0, 0, 0.5f, 0, 0, 0, 0, 0.5f, 0, 0.5f, 0.5f, 0.5f, 1}};
+                matrices[light][cascade] = multiply(bias, multiply(lightProjection, lightView));
+                
+                gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                                         textures[light][cascade], 0);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                glMatrixMode(GL_PROJECTION);
+                glLoadMatrixf(lightProjection.m);
+                glMatrixMode(GL_MODELVIEW);
+                glLoadMatrixf(lightView.m);
+                drawCasters();
+                rendered++;
+            }
+            renderedLights[light] = lights[light];
+            dirty[light] = false;
+        }
+        
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+        glDisable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glEnable(GL_LIGHTING);
+        gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        return rendered;
+    }
+    
+    // Отрисовка сцены с тенями; видовая матрица камеры уже загружена,
+    // источники включены и их позиции заданы
+    void drawLit(const Mat4& view, DrawFunction drawScene) const {
+        const GLfloat black[] = {0.0f, 0.0f, 0.0f, 1.0f};
+        
+        // Фоновое освещение всех источников одним проходом
+        GLfloat ambient[4] = {SCENE_AMBIENT[0], SCENE_AMBIENT[1], SCENE_AMBIENT[2], 1.0f};
+        for (int k = 0; k < 3; ++k) ambient[k] += lights[0].ambient[k] + lights[1].ambient[k];
+        glDisable(GL_LIGHT0);
+        glDisable(GL_LIGHT1);
+        glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambient);
+        drawScene();
+        
+        // Проходы источников складываются с кадром в тех же пикселях
+        glLightModelfv(GL_LIGHT_MODEL_AMBIENT, black);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        if (cascades > 1) markCascades(view, drawScene);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        
+        // Текстурные координаты - мировые координаты точки: плоскости
+        // задаются при загруженной видовой матрице и пересчитываются OpenGL
+        const GLfloat planes[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+        const GLenum coords[4] = {GL_S, GL_T, GL_R, GL_Q};
+        const GLenum generators[4] = {GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R, GL_TEXTURE_GEN_Q};
+        for (int k = 0; k < 4; ++k) {
+            glTexGeni(coords[k], GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+            glTexGenfv(coords[k], GL_EYE_PLANE, planes[k]);
+            glEnable(generators[k]);
+        }
+        glEnable(GL_TEXTURE_2D);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        
+        const float half = 0.5f / size;
+        const float taps[4][2] = {{-half, -half}, {half, -half}, {-half, half}, {half, half}};
+        const int tapCount = pcfTaps >= 4 ? 4 : 1;
+        for (int light = 0; light < 2; ++light) {
+            GLenum id = light == 0 ? GL_LIGHT0 : GL_LIGHT1;
+            // Выборки PCF делят яркость источника поровну
+            GLfloat diffuse[4], specular[4];
+            for (int k = 0; k < 4; ++k) {
+                diffuse[k] = lights[light].diffuse[k] / tapCount;
+                specular[k] = lights[light].specular[k] / tapCount;
+            }
+            glLightfv(id, GL_AMBIENT, black);
+            glLightfv(id, GL_DIFFUSE, diffuse);
+            glLightfv(id, GL_SPECULAR, specular);
+            glEnable(id);
+            
+            for (int cascade = 0; cascade < cascades; ++cascade) {
+                glStencilFunc(GL_EQUAL, cascade + 1, 0xFF);
+                glBindTexture(GL_TEXTURE_2D, textures[light][cascade]);
+                for (int tap = 0; tap < tapCount; ++tap) {
+                    float dx = tapCount > 1 ? taps[tap][0] : 0.0f;
+                    float dy = tapCount > 1 ? taps[tap][1] : 0.0f;
+                    Mat4 texture = multiply(translation(dx, dy, 0.0f), matrices[light][cascade]);
+                    glMatrixMode(GL_TEXTURE);
+                    glLoadMatrixf(texture.m);
+                    glMatrixMode(GL_MODELVIEW);
+                    drawScene();
+                }
+            }
+            
+            glDisable(id);
+            glLightfv(id, GL_AMBIENT, lights[light].ambient);
+            glLightfv(id, GL_DIFFUSE, lights[light].diffuse);
+            glLightfv(id, GL_SPECULAR, lights[light].specular);
+        }
+        
+        glMatrixMode(GL_TEXTURE);
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glDisable(GL_STENCIL_TEST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDisable(GL_TEXTURE_2D);
+        for (GLenum generator : generators) glDisable(generator);
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        glLightModelfv(GL_LIGHT_MODEL_AMBIENT, SCENE_AMBIENT);
+        glEnable(GL_LIGHT0);
+        glEnable(GL_LIGHT1);
+    }
+    
+private:
+    GLuint framebuffer = 0;
+    GLuint textures[2][MAX_CASCADES] = {};
+    Mat4 matrices[2][MAX_CASCADES] = {};  // мировые координаты -> текстура карты
+    float splits[MAX_CASCADES + 1] = {};
+    Vec3 renderedLights[2] = {};
+    bool dirty[2] = {true, true};
+    
+    // Разбиение [zNear, farPlane]: среднее равномерного и логарифмического,
+    // так ближние каскады короче и подробнее
+    void computeSplits(const SceneCamera& camera) {
+        float zNear = camera.zNear, zFar = farPlane;
+        splits[0] = zNear;
+        for (int k = 1; k <= cascades; ++k) {
+            float t = static_cast<float>(k) / cascades;
+            float logarithmic = zNear * std::pow(zFar / zNear, t);
+            float uniform = zNear + (zFar - zNear) * t;
+            splits[k] = 0.5f * (logarithmic + uniform);
+        }
+    }
+    
+    // Перспективная проекция из источника на описанную сферу части
+    // пирамиды видимости (но не больше сферы всей сцены)
+    void fitLight(const SceneCamera& camera, float aspect, Vec3 light, int cascade,
+                  Mat4& lightView, Mat4& lightProjection) const {
+        Vec3 corners[8];
+        float tanY = std::tan(radians(camera.fovY) / 2);
+        for (int k = 0; k < 8; ++k) {
+            float depth = splits[cascade + (k >> 2)];
+            float y = (k & 1 ? 1.0f : -1.0f) * depth * tanY;
+            float x = (k & 2 ? 1.0f : -1.0f) * depth * tanY * aspect;
+            corners[k] = camera.toWorld(x, y, depth);
+        }
+        Vec3 center = {0.0f, 0.0f, 0.0f};
+        for (const Vec3& corner : corners) center = center + corner * 0.125f;
+        float radius = 0.0f;
+        for (const Vec3& corner : corners) radius = std::max(radius, length(corner - center));
+        if (radius > sceneRadius) {
+            center = sceneCenter;
+            radius = sceneRadius;
+        }
+        
+        Vec3 direction = center - light;
+        float distance = std::max(length(direction), 1e-3f);
+        Vec3 up = std::fabs(direction.y) > 0.99f * distance ? Vec3{0.0f, 0.0f, 1.0f} : Vec3{0.0f, 1.0f, 0.0f};
+        lightView = lookAt(light, center, up);
+        float sine = std::min(radius / distance, 0.95f);
+        float fov = degrees(2.0f * std::asin(sine));
+        // Ближняя плоскость - у границы сцены, чтобы в карту попали все
+        // объекты между источником и каскадом
+        float zNear = std::max(0.1f, length(sceneCenter - light) - sceneRadius);
+        float zFar = distance + radius;
+        lightProjection = perspective(fov, 1.0f, zNear, std::max(zFar, zNear + 1.0f));
+    }
+    
+    // Разметка каскадов в буфере трафарета: проход каскада k рисует сцену,
+    // отсечённую плоскостью -z = splits[k], и записывает k + 1. Каждый
+    // видимый пиксель получает номер самого дальнего каскада, в который
+    // попадает, и ни один пиксель не остаётся без каскада
+    void markCascades(const Mat4& view, DrawFunction drawScene) const {
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+        glEnable(GL_STENCIL_TEST);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (int cascade = 0; cascade < cascades; ++cascade) {
+            if (cascade > 0) {
+                glLoadIdentity();
+                const GLdouble nearClip[4] = {0.0, 0.0, -1.0, -splits[cascade]};
+                glClipPlane(GL_CLIP_PLANE0, nearClip);
+                glEnable(GL_CLIP_PLANE0);
+                glLoadMatrixf(view.m);
+            }
+            glStencilFunc(GL_ALWAYS, cascade + 1, 0xFF);
+            drawScene();
+        }
+        glDisable(GL_CLIP_PLANE0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    }
+};
+
+// Время последних кадров: интервал между кадрами, время процессора на
+// подготовку кадра и время выполнения его команд видеокартой (запросы
+// GL_TIME_ELAPSED). Результат запроса готов через несколько кадров,
+// поэтому запросы идут по кругу и читаются, только когда готовы
+class FrameTimes {
+public:
+    static const int HISTORY = 256;   // кадров в кольцевом буфере
+    static const int QUERIES = 4;     // запросов времени в работе
+
+    void create() {
+        if (!gl::hasTimerQueries()) return;
+        gl::GenQueries(QUERIES, queries);
+        for (int& frame : queryFrame) frame = -1;
+        hasGpu = true;
+    }
+
+    void destroy() {
+        if (hasGpu) gl::DeleteQueries(QUERIES, queries);
+        hasGpu = false;
+    }
+
+    bool measuresGpu() const { return hasGpu; }
+
+    void beginFrame() {
+        cpuClock.restart();
+        query = -1;
+        // Первый кадр не замеряется: в него попадает подготовка драйвера,
+        // а некоторые драйверы возвращают для него неверное время
+        if (!hasGpu || count == 0) return;
+        collect();
+        // Все запросы ещё в работе - этот кадр видеокартой не замеряется
+        for (int i = 0; i < QUERIES; ++i) {
+            if (queryFrame[i] < 0) {
+                query = i;
+                break;
+            }
+        }
+        if (query >= 0) gl::BeginQuery(GL_TIME_ELAPSED, queries[query]);
+    }
+
+    // Вызывается после отрисовки, до window.display()
+    void endFrame() {
+        Sample& sample = samples[next];
+        sample.cpu = cpuClock.getElapsedTime().asMicroseconds() / 1000.0f;
+        sample.gpu = -1.0f;
+        // Интервал после пропущенных кадров не показателен
+        sample.interval = afterSkip ? -1.0f : intervalClock.getElapsedTime().asMicroseconds() / 1000.0f;
+        intervalClock.restart();
+        afterSkip = false;
+        if (query >= 0) {
+            gl::EndQuery(GL_TIME_ELAPSED);
+            queryFrame[query] = next;
+        }
+        next = (next + 1) % HISTORY;
+        count = std::min(count + 1, HISTORY);
+    }
+
+    // Кадр не рисовался: состояние сцены не изменилось
+    void skipFrame() {
+        skipped++;
+        afterSkip = true;
+    }
+
+    // p50/p99/max по последним кадрам и число пропущенных с прошлого отчёта
+    std::string report() {
+        std::ostringstream out;
+        out << "Кадр p50/p99/max: " << percentiles(&Sample::interval)
+            << " мс, процессор: " << percentiles(&Sample::cpu) << " мс";
+        if (hasGpu) out << ", видеокарта: " << percentiles(&Sample::gpu) << " мс";
+        out << ", пропущено одинаковых кадров: " << skipped;
+        skipped = 0;
+        return out.str();
+    }
+
+private:
+    struct Sample {
+        float interval = -1.0f;
+        float cpu = -1.0f;
+        float gpu = -1.0f;
+    };
+
+    // Готовые результаты запросов записываются в свои кадры
+    void collect() {
+        for (int i = 0; i < QUERIES; ++i) {
+            if (queryFrame[i] < 0) continue;
+            GLint available = 0;
+            gl::GetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            std::uint64_t nanoseconds = 0;
+            gl::GetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            samples[queryFrame[i]].gpu = nanoseconds / 1e6f;
+            queryFrame[i] = -1;
+        }
+    }
+
+    std::string percentiles(float Sample::* field) const {
+        std::vector<float> values;
+        values.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            if (samples[i].*field >= 0.0f) values.push_back(samples[i].*field);
+        }
+        if (values.empty()) return "-";
+        auto at = [&](size_t rank) {
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            return values[rank];
+        };
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+        out << at(values.size() / 2) << "/" << at(values.size() * 99 / 100) << "/" << at(values.size() - 1);
+        return out.str();
+    }
+
+    Sample samples[HISTORY];
+    int next = 0, count = 0;
+    int skipped = 0;
+    bool afterSkip = true;
+    sf::Clock cpuClock, intervalClock;
+
+    bool hasGpu = false;
+    GLuint queries[QUERIES] = {};
+    int queryFrame[QUERIES] = {};     // кадр, который замеряет запрос, -1 - свободен
+    int query = -1;                   // запрос текущего кадра
+};
+
+Mesh cube;
+Mesh ground;
+CubeField field;
+ShadowMaps shadows;
+FrameTimes frameTimes;
+SceneCamera camera;
+
+bool shadowsEnabled = true;
+bool paused = false;
+bool sceneChanged = true;    // событие требует перерисовать кадр
+int shadowMapsRendered = 0;  // за последнюю секунду
+
+// Объекты, отбрасывающие тень. Плоскость тень только принимает: второй
+// источник находится под ней, и иначе она закрыла бы от него весь куб
+void drawCasters() {
+    glPushMatrix();
+    glMultMatrixf(cubeModel(angleX, angleY).m);
+    cube.draw();
+    glPopMatrix();
+    
+    for (const Pillar& pillar : PILLARS) {
+        glPushMatrix();
+        glMultMatrixf(pillarModel(pillar).m);
+        cube.draw();
+        glPopMatrix();
+    }
+}
+
+void drawScene() {
+    drawCasters();
+    setMaterial(GROUND_MATERIAL);
+    glPushMatrix();
+    glMultMatrixf(groundModel().m);
+    ground.draw();
+    glPopMatrix();
+    setMaterial(CUBE_MATERIAL);
+}
+
+// Режим нагрузки: число кубов (0 - обычная сцена с одним кубом)
+size_t stressCount = 0;
+bool useInstancing = true;
+
+// Плотная сетка: тор примерно из denseCount вершин (0 - обычная сцена).
+// Освещение вершин считается на процессоре, цвета загружаются в буфер
+// и рисуются с выключенным GL_LIGHTING; L - сравнение с OpenGL
+size_t denseCount = 0;
+bool cpuLighting = true;
+Mesh torus;
+LightingMesh torusLighting;
+std::vector<uint32_t> torusColorData;
+VertexColors torusColors;
+bool torusLit = false;          // цвета соответствуют текущему положению
+float lightingMs = 0.0f;        // время освещения за секунду статистики
+int lightingRuns = 0;
+
+const float TORUS_MAJOR = 1.5f;
+const float TORUS_MINOR = 0.5f;
+
+// Перспективная проекция с углом обзора 45 градусов
+void setProjection(unsigned width, unsigned height) {
+    windowWidth = width;
+    windowHeight = height;
+    glViewport(0, 0, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(perspective(45.0f, static_cast<float>(width) / height, 0.1f, farPlane).m);
+    glMatrixMode(GL_MODELVIEW);
 }
 
 void render() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
 
-    // Настройка камеры
-    glTranslatef(0.0f, 0.0f, -5.0f);
+    if (stressCount > 0) {
+        // Камера отодвинута так, чтобы поле целиком помещалось в кадр
+        float distance = field.radius() / std::sin(radians(22.5f));
+        Mat4 view = translation(0.0f, 0.0f, -distance);
+        glLoadMatrixf(view.m);
+        field.draw(useInstancing, view);
+        return;
+    }
 
-    // Вращение куба
-    glRotatef(angleX, 1.0f, 0.0f, 0.0f);
-    glRotatef(angleY, 0.0f, 1.0f, 0.0f);
+    if (denseCount > 0) {
+        float distance = (TORUS_MAJOR + TORUS_MINOR) / std::sin(radians(22.5f));
+        Mat4 view = translation(0.0f, 0.0f, -distance);
+        Mat4 model = cubeModel(angleX, angleY);
+        glLoadMatrixf(view.m);
+        glLightfv(GL_LIGHT0, GL_POSITION, lights[0].position);
+        glLightfv(GL_LIGHT1, GL_POSITION, lights[1].position);
+        glMultMatrixf(model.m);
+        if (!cpuLighting) {
+            torus.draw();
+            return;
+        }
+        // Пока тор и источники неподвижны, цвета в буфере остаются верными
+        if (!torusLit) {
+            auto start = std::chrono::steady_clock::now();
+            LightingSetup setup = makeLightingSetup(lights, SCENE_AMBIENT, view,
+                                                    multiply(view, model), CUBE_MATERIAL);
+            lightVertices(torusLighting, setup, torusColorData);
+            torusColors.upload(torusColorData);
+            lightingMs += std::chrono::duration<float, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            lightingRuns++;
+            torusLit = true;
+        }
+        glDisable(GL_LIGHTING);
+        torus.draw(&torusColors);
+        glEnable(GL_LIGHTING);
+        return;
+    }
 
-    drawCube();
+    // Источники заданы в мировых координатах и меняются при загруженной
+    // видовой матрице камеры
+    Mat4 view = camera.view();
+    Vec3 positions[2] = {{lights[0].position[0], lights[0].position[1], lights[0].position[2]},
+                         {lights[1].position[0], lights[1].position[1], lights[1].position[2]}};
+    bool withShadows = shadowsEnabled && shadows.isReady();
+    if (withShadows) {
+        float aspect = static_cast<float>(windowWidth) / windowHeight;
+        shadowMapsRendered += shadows.update(camera, aspect, positions, drawCasters);
+    }
+    
+    glLoadMatrixf(view.m);
+    glLightfv(GL_LIGHT0, GL_POSITION, lights[0].position);
+    glLightfv(GL_LIGHT1, GL_POSITION, lights[1].position);
+    if (withShadows)
+        shadows.drawLit(view, drawScene);
+    else
+        drawScene();
 }
 
+// Один шаг состояния длиной UPDATE_STEP
 void update() {
-    angleX += 1.0f;
-    angleY += 1.0f;
+    previousStep = currentStep;
+    if (paused) return;
+    
+    currentStep.x += 1.0f;
+    currentStep.y += 1.0f;
+
+    // Предыдущий шаг сдвигается вместе с текущим, чтобы интерполяция
+    // не прошла через весь круг назад
+    if (currentStep.x > 360.0f) {
+        currentStep.x -= 360.0f;
+        previousStep.x -= 360.0f;
+    }
+    if (currentStep.y > 360.0f) {
+        currentStep.y -= 360.0f;
+        previousStep.y -= 360.0f;
+    }
+}
+
+// Положение куба для кадра: доля alpha пути от предыдущего шага к текущему.
+// Возвращает false, если кадр совпал бы с уже показанным
+bool interpolate(float alpha) {
+    float x = previousStep.x + (currentStep.x - previousStep.x) * alpha;
+    float y = previousStep.y + (currentStep.y - previousStep.y) * alpha;
+    if (x == angleX && y == angleY) return false;
+    angleX = x;
+    angleY = y;
 
-    if (angleX > 360.0f) angleX -= 360.0f;
-    if (angleY > 360.0f) angleY -= 360.0f;
+    // Куб повернулся - его тень нужно перерисовать
+    shadows.invalidate();
+    torusLit = false;
+
+    if (stressCount > 0) {
+        field.update(angleX, angleY, useInstancing);
+    }
+    return true;
 }
 
 void handleEvents(sf::Window& window) {
@@ -128,21 +1033,61 @@ void handleEvents(sf::Window& window) {
                 window.close();
                 break;
                 
-            case sf::Event::Resized: {
-                glViewport(0, 0, event.size.width, event.size.height);
-                glMatrixMode(GL_PROJECTION);
-                glLoadIdentity();
-                float aspect = static_cast<float>(event.size.width) / event.size.height;
-                float fH = tan(45.0f * 3.14159f / 360.0f) * 0.1f;
-                float fW = fH * aspect;
-                glFrustum(-fW, fW, -fH, fH, 0.1f, 100.0f);
-                glMatrixMode(GL_MODELVIEW);
+            case sf::Event::Resized:
+                sceneChanged = true;
+                setProjection(event.size.width, event.size.height);
+                shadows.invalidate();
+                break;
+                
+            case sf::Event::GainedFocus:
+                sceneChanged = true;
                 break;
-            }
                 
             case sf::Event::KeyPressed:
+                sceneChanged = true;
                 if (event.key.code == sf::Keyboard::Escape)
                     window.close();
+                else if (event.key.code == sf::Keyboard::Space) {
+                    paused = !paused;
+                }
+                else if (event.key.code == sf::Keyboard::Left || event.key.code == sf::Keyboard::Right) {
+                    // Поворот первого источника вокруг вертикальной оси
+                    float a = radians(event.key.code == sf::Keyboard::Left ? 5.0f : -5.0f);
+                    float x = lights[0].position[0], z = lights[0].position[2];
+                    lights[0].position[0] = x * std::cos(a) - z * std::sin(a);
+                    lights[0].position[2] = x * std::sin(a) + z * std::cos(a);
+                    torusLit = false;
+                }
+                else if (event.key.code == sf::Keyboard::T) {
+                    shadowsEnabled = !shadowsEnabled;
+                    std::cout << "Тени: " << (shadowsEnabled ? "включены" : "выключены") << std::endl;
+                }
+                else if (event.key.code == sf::Keyboard::F) {
+                    shadows.pcfTaps = shadows.pcfTaps == 1 ? 4 : 1;
+                    std::cout << "Выборок PCF: " << shadows.pcfTaps << std::endl;
+                }
+                else if (event.key.code == sf::Keyboard::R || event.key.code == sf::Keyboard::C) {
+                    if (event.key.code == sf::Keyboard::R)
+                        shadows.size = shadows.size >= 4096 ? 512 : shadows.size * 2;
+                    else
+                        shadows.cascades = shadows.cascades % MAX_CASCADES + 1;
+                    std::string error;
+                    if (!shadows.create(error)) std::cerr << "Ошибка теней: " << error << std::endl;
+                    std::cout << "Карта теней: " << shadows.size << "x" << shadows.size
+                              << ", каскадов: " << shadows.cascades << std::endl;
+                }
+                else if (event.key.code == sf::Keyboard::I && stressCount > 0) {
+                    if (field.canInstance()) {
+                        useInstancing = !useInstancing;
+                        field.update(angleX, angleY, useInstancing);
+                        std::cout << (useInstancing ? "Отрисовка экземпляров" : "Кубы по одному") << std::endl;
+                    }
+                }
+                else if (event.key.code == sf::Keyboard::L && denseCount > 0) {
+                    cpuLighting = !cpuLighting;
+                    torusLit = false;
+                    std::cout << "Освещение: " << (cpuLighting ? "на процессоре" : "OpenGL") << std::endl;
+                }
                 break;
                 
             default:
@@ -151,7 +1096,22 @@ void handleEvents(sf::Window& window) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "--stress") == 0) {
+            stressCount = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--dense") == 0) {
+            denseCount = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--shadow-size") == 0) {
+            shadows.size = std::max(64, std::atoi(argv[i + 1]));
+        }
+        else if (std::strcmp(argv[i], "--cascades") == 0) {
+            shadows.cascades = std::atoi(argv[i + 1]);
+        }
+    }
+
     // Настройки SFML
     sf::ContextSettings settings;
     settings.depthBits = 24;
@@ -163,35 +1123,136 @@ int main() {
     // Создание окна
     sf::Window window(sf::VideoMode(800, 600), "3D Cube with Lighting", 
                      sf::Style::Default, settings);
-    window.setVerticalSyncEnabled(true);
+    // В режиме нагрузки кадры не ждут вертикальной синхронизации,
+    // иначе время кадра упирается в частоту монитора
+    window.setVerticalSyncEnabled(stressCount == 0 && denseCount == 0);
 
     // Инициализация OpenGL
+    if (!gl::load()) {
+        std::cout << "Буферы вершин не поддерживаются, геометрия передаётся из памяти" << std::endl;
+    }
     init();
+    cube.create(makeCube());
 
-    // Настройка начально��о viewport и проекции
-    glViewport(0, 0, window.getSize().x, window.getSize().y);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    float aspect = static_cast<float>(window.getSize().x) / window.getSize().y;
-    float fH = tan(45.0f * 3.14159f / 360.0f) * 0.1f;
-    float fW = fH * aspect;
-    glFrustum(-fW, fW, -fH, fH, 0.1f, 100.0f);
-    glMatrixMode(GL_MODELVIEW);
+    if (stressCount == 0 && denseCount == 0) {
+        ground.create(makePlane(GROUND_SIZE, GROUND_DIVISIONS));
+        shadows.sceneCenter = {0.0f, GROUND_Y, -GROUND_SIZE / 4};
+        shadows.sceneRadius = GROUND_SIZE * 0.75f;
+        std::string error;
+        if (!shadows.create(error)) {
+            std::cerr << "Тени недоступны: " << error << std::endl;
+        }
+        std::cout << "Управление:" << std::endl;
+        std::cout << "- Пауза вращения: Space" << std::endl;
+        std::cout << "- Поворот первого источника: стрелки влево/вправо" << std::endl;
+        std::cout << "- Тени вкл/выкл: T" << std::endl;
+        std::cout << "- PCF 1/4 выборки: F" << std::endl;
+        std::cout << "- Размер карты теней: R" << std::endl;
+        std::cout << "- Число каскадов: C" << std::endl;
+        std::cout << "- Выход: Escape" << std::endl;
+    }
+
+    if (stressCount > 0) {
+        field.create(cube, stressCount);
+        useInstancing = field.canInstance();
+        float radius = field.radius();
+        farPlane = radius / std::sin(radians(22.5f)) + radius + 1.0f;
+        field.update(angleX, angleY, useInstancing);
+        std::cout << "Режим нагрузки: " << stressCount << " кубов" << std::endl;
+        std::cout << "- Переключение отрисовки экземпляров: I" << std::endl;
+        std::cout << "Без видеокарты: LIBGL_ALWAYS_SOFTWARE=1 " << argv[0] << " --stress N" << std::endl;
+    }
+    else if (denseCount > 0) {
+        // Вершин на окружности сечения втрое меньше, чем вдоль тора
+        int sides = std::max(3, static_cast<int>(std::sqrt(denseCount / 3.0)));
+        MeshData data = makeTorus(TORUS_MAJOR, TORUS_MINOR, 3 * sides, sides);
+        torusLighting = toLightingMesh(data);
+        size_t triangles = data.indices.size() / 3;
+        torus.create(std::move(data));
+        std::cout << "Плотная сетка: " << torusLighting.size() << " вершин, "
+                  << triangles << " треугольников, потоков освещения: "
+                  << TaskPool::shared().threadCount() << std::endl;
+        std::cout << "- Освещение на процессоре / OpenGL: L" << std::endl;
+        std::cout << "- Пауза вращения: Space" << std::endl;
+        std::cout << "- Поворот первого источника: стрелки влево/вправо" << std::endl;
+    }
+
+    // Настройка начального viewport и проекции
+    setProjection(window.getSize().x, window.getSize().y);
 
-    // Главный цикл
+    // Главный цикл: состояние догоняет реальное время целыми шагами, кадр
+    // показывает положение между двумя последними шагами. Если ни состояние,
+    // ни окно не изменились, кадр не рисуется
+    frameTimes.create();
+    if (!frameTimes.measuresGpu()) {
+        std::cout << "Запросы времени не поддерживаются, время видеокарты не измеряется" << std::endl;
+    }
     sf::Clock clock;
+    sf::Clock statsClock;
+    float lag = 0.0f;
+    int frameCount = 0;
     while (window.isOpen()) {
         handleEvents(window);
 
-        // Обновление каждые 16 мс (примерно 60 FPS)
-        if (clock.getElapsedTime().asMilliseconds() >= 16) {
+        // После долгой остановки (перетаскивание окна) не догоняем больше
+        // нескольких шагов, иначе куб скачком провернётся
+        lag = std::min(lag + clock.restart().asSeconds(), 8 * UPDATE_STEP);
+        while (lag >= UPDATE_STEP) {
             update();
-            clock.restart();
+            lag -= UPDATE_STEP;
         }
+        if (interpolate(lag / UPDATE_STEP)) sceneChanged = true;
 
-        render();
-        window.display();
+        if (sceneChanged) {
+            frameTimes.beginFrame();
+            render();
+            frameTimes.endFrame();
+            window.display();
+            sceneChanged = false;
+            frameCount++;
+        }
+        else {
+            // До следующего шага показывать нечего
+            frameTimes.skipFrame();
+            sf::sleep(sf::seconds(UPDATE_STEP - lag));
+        }
+
+        // Среднее время кадра за секунду
+        if (statsClock.getElapsedTime().asSeconds() < 1.0f) continue;
+        float seconds = statsClock.restart().asSeconds();
+        if (stressCount == 0 && denseCount == 0) {
+            std::cout << "FPS: " << frameCount << ", перерисовано карт теней: " << shadowMapsRendered << std::endl;
+            shadowMapsRendered = 0;
+        }
+        else if (stressCount > 0 && frameCount > 0) {
+            std::ostringstream stats;
+            stats << stressCount << " cubes, " << (useInstancing ? "instanced" : "one by one") << ", "
+                  << 1000.0f * seconds / frameCount << " ms/frame, " << frameCount / seconds << " FPS";
+            window.setTitle(stats.str());
+            std::cout << "Кадр: " << 1000.0f * seconds / frameCount << " мс, FPS: "
+                      << frameCount / seconds << std::endl;
+        }
+        else if (denseCount > 0 && frameCount > 0) {
+            float lighting = lightingRuns > 0 ? lightingMs / lightingRuns : 0.0f;
+            std::ostringstream stats;
+            stats << torusLighting.size() << " vertices, " << (cpuLighting ? "CPU" : "OpenGL") << " lighting, "
+                  << 1000.0f * seconds / frameCount << " ms/frame, lighting " << lighting << " ms";
+            window.setTitle(stats.str());
+            std::cout << "Кадр: " << 1000.0f * seconds / frameCount << " мс, освещение на процессоре: "
+                      << lighting << " мс" << std::endl;
+            lightingMs = 0.0f;
+            lightingRuns = 0;
+        }
+        std::cout << frameTimes.report() << std::endl;
+        frameCount = 0;
     }
 
+    frameTimes.destroy();
+    shadows.destroy();
+    field.destroy();
+    torusColors.destroy();
+    torus.destroy();
+    ground.destroy();
+    cube.destroy();
     return 0;
 }
@@ -0,0 +1,138 @@
+#include "lab2_scene.h"
+#include "soft_raster.h"
+#include <SFML/Graphics/Image.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Программная отрисовка сцены lab2 (куб, столбы и плоскость, без теней)
+// в файл без окна и без OpenGL:
+//   lab2_render [параметры] [output.png]
+// Параметры:
+//   --size WxH     размер изображения (800x600)
+//   --frames N     число кадров; куб поворачивается на градус за кадр, как в lab2
+//   --angle A      начальный угол поворота куба в градусах
+//   --threads N    число потоков (по умолчанию по числу ядер)
+//   --tile N       сторона фрагмента в пикселях
+// Выводит среднее время кадра по этапам и контрольную сумму последнего
+// кадра: при любом числе потоков и размере фрагмента она одна и та же
+
+namespace {
+
+// Дальняя плоскость отсечения, как в lab2
+const float FAR_PLANE = 100.0f;
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void usage(const char* program) {
+    std::cerr << "Использование: " << program << " [--size WxH] [--frames N] [--angle A]\n"
+              << "       [--threads N] [--tile N] [output.png]" << std::endl;
+}
+
+// Объекты сцены в том же порядке, что и drawScene в lab2
+void drawScene(SoftRasterizer& raster, const MeshData& cube, const MeshData& ground,
+               const Mat4& view, float angle) {
+    raster.draw(cube, multiply(view, cubeModel(angle, angle)), CUBE_MATERIAL);
+    for (const Pillar& pillar : PILLARS) {
+        raster.draw(cube, multiply(view, pillarModel(pillar)), CUBE_MATERIAL);
+    }
+    raster.draw(ground, multiply(view, groundModel()), GROUND_MATERIAL);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string output;
+    int width = 800, height = 600;
+    int frames = 1;
+    float angle = 0;
+    int threads = 0;
+    int tileSize = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--size") == 0 && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                std::cerr << "Ошибка: неверный размер " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+            frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--angle") == 0 && hasValue) {
+            angle = std::strtof(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--tile") == 0 && hasValue) {
+            tileSize = std::max(8, std::atoi(argv[++i]));
+        }
+        else if (argv[i][0] != '-' && output.empty()) {
+            output = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const MeshData cube = makeCube();
+    const MeshData ground = makePlane(GROUND_SIZE, GROUND_DIVISIONS);
+    const SceneCamera camera;
+    const LightSource lights[2] = {LIGHT0, LIGHT1};
+    const float background[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    SoftRasterizer raster(threads);
+    if (tileSize > 0) raster.tileSize = tileSize;
+    raster.resize(width, height);
+
+    // Та же проекция, что setProjection в lab2
+    raster.setProjection(perspective(45.0f, static_cast<float>(width) / height, 0.1f, FAR_PLANE));
+    Mat4 view = camera.view();
+    raster.setLights(lights, SCENE_AMBIENT, view);
+
+    double clearMs = 0, vertexMs = 0, rasterMs = 0, bestMs = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        raster.clear(background);
+        double cleared = millisecondsSince(start);
+        drawScene(raster, cube, ground, view, std::fmod(angle + frame, 360.0f));
+        double drawn = millisecondsSince(start);
+        raster.finish();
+        double total = millisecondsSince(start);
+        clearMs += cleared;
+        vertexMs += drawn - cleared;
+        rasterMs += total - drawn;
+        bestMs = frame == 0 ? total : std::min(bestMs, total);
+    }
+
+    if (!output.empty()) {
+        sf::Image image;
+        image.create(static_cast<unsigned>(width), static_cast<unsigned>(height), raster.getPixels());
+        if (!image.saveToFile(output)) {
+            std::cerr << "Ошибка: не удалось сохранить " << output << std::endl;
+            return 1;
+        }
+    }
+
+    const SoftRasterStats& stats = raster.stats();
+    std::cout << "Потоков: " << raster.threadCount() << ", кадров: " << frames
+              << ", размер: " << width << "x" << height << '\n'
+              << "Треугольников: " << stats.triangles << ", после отсечения: " << stats.rasterized
+              << ", ссылок из фрагментов: " << stats.binned << '\n'
+              << "Очистка: " << clearMs / frames << " мс, вершины: " << vertexMs / frames
+              << " мс, растеризация: " << rasterMs / frames << " мс\n"
+              << "Кадр: " << (clearMs + vertexMs + rasterMs) / frames << " мс (лучший " << bestMs << " мс)\n"
+              << "Контрольная сумма: " << std::hex << raster.checksum() << std::dec << std::endl;
+    if (!output.empty()) std::cout << "Сохранено в " << output << std::endl;
+    return 0;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+// Сцена лабораторной работы 2: геометрия, источники света, материалы, камера
+// и расстановка объектов. Общая для окна (lab2, OpenGL) и программного рендера
+// (lab2_render), поэтому не зависит ни от SFML, ни от OpenGL
+
+#include "cg_math.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Точечный источник: позиция в мировых координатах (w = 1) и цвета,
+// как в glLightfv
+struct LightSource {
+    float position[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+};
+
+// Материал, как в glMaterialfv
+struct Material {
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float shininess;
+};
+
+// Начальные источники света
+const LightSource LIGHT0 = {
+    {5.0f, 5.0f, 5.0f, 1.0f}, {0.2f, 0.2f, 0.2f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}
+};
+const LightSource LIGHT1 = {
+    {-5.0f, -5.0f, 5.0f, 1.0f}, {0.1f, 0.1f, 0.1f, 1.0f}, {0.5f, 0.5f, 0.5f, 1.0f}, {0.5f, 0.5f, 0.5f, 1.0f}
+};
+
+// Фоновое освещение сцены (значение OpenGL по умолчанию)
+const float SCENE_AMBIENT[4] = {0.2f, 0.2f, 0.2f, 1.0f};
+
+// Материал куба и столбов
+const Material CUBE_MATERIAL = {
+    {0.2f, 0.2f, 0.2f, 1.0f}, {0.8f, 0.8f, 0.8f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, 50.0f
+};
+
+// Материал плоскости, на которую падают тени
+const Material GROUND_MATERIAL = {
+    {0.2f, 0.25f, 0.2f, 1.0f}, {0.5f, 0.65f, 0.5f, 1.0f}, {0.1f, 0.1f, 0.1f, 1.0f}, 10.0f
+};
+
+// Вершина сетки: положение и нормаль подряд, как их читают glVertexPointer
+// и glNormalPointer
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+};
+
+// Треугольная сетка: вершины и по три индекса на треугольник
+struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Куб со стороной 2: 24 вершины (по четыре на грань, у каждой грани
+// своя нормаль) и 36 индексов
+inline MeshData makeCube() {
+    // Нормаль грани и её вершины против часовой стрелки
+    const float faces[6][5][3] = {
+        {{0, 0, 1}, {-1, -1, 1}, {1, -1, 1}, {1, 1, 1}, {-1, 1, 1}},        // передняя
+        {{0, 0, -1}, {-1, -1, -1}, {-1, 1, -1}, {1, 1, -1}, {1, -1, -1}},   // задняя
+        {{0, 1, 0}, {-1, 1, -1}, {-1, 1, 1}, {1, 1, 1}, {1, 1, -1}},        // верхняя
+        {{0, -1, 0}, {-1, -1, -1}, {1, -1, -1}, {1, -1, 1}, {-1, -1, 1}},   // нижняя
+        {{1, 0, 0}, {1, -1, -1}, {1, 1, -1}, {1, 1, 1}, {1, -1, 1}},        // правая
+        {{-1, 0, 0}, {-1, -1, -1}, {-1, -1, 1}, {-1, 1, 1}, {-1, 1, -1}}    // левая
+    };
+    MeshData mesh;
+    for (const auto& face : faces) {
+        uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+        for (int k = 1; k <= 4; ++k) {
+            mesh.vertices.push_back({{face[k][0], face[k][1], face[k][2]},
+                                     {face[0][0], face[0][1], face[0][2]}});
+        }
+        const uint32_t quad[6] = {0, 1, 2, 0, 2, 3};
+        for (uint32_t index : quad) mesh.indices.push_back(first + index);
+    }
+    return mesh;
+}
+
+// Квадрат size x size в плоскости y = 0 с нормалью вверх. Освещение
+// считается по вершинам, поэтому плоскость разбита на divisions x divisions
+// клеток, иначе блик и затухание не видны
+inline MeshData makePlane(float size, int divisions) {
+    MeshData mesh;
+    for (int j = 0; j <= divisions; ++j) {
+        for (int i = 0; i <= divisions; ++i) {
+            float x = size * (static_cast<float>(i) / divisions - 0.5f);
+            float z = size * (static_cast<float>(j) / divisions - 0.5f);
+            mesh.vertices.push_back({{x, 0, z}, {0, 1, 0}});
+        }
+    }
+    for (int j = 0; j < divisions; ++j) {
+        for (int i = 0; i < divisions; ++i) {
+            uint32_t a = static_cast<uint32_t>(j * (divisions + 1) + i);
+            uint32_t b = a + divisions + 1;
+            const uint32_t quad[6] = {a, b, b + 1, a, b + 1, a + 1};
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+    return mesh;
+}
+
+// Тор в плоскости y = 0: радиус кольца major, радиус трубки minor,
+// segments шагов вдоль кольца и sides вокруг трубки, без повторных вершин
+// на швах. Плотная сетка для освещения на процессоре
+inline MeshData makeTorus(float major, float minor, int segments, int sides) {
+    MeshData mesh;
+    mesh.vertices.reserve(static_cast<size_t>(segments) * sides);
+    for (int i = 0; i < segments; ++i) {
+        float u = 2 * PI * i / segments;
+        for (int j = 0; j < sides; ++j) {
+            float v = 2 * PI * j / sides;
+            float nx = std::cos(u) * std::cos(v), ny = std::sin(v), nz = std::sin(u) * std::cos(v);
+            float ring = major + minor * std::cos(v);
+            mesh.vertices.push_back({{ring * std::cos(u), minor * ny, ring * std::sin(u)}, {nx, ny, nz}});
+        }
+    }
+    mesh.indices.reserve(static_cast<size_t>(segments) * sides * 6);
+    for (int i = 0; i < segments; ++i) {
+        for (int j = 0; j < sides; ++j) {
+            uint32_t a = static_cast<uint32_t>(i * sides + j);
+            uint32_t b = static_cast<uint32_t>((i + 1) % segments * sides + j);
+            uint32_t c = static_cast<uint32_t>((i + 1) % segments * sides + (j + 1) % sides);
+            uint32_t d = static_cast<uint32_t>(i * sides + (j + 1) % sides);
+            const uint32_t quad[6] = {a, d, c, a, c, b};
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+    return mesh;
+}
+
+// Камера сцены с тенями: смотрит на куб сверху, чтобы была видна плоскость
+struct SceneCamera {
+    Vec3 eye = {0.0f, 4.0f, 10.0f};
+    Vec3 target = {0.0f, -1.0f, -2.0f};
+    float fovY = 45.0f;
+    float zNear = 0.1f;
+
+    Mat4 view() const { return lookAt(eye, target, {0.0f, 1.0f, 0.0f}); }
+
+    // Точка с координатами вида (x, y, -depth) в мировых координатах
+    Vec3 toWorld(float x, float y, float depth) const {
+        Vec3 f = normalize(target - eye);
+        Vec3 s = normalize(cross(f, {0.0f, 1.0f, 0.0f}));
+        Vec3 u = cross(s, f);
+        return eye + s * x + u * y + f * depth;
+    }
+};
+
+// Сцена с тенями: плоскость, вращающийся куб над ней и неподвижные столбы
+// на разном удалении, чтобы были заметны каскады
+const float GROUND_Y = -2.5f;
+const float GROUND_SIZE = 60.0f;
+const int GROUND_DIVISIONS = 60;
+
+struct Pillar {
+    float x, z, height;
+};
+
+const Pillar PILLARS[] = {
+    {-4.0f, -3.0f, 3.0f}, {5.0f, -8.0f, 5.0f}, {-9.0f, -15.0f, 6.0f},
+    {10.0f, -22.0f, 4.0f}, {-14.0f, -30.0f, 7.0f}, {3.0f, 4.0f, 1.5f}
+};
+
+// Матрицы объектов сцены (модель -> мир)
+inline Mat4 cubeModel(float angleX, float angleY) {
+    return multiply(rotationX(angleX), rotationY(angleY));
+}
+
+// Столб - куб, растянутый до высоты pillar.height и стоящий на плоскости
+inline Mat4 pillarModel(const Pillar& pillar) {
+    return multiply(translation(pillar.x, GROUND_Y + pillar.height / 2, pillar.z),
+                    scaling(0.5f, pillar.height / 2, 0.5f));
+}
+
+inline Mat4 groundModel() {
+    return translation(0.0f, GROUND_Y, 0.0f);
+}
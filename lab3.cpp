@@ -1,14 +1,33 @@
+#include "gl_loader.h"
+#include "lab3_scene.h"
+#include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
 #include <SFML/OpenGL.hpp>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
 
 // Константы для камеры
-const float PI = 3.14159265359f;
 const float MIN_DISTANCE = 2.0f;
 const float MAX_DISTANCE = 10.0f;
 const float MIN_PITCH = -89.0f;
 const float MAX_PITCH = 89.0f;
+const float FOV_Y = 45.0f;
+
+// Поле сфер: объём куба на одну сферу - FIELD_SPACING^3
+const float FIELD_SPACING = 3.0f;
+
+// Уровень детализации выбирается так, чтобы рёбра сферы на экране были
+// не длиннее стольких пикселей
+const float MAX_EDGE_PIXELS = 16.0f;
 
 // Параметры камеры
 struct Camera {
@@ -18,48 +37,378 @@ struct Camera {
     float lastX = 0.0f;      // Последняя X-координата мыши
     float lastY = 0.0f;      // Последняя Y-координата мыши
     bool firstMouse = true;  // Флаг первого движения мыши
+    float minDistance = MIN_DISTANCE;   // Пределы расстояния; для поля сфер
+    float maxDistance = MAX_DISTANCE;   // зависят от его размера
 };
 
-// Функция для создания вершин сферы
-std::vector<float> createSphereVertices(float radius, int segments) {
-    std::vector<float> vertices;
-    
-    for(int i = 0; i <= segments; i++) {
-        float lat0 = PI * (-0.5f + (float)(i - 1) / segments);
-        float lat1 = PI * (-0.5f + (float)i / segments);
-        float y0 = radius * sin(lat0);
-        float y1 = radius * sin(lat1);
-        float r0 = radius * cos(lat0);
-        float r1 = radius * cos(lat1);
+// Положение камеры в кадре. Без сглаживания совпадает с заданным мышью,
+// со сглаживанием догоняет его за несколько кадров
+struct CameraPose {
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    float distance = 0.0f;
+};
+
+// Время, за которое сглаженная камера проходит около 63% пути до цели, с
+const float SMOOTHING_TIME = 0.08f;
+
+// Шаг показываемого положения к заданному за dt секунд; false - не сдвинулось
+bool approach(CameraPose& pose, const Camera& target, float dt, bool smooth) {
+    float k = smooth ? 1.0f - std::exp(-dt / SMOOTHING_TIME) : 1.0f;
+    CameraPose next = pose;
+    next.yaw += (target.yaw - pose.yaw) * k;
+    next.pitch += (target.pitch - pose.pitch) * k;
+    next.distance += (target.distance - pose.distance) * k;
+    // Остаток меньше сотой градуса на экране не заметен
+    if (std::fabs(target.yaw - next.yaw) < 0.01f) next.yaw = target.yaw;
+    if (std::fabs(target.pitch - next.pitch) < 0.01f) next.pitch = target.pitch;
+    if (std::fabs(target.distance - next.distance) < 0.001f * target.distance) next.distance = target.distance;
+    bool moved = next.yaw != pose.yaw || next.pitch != pose.pitch || next.distance != pose.distance;
+    pose = next;
+    return moved;
+}
+
+bool reached(const CameraPose& pose, const Camera& target) {
+    return pose.yaw == target.yaw && pose.pitch == target.pitch && pose.distance == target.distance;
+}
+
+// Дальняя плоскость отсечения; для поля сфер отодвигается за поле
+float farPlane = 100.0f;
+
+// Проекция, загруженная в OpenGL последним setProjection
+Mat4 projection = Mat4::identity();
 
-        for(int j = 0; j <= segments; j++) {
-            float lng = 2 * PI * (float)j / segments;
-            float x = cos(lng);
-            float z = sin(lng);
+// Все уровни детализации сферы в одном буфере вершин и одном буфере
+// индексов: смена уровня - только другой диапазон индексов. Нормаль
+// единичной сферы равна положению, поэтому оба указателя смотрят в один
+// массив. Без буферов те же массивы передаются из памяти
+class SphereLods {
+public:
+    void create(std::vector<SphereMesh> meshes) {
+        destroy();
+        levels = std::move(meshes);
+        positions.clear();
+        indices.clear();
+        firstIndex.clear();
+        for (const SphereMesh& mesh : levels) {
+            uint32_t base = static_cast<uint32_t>(positions.size() / 3);
+            firstIndex.push_back(indices.size());
+            positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+            for (uint32_t index : mesh.indices) indices.push_back(base + index);
+        }
+
+        if (gl::GenBuffers) {
+            gl::GenBuffers(1, &vertexBuffer);
+            gl::BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            gl::BufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            gl::GenBuffers(1, &indexBuffer);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            gl::BufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    }
+
+    void destroy() {
+        if (vertexBuffer) gl::DeleteBuffers(1, &vertexBuffer);
+        if (indexBuffer) gl::DeleteBuffers(1, &indexBuffer);
+        vertexBuffer = indexBuffer = 0;
+    }
 
-            // Первый треугольник
-            vertices.push_back(r0 * x);
-            vertices.push_back(y0);
-            vertices.push_back(r0 * z);
+    const std::vector<SphereMesh>& meshes() const { return levels; }
 
-            vertices.push_back(r1 * x);
-            vertices.push_back(y1);
-            vertices.push_back(r1 * z);
+    void bind() const {
+        const float* data = positions.data();
+        if (vertexBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            data = nullptr;
         }
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, data);
+        glNormalPointer(GL_FLOAT, 0, data);
     }
-    
-    return vertices;
+
+    void draw(size_t level) const {
+        const uint32_t* first = vertexBuffer ? nullptr : indices.data();
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(levels[level].indices.size()), GL_UNSIGNED_INT,
+                       first + firstIndex[level]);
+    }
+
+    void unbind() const {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        if (vertexBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    }
+
+private:
+    std::vector<SphereMesh> levels;
+    std::vector<float> positions;       // вершины всех уровней подряд
+    std::vector<uint32_t> indices;      // индексы уровней со сдвигом на их вершины
+    std::vector<size_t> firstIndex;     // начало уровня в indices
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+};
+
+// Перспективная проекция с углом обзора FOV_Y
+void setProjection(unsigned width, unsigned height) {
+    glViewport(0, 0, width, height);
+    projection = perspective(FOV_Y, static_cast<float>(width) / height, 0.1f, farPlane);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(projection.m);
+    glMatrixMode(GL_MODELVIEW);
 }
 
-// Функция для отрисовки сферы
-void drawSphere(const std::vector<float>& vertices) {
-    glBegin(GL_LINE_STRIP);
-    for(size_t i = 0; i < vertices.size(); i += 3) {
-        glVertex3f(vertices[i], vertices[i + 1], vertices[i + 2]);
+// Перекрытие листьев иерархии запросами GL_SAMPLES_PASSED. Лист, который в
+// прошлый раз не дал ни одного фрагмента, не рисуется, а проверяется своей
+// коробкой без записи цвета и глубины. Результаты читаются в следующих
+// кадрах, когда готовы, чтобы не ждать видеокарту
+class LeafOcclusion {
+public:
+    void create(size_t nodeCount) {
+        destroy();
+        queries.assign(nodeCount, 0);
+        occluded.assign(nodeCount, 0);
+        pending.assign(nodeCount, 0);
+    }
+
+    void destroy() {
+        for (GLuint query : queries) {
+            if (query) gl::DeleteQueries(1, &query);
+        }
+        queries.clear();
+        issued.clear();
+    }
+
+    // Готовые результаты прошлых кадров; возвращает, сколько листьев
+    // перестали быть перекрытыми
+    size_t collect() {
+        size_t kept = 0, revealed = 0;
+        for (uint32_t node : issued) {
+            GLint available = 0;
+            gl::GetQueryObjectiv(queries[node], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                issued[kept++] = node;
+                continue;
+            }
+            GLint samples = 0;
+            gl::GetQueryObjectiv(queries[node], GL_QUERY_RESULT, &samples);
+            if (occluded[node] && samples > 0) revealed++;
+            occluded[node] = samples == 0;
+            pending[node] = 0;
+        }
+        issued.resize(kept);
+        return revealed;
+    }
+
+    bool hasPending() const { return !issued.empty(); }
+
+    bool isOccluded(uint32_t node) const { return occluded[node] != 0; }
+
+    // Пока прошлый запрос листа не готов, новый не начинается
+    bool begin(uint32_t node) {
+        if (pending[node]) return false;
+        if (!queries[node]) gl::GenQueries(1, &queries[node]);
+        gl::BeginQuery(GL_SAMPLES_PASSED, queries[node]);
+        pending[node] = 1;
+        issued.push_back(node);
+        return true;
+    }
+
+    void end() { gl::EndQuery(GL_SAMPLES_PASSED); }
+
+private:
+    std::vector<GLuint> queries;     // по узлам иерархии, создаются по мере надобности
+    std::vector<uint8_t> occluded;
+    std::vector<uint8_t> pending;
+    std::vector<uint32_t> issued;    // листья с неготовыми результатами
+};
+
+// Параллелепипед без нормалей, для проверки перекрытия
+void drawBox(const Aabb& box) {
+    static const int FACES[6][4] = {
+        {0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3},
+    };
+    glBegin(GL_QUADS);
+    for (const auto& face : FACES) {
+        for (int corner : face) {
+            glVertex3f(corner & 4 ? box.max[0] : box.min[0], corner & 2 ? box.max[1] : box.min[1],
+                       corner & 1 ? box.max[2] : box.min[2]);
+        }
     }
     glEnd();
 }
 
+// Статистика поля за несколько кадров
+struct FieldStats {
+    size_t frames = 0;
+    size_t inFrustum = 0;    // сфер в пирамиде видимости
+    size_t occluded = 0;     // из них в перекрытых листьях
+    size_t triangles = 0;    // нарисованных треугольников сфер
+    double cullMs = 0.0;     // обход иерархии и выбор детализации
+};
+
+// Поле из многих сфер. Каждый кадр пирамида видимости строится по
+// проекции и видовой матрице камеры, иерархия отбрасывает невидимые сферы,
+// а видимые рисуются группами по уровню детализации, чтобы между ними не
+// менялось состояние
+class SphereField {
+public:
+    bool occlusionCulling = false;
+    FieldStats stats;
+
+    void create(size_t count) {
+        bvh.build(makeSphereField(count, FIELD_SPACING));
+        if (gl::hasQueries()) occlusion.create(bvh.tree().size());
+    }
+
+    void destroy() { occlusion.destroy(); }
+
+    size_t size() const { return bvh.instances().size(); }
+
+    // Кадр показан, но результаты запросов перекрытия ещё идут: если
+    // какой-то лист оказался виден, кадр нужно нарисовать заново
+    bool occlusionPending() const { return occlusionCulling && occlusion.hasPending(); }
+    bool occlusionRevealed() { return occlusion.collect() > 0; }
+
+    // Радиус шара, описанного вокруг поля с центром в начале координат
+    float radius() const {
+        const Aabb& box = bvh.tree().front().box;
+        float sum = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            float extent = std::max(std::fabs(box.min[k]), std::fabs(box.max[k]));
+            sum += extent * extent;
+        }
+        return std::sqrt(sum);
+    }
+
+    // view - видовая матрица камеры, она же загружена в OpenGL
+    void draw(const SphereLods& lods, const Mat4& view, unsigned viewportHeight) {
+        auto start = std::chrono::steady_clock::now();
+        Frustum frustum = extractFrustum(multiply(projection, view).m);
+        // Видовая матрица без масштаба: камера - сдвиг обратной к ней
+        const Mat4 toWorld = invertRigid(view);
+        const float* eye = toWorld.m + 12;
+
+        bvh.cull(frustum, visible, leaves);
+        const auto& spheres = bvh.instances();
+        const auto& meshes = lods.meshes();
+        // Центры видимых сфер переводятся в координаты вида одним пакетом:
+        // расстояние до камеры - длина центра, он же - сдвиг модель-вида сферы
+        const size_t count = visible.size();
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const float* center = spheres[visible[i]].center;
+            centerX[i] = center[0];
+            centerY[i] = center[1];
+            centerZ[i] = center[2];
+        }
+        transformPoints(view, centerX.data(), centerY.data(), centerZ.data(), centerX.data(), centerY.data(),
+                        centerZ.data(), count);
+        levels.resize(count);
+        batches.resize(meshes.size());
+        for (auto& batch : batches) batch.clear();
+        for (size_t i = 0; i < count; ++i) {
+            float distance = std::sqrt(centerX[i] * centerX[i] + centerY[i] * centerY[i] + centerZ[i] * centerZ[i]);
+            float radius = projectedRadius(spheres[visible[i]].radius, distance, FOV_Y, static_cast<int>(viewportHeight));
+            levels[i] = static_cast<uint8_t>(selectLod(meshes, radius, MAX_EDGE_PIXELS));
+            batches[levels[i]].push_back(static_cast<uint32_t>(i));
+        }
+        if (occlusionCulling) {
+            // Ближние листья рисуются первыми и закрывают дальние
+            auto distance = [&](const VisibleLeaf& leaf) {
+                const Aabb& box = bvh.tree()[leaf.node].box;
+                float sum = 0.0f;
+                for (int k = 0; k < 3; ++k) {
+                    float c = (box.min[k] + box.max[k]) / 2 - eye[k];
+                    sum += c * c;
+                }
+                return sum;
+            };
+            std::sort(leaves.begin(), leaves.end(),
+                      [&](const VisibleLeaf& a, const VisibleLeaf& b) { return distance(a) < distance(b); });
+        }
+        stats.cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.inFrustum += visible.size();
+        stats.frames++;
+
+        glEnable(GL_COLOR_MATERIAL);
+        lods.bind();
+        if (!occlusionCulling) {
+            for (size_t level = 0; level < batches.size(); ++level) {
+                for (uint32_t i : batches[level]) drawSphere(lods, view, i, level);
+                stats.triangles += batches[level].size() * meshes[level].triangleCount();
+            }
+            glLoadMatrixf(view.m);
+            lods.unbind();
+            glDisable(GL_COLOR_MATERIAL);
+            return;
+        }
+
+        occlusion.collect();
+        for (const VisibleLeaf& leaf : leaves) {
+            if (occlusion.isOccluded(leaf.node)) {
+                stats.occluded += leaf.count;
+                continue;
+            }
+            bool queried = occlusion.begin(leaf.node);
+            for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+                drawSphere(lods, view, i, levels[i]);
+                stats.triangles += meshes[levels[i]].triangleCount();
+            }
+            if (queried) occlusion.end();
+        }
+        glLoadMatrixf(view.m);
+        lods.unbind();
+        glDisable(GL_COLOR_MATERIAL);
+
+        // Перекрытые листья проверяются коробками: следующий кадр нарисует
+        // те, что снова стали видны
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_CULL_FACE);
+        for (const VisibleLeaf& leaf : leaves) {
+            if (!occlusion.isOccluded(leaf.node) || !occlusion.begin(leaf.node)) continue;
+            drawBox(bvh.tree()[leaf.node].box);
+            occlusion.end();
+        }
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_LIGHTING);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+private:
+    // Сфера visible[i]: модель-вид - поворот камеры, умноженный на радиус,
+    // со сдвигом в центр сферы в координатах вида
+    void drawSphere(const SphereLods& lods, const Mat4& view, size_t i, size_t level) const {
+        const SphereInstance& sphere = bvh.instances()[visible[i]];
+        Mat4 modelView = view;
+        for (int k = 0; k < 12; ++k) modelView.m[k] *= sphere.radius;
+        modelView.m[12] = centerX[i];
+        modelView.m[13] = centerY[i];
+        modelView.m[14] = centerZ[i];
+        glLoadMatrixf(modelView.m);
+        glColor3fv(sphere.color);
+        lods.draw(level);
+    }
+
+    SphereBvh bvh;
+    LeafOcclusion occlusion;
+    std::vector<uint32_t> visible;                  // сферы в пирамиде
+    std::vector<VisibleLeaf> leaves;
+    std::vector<uint8_t> levels;                    // детализация сфер visible
+    std::vector<float> centerX, centerY, centerZ;   // центры сфер visible в координатах вида
+    std::vector<std::vector<uint32_t>> batches;     // номера в visible по уровням детализации
+};
+
 // Обработчик движения мыши
 void handleMouseMove(Camera& camera, float xpos, float ypos) {
     if (camera.firstMouse) {
@@ -86,7 +435,326 @@ void handleMouseMove(Camera& camera, float xpos, float ypos) {
     if (camera.pitch < MIN_PITCH) camera.pitch = MIN_PITCH;
 }
 
-int main() {
+const char* kindName(SphereKind kind) {
+    return kind == SphereKind::Uv ? "по параллелям и меридианам" : "из икосаэдра";
+}
+
+void initGl() {
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    // Сферы поля рисуются единичной сферой с равномерным масштабом на радиус,
+    // нормали возвращаются к единичной длине
+    glEnable(GL_RESCALE_NORMAL);
+}
+
+// Камера облетает поле снаружи и может въехать внутрь
+void fitCameraToField(const SphereField& field, Camera& camera) {
+    float radius = field.radius();
+    camera.minDistance = MIN_DISTANCE;
+    camera.maxDistance = 3 * radius;
+    camera.distance = 1.5f * radius;
+    farPlane = camera.maxDistance + radius;
+}
+
+// Детализация одиночной сферы по её размеру на экране
+size_t sphereLod(const SphereLods& sphere, const CameraPose& pose, unsigned viewportHeight) {
+    float radius = projectedRadius(1.0f, pose.distance, FOV_Y, static_cast<int>(viewportHeight));
+    return selectLod(sphere.meshes(), radius, MAX_EDGE_PIXELS);
+}
+
+// Кадр с камерой pose: одна сфера в центре или поле (field != nullptr).
+// Возвращает число нарисованных треугольников
+size_t drawFrame(const CameraPose& pose, const SphereLods& sphere, SphereField* field, unsigned viewportHeight) {
+    // Очистка буферов
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Установка камеры: отъезд на distance, наклон и поворот вокруг центра
+    const Mat4 view = multiply(translation(0.0f, 0.0f, -pose.distance),
+                               multiply(rotationX(pose.pitch), rotationY(pose.yaw)));
+    glLoadMatrixf(view.m);
+
+    if (field) {
+        size_t before = field->stats.triangles;
+        field->draw(sphere, view, viewportHeight);
+        return field->stats.triangles - before;
+    }
+    size_t level = sphereLod(sphere, pose, viewportHeight);
+    sphere.bind();
+    sphere.draw(level);
+    sphere.unbind();
+    return sphere.meshes()[level].triangleCount();
+}
+
+// Путь камеры: ключевые положения, равномерно распределённые по кадрам,
+// между ними - линейно
+CameraPose samplePath(const std::vector<CameraPose>& keys, float t) {
+    if (keys.size() == 1) return keys.front();
+    float position = t * (keys.size() - 1);
+    size_t i = std::min(static_cast<size_t>(position), keys.size() - 2);
+    float k = position - i;
+    CameraPose pose;
+    pose.yaw = keys[i].yaw + (keys[i + 1].yaw - keys[i].yaw) * k;
+    pose.pitch = keys[i].pitch + (keys[i + 1].pitch - keys[i].pitch) * k;
+    pose.distance = keys[i].distance + (keys[i + 1].distance - keys[i].distance) * k;
+    return pose;
+}
+
+// Полный оборот с наклоном то снизу, то сверху, с приближением к ближнему
+// пределу камеры и отходом к дальнему
+std::vector<CameraPose> defaultCameraPath(const Camera& camera) {
+    float middle = camera.distance;
+    float nearest = camera.minDistance + (middle - camera.minDistance) * 0.2f;
+    float farthest = middle + (camera.maxDistance - middle) * 0.8f;
+    std::vector<CameraPose> keys(5);
+    const float yaws[5] = {0.0f, 90.0f, 180.0f, 270.0f, 360.0f};
+    const float pitches[5] = {0.0f, 30.0f, -30.0f, 60.0f, 0.0f};
+    const float distances[5] = {middle, nearest, farthest, nearest, middle};
+    for (int i = 0; i < 5; ++i) {
+        keys[i].yaw = yaws[i];
+        keys[i].pitch = pitches[i];
+        keys[i].distance = distances[i];
+    }
+    return keys;
+}
+
+// Файл пути: по строке "рыскание наклон расстояние" на ключевое положение,
+// строки с # пропускаются
+bool loadCameraPath(const std::string& fileName, std::vector<CameraPose>& keys, std::string& error) {
+    std::ifstream file(fileName);
+    if (!file) {
+        error = "не удалось открыть " + fileName;
+        return false;
+    }
+    keys.clear();
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        ++number;
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        std::istringstream fields(line);
+        CameraPose pose;
+        if (!(fields >> pose.yaw >> pose.pitch >> pose.distance)) {
+            error = fileName + ", строка " + std::to_string(number) + ": ожидается рыскание, наклон и расстояние";
+            return false;
+        }
+        keys.push_back(pose);
+    }
+    if (keys.empty()) {
+        error = fileName + ": нет ни одного положения камеры";
+        return false;
+    }
+    return true;
+}
+
+// Буфер кадра вне экрана: цвет и глубина в текстурах
+class OffscreenTarget {
+public:
+    bool create(unsigned width, unsigned height, std::string& error) {
+        if (!gl::hasFramebuffers()) {
+            error = "буферы кадра не поддерживаются";
+            return false;
+        }
+        glGenTextures(2, textures);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        gl::GenFramebuffers(1, &framebuffer);
+        gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[0], 0);
+        gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[1], 0);
+        if (gl::CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            destroy();
+            error = "буфер кадра неполон";
+            return false;
+        }
+        return true;
+    }
+
+    void destroy() {
+        if (framebuffer) {
+            gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+            gl::DeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(2, textures);
+        }
+        framebuffer = 0;
+    }
+
+private:
+    GLuint framebuffer = 0;
+    GLuint textures[2] = {};
+};
+
+// Замер без окна и без мыши: камера проходит путь за frames кадров
+struct BenchmarkOptions {
+    int frames = 0;
+    unsigned width = 800, height = 600;
+    std::string pathFile;       // пусто - путь по умолчанию
+    std::string dumpPrefix;     // кадры в prefixNNNN.png
+    std::string timingsFile;    // время каждого кадра в CSV
+};
+
+bool runBenchmark(const BenchmarkOptions& options, SphereKind sphereKind, size_t fieldCount, bool occlusion) {
+    // Контекст без окна; SFML создаёт его в pbuffer или скрытом окне.
+    // Рисуется в буфер кадра, а без его поддержки - в буфер самого контекста
+    sf::ContextSettings settings;
+    settings.depthBits = 24;
+    settings.majorVersion = 2;
+    settings.minorVersion = 1;
+    sf::Context context(settings, options.width, options.height);
+    gl::load();
+    OffscreenTarget target;
+    std::string error;
+    if (!target.create(options.width, options.height, error)) {
+        std::cerr << "Рисование в буфер контекста: " << error << std::endl;
+    }
+    initGl();
+    setProjection(options.width, options.height);
+
+    SphereLods sphere;
+    sphere.create(makeSphereLods(sphereKind));
+    Camera camera;
+    SphereField field;
+    field.occlusionCulling = occlusion && gl::hasQueries();
+    if (fieldCount > 0) {
+        field.create(fieldCount);
+        fitCameraToField(field, camera);
+        setProjection(options.width, options.height);
+    }
+    std::vector<CameraPose> keys = defaultCameraPath(camera);
+    if (!options.pathFile.empty() && !loadCameraPath(options.pathFile, keys, error)) {
+        std::cerr << "Ошибка пути камеры: " << error << std::endl;
+        target.destroy();
+        field.destroy();
+        sphere.destroy();
+        return false;
+    }
+
+    std::ofstream timings;
+    if (!options.timingsFile.empty()) {
+        timings.open(options.timingsFile);
+        timings << "frame,ms,triangles" << std::endl;
+    }
+
+    // Первый кадр без замера: в него попадает подготовка драйвера
+    SphereField* drawnField = fieldCount > 0 ? &field : nullptr;
+    drawFrame(keys.front(), sphere, drawnField, options.height);
+    glFinish();
+    field.stats = FieldStats();
+
+    std::vector<double> frameMs;
+    frameMs.reserve(options.frames);
+    double triangles = 0.0;
+    std::vector<uint8_t> pixels;
+    sf::Image image;
+    auto total = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; ++frame) {
+        float t = options.frames > 1 ? static_cast<float>(frame) / (options.frames - 1) : 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        size_t drawn = drawFrame(samplePath(keys, t), sphere, drawnField, options.height);
+        // Кадр считается готовым, когда видеокарта закончила
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        frameMs.push_back(ms);
+        triangles += drawn;
+        if (timings) timings << frame << "," << ms << "," << drawn << std::endl;
+
+        if (!options.dumpPrefix.empty()) {
+            // Строки в OpenGL снизу вверх, в изображении - сверху вниз
+            pixels.resize(4 * options.width * options.height);
+            glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            for (unsigned y = 0; y < options.height / 2; ++y) {
+                std::swap_ranges(pixels.begin() + 4 * options.width * y, pixels.begin() + 4 * options.width * (y + 1),
+                                 pixels.begin() + 4 * options.width * (options.height - 1 - y));
+            }
+            image.create(options.width, options.height, pixels.data());
+            char name[16];
+            std::snprintf(name, sizeof(name), "%04d.png", frame);
+            if (!image.saveToFile(options.dumpPrefix + name)) {
+                std::cerr << "Не удалось сохранить " << options.dumpPrefix + name << std::endl;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - total).count();
+
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) { return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))]; };
+    double renderSeconds = 0.0;
+    for (double ms : frameMs) renderSeconds += ms / 1000.0;
+
+    std::cout << "Кадров: " << options.frames << ", " << options.width << "x" << options.height
+              << ", ключевых положений камеры: " << keys.size() << std::endl;
+    std::cout << "Сфера " << kindName(sphereKind);
+    if (fieldCount > 0) {
+        std::cout << ", поле из " << field.size() << " сфер"
+                  << (field.occlusionCulling ? ", с отсечением перекрытых" : "");
+    }
+    std::cout << std::endl;
+    std::cout << "Кадр p50/p95/p99/max: " << percentile(0.5) << "/" << percentile(0.95) << "/" << percentile(0.99)
+              << "/" << sorted.back() << " мс, среднее: " << 1000.0 * renderSeconds / options.frames << " мс" << std::endl;
+    if (fieldCount > 0) {
+        const FieldStats& stats = field.stats;
+        std::cout << "В пирамиде в среднем: " << stats.inFrustum / options.frames << " сфер, перекрыто: "
+                  << stats.occluded / options.frames << ", отсечение: " << stats.cullMs / options.frames << " мс"
+                  << std::endl;
+    }
+    std::cout << "Всего: " << seconds << " с, " << options.frames / seconds << " кадров/с, "
+              << triangles / renderSeconds / 1e6 << " млн треугольников/с" << std::endl;
+
+    target.destroy();
+    field.destroy();
+    sphere.destroy();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    SphereKind sphereKind = SphereKind::Uv;
+    size_t fieldCount = 0;   // 0 - одна сфера в центре
+    bool continuous = false; // рисовать каждую итерацию, а не по изменениям
+    bool smoothing = false;
+    bool occlusion = false;
+    BenchmarkOptions benchmark;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--continuous") == 0) continuous = true;
+        else if (std::strcmp(argv[i], "--smooth") == 0) smoothing = true;
+        else if (std::strcmp(argv[i], "--occlusion") == 0) occlusion = true;
+        if (i + 1 == argc) break;
+        if (std::strcmp(argv[i], "--benchmark") == 0) {
+            benchmark.frames = std::atoi(argv[i + 1]);
+        }
+        else if (std::strcmp(argv[i], "--size") == 0) {
+            std::sscanf(argv[i + 1], "%ux%u", &benchmark.width, &benchmark.height);
+        }
+        else if (std::strcmp(argv[i], "--path") == 0) {
+            benchmark.pathFile = argv[i + 1];
+        }
+        else if (std::strcmp(argv[i], "--dump") == 0) {
+            benchmark.dumpPrefix = argv[i + 1];
+        }
+        else if (std::strcmp(argv[i], "--timings") == 0) {
+            benchmark.timingsFile = argv[i + 1];
+        }
+        if (std::strcmp(argv[i], "--sphere") == 0) {
+            sphereKind = std::strcmp(argv[i + 1], "ico") == 0 ? SphereKind::Icosphere : SphereKind::Uv;
+        }
+        else if (std::strcmp(argv[i], "--field") == 0) {
+            fieldCount = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    if (benchmark.frames > 0) {
+        return runBenchmark(benchmark, sphereKind, fieldCount, occlusion) ? 0 : 1;
+    }
+
     // Создание окна SFML
     sf::ContextSettings settings;
     settings.depthBits = 24;
@@ -99,83 +767,184 @@ int main() {
     window.setVerticalSyncEnabled(true);
 
     // Инициализация OpenGL
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
+    if (!gl::load()) {
+        std::cout << "Буферы вершин не поддерживаются, геометрия передаётся из памяти" << std::endl;
+    }
+    initGl();
     
-    // Создание вершин сферы
-    std::vector<float> sphereVertices = createSphereVertices(1.0f, 32);
+    // Сетки сферы всех уровней детализации
+    SphereLods sphere;
+    sphere.create(makeSphereLods(sphereKind));
+    bool wireframe = false;
+    size_t shownLevel = sphere.meshes().size();  // ещё ничего не показано
     Camera camera;
+    float zoomStep = 0.5f;
+
+    SphereField field;
+    field.occlusionCulling = occlusion && gl::hasQueries();
+    if (fieldCount > 0) {
+        field.create(fieldCount);
+        fitCameraToField(field, camera);
+        zoomStep = field.radius() / 10;
+    }
+
+    std::cout << "Управление:" << std::endl;
+    std::cout << "- Вращение камеры: мышь, расстояние: колесо" << std::endl;
+    std::cout << "- Сфера по параллелям или из икосаэдра: S" << std::endl;
+    std::cout << "- Каркас: W" << std::endl;
+    std::cout << "- Сглаживание движения камеры: M" << std::endl;
+    if (fieldCount > 0) {
+        std::cout << "- Отсечение перекрытых групп сфер: O" << std::endl;
+        std::cout << "Поле: " << field.size() << " сфер" << std::endl;
+    }
+    std::cout << "- Выход: Escape" << std::endl;
 
     // Настройка начального viewport и проекции
-    glViewport(0, 0, window.getSize().x, window.getSize().y);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    float aspect = static_cast<float>(window.getSize().x) / window.getSize().y;
-    float fH = tan(45.0f * PI / 360.0f) * 0.1f;
-    float fW = fH * aspect;
-    glFrustum(-fW, fW, -fH, fH, 0.1f, 100.0f);
-    glMatrixMode(GL_MODELVIEW);
+    unsigned viewportHeight = window.getSize().y;
+    setProjection(window.getSize().x, viewportHeight);
+    sf::Clock statsClock;
+
+    // Кадр рисуется, только когда меняется камера, окно или настройки.
+    // Все события, пришедшие до кадра, сводятся в одно смещение камеры;
+    // когда показывать нечего, цикл спит в waitEvent
+    CameraPose pose;
+    pose.yaw = camera.yaw;
+    pose.pitch = camera.pitch;
+    pose.distance = camera.distance;
+    bool redraw = true;
+    sf::Clock frameClock;
+    double drawMs = 0.0;
+
+    auto handleEvent = [&](const sf::Event& event, float& mouseX, float& mouseY, bool& mouseMoved, float& wheel) {
+        switch (event.type) {
+            case sf::Event::Closed:
+                window.close();
+                break;
+                
+            case sf::Event::Resized:
+                viewportHeight = event.size.height;
+                setProjection(event.size.width, event.size.height);
+                redraw = true;
+                break;
+                
+            case sf::Event::GainedFocus:
+                redraw = true;
+                break;
+                
+            case sf::Event::MouseMoved:
+                mouseX = static_cast<float>(event.mouseMove.x);
+                mouseY = static_cast<float>(event.mouseMove.y);
+                // Первое положение мыши - точка отсчёта, от него считается смещение
+                if (camera.firstMouse) handleMouseMove(camera, mouseX, mouseY);
+                mouseMoved = true;
+                break;
+                
+            case sf::Event::MouseWheelScrolled:
+                wheel += event.mouseWheelScroll.delta;
+                break;
+                
+            case sf::Event::KeyPressed:
+                redraw = true;
+                if (event.key.code == sf::Keyboard::Escape)
+                    window.close();
+                else if (event.key.code == sf::Keyboard::S) {
+                    sphereKind = sphereKind == SphereKind::Uv ? SphereKind::Icosphere : SphereKind::Uv;
+                    sphere.create(makeSphereLods(sphereKind));
+                    shownLevel = sphere.meshes().size();
+                }
+                else if (event.key.code == sf::Keyboard::W) {
+                    wireframe = !wireframe;
+                    glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
+                }
+                else if (event.key.code == sf::Keyboard::M) {
+                    smoothing = !smoothing;
+                    std::cout << "Сглаживание: " << (smoothing ? "включено" : "выключено") << std::endl;
+                }
+                else if (event.key.code == sf::Keyboard::O && fieldCount > 0) {
+                    if (!gl::hasQueries()) {
+                        std::cout << "Запросы перекрытия не поддерживаются" << std::endl;
+                        break;
+                    }
+                    field.occlusionCulling = !field.occlusionCulling;
+                    std::cout << "Отсечение перекрытых: "
+                              << (field.occlusionCulling ? "включено" : "выключено") << std::endl;
+                }
+                break;
+                
+            default:
+                break;
+        }
+    };
 
     while (window.isOpen()) {
+        float mouseX = 0.0f, mouseY = 0.0f, wheel = 0.0f;
+        bool mouseMoved = false;
         sf::Event event;
+
+        // Результаты запросов перекрытия приходят после кадра: пока они
+        // идут, цикл не засыпает, а проверяет, не открылась ли часть поля
+        bool animating = !reached(pose, camera);
+        if (!continuous && !redraw && !animating && field.occlusionPending()) {
+            if (field.occlusionRevealed()) redraw = true;
+            else sf::sleep(sf::milliseconds(1));
+        }
+        else if (!continuous && !redraw && !animating) {
+            if (window.waitEvent(event)) handleEvent(event, mouseX, mouseY, mouseMoved, wheel);
+        }
         while (window.pollEvent(event)) {
-            switch (event.type) {
-                case sf::Event::Closed:
-                    window.close();
-                    break;
-                    
-                case sf::Event::Resized:
-                    glViewport(0, 0, event.size.width, event.size.height);
-                    glMatrixMode(GL_PROJECTION);
-                    glLoadIdentity();
-                    aspect = static_cast<float>(event.size.width) / event.size.height;
-                    fH = tan(45.0f * PI / 360.0f) * 0.1f;
-                    fW = fH * aspect;
-                    glFrustum(-fW, fW, -fH, fH, 0.1f, 100.0f);
-                    glMatrixMode(GL_MODELVIEW);
-                    break;
-                    
-                case sf::Event::MouseMoved:
-                    handleMouseMove(camera, event.mouseMove.x, event.mouseMove.y);
-                    break;
-                    
-                case sf::Event::MouseWheelScrolled:
-                    camera.distance -= event.mouseWheelScroll.delta * 0.5f;
-                    camera.distance = std::max(MIN_DISTANCE, std::min(MAX_DISTANCE, camera.distance));
-                    break;
-                    
-                case sf::Event::KeyPressed:
-                    if (event.key.code == sf::Keyboard::Escape)
-                        window.close();
-                    break;
-                    
-                default:
-                    break;
-            }
+            handleEvent(event, mouseX, mouseY, mouseMoved, wheel);
         }
+        if (!window.isOpen()) break;
 
-        // Очистка буферов
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glLoadIdentity();
+        // Одно смещение камеры за все события кадра
+        if (mouseMoved) handleMouseMove(camera, mouseX, mouseY);
+        if (wheel != 0.0f) {
+            camera.distance -= wheel * zoomStep;
+            camera.distance = std::max(camera.minDistance, std::min(camera.maxDistance, camera.distance));
+        }
 
-        // Вычисление позиции камеры
-        float x = camera.distance * cos(camera.pitch * PI / 180.0f) * cos(camera.yaw * PI / 180.0f);
-        float y = camera.distance * sin(camera.pitch * PI / 180.0f);
-        float z = camera.distance * cos(camera.pitch * PI / 180.0f) * sin(camera.yaw * PI / 180.0f);
+        // После простоя шаг сглаживания считается как за один кадр
+        float dt = std::min(frameClock.restart().asSeconds(), 1.0f / 30);
+        if (approach(pose, camera, dt, smoothing)) redraw = true;
+        if (!redraw && !continuous) continue;
+        redraw = false;
 
-        // Установка камеры
-        glLoadIdentity();
-        glTranslatef(0.0f, 0.0f, -camera.distance);
-        glRotatef(camera.pitch, 1.0f, 0.0f, 0.0f);
-        glRotatef(camera.yaw, 0.0f, 1.0f, 0.0f);
+        size_t level = sphereLod(sphere, pose, viewportHeight);
+        if (fieldCount == 0 && level != shownLevel) {
+            shownLevel = level;
+            std::cout << "Сфера " << kindName(sphereKind) << ": уровень " << level + 1 << " из "
+                      << sphere.meshes().size() << ", треугольников: "
+                      << sphere.meshes()[level].triangleCount() << std::endl;
+        }
 
-        // Отрисовка сферы
-        drawSphere(sphereVertices);
+        auto start = std::chrono::steady_clock::now();
+        drawFrame(pose, sphere, fieldCount > 0 ? &field : nullptr, viewportHeight);
 
         // Отображение кадра
         window.display();
+        drawMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Сколько сфер отброшено и сколько времени заняли отсечение и кадр
+        // (от начала отрисовки до показа, простой не считается)
+        if (fieldCount > 0 && statsClock.getElapsedTime().asSeconds() >= 1.0f) {
+            statsClock.restart();
+            const FieldStats& stats = field.stats;
+            size_t frames = std::max<size_t>(stats.frames, 1);
+            size_t inFrustum = stats.inFrustum / frames, occluded = stats.occluded / frames;
+            std::ostringstream title;
+            title << "Orbital Camera: " << inFrustum - occluded << " of " << field.size() << " spheres drawn, "
+                  << drawMs / frames << " ms/frame";
+            window.setTitle(title.str());
+            std::cout << "Сфер нарисовано: " << inFrustum - occluded << ", вне пирамиды: "
+                      << field.size() - inFrustum << ", перекрыто: " << occluded
+                      << "; отсечение: " << stats.cullMs / frames << " мс, кадр: "
+                      << drawMs / frames << " мс, кадров: " << stats.frames << std::endl;
+            field.stats = FieldStats();
+            drawMs = 0.0;
+        }
     }
 
+    field.destroy();
+    sphere.destroy();
     return 0;
 }
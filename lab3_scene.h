@@ -0,0 +1,321 @@
+#pragma once
+
+// Сцена лабораторной работы 3: сетки единичной сферы разной детализации
+// (по параллелям и меридианам или из икосаэдра), выбор детализации по
+// размеру сферы на экране, поле сфер и отсечение его пирамидой видимости
+// по иерархии ограничивающих объёмов. Не зависит ни от SFML, ни от OpenGL
+
+#include "cg_math.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Сфера радиуса 1 с центром в начале координат. Нормаль вершины совпадает
+// с её положением, поэтому хранятся только координаты
+struct SphereMesh {
+    std::vector<float> positions;   // x, y, z подряд
+    std::vector<uint32_t> indices;  // треугольники, против часовой стрелки снаружи
+    float edgeLength = 0.0f;        // средняя длина ребра
+
+    size_t vertexCount() const { return positions.size() / 3; }
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+inline float averageEdgeLength(const SphereMesh& mesh) {
+    double sum = 0.0;
+    for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+        for (int k = 0; k < 3; ++k) {
+            const float* a = &mesh.positions[3 * mesh.indices[t + k]];
+            const float* b = &mesh.positions[3 * mesh.indices[t + (k + 1) % 3]];
+            sum += std::sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) +
+                             (a[2] - b[2]) * (a[2] - b[2]));
+        }
+    }
+    return mesh.indices.empty() ? 0.0f : static_cast<float>(sum / mesh.indices.size());
+}
+
+// Сфера по параллелям и меридианам: segments меридианов и segments / 2
+// поясов. Полюс - одна вершина, шов по нулевому меридиану не дублируется
+inline SphereMesh makeUvSphere(int segments) {
+    const int rings = segments / 2;
+    SphereMesh mesh;
+    mesh.positions.reserve(3 * (static_cast<size_t>(rings - 1) * segments + 2));
+    mesh.positions.insert(mesh.positions.end(), {0.0f, 1.0f, 0.0f});
+    for (int i = 1; i < rings; ++i) {
+        float theta = PI * i / rings;
+        for (int j = 0; j < segments; ++j) {
+            float phi = 2 * PI * j / segments;
+            mesh.positions.insert(mesh.positions.end(), {std::sin(theta) * std::cos(phi), std::cos(theta),
+                                                         std::sin(theta) * std::sin(phi)});
+        }
+    }
+    mesh.positions.insert(mesh.positions.end(), {0.0f, -1.0f, 0.0f});
+
+    // Вершина j пояса i (пояса с 1 по rings - 1)
+    auto at = [&](int i, int j) { return static_cast<uint32_t>(1 + (i - 1) * segments + j % segments); };
+    const uint32_t south = static_cast<uint32_t>(mesh.vertexCount() - 1);
+    mesh.indices.reserve(6 * static_cast<size_t>(rings - 1) * segments);
+    for (int j = 0; j < segments; ++j) {
+        mesh.indices.insert(mesh.indices.end(), {0u, at(1, j + 1), at(1, j)});
+        for (int i = 1; i + 1 < rings; ++i) {
+            uint32_t a = at(i, j), b = at(i, j + 1), c = at(i + 1, j + 1), d = at(i + 1, j);
+            mesh.indices.insert(mesh.indices.end(), {a, b, c, a, c, d});
+        }
+        mesh.indices.insert(mesh.indices.end(), {south, at(rings - 1, j), at(rings - 1, j + 1)});
+    }
+    mesh.edgeLength = averageEdgeLength(mesh);
+    return mesh;
+}
+
+// Сфера из икосаэдра: каждое деление разбивает треугольник на четыре,
+// новые вершины выносятся на сферу. Треугольники почти одинаковые,
+// без сгущения у полюсов
+inline SphereMesh makeIcosphere(int subdivisions) {
+    const float t = (1.0f + std::sqrt(5.0f)) / 2;
+    const float s = 1.0f / std::sqrt(1 + t * t);
+    SphereMesh mesh;
+    mesh.positions = {
+        -s, t * s, 0, s, t * s, 0, -s, -t * s, 0, s, -t * s, 0,
+        0, -s, t * s, 0, s, t * s, 0, -s, -t * s, 0, s, -t * s,
+        t * s, 0, -s, t * s, 0, s, -t * s, 0, -s, -t * s, 0, s,
+    };
+    mesh.indices = {
+        0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+        1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+        4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1,
+    };
+
+    for (int level = 0; level < subdivisions; ++level) {
+        // Середина ребра общая для двух соседних треугольников
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> middles;
+        auto middle = [&](uint32_t a, uint32_t b) {
+            auto key = std::make_pair(std::min(a, b), std::max(a, b));
+            auto found = middles.find(key);
+            if (found != middles.end()) return found->second;
+            float p[3], length = 0.0f;
+            for (int k = 0; k < 3; ++k) {
+                p[k] = mesh.positions[3 * a + k] + mesh.positions[3 * b + k];
+                length += p[k] * p[k];
+            }
+            length = std::sqrt(length);
+            uint32_t index = static_cast<uint32_t>(mesh.vertexCount());
+            mesh.positions.insert(mesh.positions.end(), {p[0] / length, p[1] / length, p[2] / length});
+            middles.emplace(key, index);
+            return index;
+        };
+
+        std::vector<uint32_t> indices;
+        indices.reserve(4 * mesh.indices.size());
+        for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+            uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+            uint32_t ab = middle(a, b), bc = middle(b, c), ca = middle(c, a);
+            indices.insert(indices.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        mesh.indices = std::move(indices);
+    }
+    mesh.edgeLength = averageEdgeLength(mesh);
+    return mesh;
+}
+
+enum class SphereKind { Uv, Icosphere };
+
+// Уровни детализации от грубого к подробному
+inline std::vector<SphereMesh> makeSphereLods(SphereKind kind) {
+    std::vector<SphereMesh> levels;
+    if (kind == SphereKind::Uv) {
+        for (int segments : {8, 16, 32, 64, 128}) levels.push_back(makeUvSphere(segments));
+    }
+    else {
+        for (int subdivisions = 1; subdivisions <= 5; ++subdivisions) levels.push_back(makeIcosphere(subdivisions));
+    }
+    return levels;
+}
+
+// Радиус проекции сферы в пикселях: сфера радиуса radius, центр на
+// расстоянии distance от камеры, вертикальный угол обзора fovY (в
+// градусах) на viewportHeight пикселей
+inline float projectedRadius(float radius, float distance, float fovY, int viewportHeight) {
+    float pixelsPerUnit = viewportHeight / (2 * std::tan(radians(fovY) / 2));
+    // Камера внутри сферы - сфера закрывает весь экран
+    if (distance <= radius) return static_cast<float>(viewportHeight);
+    return radius / std::sqrt(distance * distance - radius * radius) * pixelsPerUnit;
+}
+
+// Самый грубый уровень, рёбра которого на экране не длиннее maxEdgePixels;
+// если такого нет - самый подробный
+inline size_t selectLod(const std::vector<SphereMesh>& levels, float projectedRadius, float maxEdgePixels) {
+    for (size_t i = 0; i < levels.size(); ++i) {
+        if (levels[i].edgeLength * projectedRadius <= maxEdgePixels) return i;
+    }
+    return levels.size() - 1;
+}
+
+// Поле сфер для режима lab3 --field: центры равномерно в кубе, радиусы и
+// цвета случайные, но одинаковые при каждом запуске
+struct SphereInstance {
+    float center[3];
+    float radius;
+    float color[3];
+};
+
+inline std::vector<SphereInstance> makeSphereField(size_t count, float spacing) {
+    // Куб, в котором на сферу приходится spacing^3 объёма
+    const float side = spacing * std::cbrt(static_cast<float>(count));
+    uint32_t state = 12345;
+    auto random = [&] {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    std::vector<SphereInstance> spheres(count);
+    for (SphereInstance& sphere : spheres) {
+        for (float& c : sphere.center) c = (random() - 0.5f) * side;
+        sphere.radius = spacing * (0.1f + 0.2f * random());
+        for (float& c : sphere.color) c = 0.3f + 0.7f * random();
+    }
+    return spheres;
+}
+
+// Пирамида видимости: шесть плоскостей ax + by + cz + d >= 0 внутри,
+// нормали единичные, чтобы сравнивать расстояния с радиусами
+struct Frustum {
+    float planes[6][4];
+};
+
+// Плоскости из матрицы проекция * модель-вид (метод Грибба - Хартманна):
+// строка w плюс или минус строки x, y, z
+inline Frustum extractFrustum(const float clip[16]) {
+    Frustum frustum;
+    for (int i = 0; i < 6; ++i) {
+        int axis = i / 2;
+        float sign = i % 2 == 0 ? 1.0f : -1.0f;
+        float* plane = frustum.planes[i];
+        for (int k = 0; k < 4; ++k) plane[k] = clip[k * 4 + 3] + sign * clip[k * 4 + axis];
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for (int k = 0; k < 4; ++k) plane[k] /= length;
+    }
+    return frustum;
+}
+
+inline bool sphereVisible(const Frustum& frustum, const float center[3], float radius) {
+    for (const auto& plane : frustum.planes) {
+        if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius) return false;
+    }
+    return true;
+}
+
+struct Aabb {
+    float min[3], max[3];
+};
+
+// Иерархия ограничивающих объёмов над полем сфер. Узлы лежат в порядке
+// обхода в глубину: левый потомок сразу за родителем, правый - по индексу.
+// Сферы переставлены так, что у каждого узла они идут подряд
+struct BvhNode {
+    Aabb box;
+    uint32_t first;   // первая сфера узла
+    uint32_t count;   // число сфер узла
+    uint32_t right;   // правый потомок; 0 - лист
+};
+
+// Лист, попавший в пирамиду: его видимые сферы - visible[first, first + count)
+struct VisibleLeaf {
+    uint32_t node;
+    uint32_t first;
+    uint32_t count;
+};
+
+class SphereBvh {
+public:
+    static const uint32_t LEAF_SIZE = 8;
+
+    void build(std::vector<SphereInstance> instances) {
+        spheres = std::move(instances);
+        nodes.clear();
+        nodes.reserve(2 * spheres.size() / LEAF_SIZE + 1);
+        if (!spheres.empty()) buildNode(0, static_cast<uint32_t>(spheres.size()));
+    }
+
+    const std::vector<SphereInstance>& instances() const { return spheres; }
+    const std::vector<BvhNode>& tree() const { return nodes; }
+
+    // Сферы в пирамиде. Узел целиком вне любой плоскости отбрасывается вместе
+    // с поддеревом, а плоскости, которые узел целиком проходит, у потомков
+    // не проверяются
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible, std::vector<VisibleLeaf>& leaves) const {
+        visible.clear();
+        leaves.clear();
+        if (!nodes.empty()) cullNode(frustum, 0, 0x3F, visible, leaves);
+    }
+
+private:
+    uint32_t buildNode(uint32_t first, uint32_t count) {
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({});
+        Aabb box = {{INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY}};
+        Aabb centers = box;
+        for (uint32_t i = first; i < first + count; ++i) {
+            const SphereInstance& s = spheres[i];
+            for (int k = 0; k < 3; ++k) {
+                box.min[k] = std::min(box.min[k], s.center[k] - s.radius);
+                box.max[k] = std::max(box.max[k], s.center[k] + s.radius);
+                centers.min[k] = std::min(centers.min[k], s.center[k]);
+                centers.max[k] = std::max(centers.max[k], s.center[k]);
+            }
+        }
+        uint32_t right = 0;
+        if (count > LEAF_SIZE) {
+            // Деление пополам по медиане вдоль самой длинной стороны центров
+            int axis = 0;
+            for (int k = 1; k < 3; ++k) {
+                if (centers.max[k] - centers.min[k] > centers.max[axis] - centers.min[axis]) axis = k;
+            }
+            uint32_t half = count / 2;
+            std::nth_element(spheres.begin() + first, spheres.begin() + first + half, spheres.begin() + first + count,
+                             [axis](const SphereInstance& a, const SphereInstance& b) {
+                                 return a.center[axis] < b.center[axis];
+                             });
+            buildNode(first, half);
+            right = buildNode(first + half, count - half);
+        }
+        nodes[index] = {box, first, count, right};
+        return index;
+    }
+
+    void cullNode(const Frustum& frustum, uint32_t index, int mask, std::vector<uint32_t>& visible,
+                  std::vector<VisibleLeaf>& leaves) const {
+        const BvhNode& node = nodes[index];
+        for (int i = 0; i < 6; ++i) {
+            if (!(mask & (1 << i))) continue;
+            const float* plane = frustum.planes[i];
+            // Самая дальняя и самая ближняя вдоль нормали вершины коробки
+            float farthest = plane[3], nearest = plane[3];
+            for (int k = 0; k < 3; ++k) {
+                float a = plane[k] * node.box.min[k], b = plane[k] * node.box.max[k];
+                farthest += std::max(a, b);
+                nearest += std::min(a, b);
+            }
+            if (farthest < 0.0f) return;
+            if (nearest >= 0.0f) mask &= ~(1 << i);
+        }
+
+        if (node.right) {
+            cullNode(frustum, index + 1, mask, visible, leaves);
+            cullNode(frustum, node.right, mask, visible, leaves);
+            return;
+        }
+        VisibleLeaf leaf = {index, static_cast<uint32_t>(visible.size()), 0};
+        for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+            if (mask == 0 || sphereVisible(frustum, spheres[i].center, spheres[i].radius)) visible.push_back(i);
+        }
+        leaf.count = static_cast<uint32_t>(visible.size()) - leaf.first;
+        if (leaf.count > 0) leaves.push_back(leaf);
+    }
+
+    std::vector<SphereInstance> spheres;
+    std::vector<BvhNode> nodes;
+};
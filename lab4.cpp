@@ -1,34 +1,29 @@
+#include "gl_loader.h"
+#include "lab4_scene.h"
+#include "light_clusters.h"
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <SFML/Window.hpp>
-#ifdef __APPLE__
-    #include <OpenGL/glu.h>
-#else
-    #include <GL/glu.h>
-#endif
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
 // Параметры вращения
 float angleX = 0.0f;
 float angleY = 0.0f;
 
+// Анимация идёт по времени кадра, а не по числу кадров: без вертикальной
+// синхронизации (сцена с прожекторами) кадров в секунду намного больше 60
+const float ROTATION_SPEED = 30.0f;     // градусов в секунду
+const float MAX_FRAME_TIME = 0.1f;      // после долгой паузы сцена не перескакивает
+
 // Параметры прожектора
-struct SpotLight {
-    float position[4] = {0.0f, 5.0f, 0.0f, 1.0f};
-    float direction[3] = {0.0f, -1.0f, 0.0f};
-    float ambient[4] = {0.2f, 0.2f, 0.2f, 1.0f};
-    float diffuse[4] = {1.0f, 1.0f, 1.0f, 1.0f};
-    float specular[4] = {1.0f, 1.0f, 1.0f, 1.0f};
-    float cutoff = 45.0f;
-    float exponent = 2.0f;
-    
-    // Коэффициенты затухания
-    float constant = 1.0f;
-    float linear = 0.09f;
-    float quadratic = 0.032f;
-} spotlight;
+SpotLight spotlight;
 
 // Характеристики материала
 GLfloat material_ambient[] = {0.2f, 0.2f, 0.2f, 1.0f};
@@ -47,59 +42,1163 @@ const unsigned int WINDOW_WIDTH = 800;
 const unsigned int WINDOW_HEIGHT = 600;
 const std::string WINDOW_TITLE = "Cylinder with Spotlight"; // Меняем на английский заголовок
 
-void drawCylinder() {
-    std::vector<float> vertices;
-    std::vector<float> normals;
-    
-    // Генерация вершин и нормалей для боковой поверхности
-    for (int i = 0; i <= SLICES; ++i) {
-        float theta = (2.0f * M_PI * i) / SLICES;
-        float x = RADIUS * cos(theta);
-        float z = RADIUS * sin(theta);
-        
-        // Нормаль для текущей точки
-        float nx = cos(theta);
-        float nz = sin(theta);
-        
-        vertices.push_back(x);
-        vertices.push_back(HEIGHT/2);
-        vertices.push_back(z);
-        normals.push_back(nx);
-        normals.push_back(0.0f);
-        normals.push_back(nz);
-        
-        vertices.push_back(x);
-        vertices.push_back(-HEIGHT/2);
-        vertices.push_back(z);
-        normals.push_back(nx);
-        normals.push_back(0.0f);
-        normals.push_back(nz);
+// Сцена со многими прожекторами: цилиндры в узлах решётки на полу
+const float FLOOR_HALF_SIZE = 25.0f;
+const int CYLINDER_GRID = 7;
+const float CYLINDER_SPACING = 6.0f;
+const float FIELD_CAMERA_DISTANCE = 45.0f;
+const float FIELD_CAMERA_PITCH = 35.0f;
+const int MOVING_CYLINDERS = 4;         // ходят по проходам между рядами
+const int FIELD_SHADOW_TILE = 256;      // сторона ячейки атласа теней, 64 прожектора с тенью
+
+// Дальность карты тени единственного прожектора
+const float SPOTLIGHT_SHADOW_RANGE = 20.0f;
+
+// Угол обзора и плоскости отсечения
+const float FOV_Y = 45.0f;
+const float Z_NEAR = 0.1f;
+const float Z_FAR = 100.0f;
+
+// Сетка строится один раз; за кадр - один вызов glDrawElements без
+// выделения памяти. Без буферов те же массивы передаются из памяти
+class MeshBuffers {
+public:
+    void create(const TriangleMesh& triangles) {
+        destroy();
+        mesh = triangles;
+        if (gl::GenBuffers) {
+            gl::GenBuffers(1, &vertexBuffer);
+            gl::BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            gl::BufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(MeshVertex), mesh.vertices.data(),
+                           GL_STATIC_DRAW);
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            gl::GenBuffers(1, &indexBuffer);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            gl::BufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(),
+                           GL_STATIC_DRAW);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
     }
-    
-    glBegin(GL_TRIANGLE_STRIP);
-    for (size_t i = 0; i < vertices.size()/3; ++i) {
-        glNormal3f(normals[i*3], normals[i*3+1], normals[i*3+2]);
-        glVertex3f(vertices[i*3], vertices[i*3+1], vertices[i*3+2]);
+
+    void destroy() {
+        if (vertexBuffer) gl::DeleteBuffers(1, &vertexBuffer);
+        if (indexBuffer) gl::DeleteBuffers(1, &indexBuffer);
+        vertexBuffer = indexBuffer = 0;
     }
-    glEnd();
-    
-    // Отрисовка оснований
-    for (int side = 0; side <= 1; ++side) {
-        float y = (side == 0) ? -HEIGHT/2 : HEIGHT/2;
-        float ny = (side == 0) ? -1.0f : 1.0f;
-        
-        glBegin(GL_TRIANGLE_FAN);
-        glNormal3f(0.0f, ny, 0.0f);
-        glVertex3f(0.0f, y, 0.0f);
-        
-        for (int i = 0; i <= SLICES; ++i) {
-            float theta = (side == 0) ? -2.0f * M_PI * i / SLICES : 2.0f * M_PI * i / SLICES;
-            float x = RADIUS * cos(theta);
-            float z = RADIUS * sin(theta);
-            glVertex3f(x, y, z);
+
+    void bind() const {
+        const char* vertices = reinterpret_cast<const char*>(mesh.vertices.data());
+        if (vertexBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            vertices = nullptr;
+        }
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), vertices + offsetof(MeshVertex, position));
+        glNormalPointer(GL_FLOAT, sizeof(MeshVertex), vertices + offsetof(MeshVertex, normal));
+    }
+
+    void drawElements() const {
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT,
+                       vertexBuffer ? nullptr : mesh.indices.data());
+    }
+
+    void unbind() const {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        if (vertexBuffer) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    }
+
+    void draw() const {
+        bind();
+        drawElements();
+        unbind();
+    }
+
+private:
+    TriangleMesh mesh;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+};
+
+MeshBuffers cylinder;
+MeshBuffers floorMesh;
+
+// Выборка из атласа теней (ShadowAtlas ниже): matrix переводит точку из
+// координат вида в текстуру атласа, bounds - ячейка прожектора, за которую
+// не выходят четыре выборки со сдвигом на полтекселя. Вместе с линейной
+// фильтрацией при сравнении это PCF 3x3 с весами. Подставляется в конец
+// шейдеров, которые объявляют shadowFactor заранее
+const char* SHADOW_LOOKUP = R"(
+uniform sampler2DShadow shadowAtlas;
+const float SHADOW_TEXEL = 1.0 / 2048.0;
+
+float shadowFactor(mat4 matrix, vec4 bounds, vec3 position) {
+    vec4 coord = matrix * vec4(position, 1.0);
+    if (coord.w <= 0.0) return 1.0;
+    vec3 p = coord.xyz / coord.w;
+    p.z = min(p.z, 1.0);
+    float h = 0.5 * SHADOW_TEXEL;
+    float lit = shadow2D(shadowAtlas, vec3(clamp(p.xy + vec2(-h, -h), bounds.xy, bounds.zw), p.z)).r +
+                shadow2D(shadowAtlas, vec3(clamp(p.xy + vec2(h, -h), bounds.xy, bounds.zw), p.z)).r +
+                shadow2D(shadowAtlas, vec3(clamp(p.xy + vec2(-h, h), bounds.xy, bounds.zw), p.z)).r +
+                shadow2D(shadowAtlas, vec3(clamp(p.xy + vec2(h, h), bounds.xy, bounds.zw), p.z)).r;
+    return 0.25 * lit;
+}
+)";
+
+// Освещение прожектором в каждом фрагменте. Параметры прожектора приходят
+// блоком однородных переменных, материал и фоновый свет сцены - из
+// состояния glMaterialfv/glLightModel. Формула та же, что у фиксированного
+// конвейера для GL_LIGHT0: конус с показателем, затухание 1 / (kc + kl d + kq d^2)
+// и Фонг-Блинн с бесконечно удалённым наблюдателем
+const char* SPOTLIGHT_VERTEX_SHADER = R"(
+#version 120
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+
+void main() {
+    eyePosition = vec3(gl_ModelViewMatrix * gl_Vertex);
+    eyeNormal = gl_NormalMatrix * gl_Normal;
+    gl_Position = ftransform();
+}
+)";
+
+const char* SPOTLIGHT_FRAGMENT_SHADER = R"(
+#version 120
+#extension GL_ARB_uniform_buffer_object : require
+layout(std140) uniform SpotLightBlock {
+    vec4 lightPosition;     // в координатах вида
+    vec4 spotDirection;     // w - косинус угла отсечки
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+    vec4 attenuation;       // постоянный, линейный, квадратичный коэффициенты и показатель конуса
+    mat4 shadowMatrix;
+    vec4 shadowBounds;      // пустой прямоугольник - без тени
+};
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+
+float shadowFactor(mat4 matrix, vec4 bounds, vec3 position);
+
+void main() {
+    vec3 normal = normalize(eyeNormal);
+    vec3 toLight = lightPosition.xyz - eyePosition;
+    float distance = length(toLight);
+    vec3 light = toLight / distance;
+    vec4 color = gl_FrontMaterial.emission + gl_LightModel.ambient * gl_FrontMaterial.ambient;
+    float spot = dot(-light, normalize(spotDirection.xyz));
+    if (spot >= spotDirection.w) {
+        float factor = pow(spot, attenuation.w) /
+                       (attenuation.x + attenuation.y * distance + attenuation.z * distance * distance);
+        float diffuse = max(dot(normal, light), 0.0);
+        vec4 lit = lightDiffuse * gl_FrontMaterial.diffuse * diffuse;
+        if (diffuse > 0.0) {
+            vec3 halfway = normalize(light + vec3(0.0, 0.0, 1.0));
+            lit += lightSpecular * gl_FrontMaterial.specular *
+                   pow(max(dot(normal, halfway), 0.0), gl_FrontMaterial.shininess);
+            if (shadowBounds.z > shadowBounds.x) lit *= shadowFactor(shadowMatrix, shadowBounds, eyePosition);
+        }
+        color += factor * (lightAmbient * gl_FrontMaterial.ambient + lit);
+    }
+    gl_FragColor = vec4(clamp(color.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);
+}
+)";
+
+// Блок SpotLightBlock в раскладке std140: только vec4 и mat4, поэтому без пропусков
+struct SpotLightBlock {
+    float position[4];
+    float direction[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float attenuation[4];
+    float shadow[20];   // матрица и ячейка атласа теней
+};
+
+// Точка привязки буфера прожектора
+const GLuint SPOTLIGHT_BINDING = 0;
+
+class SpotLightShader {
+public:
+    bool create(std::string& error) {
+        destroy();
+        if (!gl::hasUniformBuffers()) {
+            error = "буферы однородных переменных не поддерживаются";
+            return false;
+        }
+        std::string fragment = std::string(SPOTLIGHT_FRAGMENT_SHADER) + SHADOW_LOOKUP;
+        if (!gl::buildProgram(SPOTLIGHT_VERTEX_SHADER, fragment.c_str(), {}, program, error)) return false;
+        GLuint block = gl::GetUniformBlockIndex(program, "SpotLightBlock");
+        if (block == GL_INVALID_INDEX) {
+            destroy();
+            error = "в программе нет блока SpotLightBlock";
+            return false;
+        }
+        gl::UniformBlockBinding(program, block, SPOTLIGHT_BINDING);
+        gl::UseProgram(program);
+        gl::Uniform1i(gl::GetUniformLocation(program, "shadowAtlas"), 0);
+        gl::UseProgram(0);
+        gl::GenBuffers(1, &uniformBuffer);
+        gl::BindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        gl::BufferData(GL_UNIFORM_BUFFER, sizeof(SpotLightBlock), nullptr, GL_DYNAMIC_DRAW);
+        gl::BindBuffer(GL_UNIFORM_BUFFER, 0);
+        return true;
+    }
+
+    void destroy() {
+        if (uniformBuffer) gl::DeleteBuffers(1, &uniformBuffer);
+        if (program) gl::DeleteProgram(program);
+        uniformBuffer = program = 0;
+    }
+
+    bool isReady() const { return program != 0; }
+
+    // Прожектор в координатах вида, как его переводит glLightfv при
+    // загруженной видовой матрице modelView; shadow - матрица и ячейка
+    // атласа теней (ShadowAtlas::shadowData), nullptr - без тени
+    void setLight(const SpotLight& light, const GLfloat modelView[16], const float* shadow = nullptr) {
+        SpotLightBlock block;
+        for (int i = 0; i < 4; ++i) {
+            block.position[i] = modelView[i] * light.position[0] + modelView[4 + i] * light.position[1] +
+                                modelView[8 + i] * light.position[2] + modelView[12 + i] * light.position[3];
+        }
+        for (int i = 0; i < 3; ++i) {
+            block.direction[i] = modelView[i] * light.direction[0] + modelView[4 + i] * light.direction[1] +
+                                 modelView[8 + i] * light.direction[2];
+        }
+        block.direction[3] = std::cos(radians(light.cutoff));
+        for (int i = 0; i < 4; ++i) {
+            block.ambient[i] = light.ambient[i];
+            block.diffuse[i] = light.diffuse[i];
+            block.specular[i] = light.specular[i];
+        }
+        block.attenuation[0] = light.constant;
+        block.attenuation[1] = light.linear;
+        block.attenuation[2] = light.quadratic;
+        block.attenuation[3] = light.exponent;
+        if (shadow) std::copy(shadow, shadow + 20, block.shadow);
+        else std::fill(block.shadow, block.shadow + 20, 0.0f);
+
+        gl::BindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        gl::BufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+        gl::BindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void begin() const {
+        gl::UseProgram(program);
+        gl::BindBufferBase(GL_UNIFORM_BUFFER, SPOTLIGHT_BINDING, uniformBuffer);
+    }
+
+    void end() const {
+        gl::UseProgram(0);
+    }
+
+private:
+    GLuint program = 0;
+    GLuint uniformBuffer = 0;
+} spotlightShader;
+
+// Освещение в каждом фрагменте шейдером или по вершинам фиксированным конвейером
+bool perFragment = true;
+
+// Свет одного из многих прожекторов, общий для прямого и отложенного
+// освещения. Прожекторы в координатах вида лежат в текстуре из буфера по
+// четыре RGBA на источник
+const char* SPOTLIGHT_FIELD_COMMON = R"(
+#version 120
+#extension GL_EXT_gpu_shader4 : require
+#extension GL_ARB_uniform_buffer_object : require
+uniform samplerBuffer lights;
+uniform samplerBuffer shadowMatrices;   // по пять RGBA на ячейку атласа теней
+
+float shadowFactor(mat4 matrix, vec4 bounds, vec3 position);
+
+vec3 spotLight(int light, vec3 position, vec3 normal, vec3 diffuseColor, vec3 specularColor, float shininess) {
+    vec4 source = texelFetchBuffer(lights, 4 * light);          // w - дальность света
+    vec4 direction = texelFetchBuffer(lights, 4 * light + 1);   // w - косинус угла отсечки
+    vec4 color = texelFetchBuffer(lights, 4 * light + 2);       // w - показатель конуса
+    vec4 attenuation = texelFetchBuffer(lights, 4 * light + 3);  // w - ячейка тени + 1
+    vec3 toLight = source.xyz - position;
+    float distance = length(toLight);
+    vec3 l = toLight / distance;
+    float spot = dot(-l, direction.xyz);
+    if (spot < direction.w || distance >= source.w) return vec3(0.0);
+
+    // Затухание с плавным спадом до нуля на дальности света
+    float ratio = distance / source.w;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    float factor = pow(spot, color.w) * window * window /
+                   (attenuation.x + attenuation.y * distance + attenuation.z * distance * distance);
+    float diffuse = max(dot(normal, l), 0.0);
+    vec3 result = diffuseColor * diffuse;
+    if (diffuse > 0.0) {
+        vec3 halfway = normalize(l + vec3(0.0, 0.0, 1.0));
+        result += specularColor * pow(max(dot(normal, halfway), 0.0), shininess);
+        if (attenuation.w > 0.0) {
+            int cell = 5 * (int(attenuation.w) - 1);
+            mat4 matrix = mat4(texelFetchBuffer(shadowMatrices, cell), texelFetchBuffer(shadowMatrices, cell + 1),
+                               texelFetchBuffer(shadowMatrices, cell + 2), texelFetchBuffer(shadowMatrices, cell + 3));
+            result *= shadowFactor(matrix, texelFetchBuffer(shadowMatrices, cell + 4), position);
+        }
+    }
+    return factor * color.rgb * result;
+}
+)";
+
+// Прямое освещение по кластерам: для каждого кластера - начало и длина его
+// списка, списки номеров прожекторов подряд - в двух других текстурах из
+// буферов. Фрагмент находит свой кластер по положению на экране и глубине
+// и перебирает только его список; при depth.w = 1 перебираются все
+// прожекторы (для сравнения)
+const char* CLUSTERED_FRAGMENT_SHADER = R"(
+uniform usamplerBuffer clusters;
+uniform usamplerBuffer lightIndices;
+layout(std140) uniform ClusterGrid {
+    vec4 grid;      // столбцы, строки, слои, сторона квадрата в пикселях
+    vec4 depth;     // ближняя плоскость, множитель номера слоя, число прожекторов, перебор всех
+};
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+
+vec3 shade(int light, vec3 normal) {
+    return spotLight(light, eyePosition, normal, gl_FrontMaterial.diffuse.rgb, gl_FrontMaterial.specular.rgb,
+                     gl_FrontMaterial.shininess);
+}
+
+void main() {
+    vec3 normal = normalize(eyeNormal);
+    vec3 color = gl_FrontMaterial.emission.rgb + gl_LightModel.ambient.rgb * gl_FrontMaterial.ambient.rgb;
+    if (depth.w > 0.5) {
+        int count = int(depth.z);
+        for (int i = 0; i < count; ++i) color += shade(i, normal);
+    }
+    else {
+        ivec2 tile = min(ivec2(gl_FragCoord.xy / grid.w), ivec2(grid.xy) - 1);
+        int slice = int(clamp(log(-eyePosition.z / depth.x) * depth.y, 0.0, grid.z - 1.0));
+        int cluster = (slice * int(grid.y) + tile.y) * int(grid.x) + tile.x;
+        uvec4 range = texelFetchBuffer(clusters, cluster);
+        for (int k = 0; k < int(range.y); ++k) {
+            color += shade(int(texelFetchBuffer(lightIndices, int(range.x) + k).x), normal);
+        }
+    }
+    gl_FragColor = vec4(clamp(color, 0.0, 1.0), gl_FrontMaterial.diffuse.a);
+}
+)";
+
+// Блок ClusterGrid в раскладке std140
+struct ClusterGridBlock {
+    float grid[4];
+    float depth[4];
+};
+
+const GLuint CLUSTER_GRID_BINDING = 1;
+
+class ClusteredLighting {
+public:
+    bool create(std::string& error) {
+        destroy();
+        if (!gl::hasUniformBuffers() || !gl::hasTextureBuffers()) {
+            error = "буферы однородных переменных или текстуры из буферов не поддерживаются";
+            return false;
+        }
+        std::string fragment = std::string(SPOTLIGHT_FIELD_COMMON) + CLUSTERED_FRAGMENT_SHADER + SHADOW_LOOKUP;
+        if (!gl::buildProgram(SPOTLIGHT_VERTEX_SHADER, fragment.c_str(), {}, program, error)) return false;
+        GLuint block = gl::GetUniformBlockIndex(program, "ClusterGrid");
+        if (block == GL_INVALID_INDEX) {
+            destroy();
+            error = "в программе нет блока ClusterGrid";
+            return false;
+        }
+        gl::UniformBlockBinding(program, block, CLUSTER_GRID_BINDING);
+        gl::UseProgram(program);
+        const char* samplers[5] = {"lights", "clusters", "lightIndices", "shadowMatrices", "shadowAtlas"};
+        for (int i = 0; i < 5; ++i) gl::Uniform1i(gl::GetUniformLocation(program, samplers[i]), i);
+        gl::UseProgram(0);
+
+        gl::GenBuffers(1, &gridBuffer);
+        gl::BindBuffer(GL_UNIFORM_BUFFER, gridBuffer);
+        gl::BufferData(GL_UNIFORM_BUFFER, sizeof(ClusterGridBlock), nullptr, GL_DYNAMIC_DRAW);
+        gl::BindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // Буферы и текстуры, которые их читают
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        gl::GenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; ++i) {
+            gl::BindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            gl::BufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            gl::TexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        gl::BindBuffer(GL_TEXTURE_BUFFER, 0);
+        return true;
+    }
+
+    void destroy() {
+        if (buffers[0]) {
+            gl::DeleteBuffers(3, buffers);
+            glDeleteTextures(3, textures);
+        }
+        if (gridBuffer) gl::DeleteBuffers(1, &gridBuffer);
+        if (program) gl::DeleteProgram(program);
+        buffers[0] = buffers[1] = buffers[2] = gridBuffer = program = 0;
+    }
+
+    bool isReady() const { return program != 0; }
+
+    // Прожекторы в координатах вида, их дальность и ячейки атласа теней
+    // (пусто - без теней) за этот кадр
+    void uploadLights(const std::vector<SpotLightSource>& lights, const std::vector<float>& ranges,
+                      const std::vector<int>& shadowSlots) {
+        packed.resize(16 * lights.size());
+        for (size_t i = 0; i < lights.size(); ++i) {
+            const SpotLightSource& light = lights[i];
+            float* out = &packed[16 * i];
+            const float values[16] = {
+                light.position[0], light.position[1], light.position[2], ranges[i],
+                light.direction[0], light.direction[1], light.direction[2], std::cos(radians(light.cutoff)),
+                light.color[0], light.color[1], light.color[2], light.exponent,
+                light.constant, light.linear, light.quadratic,
+                shadowSlots.empty() ? 0.0f : static_cast<float>(shadowSlots[i] + 1),
+            };
+            std::copy(values, values + 16, out);
+        }
+        uploadBuffer(buffers[0], packed.size() * sizeof(float), packed.data());
+        lightCount = lights.size();
+    }
+
+    // Раскладка прожекторов по кластерам за этот кадр
+    void uploadClusters(const LightClusters& clusters, bool allLights) {
+        uploadBuffer(buffers[1], clusters.clusters().size() * sizeof(uint32_t), clusters.clusters().data());
+        uploadBuffer(buffers[2], clusters.indices().size() * sizeof(uint32_t), clusters.indices().data());
+
+        ClusterGridBlock block = {
+            {static_cast<float>(clusters.columnCount()), static_cast<float>(clusters.rowCount()),
+             static_cast<float>(LightClusters::SLICES), static_cast<float>(LightClusters::TILE_PIXELS)},
+            {clusters.nearPlane(), clusters.depthScale(), static_cast<float>(lightCount), allLights ? 1.0f : 0.0f},
+        };
+        gl::BindBuffer(GL_UNIFORM_BUFFER, gridBuffer);
+        gl::BufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+        gl::BindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void begin() const {
+        gl::UseProgram(program);
+        gl::BindBufferBase(GL_UNIFORM_BUFFER, CLUSTER_GRID_BINDING, gridBuffer);
+        for (int i = 0; i < 3; ++i) {
+            gl::ActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+    }
+
+    void end() const {
+        for (int i = 2; i >= 0; --i) {
+            gl::ActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        gl::UseProgram(0);
+    }
+
+    // Блоки текстур атласа теней (ShadowAtlas::bind)
+    static const int SHADOW_MATRIX_UNIT = 3;
+    static const int SHADOW_ATLAS_UNIT = 4;
+
+    // Текстура прожекторов для отложенного освещения
+    GLuint lightTexture() const { return textures[0]; }
+
+private:
+    GLuint program = 0;
+    size_t lightCount = 0;
+    GLuint gridBuffer = 0;
+    GLuint buffers[3] = {};     // прожекторы, кластеры, номера прожекторов
+    GLuint textures[3] = {};
+    std::vector<float> packed;
+
+    // Старое содержимое отбрасывается, чтобы не ждать предыдущий кадр
+    static void uploadBuffer(GLuint buffer, size_t bytes, const void* data) {
+        gl::BindBuffer(GL_TEXTURE_BUFFER, buffer);
+        gl::BufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), nullptr, GL_STREAM_DRAW);
+        if (bytes > 0) gl::BufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        gl::BindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+} clusteredLighting;
+
+// Отложенное освещение. Проход геометрии записывает в G-буфер положение
+// в координатах вида, нормаль, материал и фоновую составляющую; затем
+// каждый прожектор рисуется прямоугольником с ножницами по своим границам
+// на экране и добавляет свой свет смешиванием. Свет прожектора считается
+// один раз на видимый пиксель в его прямоугольнике, сколько бы граней ни
+// перекрывало друг друга. Зеркальный цвет материала хранится одним числом
+const char* GBUFFER_FRAGMENT_SHADER = R"(
+#version 120
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+
+void main() {
+    gl_FragData[0] = vec4(eyePosition, 1.0);
+    gl_FragData[1] = vec4(normalize(eyeNormal), gl_FrontMaterial.specular.g);
+    gl_FragData[2] = vec4(gl_FrontMaterial.diffuse.rgb, gl_FrontMaterial.shininess / 128.0);
+    gl_FragData[3] = vec4(gl_FrontMaterial.emission.rgb + gl_LightModel.ambient.rgb * gl_FrontMaterial.ambient.rgb,
+                          gl_FrontMaterial.diffuse.a);
+}
+)";
+
+// Прямоугольник во весь экран в координатах отсечения
+const char* FULLSCREEN_VERTEX_SHADER = R"(
+#version 120
+void main() {
+    gl_Position = gl_Vertex;
+}
+)";
+
+const char* DEFERRED_AMBIENT_SHADER = R"(
+#version 120
+#extension GL_EXT_gpu_shader4 : require
+uniform sampler2D ambient;
+
+void main() {
+    gl_FragColor = texelFetch2D(ambient, ivec2(gl_FragCoord.xy), 0);
+}
+)";
+
+const char* DEFERRED_LIGHT_SHADER = R"(
+uniform sampler2D positions;
+uniform sampler2D normals;
+uniform sampler2D materials;
+uniform int light;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 position = texelFetch2D(positions, pixel, 0);
+    if (position.w == 0.0) discard;
+    vec4 normal = texelFetch2D(normals, pixel, 0);
+    vec4 material = texelFetch2D(materials, pixel, 0);
+    gl_FragColor = vec4(spotLight(light, position.xyz, normal.xyz, material.rgb, vec3(normal.w), material.w * 128.0), 0.0);
+}
+)";
+
+class DeferredLighting {
+public:
+    static const int TARGETS = 4;   // положение, нормаль, материал, фоновый цвет
+
+    // Блоки текстур атласа теней (ShadowAtlas::bind)
+    static const int SHADOW_MATRIX_UNIT = TARGETS + 1;
+    static const int SHADOW_ATLAS_UNIT = TARGETS + 2;
+
+    bool create(unsigned newWidth, unsigned newHeight, std::string& error) {
+        destroy();
+        width = newWidth;
+        height = newHeight;
+        if (!gl::hasFramebuffers() || !gl::hasDrawBuffers() || !gl::hasTextureBuffers()) {
+            error = "буферы кадра с несколькими целями не поддерживаются";
+            return false;
+        }
+        if (!gl::buildProgram(SPOTLIGHT_VERTEX_SHADER, GBUFFER_FRAGMENT_SHADER, {}, geometryProgram, error) ||
+            !gl::buildProgram(FULLSCREEN_VERTEX_SHADER, DEFERRED_AMBIENT_SHADER, {}, ambientProgram, error)) {
+            destroy();
+            return false;
+        }
+        std::string fragment = std::string(SPOTLIGHT_FIELD_COMMON) + DEFERRED_LIGHT_SHADER + SHADOW_LOOKUP;
+        if (!gl::buildProgram(FULLSCREEN_VERTEX_SHADER, fragment.c_str(), {}, lightProgram, error)) {
+            destroy();
+            return false;
+        }
+        gl::UseProgram(ambientProgram);
+        gl::Uniform1i(gl::GetUniformLocation(ambientProgram, "ambient"), 3);
+        gl::UseProgram(lightProgram);
+        const char* samplers[TARGETS - 1] = {"positions", "normals", "materials"};
+        for (int i = 0; i < TARGETS - 1; ++i) gl::Uniform1i(gl::GetUniformLocation(lightProgram, samplers[i]), i);
+        gl::Uniform1i(gl::GetUniformLocation(lightProgram, "lights"), TARGETS);
+        gl::Uniform1i(gl::GetUniformLocation(lightProgram, "shadowMatrices"), SHADOW_MATRIX_UNIT);
+        gl::Uniform1i(gl::GetUniformLocation(lightProgram, "shadowAtlas"), SHADOW_ATLAS_UNIT);
+        lightLocation = gl::GetUniformLocation(lightProgram, "light");
+        gl::UseProgram(0);
+
+        // Положение в полной точности, чтобы затухание считалось как при
+        // прямом освещении; нормаль - в половинной, цвета - по байту
+        const GLint formats[TARGETS] = {GL_RGBA32F, GL_RGBA16F, GL_RGBA8, GL_RGBA8};
+        glGenTextures(TARGETS + 1, textures);
+        for (int i = 0; i <= TARGETS; ++i) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            if (i < TARGETS) {
+                glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+            }
+            else {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT,
+                             GL_UNSIGNED_INT, nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        gl::GenFramebuffers(1, &framebuffer);
+        gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        for (int i = 0; i < TARGETS; ++i) {
+            gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+        }
+        gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[TARGETS], 0);
+        bool complete = gl::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            destroy();
+            error = "G-буфер неполон";
+            return false;
+        }
+        return true;
+    }
+
+    void destroy() {
+        if (framebuffer) gl::DeleteFramebuffers(1, &framebuffer);
+        if (textures[0]) glDeleteTextures(TARGETS + 1, textures);
+        for (GLuint* program : {&geometryProgram, &ambientProgram, &lightProgram}) {
+            if (*program) gl::DeleteProgram(*program);
+            *program = 0;
+        }
+        framebuffer = 0;
+        std::fill(textures, textures + TARGETS + 1, 0);
+    }
+
+    bool isReady() const { return framebuffer != 0; }
+
+    // Проход геометрии: всё, что рисуется до endGeometry, попадает в G-буфер
+    void beginGeometry() const {
+        const GLenum targets[TARGETS] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT0 + 1, GL_COLOR_ATTACHMENT0 + 2,
+                                         GL_COLOR_ATTACHMENT0 + 3};
+        gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        gl::DrawBuffers(TARGETS, targets);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gl::UseProgram(geometryProgram);
+    }
+
+    void endGeometry() const {
+        gl::UseProgram(0);
+        gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLenum back = GL_BACK;
+        gl::DrawBuffers(1, &back);
+    }
+
+    // Фон и свет видимых прожекторов в кадр окна; возвращает число
+    // освещённых прожектором пикселей
+    size_t shade(const LightClusters& clusters, const ClusteredLighting& lighting, size_t lightCount) const {
+        glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_SCISSOR_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_LIGHTING);
+        for (int i = 0; i < TARGETS; ++i) {
+            gl::ActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        gl::ActiveTexture(GL_TEXTURE0 + TARGETS);
+        glBindTexture(GL_TEXTURE_BUFFER, lighting.lightTexture());
+
+        gl::UseProgram(ambientProgram);
+        drawFullscreen();
+
+        size_t pixels = 0;
+        gl::UseProgram(lightProgram);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_SCISSOR_TEST);
+        for (size_t i = 0; i < lightCount; ++i) {
+            int rect[4];
+            if (!clusters.lightRect(i, rect)) continue;
+            glScissor(rect[0], rect[1], rect[2], rect[3]);
+            gl::Uniform1i(lightLocation, static_cast<GLint>(i));
+            drawFullscreen();
+            pixels += static_cast<size_t>(rect[2]) * rect[3];
+        }
+        gl::UseProgram(0);
+
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        for (int i = TARGETS - 1; i >= 0; --i) {
+            gl::ActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
         }
+        glPopAttrib();
+        return pixels;
+    }
+
+private:
+    unsigned width = 0, height = 0;
+    GLuint framebuffer = 0;
+    GLuint textures[TARGETS + 1] = {};  // цели и глубина
+    GLuint geometryProgram = 0;
+    GLuint ambientProgram = 0;
+    GLuint lightProgram = 0;
+    GLint lightLocation = -1;
+
+    static void drawFullscreen() {
+        glBegin(GL_QUADS);
+        glVertex2f(-1.0f, -1.0f);
+        glVertex2f(1.0f, -1.0f);
+        glVertex2f(1.0f, 1.0f);
+        glVertex2f(-1.0f, 1.0f);
         glEnd();
     }
+} deferredLighting;
+
+// Время рисования сцены на видеокарте по запросам GL_TIME_ELAPSED.
+// Результаты читаются через несколько кадров, когда готовы
+class GpuTimer {
+public:
+    static const int QUERIES = 4;
+
+    void create() {
+        if (!gl::hasTimerQueries()) return;
+        gl::GenQueries(QUERIES, queries);
+        for (bool& flag : busy) flag = false;
+        created = true;
+    }
+
+    void destroy() {
+        if (created) gl::DeleteQueries(QUERIES, queries);
+        created = false;
+    }
+
+    void begin() {
+        current = -1;
+        if (!created) return;
+        collect();
+        // Первый замер не учитывается: некоторые драйверы возвращают для
+        // него неверное время
+        if (!started) {
+            started = true;
+            return;
+        }
+        for (int i = 0; i < QUERIES; ++i) {
+            if (!busy[i]) {
+                current = i;
+                break;
+            }
+        }
+        if (current >= 0) gl::BeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void end() {
+        if (current < 0) return;
+        gl::EndQuery(GL_TIME_ELAPSED);
+        busy[current] = true;
+    }
+
+    // Среднее по готовым замерам с прошлого вызова, мс; меньше нуля - замеров нет
+    double average() {
+        double result = count ? totalMs / count : -1.0;
+        totalMs = 0.0;
+        count = 0;
+        return result;
+    }
+
+private:
+    GLuint queries[QUERIES] = {};
+    bool busy[QUERIES] = {};
+    bool created = false;
+    bool started = false;
+    int current = -1;
+    double totalMs = 0.0;
+    int count = 0;
+
+    void collect() {
+        for (int i = 0; i < QUERIES; ++i) {
+            if (!busy[i]) continue;
+            GLint available = 0;
+            gl::GetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            std::uint64_t nanoseconds = 0;
+            gl::GetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            totalMs += nanoseconds / 1e6;
+            count++;
+            busy[i] = false;
+        }
+    }
+} sceneTimer;
+
+// Объект, отбрасывающий тень: экземпляр сетки с матрицей модели и
+// описанным шаром в мировых координатах
+struct ShadowCaster {
+    float transform[16];
+    float center[3];
+    float radius;
+};
+
+// Счётчики последнего обновления атласа теней
+struct ShadowAtlasStats {
+    size_t shadowedLights = 0;  // прожекторов с ячейкой
+    size_t staticRenders = 0;   // ячеек, где перерисованы неподвижные объекты
+    size_t movingRenders = 0;   // ячеек, где поверх дорисованы движущиеся
+    size_t casterDraws = 0;     // нарисованных в ячейки объектов
+};
+
+// Карты теней прожекторов в общем атласе: текстура глубины SIZE x SIZE
+// делится на квадратные ячейки, каждый прожектор с тенью получает свою
+// ячейку и держит её, пока виден. Неподвижные объекты рисуются во второй
+// атлас-кэш, только когда поза прожектора меняется; в кадре ячейка кэша
+// копируется в атлас и поверх дорисовываются лишь движущиеся объекты.
+// Ячейки, которых не коснулось ни то, ни другое, не трогаются, так что
+// стоимость кадра растёт с числом прожекторов, рядом с которыми что-то
+// движется, а не с числом всех прожекторов. В каждую ячейку рисуются только
+// объекты, шар которых задевает конус прожектора. Без копирования между
+// буферами кадра кэша нет, и ячейка при обновлении рисуется целиком
+class ShadowAtlas {
+public:
+    static const int SIZE = 2048;   // сторона атласа, как SHADOW_TEXEL в SHADOW_LOOKUP
+    static constexpr float NEAR_PLANE = 0.1f;
+
+    bool create(int tileSize, std::string& error) {
+        destroy();
+        if (!gl::hasFramebuffers()) {
+            error = "буферы кадра не поддерживаются";
+            return false;
+        }
+        tile = std::max(16, std::min(tileSize, SIZE));
+        perRow = SIZE / tile;
+        cells.assign(static_cast<size_t>(perRow) * perRow, Cell());
+        int layers = gl::hasFramebufferBlit() ? 2 : 1;
+
+        glGenTextures(layers, textures);
+        gl::GenFramebuffers(layers, framebuffers);
+        for (int layer = 0; layer < layers; ++layer) {
+            glBindTexture(GL_TEXTURE_2D, textures[layer]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SIZE, SIZE, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT,
+                         nullptr);
+            if (layer == 0) {
+                // Линейная фильтрация при сравнении даёт аппаратный PCF 2x2
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            }
+            else {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffers[layer]);
+            gl::FramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[layer], 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            bool complete = gl::CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+            gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+            if (!complete) {
+                glBindTexture(GL_TEXTURE_2D, 0);
+                destroy();
+                error = "буфер кадра для атласа теней неполон";
+                return false;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // Матрицы ячеек для шейдеров со многими прожекторами
+        if (gl::hasTextureBuffers()) {
+            gl::GenBuffers(1, &matrixBuffer);
+            gl::BindBuffer(GL_TEXTURE_BUFFER, matrixBuffer);
+            gl::BufferData(GL_TEXTURE_BUFFER, 20 * sizeof(float) * cells.size(), nullptr, GL_STREAM_DRAW);
+            gl::BindBuffer(GL_TEXTURE_BUFFER, 0);
+            glGenTextures(1, &matrixTexture);
+            glBindTexture(GL_TEXTURE_BUFFER, matrixTexture);
+            gl::TexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, matrixBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        return true;
+    }
+
+    void destroy() {
+        for (int layer = 0; layer < 2; ++layer) {
+            if (framebuffers[layer]) gl::DeleteFramebuffers(1, &framebuffers[layer]);
+            if (textures[layer]) glDeleteTextures(1, &textures[layer]);
+            framebuffers[layer] = textures[layer] = 0;
+        }
+        if (matrixTexture) glDeleteTextures(1, &matrixTexture);
+        if (matrixBuffer) gl::DeleteBuffers(1, &matrixBuffer);
+        matrixTexture = matrixBuffer = 0;
+        cells.clear();
+        slots.clear();
+    }
+
+    bool isReady() const { return framebuffers[0] != 0; }
+
+    size_t cellCount() const { return cells.size(); }
+
+    // Раздача ячеек: priorities[i] < 0 - прожектору i тень не нужна, иначе
+    // чем меньше число, тем важнее. Ячейки остаются за прожекторами, пока
+    // те в них нуждаются, свободные достаются самым важным из остальных
+    void assign(const std::vector<float>& priorities) {
+        size_t count = priorities.size();
+        for (Cell& cell : cells) {
+            if (cell.light < 0) continue;
+            size_t light = static_cast<size_t>(cell.light);
+            if (light < count && priorities[light] >= 0.0f) continue;
+            if (light < slots.size()) slots[light] = -1;
+            cell = Cell();
+        }
+        slots.resize(count, -1);
+
+        candidates.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (priorities[i] >= 0.0f && slots[i] < 0) candidates.push_back(static_cast<int>(i));
+        }
+        auto byPriority = [&](int a, int b) { return priorities[a] < priorities[b]; };
+        size_t free = 0;
+        for (const Cell& cell : cells) free += cell.light < 0;
+        if (candidates.size() > free) {
+            std::nth_element(candidates.begin(), candidates.begin() + free, candidates.end(), byPriority);
+            candidates.resize(free);
+        }
+        std::sort(candidates.begin(), candidates.end(), byPriority);
+        size_t next = 0;
+        for (size_t slot = 0; slot < cells.size() && next < candidates.size(); ++slot) {
+            if (cells[slot].light >= 0) continue;
+            cells[slot].light = candidates[next];
+            slots[candidates[next++]] = static_cast<int>(slot);
+        }
+    }
+
+    // Ячейка каждого прожектора последней раздачи, -1 - без тени
+    const std::vector<int>& lightSlots() const { return slots; }
+
+    // Обновление ячеек. Прожекторы и объекты - в мировых координатах,
+    // объекты - экземпляры сетки mesh
+    void render(const std::vector<SpotLightSource>& lights, const std::vector<float>& ranges,
+                const MeshBuffers& mesh, const std::vector<ShadowCaster>& staticCasters,
+                const std::vector<ShadowCaster>& movingCasters) {
+        lastStats = ShadowAtlasStats();
+        if (!isReady()) return;
+        bool caching = framebuffers[1] != 0;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glPushAttrib(GL_ENABLE_BIT | GL_POLYGON_BIT | GL_SCISSOR_BIT);
+        glDisable(GL_LIGHTING);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_SCISSOR_TEST);
+        // Смещение глубины и отбрасывание лицевых граней убирают
+        // самозатенение освещённых граней
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        mesh.bind();
+
+        for (size_t slot = 0; slot < cells.size(); ++slot) {
+            Cell& cell = cells[slot];
+            if (cell.light < 0) continue;
+            lastStats.shadowedLights++;
+            const SpotLightSource& light = lights[cell.light];
+            float range = ranges[cell.light];
+            if (!cell.cached || !samePose(cell.pose, light) || cell.range != range) {
+                cell.pose = light;
+                cell.range = range;
+                cell.cached = false;
+                spotShadowMatrix(light.position, light.direction, light.cutoff, NEAR_PLANE,
+                                 std::max(range, 2 * NEAR_PLANE), cell.matrix);
+            }
+            bool moving = false;
+            for (const ShadowCaster& caster : movingCasters) {
+                if (spotLightTouchesSphere(light, range, caster.center, caster.radius)) {
+                    moving = true;
+                    break;
+                }
+            }
+            // Тень не менялась: ни поза прожектора, ни движущиеся объекты
+            if (cell.cached && !moving && !cell.hadMoving) continue;
+
+            int x = static_cast<int>(slot % perRow) * tile;
+            int y = static_cast<int>(slot / perRow) * tile;
+            glViewport(x, y, tile, tile);
+            glScissor(x, y, tile, tile);
+            glMatrixMode(GL_PROJECTION);
+            glLoadMatrixf(cell.matrix);
+            glMatrixMode(GL_MODELVIEW);
+            if (caching) {
+                if (!cell.cached) {
+                    gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffers[1]);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    drawCasters(mesh, staticCasters, light, range);
+                    lastStats.staticRenders++;
+                }
+                gl::BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[1]);
+                gl::BindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[0]);
+                gl::BlitFramebuffer(x, y, x + tile, y + tile, x, y, x + tile, y + tile, GL_DEPTH_BUFFER_BIT,
+                                    GL_NEAREST);
+                gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+            }
+            else {
+                gl::BindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawCasters(mesh, staticCasters, light, range);
+                lastStats.staticRenders++;
+            }
+            if (moving) {
+                drawCasters(mesh, movingCasters, light, range);
+                lastStats.movingRenders++;
+            }
+            cell.cached = true;
+            cell.hadMoving = moving;
+        }
+
+        mesh.unbind();
+        gl::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+        glPopAttrib();
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // Матрица из координат вида камеры cameraView в текстуру атласа и
+    // ячейка (x0, y0, x1, y1 с отступом в тексель) прожектора light -
+    // 20 чисел; false - у прожектора нет тени
+    bool shadowData(size_t light, const float cameraView[16], float out[20]) const {
+        if (light >= slots.size() || slots[light] < 0) return false;
+        cellData(static_cast<size_t>(slots[light]), cameraView, out);
+        return true;
+    }
+
+    // Данные всех занятых ячеек - в текстуру из буфера, по пять RGBA на ячейку
+    void upload(const float cameraView[16]) {
+        if (!matrixBuffer) return;
+        packed.assign(20 * cells.size(), 0.0f);
+        for (size_t slot = 0; slot < cells.size(); ++slot) {
+            if (cells[slot].light >= 0) cellData(slot, cameraView, &packed[20 * slot]);
+        }
+        gl::BindBuffer(GL_TEXTURE_BUFFER, matrixBuffer);
+        gl::BufferData(GL_TEXTURE_BUFFER, packed.size() * sizeof(float), packed.data(), GL_STREAM_DRAW);
+        gl::BindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Атлас и матрицы ячеек в блоки текстур; matrixUnit < 0 - только атлас
+    void bind(int matrixUnit, int atlasUnit) const {
+        setTextures(matrixUnit, atlasUnit, textures[0], matrixTexture);
+    }
+
+    void unbind(int matrixUnit, int atlasUnit) const {
+        setTextures(matrixUnit, atlasUnit, 0, 0);
+    }
+
+    const ShadowAtlasStats& stats() const { return lastStats; }
+
+private:
+    struct Cell {
+        int light = -1;
+        SpotLightSource pose = {};  // поза прожектора, для которой нарисован кэш
+        float range = 0.0f;
+        bool cached = false;        // неподвижные объекты нарисованы для pose
+        bool hadMoving = false;     // поверх нарисованы движущиеся объекты
+        float matrix[16] = {};      // мировые координаты -> отсечение прожектора
+    };
+
+    int tile = SIZE, perRow = 1;
+    GLuint textures[2] = {};        // атлас и кэш неподвижных объектов
+    GLuint framebuffers[2] = {};
+    GLuint matrixBuffer = 0;
+    GLuint matrixTexture = 0;
+    std::vector<Cell> cells;
+    std::vector<int> slots;
+    std::vector<int> candidates;
+    std::vector<float> packed;
+    ShadowAtlasStats lastStats;
+
+    static bool samePose(const SpotLightSource& a, const SpotLightSource& b) {
+        for (int k = 0; k < 3; ++k) {
+            if (a.position[k] != b.position[k] || a.direction[k] != b.direction[k]) return false;
+        }
+        return a.cutoff == b.cutoff;
+    }
+
+    void drawCasters(const MeshBuffers& mesh, const std::vector<ShadowCaster>& casters,
+                     const SpotLightSource& light, float range) {
+        for (const ShadowCaster& caster : casters) {
+            if (!spotLightTouchesSphere(light, range, caster.center, caster.radius)) continue;
+            glLoadMatrixf(caster.transform);
+            mesh.drawElements();
+            lastStats.casterDraws++;
+        }
+    }
+
+    // Отсечение прожектора -> текстура ячейки, после перевода из координат вида в мировые
+    void cellData(size_t slot, const float cameraView[16], float out[20]) const {
+        float x0 = static_cast<float>(slot % perRow) * tile / SIZE;
+        float y0 = static_cast<float>(slot / perRow) * tile / SIZE;
+        float scale = 0.5f * tile / SIZE;
+        const float bias[16] = {scale, 0.0f, 0.0f, 0.0f, 0.0f, scale, 0.0f, 0.0f,
+                                0.0f, 0.0f, 0.5f, 0.0f, x0 + scale, y0 + scale, 0.5f, 1.0f};
+        float toWorld[16];
+        invertRigidMatrix(cameraView, toWorld);
+        multiplyMatrices(cells[slot].matrix, toWorld, out);
+        multiplyMatrices(bias, out, out);
+        float texel = 1.0f / SIZE;
+        out[16] = x0 + texel;
+        out[17] = y0 + texel;
+        out[18] = x0 + 2 * scale - texel;
+        out[19] = y0 + 2 * scale - texel;
+    }
+
+    void setTextures(int matrixUnit, int atlasUnit, GLuint atlas, GLuint matrices) const {
+        if (!gl::ActiveTexture) {
+            glBindTexture(GL_TEXTURE_2D, atlas);
+            return;
+        }
+        gl::ActiveTexture(GL_TEXTURE0 + atlasUnit);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        if (matrixUnit >= 0 && matrixTexture) {
+            gl::ActiveTexture(GL_TEXTURE0 + matrixUnit);
+            glBindTexture(GL_TEXTURE_BUFFER, matrices);
+        }
+        gl::ActiveTexture(GL_TEXTURE0);
+    }
+} shadowAtlas;
+
+// Прожекторы сцены со многими источниками (пусто - один прожектор GL_LIGHT0)
+std::vector<MovingSpotLight> movingLights;
+std::vector<SpotLightSource> viewLights;
+LightClusters lightClusters;
+float lightTime = 0.0f;
+bool allLights = false;     // перебирать все прожекторы вместо списков кластеров
+bool deferred = false;      // отложенное освещение вместо прямого по кластерам
+size_t deferredPixels = 0;  // освещённых прожекторами пикселей в последнем кадре
+bool lightsMoving = true;   // прожекторы ходят по окружностям
+
+// Тени прожекторов: объекты, отбрасывающие тень, и прожекторы в мировых координатах
+bool shadows = true;
+float objectTime = 0.0f;
+std::vector<ShadowCaster> staticCasters;
+std::vector<ShadowCaster> movingCasters;
+std::vector<SpotLightSource> worldLights;
+std::vector<float> shadowPriorities;
+const std::vector<int> NO_SHADOWS;
+
+// Цилиндр с матрицей модели transform (поворот и сдвиг) как объект, отбрасывающий тень
+ShadowCaster cylinderCaster(const float transform[16]) {
+    ShadowCaster caster;
+    std::copy(transform, transform + 16, caster.transform);
+    for (int k = 0; k < 3; ++k) caster.center[k] = transform[12 + k];
+    caster.radius = std::sqrt(RADIUS * RADIUS + HEIGHT * HEIGHT / 4);
+    return caster;
+}
+
+// Движущиеся цилиндры ходят взад-вперёд по проходам между рядами решётки
+void updateMovingCylinders() {
+    movingCasters.clear();
+    for (int i = 0; i < MOVING_CYLINDERS; ++i) {
+        float x = (2 * i - MOVING_CYLINDERS + 1) * CYLINDER_SPACING / 2;
+        float z = (FLOOR_HALF_SIZE - 4.0f) * std::sin(0.4f * objectTime + 1.7f * i);
+        const float transform[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, HEIGHT / 2, z, 1};
+        movingCasters.push_back(cylinderCaster(transform));
+    }
 }
 
 void init() {
@@ -126,6 +1225,51 @@ void init() {
     glMaterialfv(GL_FRONT, GL_DIFFUSE, material_diffuse);
     glMaterialfv(GL_FRONT, GL_SPECULAR, material_specular);
     glMaterialfv(GL_FRONT, GL_SHININESS, material_shininess);
+
+    // Цилиндр и шейдер прожектора
+    cylinder.create(makeCylinder(SLICES, STACKS, RADIUS, HEIGHT));
+    std::string error;
+    if (!spotlightShader.create(error)) {
+        std::cerr << "Освещение по вершинам, шейдер прожектора недоступен: " << error << std::endl;
+        perFragment = false;
+    }
+    else if (!shadowAtlas.create(ShadowAtlas::SIZE, error)) {
+        std::cerr << "Тени недоступны: " << error << std::endl;
+        shadows = false;
+    }
+}
+
+// Пол и освещение многими прожекторами; false, если шейдер недоступен
+bool initLightField(size_t lightCount, unsigned width, unsigned height, std::string& error) {
+    floorMesh.create(makeFloor(FLOOR_HALF_SIZE));
+    movingLights = makeSpotLights(lightCount, FLOOR_HALF_SIZE);
+    viewLights.resize(lightCount);
+    worldLights.resize(lightCount);
+    shadowPriorities.resize(lightCount);
+
+    // Пол ничего не затеняет, поэтому в карты теней попадают только цилиндры
+    staticCasters.clear();
+    for (int i = 0; i < CYLINDER_GRID; ++i) {
+        for (int j = 0; j < CYLINDER_GRID; ++j) {
+            const float transform[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0,
+                                         (i - (CYLINDER_GRID - 1) / 2.0f) * CYLINDER_SPACING, HEIGHT / 2,
+                                         (j - (CYLINDER_GRID - 1) / 2.0f) * CYLINDER_SPACING, 1};
+            staticCasters.push_back(cylinderCaster(transform));
+        }
+    }
+    std::string shadowError;
+    if (!shadowAtlas.create(FIELD_SHADOW_TILE, shadowError)) {
+        std::cerr << "Тени недоступны: " << shadowError << std::endl;
+        shadows = false;
+    }
+    lightClusters.configure(static_cast<int>(width), static_cast<int>(height), FOV_Y, Z_NEAR, Z_FAR);
+    if (!clusteredLighting.create(error)) return false;
+    sceneTimer.create();
+    std::string deferredError;
+    if (!deferredLighting.create(width, height, deferredError)) {
+        std::cerr << "Отложенное освещение недоступно: " << deferredError << std::endl;
+    }
+    return true;
 }
 
 void handleInput(sf::Window& window) {
@@ -154,6 +1298,27 @@ void handleInput(sf::Window& window) {
                 case sf::Keyboard::X:
                     spotlight.quadratic += 0.001f;
                     break;
+                case sf::Keyboard::C:
+                    allLights = !allLights;
+                    std::cout << (allLights ? "Перебор всех прожекторов" : "Прожекторы по спискам кластеров")
+                              << std::endl;
+                    break;
+                case sf::Keyboard::D:
+                    deferred = !deferred && deferredLighting.isReady();
+                    std::cout << (deferred ? "Отложенное освещение" : "Прямое освещение") << std::endl;
+                    break;
+                case sf::Keyboard::H:
+                    shadows = !shadows && shadowAtlas.isReady();
+                    std::cout << "Тени: " << (shadows ? "включены" : "выключены") << std::endl;
+                    break;
+                case sf::Keyboard::M:
+                    lightsMoving = !lightsMoving;
+                    std::cout << (lightsMoving ? "Прожекторы движутся" : "Прожекторы остановлены") << std::endl;
+                    break;
+                case sf::Keyboard::F:
+                    perFragment = !perFragment && spotlightShader.isReady();
+                    std::cout << (perFragment ? "Освещение в каждом фрагменте" : "Освещение по вершинам") << std::endl;
+                    break;
                 case sf::Keyboard::Escape:
                     window.close();
                     break;
@@ -169,40 +1334,151 @@ void handleInput(sf::Window& window) {
     }
 }
 
-void update() {
-    angleX += 0.5f;
-    angleY += 0.5f;
+// Продвижение анимации на seconds секунд
+void update(float seconds) {
+    angleX += ROTATION_SPEED * seconds;
+    angleY += ROTATION_SPEED * seconds;
     
     if (angleX > 360.0f) angleX -= 360.0f;
     if (angleY > 360.0f) angleY -= 360.0f;
+    objectTime += seconds;
+    if (lightsMoving) lightTime += seconds;
+}
+
+// Тень вращающегося цилиндра от прожектора spotlight. Цилиндр движется,
+// поэтому его ячейка перерисовывается каждый кадр; неподвижных объектов
+// в этой сцене нет. cameraView - видовая матрица, при которой задан прожектор,
+// model - поворот цилиндра
+bool renderSpotlightShadow(const Mat4& cameraView, const Mat4& model, float shadow[20]) {
+    static const std::vector<float> ranges = {SPOTLIGHT_SHADOW_RANGE};
+    SpotLightSource light = {};
+    float length = std::sqrt(spotlight.direction[0] * spotlight.direction[0] +
+                             spotlight.direction[1] * spotlight.direction[1] +
+                             spotlight.direction[2] * spotlight.direction[2]);
+    for (int k = 0; k < 3; ++k) {
+        light.position[k] = spotlight.position[k];
+        light.direction[k] = spotlight.direction[k] / length;
+    }
+    light.cutoff = spotlight.cutoff;
+    worldLights.assign(1, light);
+
+    movingCasters.assign(1, cylinderCaster(model.m));
+
+    shadowPriorities.assign(1, 0.0f);
+    shadowAtlas.assign(shadowPriorities);
+    shadowAtlas.render(worldLights, ranges, cylinder, staticCasters, movingCasters);
+    return shadowAtlas.shadowData(0, cameraView.m, shadow);
 }
 
 void render() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
     
-    // Настройка камеры
-    #ifdef __APPLE__
-        // Для macOS используем gluLookAt
-        gluLookAt(0.0f, 0.0f, 10.0f,
-                  0.0f, 0.0f, 0.0f,
-                  0.0f, 1.0f, 0.0f);
-    #else
-        // Для других платформ можно использовать альтернативный подход
-        glTranslatef(0.0f, 0.0f, -10.0f);
-    #endif
+    // Камера в (0, 0, 10) смотрит в начало координат; матрицы кадра
+    // считаются на процессоре и загружаются целиком
+    const Mat4 view = translation(0.0f, 0.0f, -10.0f);
+    const Mat4 model = multiply(rotationX(angleX), rotationY(angleY));
+    glLoadMatrixf(view.m);
     
     // Обновление позиции прожектора
     glLightfv(GL_LIGHT0, GL_POSITION, spotlight.position);
+    if (perFragment) {
+        float shadow[20];
+        bool withShadow = shadows && shadowAtlas.isReady() && renderSpotlightShadow(view, model, shadow);
+        spotlightShader.setLight(spotlight, view.m, withShadow ? shadow : nullptr);
+    }
     
     // Вращение сцены
-    glRotatef(angleX, 1.0f, 0.0f, 0.0f);
-    glRotatef(angleY, 0.0f, 1.0f, 0.0f);
+    glLoadMatrixf(multiply(view, model).m);
     
-    drawCylinder();
+    if (perFragment) {
+        shadowAtlas.bind(-1, 0);
+        spotlightShader.begin();
+    }
+    cylinder.draw();
+    if (perFragment) {
+        spotlightShader.end();
+        shadowAtlas.unbind(-1, 0);
+    }
+}
+
+// Пол, решётка цилиндров и движущиеся цилиндры
+void drawLightFieldGeometry() {
+    floorMesh.draw();
+    cylinder.bind();
+    for (const std::vector<ShadowCaster>* casters : {&staticCasters, &movingCasters}) {
+        for (const ShadowCaster& caster : *casters) {
+            glPushMatrix();
+            glMultMatrixf(caster.transform);
+            cylinder.drawElements();
+            glPopMatrix();
+        }
+    }
+    cylinder.unbind();
+}
+
+// Кадр сцены со многими прожекторами: камера медленно облетает поле
+// цилиндров; прожекторы переводятся в координаты вида и раскладываются
+// по кластерам на процессоре, затем сцена рисуется одним шейдером. При
+// отложенном освещении нужны только границы прожекторов на экране.
+// Ячейки атласа теней достаются видимым прожекторам, ближайшим к камере
+void renderLightField() {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const Mat4 view = multiply(translation(0.0f, 0.0f, -FIELD_CAMERA_DISTANCE),
+                               multiply(rotationX(FIELD_CAMERA_PITCH), rotationY(angleY * 0.2f)));
+    glLoadMatrixf(view.m);
+    for (size_t i = 0; i < movingLights.size(); ++i) {
+        moveSpotLight(movingLights[i], lightTime);
+        worldLights[i] = movingLights[i].light;
+        viewLights[i] = transformSpotLight(worldLights[i], view.m);
+    }
+    updateMovingCylinders();
+    if (deferred) lightClusters.boundLights(viewLights);
+    else lightClusters.build(viewLights);
+
+    sceneTimer.begin();
+    bool withShadows = shadows && shadowAtlas.isReady();
+    if (withShadows) {
+        for (size_t i = 0; i < viewLights.size(); ++i) {
+            int rect[4];
+            const float* p = viewLights[i].position;
+            shadowPriorities[i] = lightClusters.lightRect(i, rect) ? std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2])
+                                                                   : -1.0f;
+        }
+        shadowAtlas.assign(shadowPriorities);
+        shadowAtlas.render(worldLights, lightClusters.lightRanges(), cylinder, staticCasters, movingCasters);
+        shadowAtlas.upload(view.m);
+    }
+    clusteredLighting.uploadLights(viewLights, lightClusters.lightRanges(),
+                                   withShadows ? shadowAtlas.lightSlots() : NO_SHADOWS);
+
+    if (deferred) {
+        deferredLighting.beginGeometry();
+        drawLightFieldGeometry();
+        deferredLighting.endGeometry();
+        shadowAtlas.bind(DeferredLighting::SHADOW_MATRIX_UNIT, DeferredLighting::SHADOW_ATLAS_UNIT);
+        deferredPixels = deferredLighting.shade(lightClusters, clusteredLighting, viewLights.size());
+        shadowAtlas.unbind(DeferredLighting::SHADOW_MATRIX_UNIT, DeferredLighting::SHADOW_ATLAS_UNIT);
+    }
+    else {
+        clusteredLighting.uploadClusters(lightClusters, allLights);
+        clusteredLighting.begin();
+        shadowAtlas.bind(ClusteredLighting::SHADOW_MATRIX_UNIT, ClusteredLighting::SHADOW_ATLAS_UNIT);
+        drawLightFieldGeometry();
+        shadowAtlas.unbind(ClusteredLighting::SHADOW_MATRIX_UNIT, ClusteredLighting::SHADOW_ATLAS_UNIT);
+        clusteredLighting.end();
+    }
+    sceneTimer.end();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --lights N: сцена с N прожекторами вместо одного цилиндра
+    size_t lightCount = 0;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "--lights") == 0) {
+            lightCount = static_cast<size_t>(std::max(0, std::atoi(argv[i + 1])));
+        }
+    }
+    
     // Настройки SFML
     sf::ContextSettings settings;
     settings.depthBits = 24;
@@ -217,7 +1493,9 @@ int main() {
                      sf::Style::Default, 
                      settings);
                      
-    window.setVerticalSyncEnabled(true);
+    // Со многими прожекторами время кадра показывает стоимость освещения,
+    // поэтому без вертикальной синхронизации
+    window.setVerticalSyncEnabled(lightCount == 0);
     
     // Вывод информации об управлении в консоль
     std::cout << "\nУправление программой:" << std::endl;
@@ -226,6 +1504,13 @@ int main() {
     std::cout << "Q/W - уменьшить/увеличить постоянный коэффициент затухания" << std::endl;
     std::cout << "A/S - уменьшить/увеличить линейный коэффициент затухания" << std::endl;
     std::cout << "Z/X - уменьшить/увеличить квадратичный коэффициент затухания" << std::endl;
+    std::cout << "F - освещение в каждом фрагменте или по вершинам" << std::endl;
+    std::cout << "H - включить/выключить тени прожекторов" << std::endl;
+    if (lightCount > 0) {
+        std::cout << "M - остановить/запустить прожекторы" << std::endl;
+        std::cout << "C - перебор всех прожекторов или только списков кластеров" << std::endl;
+        std::cout << "D - отложенное освещение через G-буфер или прямое" << std::endl;
+    }
     std::cout << "ESC - выход из программы" << std::endl;
     std::cout << "------------------------" << std::endl;
     
@@ -237,30 +1522,72 @@ int main() {
     
     try {
         // Инициализация OpenGL
+        gl::load();
         init();
+        if (lightCount > 0) {
+            std::string error;
+            if (!initLightField(lightCount, window.getSize().x, window.getSize().y, error)) {
+                std::cerr << "Сцена с прожекторами недоступна: " << error << std::endl;
+                return -1;
+            }
+        }
         
         // Настройка viewport
         glViewport(0, 0, window.getSize().x, window.getSize().y);
         glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        
-        #ifdef __APPLE__
-            gluPerspective(45.0f, (float)window.getSize().x/window.getSize().y, 0.1f, 100.0f);
-        #else
-            float aspect = (float)window.getSize().x/window.getSize().y;
-            float fH = tan(45.0f * 3.14159f / 360.0f) * 0.1f;
-            float fW = fH * aspect;
-            glFrustum(-fW, fW, -fH, fH, 0.1f, 100.0f);
-        #endif
-        
+        float aspect = static_cast<float>(window.getSize().x) / window.getSize().y;
+        glLoadMatrixf(perspective(FOV_Y, aspect, Z_NEAR, Z_FAR).m);
         glMatrixMode(GL_MODELVIEW);
         
         // Главный цикл
+        auto statsStart = std::chrono::steady_clock::now();
+        int statsFrames = 0;
+        double buildMs = 0.0;
+        sf::Clock frameClock;
         while (window.isOpen()) {
             handleInput(window);
-            update();
-            render();
+            update(std::min(frameClock.restart().asSeconds(), MAX_FRAME_TIME));
+            if (lightCount == 0) {
+                render();
+                window.display();
+                continue;
+            }
+            renderLightField();
             window.display();
+
+            // Раз в секунду - время кадра и заполнение кластеров
+            statsFrames++;
+            buildMs += lightClusters.stats().buildMs;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - statsStart).count();
+            if (seconds >= 1.0) {
+                const LightClusterStats& stats = lightClusters.stats();
+                std::cout << "Прожекторов: " << stats.lights << " (в пирамиде " << stats.visibleLights << "), ";
+                if (deferred) {
+                    std::cout << "отложенное, на пиксель окна в среднем "
+                              << static_cast<double>(deferredPixels) / (window.getSize().x * window.getSize().y)
+                              << " прожекторов";
+                }
+                else {
+                    std::cout << (allLights ? "прямое перебором всех" : "прямое по кластерам")
+                              << ", в непустом кластере в среднем "
+                              << (stats.busyClusters ? static_cast<double>(stats.references) / stats.busyClusters : 0.0)
+                              << ", максимум " << stats.maxPerCluster;
+                }
+                std::cout << ", границы " << buildMs / statsFrames << " мс, кадр " << 1000.0 * seconds / statsFrames
+                          << " мс";
+                if (shadows) {
+                    const ShadowAtlasStats& shadowStats = shadowAtlas.stats();
+                    std::cout << ", тени у " << shadowStats.shadowedLights << " прожекторов, перерисовано ячеек: "
+                              << shadowStats.staticRenders << " с неподвижными, " << shadowStats.movingRenders
+                              << " с движущимися цилиндрами (всего цилиндров " << shadowStats.casterDraws << ")";
+                }
+                double gpuMs = sceneTimer.average();
+                if (gpuMs >= 0.0) std::cout << ", видеокарта " << gpuMs << " мс";
+                std::cout << std::endl;
+                statsStart = std::chrono::steady_clock::now();
+                statsFrames = 0;
+                buildMs = 0.0;
+            }
         }
     }
     catch (const std::exception& e) {
@@ -268,5 +1595,13 @@ int main() {
         return -1;
     }
     
+    shadowAtlas.destroy();
+    sceneTimer.destroy();
+    deferredLighting.destroy();
+    clusteredLighting.destroy();
+    spotlightShader.destroy();
+    floorMesh.destroy();
+    cylinder.destroy();
+    
     return 0;
 }
@@ -0,0 +1,230 @@
+#pragma once
+
+// Сцена лабораторной работы 4: сетки цилиндра и пола, прожекторы с
+// затуханием. Не зависит ни от SFML, ни от OpenGL
+
+#include "cg_math.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Вершина с нормалью подряд, как их читают glVertexPointer/glNormalPointer
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+};
+
+struct TriangleMesh {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;  // треугольники, против часовой стрелки снаружи
+
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+// Цилиндр с осью Y и центром в начале координат: боковая поверхность из
+// slices граней по окружности и stacks поясов по высоте, основания -
+// веером из центра. Шов и края оснований продублированы, чтобы у каждой
+// вершины была своя нормаль
+inline TriangleMesh makeCylinder(int slices, int stacks, float radius, float height) {
+    TriangleMesh mesh;
+    mesh.vertices.reserve(static_cast<size_t>(slices + 1) * (stacks + 1) + 2 * (slices + 2));
+    mesh.indices.reserve(6 * static_cast<size_t>(slices) * stacks + 6 * slices);
+
+    // Боковая поверхность: пояс r идёт снизу вверх
+    for (int r = 0; r <= stacks; ++r) {
+        float y = height * (static_cast<float>(r) / stacks - 0.5f);
+        for (int i = 0; i <= slices; ++i) {
+            float theta = 2 * PI * i / slices;
+            float c = std::cos(theta), s = std::sin(theta);
+            mesh.vertices.push_back({{radius * c, y, radius * s}, {c, 0.0f, s}});
+        }
+    }
+    auto side = [&](int r, int i) { return static_cast<uint32_t>(r * (slices + 1) + i); };
+    for (int r = 0; r < stacks; ++r) {
+        for (int i = 0; i < slices; ++i) {
+            mesh.indices.insert(mesh.indices.end(), {side(r, i), side(r + 1, i), side(r + 1, i + 1),
+                                                     side(r, i), side(r + 1, i + 1), side(r, i + 1)});
+        }
+    }
+
+    // Основания: центр, затем край
+    for (int top = 0; top <= 1; ++top) {
+        float y = top ? height / 2 : -height / 2;
+        float ny = top ? 1.0f : -1.0f;
+        uint32_t center = static_cast<uint32_t>(mesh.vertices.size());
+        mesh.vertices.push_back({{0.0f, y, 0.0f}, {0.0f, ny, 0.0f}});
+        for (int i = 0; i <= slices; ++i) {
+            float theta = 2 * PI * i / slices;
+            mesh.vertices.push_back({{radius * std::cos(theta), y, radius * std::sin(theta)}, {0.0f, ny, 0.0f}});
+        }
+        for (int i = 0; i < slices; ++i) {
+            uint32_t a = center + 1 + i, b = center + 2 + i;
+            if (top) mesh.indices.insert(mesh.indices.end(), {center, b, a});
+            else mesh.indices.insert(mesh.indices.end(), {center, a, b});
+        }
+    }
+    return mesh;
+}
+
+// Квадрат пола со стороной 2 * halfSize в плоскости y = 0, нормаль вверх
+inline TriangleMesh makeFloor(float halfSize) {
+    TriangleMesh mesh;
+    mesh.vertices = {{{-halfSize, 0.0f, -halfSize}, {0.0f, 1.0f, 0.0f}},
+                     {{-halfSize, 0.0f, halfSize}, {0.0f, 1.0f, 0.0f}},
+                     {{halfSize, 0.0f, halfSize}, {0.0f, 1.0f, 0.0f}},
+                     {{halfSize, 0.0f, -halfSize}, {0.0f, 1.0f, 0.0f}}};
+    mesh.indices = {0, 1, 2, 0, 2, 3};
+    return mesh;
+}
+
+// Единственный прожектор лабораторной работы 4 (GL_LIGHT0) над цилиндром
+// в начале координат
+struct SpotLight {
+    float position[4] = {0.0f, 5.0f, 0.0f, 1.0f};
+    float direction[3] = {0.0f, -1.0f, 0.0f};
+    float ambient[4] = {0.2f, 0.2f, 0.2f, 1.0f};
+    float diffuse[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    float specular[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    float cutoff = 45.0f;
+    float exponent = 2.0f;
+    
+    // Коэффициенты затухания
+    float constant = 1.0f;
+    float linear = 0.09f;
+    float quadratic = 0.032f;
+};
+
+// Прожектор для сцены со многими источниками. Освещённость на расстоянии d
+// внутри конуса: color * cos^exponent / (constant + linear d + quadratic d^2),
+// у границы range плавно доводится до нуля, чтобы источник можно было
+// не учитывать дальше
+struct SpotLightSource {
+    float position[3];
+    float direction[3];     // единичный
+    float color[3];
+    float cutoff;           // половина угла конуса, градусы
+    float exponent;
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// Освещённость, ниже которой свет источника не учитывается
+const float LIGHT_THRESHOLD = 1.0f / 64.0f;
+
+// Расстояние, на котором освещённость самого яркого канала падает до
+// LIGHT_THRESHOLD: корень constant + linear d + quadratic d^2 = max / порог
+inline float lightRange(const SpotLightSource& light) {
+    float brightest = std::max(light.color[0], std::max(light.color[1], light.color[2]));
+    float c = light.constant - brightest / LIGHT_THRESHOLD;
+    if (c >= 0.0f) return 0.0f;
+    if (light.quadratic <= 0.0f) return light.linear > 0.0f ? -c / light.linear : 1e30f;
+    return (-light.linear + std::sqrt(light.linear * light.linear - 4 * light.quadratic * c)) / (2 * light.quadratic);
+}
+
+// Прожектор над полом ходит по своей окружности и светит вниз с наклоном
+// к её центру
+struct MovingSpotLight {
+    SpotLightSource light;
+    float center[2];    // x, z центра окружности
+    float orbit;        // радиус окружности
+    float height;
+    float speed;        // радиан в секунду
+    float phase;
+    float tilt;         // наклон от вертикали, радианы
+};
+
+// count прожекторов со случайными цветами и конусами над квадратом пола
+// со стороной 2 * halfSize. Случайные числа воспроизводимы
+inline std::vector<MovingSpotLight> makeSpotLights(size_t count, float halfSize) {
+    uint32_t state = 2024;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+    };
+    std::vector<MovingSpotLight> lights(count);
+    for (MovingSpotLight& moving : lights) {
+        moving.center[0] = (2 * random() - 1) * halfSize;
+        moving.center[1] = (2 * random() - 1) * halfSize;
+        moving.orbit = 1.0f + 4.0f * random();
+        moving.height = 3.0f + 3.0f * random();
+        moving.speed = (random() < 0.5f ? -1.0f : 1.0f) * (0.2f + 0.6f * random());
+        moving.phase = 2 * PI * random();
+        moving.tilt = 0.4f * random();
+
+        // Насыщенный цвет: один канал полный, остальные случайные
+        SpotLightSource& light = moving.light;
+        int strongest = static_cast<int>(3 * random()) % 3;
+        for (int k = 0; k < 3; ++k) light.color[k] = k == strongest ? 1.0f : random();
+        light.cutoff = 15.0f + 20.0f * random();
+        light.exponent = 2.0f + 8.0f * random();
+        light.constant = 1.0f;
+        light.linear = 0.0f;
+        light.quadratic = 0.15f + 0.3f * random();
+    }
+    return lights;
+}
+
+// Положение и направление прожектора в момент time, секунды
+inline void moveSpotLight(MovingSpotLight& moving, float time) {
+    float angle = moving.phase + moving.speed * time;
+    float c = std::cos(angle), s = std::sin(angle);
+    SpotLightSource& light = moving.light;
+    light.position[0] = moving.center[0] + moving.orbit * c;
+    light.position[1] = moving.height;
+    light.position[2] = moving.center[1] + moving.orbit * s;
+    float st = std::sin(moving.tilt);
+    light.direction[0] = -c * st;
+    light.direction[1] = -std::cos(moving.tilt);
+    light.direction[2] = -s * st;
+}
+
+// Прожектор в системе координат матрицы matrix (по столбцам, как у OpenGL):
+// положение - как точка, направление - как вектор
+inline SpotLightSource transformSpotLight(const SpotLightSource& light, const float matrix[16]) {
+    SpotLightSource result = light;
+    for (int i = 0; i < 3; ++i) {
+        result.position[i] = matrix[i] * light.position[0] + matrix[4 + i] * light.position[1] +
+                             matrix[8 + i] * light.position[2] + matrix[12 + i];
+        result.direction[i] = matrix[i] * light.direction[0] + matrix[4 + i] * light.direction[1] +
+                              matrix[8 + i] * light.direction[2];
+    }
+    return result;
+}
+
+// Проекция карты теней прожектора: вид из position вдоль direction и
+// перспектива с квадратным основанием, в которое вписан конус cutoff.
+// Верх вида выбирается по мировым осям, так что одна и та же поза
+// прожектора всегда даёт одну и ту же матрицу
+inline void spotShadowMatrix(const float position[3], const float direction[3], float cutoff, float zNear,
+                             float zFar, float out[16]) {
+    Vec3 eye(position[0], position[1], position[2]);
+    Vec3 forward = normalize(Vec3(direction[0], direction[1], direction[2]));
+    Vec3 up = std::fabs(forward.y) > 0.99f ? Vec3(0.0f, 0.0f, 1.0f) : Vec3(0.0f, 1.0f, 0.0f);
+    // Запас в градус, чтобы край конуса не попадал на край карты
+    float fovY = 2 * std::min(cutoff + 1.0f, 89.0f);
+    Mat4 shadow = multiply(perspective(fovY, 1.0f, zNear, zFar), lookAt(eye, eye + forward, up));
+    std::copy(shadow.m, shadow.m + 16, out);
+}
+
+// Может ли шар задеть конус с вершиной position, единичной осью direction,
+// углом раствора с косинусом cosCutoff и синусом sinCutoff и высотой range:
+// расстояние от центра шара до боковой поверхности, основания и вершины.
+// Общая проверка для кластеров и для теней прожекторов
+inline bool coneTouchesSphere(const float position[3], const float direction[3], float cosCutoff, float sinCutoff,
+                              float range, const float center[3], float radius) {
+    float v[3] = {center[0] - position[0], center[1] - position[1], center[2] - position[2]};
+    float along = v[0] * direction[0] + v[1] * direction[1] + v[2] * direction[2];
+    float across = std::sqrt(std::max(v[0] * v[0] + v[1] * v[1] + v[2] * v[2] - along * along, 0.0f));
+    float side = cosCutoff * across - sinCutoff * along;
+    return side <= radius && along <= range + radius && along >= -radius;
+}
+
+// Может ли шар задеть конус прожектора в пределах дальности range
+inline bool spotLightTouchesSphere(const SpotLightSource& light, float range, const float center[3], float radius) {
+    float angle = radians(light.cutoff);
+    return coneTouchesSphere(light.position, light.direction, std::cos(angle), std::sin(angle), range, center,
+                             radius);
+}
@@ -0,0 +1,191 @@
+#include "attenuation_sweep.h"
+#include <SFML/Graphics/Image.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Перебор коэффициентов затухания прожектора lab4 на процессоре, без окна
+// и без OpenGL:
+//   lab4_sweep [параметры] [atlas.png]
+// Параметры:
+//   --constant A:B:N    N значений постоянного коэффициента от A до B (0.5:2:4)
+//   --linear A:B:N      линейного (0:0.2:8)
+//   --quadratic A:B:N   квадратичного (0:0.1:8)
+//   --tile WxH          развёртка цилиндра на набор: точек по углу и по высоте (64x80)
+//   --angle A           поворот цилиндра вокруг осей X и Y, как в lab4 (45)
+//   --threads N         число потоков (по умолчанию по числу ядер)
+//   --csv FILE          счётчики каждого набора в CSV
+// В атласе развёртки наборов идут по строкам: в строке - линейный
+// коэффициент, строки - по квадратичному, затем по постоянному. Освещённость
+// 1 и выше - белый. Выводит время перебора и наборы с наибольшей освещённой
+// долей поверхности без пересвета
+
+namespace {
+
+// Цилиндр, как в lab4
+const float RADIUS = 1.0f;
+const float HEIGHT = 3.0f;
+
+// Диапазон значений одного коэффициента
+struct ParameterRange {
+    float first, last;
+    int count;
+
+    float value(int i) const { return count > 1 ? first + (last - first) * i / (count - 1) : first; }
+};
+
+bool parseRange(const char* text, ParameterRange& range) {
+    return std::sscanf(text, "%f:%f:%d", &range.first, &range.last, &range.count) == 3 && range.count > 0 &&
+           range.first >= 0.0f && range.last >= 0.0f;
+}
+
+void usage(const char* program) {
+    std::cerr << "Использование: " << program << " [--constant A:B:N] [--linear A:B:N] [--quadratic A:B:N]\n"
+              << "       [--tile WxH] [--angle A] [--threads N] [--csv FILE] [atlas.png]" << std::endl;
+}
+
+// Прожектор lab4 в системе координат цилиндра, повёрнутого на angle
+// градусов вокруг X, затем вокруг Y, как в lab4
+SpotLightSource lightInCylinderSpace(const SpotLight& spotlight, float angle) {
+    const Mat4 toCylinder = invertRigid(multiply(rotationX(angle), rotationY(angle)));
+    SpotLightSource light = {};
+    float length = std::sqrt(spotlight.direction[0] * spotlight.direction[0] +
+                             spotlight.direction[1] * spotlight.direction[1] +
+                             spotlight.direction[2] * spotlight.direction[2]);
+    for (int k = 0; k < 3; ++k) {
+        light.position[k] = spotlight.position[k];
+        light.direction[k] = spotlight.direction[k] / length;
+        light.color[k] = 1.0f;
+    }
+    light.cutoff = spotlight.cutoff;
+    light.exponent = spotlight.exponent;
+    return transformSpotLight(light, toCylinder.m);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string output, csv;
+    ParameterRange constant = {0.5f, 2.0f, 4}, linear = {0.0f, 0.2f, 8}, quadratic = {0.0f, 0.1f, 8};
+    int columns = 64, rows = 80;
+    float angle = 45.0f;
+    int threads = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if ((std::strcmp(argv[i], "--constant") == 0 || std::strcmp(argv[i], "--linear") == 0 ||
+             std::strcmp(argv[i], "--quadratic") == 0) && hasValue) {
+            ParameterRange& range = argv[i][2] == 'c' ? constant : argv[i][2] == 'l' ? linear : quadratic;
+            if (!parseRange(argv[++i], range)) {
+                std::cerr << "Ошибка: неверный диапазон " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--tile") == 0 && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &columns, &rows) != 2 || columns <= 0 || rows <= 0) {
+                std::cerr << "Ошибка: неверный размер " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--angle") == 0 && hasValue) {
+            angle = std::strtof(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--csv") == 0 && hasValue) {
+            csv = argv[++i];
+        }
+        else if (argv[i][0] != '-' && output.empty()) {
+            output = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<AttenuationSetting> settings;
+    settings.reserve(static_cast<size_t>(constant.count) * linear.count * quadratic.count);
+    for (int c = 0; c < constant.count; ++c) {
+        for (int q = 0; q < quadratic.count; ++q) {
+            for (int l = 0; l < linear.count; ++l) {
+                settings.push_back({constant.value(c), linear.value(l), quadratic.value(q)});
+            }
+        }
+    }
+
+    TaskPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    const CylinderSurface surface = makeCylinderSurface(columns, rows, RADIUS, HEIGHT);
+    const SpotGeometry geometry = makeSpotGeometry(surface, lightInCylinderSpace(SpotLight(), angle));
+    double prepareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Атлас: linear.count развёрток в строке
+    std::vector<uint8_t> atlas;
+    int atlasWidth = linear.count * columns;
+    int atlasHeight = static_cast<int>(settings.size() / linear.count) * rows;
+    if (!output.empty()) atlas.assign(static_cast<size_t>(atlasWidth) * atlasHeight * 4, 0);
+
+    std::vector<IrradianceStats> stats;
+    start = std::chrono::steady_clock::now();
+    sweepAttenuation(geometry, settings, stats, atlas.empty() ? nullptr : atlas.data(), linear.count, pool);
+    double sweepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!output.empty()) {
+        sf::Image image;
+        image.create(static_cast<unsigned>(atlasWidth), static_cast<unsigned>(atlasHeight), atlas.data());
+        if (!image.saveToFile(output)) {
+            std::cerr << "Ошибка: не удалось сохранить " << output << std::endl;
+            return 1;
+        }
+    }
+    if (!csv.empty()) {
+        std::ofstream file(csv);
+        file << "constant,linear,quadratic,mean,max,lit_area,saturated_area\n";
+        for (size_t i = 0; i < settings.size(); ++i) {
+            file << settings[i].constant << ',' << settings[i].linear << ',' << settings[i].quadratic << ','
+                 << stats[i].mean << ',' << stats[i].max << ',' << stats[i].litArea << ','
+                 << stats[i].saturatedArea << '\n';
+        }
+        if (!file) {
+            std::cerr << "Ошибка: не удалось записать " << csv << std::endl;
+            return 1;
+        }
+    }
+
+    size_t saturatedSettings = 0;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < settings.size(); ++i) {
+        if (stats[i].saturatedArea > 0.0f) saturatedSettings++;
+        else order.push_back(i);
+    }
+    auto byLitArea = [&](size_t a, size_t b) {
+        return stats[a].litArea != stats[b].litArea ? stats[a].litArea > stats[b].litArea : stats[a].mean > stats[b].mean;
+    };
+    size_t shown = std::min<size_t>(5, order.size());
+    std::partial_sort(order.begin(), order.begin() + shown, order.end(), byLitArea);
+
+    double samples = static_cast<double>(settings.size()) * geometry.size();
+    std::cout << "Потоков: " << pool.threadCount() << ", наборов: " << settings.size() << ", точек на набор: "
+              << geometry.size() << " (" << columns << "x" << rows << "), поворот " << angle << "°\n"
+              << "Подготовка: " << prepareMs << " мс, перебор: " << sweepMs << " мс, "
+              << samples / (sweepMs * 1000.0) << " млн точек/с\n"
+              << "Наборов с пересветом: " << saturatedSettings << '\n';
+    if (shown > 0) std::cout << "Больше всего освещённой поверхности без пересвета:\n";
+    for (size_t k = 0; k < shown; ++k) {
+        const AttenuationSetting& s = settings[order[k]];
+        const IrradianceStats& st = stats[order[k]];
+        std::cout << "  " << s.constant << " " << s.linear << " " << s.quadratic << ": освещено "
+                  << 100.0f * st.litArea << "%, средняя " << st.mean << ", максимум " << st.max << '\n';
+    }
+    if (!output.empty()) std::cout << "Сохранено в " << output << '\n';
+    if (!csv.empty()) std::cout << "Счётчики в " << csv << '\n';
+    std::cout.flush();
+    return 0;
+}
@@ -1,369 +1,659 @@
 #include <SFML/Graphics.hpp>
+#include "raytracer.h"
 #include <vector>
 #include <cmath>
-#include <random>
 #include <iostream>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <string>
+#include <sstream>
+#include <map>
+#include <list>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#ifndef _WIN32
+    #include <csignal>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
 
 // Константы
 const int WIDTH = 800;
 const int HEIGHT = 600;
-const float EPSILON = 0.0001f;
 
 // Настраиваемые параметры
-struct RenderSettings {
-    int maxDepth = 3;     // Уменьшаем глубину рекурсии
-    int samples = 4;      // Уменьшаем количество сэмплов
-    int antialiasing = 2; // Уменьшаем антиалиасинг
+struct ViewerSettings : RenderSettings {
     bool needsUpdate = true;
     bool preview_mode = false;
     // Временные переменные для режима предпросмотра
     int temp_samples = 4;
     int temp_antialiasing = 2;
-} settings;
+};
 
-// Структуры для работы с векторами и цветом
-struct Vec3 {
-    float x, y, z;
-    
-    Vec3(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
-    
-    Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
-    Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
-    Vec3 operator*(float f) const { return Vec3(x * f, y * f, z * f); }
-    Vec3 operator*(const Vec3& v) const { return Vec3(x * v.x, y * v.y, z * v.z); }
-    Vec3 operator-() const { return Vec3(-x, -y, -z); }
+// Копирование кадра в изображение SFML и запись в файл
+bool saveFrame(const FrameBuffer& frame, sf::Image& image, const std::string& path) {
+    image.create(frame.width, frame.height, frame.pixels.data());
+    return image.saveToFile(path);
+}
+
+// Ключевые кадры анимации
+struct CameraKeyframe {
+    float time;
+    Camera camera;
+};
+
+struct ObjectKeyframe {
+    float time;
+    Vec3 center;
+    Vec3 rotation;  // углы Эйлера в градусах
+};
+
+// Поиск пары ключей вокруг момента time: возвращает индекс левого ключа
+// и долю t в интервале до следующего (t = 0 за пределами анимации)
+template <typename Key>
+size_t findKey(const std::vector<Key>& keys, float time, float& t) {
+    t = 0.0f;
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (time < keys[i].time) {
+            if (time <= keys[i - 1].time) return i - 1;
+            t = (time - keys[i - 1].time) / (keys[i].time - keys[i - 1].time);
+            return i - 1;
+        }
+    }
+    return keys.size() - 1;
+}
+
+struct Animation {
+    float fps = 24.0f;
+    int frames = 48;
+    std::vector<CameraKeyframe> camera;
+    // objects[i] - ключи для i-го экземпляра сцены (пустой вектор - экземпляр неподвижен)
+    std::vector<std::vector<ObjectKeyframe>> objects;
     
-    float dot(const Vec3& v) const { return x * v.x + y * v.y + z * v.z; }
-    Vec3 cross(const Vec3& v) const { 
-        return Vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); 
+    Camera cameraAt(float time) const {
+        float t;
+        size_t i = findKey(camera, time, t);
+        if (t == 0.0f) return camera[i].camera;
+        Camera result;
+        result.position = lerp(camera[i].camera.position, camera[i + 1].camera.position, t);
+        result.target = lerp(camera[i].camera.target, camera[i + 1].camera.target, t);
+        return result;
     }
     
-    float length() const { return std::sqrt(dot(*this)); }
-    Vec3 normalize() const { return *this * (1.0f / length()); }
+    // Устанавливает положения экземпляров сцены на момент времени time;
+    // перестраивается только верхний уровень BVH
+    void apply(Scene& scene, float time) const {
+        for (size_t i = 0; i < objects.size() && i < scene.instanceCount(); ++i) {
+            const auto& keys = objects[i];
+            if (keys.empty()) continue;
+            float t;
+            size_t k = findKey(keys, time, t);
+            if (t == 0.0f) {
+                scene.setTransform(i, Transform::make(keys[k].center, keys[k].rotation));
+            } else {
+                scene.setTransform(i, Transform::make(lerp(keys[k].center, keys[k + 1].center, t),
+                                                      lerp(keys[k].rotation, keys[k + 1].rotation, t)));
+            }
+        }
+        scene.refit();
+    }
 };
 
-// Луч
-struct Ray {
-    Vec3 origin;
-    Vec3 direction;
+// Демонстрационная анимация: облёт камеры и движение сферы и куба
+Animation makeDemoAnimation(int frames) {
+    Animation anim;
+    anim.frames = frames;
+    float duration = frames / anim.fps;
     
-    Ray(const Vec3& o, const Vec3& d) : origin(o), direction(d.normalize()) {}
-};
+    const int cameraKeys = 8;
+    for (int i = 0; i <= cameraKeys; ++i) {
+        float a = 0.5f * PI * (static_cast<float>(i) / cameraKeys - 0.5f);
+        Camera cam;
+        cam.target = Vec3(-0.5f, -0.5f, -5.5f);
+        cam.position = cam.target + Vec3(6.5f * std::sin(a), 1.0f, 6.5f * std::cos(a));
+        anim.camera.push_back({duration * i / cameraKeys, cam});
+    }
+    
+    anim.objects.resize(2);
+    anim.objects[0] = {
+        {0.0f, Vec3(0, 0, -5), Vec3()},
+        {duration * 0.5f, Vec3(0, 1.0f, -5), Vec3()},
+        {duration, Vec3(0, 0, -5), Vec3()}
+    };
+    anim.objects[1] = {
+        {0.0f, Vec3(-1.5f, -1.5f, -6.5f), Vec3(0, 0, 0)},
+        {duration, Vec3(1.5f, -1.5f, -6.5f), Vec3(45.0f, 180.0f, 0)}
+    };
+    return anim;
+}
 
-// Материал
-struct Material {
-    Vec3 color;
-    float diffuse;
-    float specular;
-    float reflection;
-    
-    Material(const Vec3& c = Vec3(1, 1, 1), float d = 0.7f, float s = 0.3f, float r = 0.5f)
-        : color(c), diffuse(d), specular(s), reflection(r) {}
-};
 
-// Базовый класс для объектов сцены
-class Object {
+// Пул буферов кадров: память выделяется один раз, затем буферы
+// переходят по кругу между трассировщиком и потоком записи
+class FramePool {
+    std::vector<FrameBuffer> frames;
+    std::vector<FrameBuffer*> free;
+    std::mutex mtx;
+    std::condition_variable cv;
+    
 public:
-    Material material;
+    FramePool(size_t count, int width, int height) : frames(count) {
+        for (auto& frame : frames) {
+            frame.resize(width, height);
+            free.push_back(&frame);
+        }
+    }
+    
+    FrameBuffer* acquire() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return !free.empty(); });
+        FrameBuffer* frame = free.back();
+        free.pop_back();
+        return frame;
+    }
     
-    virtual bool intersect(const Ray& ray, float& t) const = 0;
-    virtual Vec3 getNormal(const Vec3& point) const = 0;
-    virtual ~Object() = default;
+    void release(FrameBuffer* frame) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            free.push_back(frame);
+        }
+        cv.notify_one();
+    }
 };
 
-// Сфера
-class Sphere : public Object {
-    Vec3 center;
-    float radius;
+// Фоновый поток кодирования и записи кадров на диск. Очередь ограничена
+// размером пула, так что трассировщик ждёт только если запись отстала на
+// весь пул, а в обычном режиме запись кадра N идёт параллельно рендеру N+1
+class FrameWriter {
+    struct Job {
+        FrameBuffer* frame;
+        std::string path;
+    };
+    
+    FramePool& pool;
+    std::deque<Job> queue;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool finished = false;
+    int failed = 0;
+    std::thread worker;
+    
+    void run() {
+        sf::Image image;
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return finished || !queue.empty(); });
+                if (queue.empty()) return;
+                job = queue.front();
+                queue.pop_front();
+            }
+            if (!saveFrame(*job.frame, image, job.path)) {
+                std::cerr << "\nОшибка записи кадра " << job.path << std::endl;
+                std::lock_guard<std::mutex> lock(mtx);
+                failed++;
+            }
+            pool.release(job.frame);
+        }
+    }
     
 public:
-    Sphere(const Vec3& c, float r, const Material& m) : center(c), radius(r) {
-        material = m;
+    explicit FrameWriter(FramePool& p) : pool(p), worker(&FrameWriter::run, this) {}
+    
+    ~FrameWriter() {
+        finish();
     }
     
-    bool intersect(const Ray& ray, float& t) const override {
-        Vec3 oc = ray.origin - center;
-        float a = ray.direction.dot(ray.direction);
-        float b = 2.0f * oc.dot(ray.direction);
-        float c = oc.dot(oc) - radius * radius;
-        float discriminant = b * b - 4 * a * c;
-        
-        if (discriminant < 0) return false;
-        
-        float t0 = (-b - std::sqrt(discriminant)) / (2.0f * a);
-        float t1 = (-b + std::sqrt(discriminant)) / (2.0f * a);
-        
-        if (t0 > EPSILON) {
-            t = t0;
-            return true;
-        }
-        if (t1 > EPSILON) {
-            t = t1;
-            return true;
+    void submit(FrameBuffer* frame, const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back({frame, path});
         }
-        return false;
+        cv.notify_one();
     }
     
-    Vec3 getNormal(const Vec3& point) const override {
-        return (point - center).normalize();
+    // Дожидается записи всех кадров, возвращает число ошибок
+    int finish() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            finished = true;
+        }
+        cv.notify_one();
+        if (worker.joinable()) worker.join();
+        return failed;
     }
 };
 
-// Куб
-class Cube : public Object {
-    Vec3 min, max;
+// Рендер последовательности кадров без окна с конвейерной записью
+int renderAnimation(const RenderSettings& settings, const Animation& anim, const std::string& prefix,
+                    int extraInstances) {
+    Scene scene;
+    buildDemoScene(scene, extraInstances);
+    Renderer renderer;
+    FramePool pool(3, settings.width, settings.height);
+    FrameWriter writer(pool);
     
-public:
-    Cube(const Vec3& min_point, const Vec3& max_point, const Material& m) 
-        : min(min_point), max(max_point) {
-        material = m;
-    }
+    std::cout << "Рендер анимации: " << anim.frames << " кадров -> " << prefix << "_NNNN.png" << std::endl;
+    auto start = std::chrono::steady_clock::now();
     
-    bool intersect(const Ray& ray, float& t) const override {
-        Vec3 tMin = (min - ray.origin) * Vec3(1.0f / ray.direction.x, 
-                                             1.0f / ray.direction.y, 
-                                             1.0f / ray.direction.z);
-        Vec3 tMax = (max - ray.origin) * Vec3(1.0f / ray.direction.x, 
-                                             1.0f / ray.direction.y, 
-                                             1.0f / ray.direction.z);
+    for (int frame = 0; frame < anim.frames; ++frame) {
+        float time = frame / anim.fps;
+        anim.apply(scene, time);
         
-        Vec3 t1 = Vec3(std::min(tMin.x, tMax.x),
-                       std::min(tMin.y, tMax.y),
-                       std::min(tMin.z, tMax.z));
-        Vec3 t2 = Vec3(std::max(tMin.x, tMax.x),
-                       std::max(tMin.y, tMax.y),
-                       std::max(tMin.z, tMax.z));
+        FrameBuffer* buffer = pool.acquire();
+        renderer.render(scene, anim.cameraAt(time), settings, *buffer).wait();
         
-        float tNear = std::max(std::max(t1.x, t1.y), t1.z);
-        float tFar = std::min(std::min(t2.x, t2.y), t2.z);
-        
-        if (tNear > tFar || tFar < EPSILON) return false;
-        
-        t = tNear > EPSILON ? tNear : tFar;
-        return true;
+        char name[32];
+        std::snprintf(name, sizeof(name), "_%04d.png", frame);
+        writer.submit(buffer, prefix + name);
+        std::cout << "\rКадр " << (frame + 1) << "/" << anim.frames << std::flush;
     }
     
-    Vec3 getNormal(const Vec3& point) const override {
-        float dx1 = std::abs(point.x - min.x);
-        float dx2 = std::abs(point.x - max.x);
-        float dy1 = std::abs(point.y - min.y);
-        float dy2 = std::abs(point.y - max.y);
-        float dz1 = std::abs(point.z - min.z);
-        float dz2 = std::abs(point.z - max.z);
-        
-        float minDist = std::min({dx1, dx2, dy1, dy2, dz1, dz2});
-        
-        if (minDist == dx1) return Vec3(-1, 0, 0);
-        if (minDist == dx2) return Vec3(1, 0, 0);
-        if (minDist == dy1) return Vec3(0, -1, 0);
-        if (minDist == dy2) return Vec3(0, 1, 0);
-        if (minDist == dz1) return Vec3(0, 0, -1);
-        return Vec3(0, 0, 1);
-    }
-};
+    int failed = writer.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "\nГотово за " << seconds << " с (" << anim.frames / seconds << " кадр/с)" << std::endl;
+    return failed ? -1 : 0;
+}
 
-// Класс сцены
-class Scene {
-    std::vector<Object*> objects;
-    std::vector<Vec3> lights;
-    std::random_device rd;
-    std::mt19937 gen;
-    std::uniform_real_distribution<float> dis;
-    RenderSettings& settings;
+#ifndef _WIN32
+// Локальный сервер рендера. Сцена загружается и пул потоков создаётся один раз,
+// задачи принимаются через Unix-сокет, одна строка на соединение:
+//   RENDER <приоритет> <файл.png> [width=W] [height=H] [depth=D] [samples=S]
+//          [aa=A] [seed=N] [camera=x,y,z] [target=x,y,z]
+//       -> "QUEUED <id>", затем по завершении "DONE <id> <секунды>",
+//          "CANCELLED <id>" или "FAILED <id> <причина>"
+//   CANCEL <id>  -> "OK" / "UNKNOWN"
+//   STATUS       -> "QUEUED <n> RUNNING <id|->"
+//   SHUTDOWN     -> "OK", сервер завершает работу
+// Каждое соединение читается своим потоком, так что медленный клиент не
+// задерживает остальных.
+// Пример: echo "RENDER 5 out.png samples=8" | nc -U /tmp/lab5.sock
+class RenderServer {
+    struct Request {
+        int priority;
+        unsigned long id;
+        std::string output;
+        RenderSettings settings;
+        Camera camera;
+        int client;
+    };
     
-public:
-    Scene(RenderSettings& s) : gen(rd()), dis(0, 1), settings(s) {
-        // Добавляем объекты в сцену
-        objects.push_back(new Sphere(Vec3(0, 0, -5), 1, 
-                         Material(Vec3(1, 0.2f, 0.2f), 0.7f, 0.3f, 0.5f)));
-        objects.push_back(new Cube(Vec3(-2, -2, -7), Vec3(-1, -1, -6),
-                         Material(Vec3(0.2f, 1, 0.2f), 0.7f, 0.3f, 0.5f)));
-        
-        // Добавляем источники света
-        lights.push_back(Vec3(5, 5, 5));
-        lights.push_back(Vec3(-5, 5, 5));
+    // Больший приоритет - раньше; при равном - в порядке поступления
+    struct Order {
+        bool operator()(const Request& a, const Request& b) const {
+            return a.priority != b.priority ? a.priority < b.priority : a.id > b.id;
+        }
+    };
+    
+    const Scene& scene;
+    const RenderSettings defaults;
+    Renderer renderer;
+    std::priority_queue<Request, std::vector<Request>, Order> pending;
+    std::map<unsigned long, bool> queued;  // задачи в очереди: id -> отменена ли
+    unsigned long nextId = 1;
+    unsigned long runningId = 0;
+    RenderJob running;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    int wakeFds[2] = {-1, -1};  // SHUTDOWN будит цикл приёма соединений
+    
+    // Поток чтения команды одного соединения; finished - можно присоединять
+    struct Connection {
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+    
+    static void reply(int client, const std::string& text) {
+        std::string line = text + "\n";
+        ssize_t written = ::write(client, line.data(), line.size());
+        (void)written;
     }
     
-    ~Scene() {
-        for (auto obj : objects) {
-            delete obj;
-        }
+    static bool parseVec3(const std::string& text, Vec3& v) {
+        return std::sscanf(text.c_str(), "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
     }
     
-    Vec3 trace(const Ray& ray, int depth) {
-        // Ранний выход для слабых лучей
-        if (depth > 2 && dis(gen) > 0.5f) {
-            return Vec3();
+    bool parseRender(std::istringstream& in, Request& request, std::string& error) {
+        request.settings = defaults;
+        if (!(in >> request.priority >> request.output)) {
+            error = "ожидается RENDER <приоритет> <файл>";
+            return false;
         }
-        
-        if (depth >= settings.maxDepth) return Vec3();
-        
-        float closest = std::numeric_limits<float>::infinity();
-        const Object* hitObject = nullptr;
-        float t;
-        
-        // Находим ближайшее пересечение
-        for (const auto& obj : objects) {
-            if (obj->intersect(ray, t) && t < closest) {
-                closest = t;
-                hitObject = obj;
+        std::string option;
+        while (in >> option) {
+            size_t eq = option.find('=');
+            std::string key = option.substr(0, eq);
+            std::string value = eq == std::string::npos ? "" : option.substr(eq + 1);
+            RenderSettings& s = request.settings;
+            bool ok = true;
+            if (key == "width") s.width = std::atoi(value.c_str());
+            else if (key == "height") s.height = std::atoi(value.c_str());
+            else if (key == "depth") s.maxDepth = std::atoi(value.c_str());
+            else if (key == "samples") s.samples = std::atoi(value.c_str());
+            else if (key == "aa") s.antialiasing = std::atoi(value.c_str());
+            else if (key == "seed") s.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+            else if (key == "camera") ok = parseVec3(value, request.camera.position);
+            else if (key == "target") ok = parseVec3(value, request.camera.target);
+            else ok = false;
+            if (!ok) {
+                error = "неверный параметр " + option;
+                return false;
             }
         }
+        if (request.settings.width <= 0 || request.settings.height <= 0 ||
+            request.settings.width > 16384 || request.settings.height > 16384 ||
+            request.settings.samples < 1 || request.settings.maxDepth < 1 ||
+            request.settings.antialiasing < 1) {
+            error = "недопустимые настройки рендера";
+            return false;
+        }
+        return true;
+    }
+    
+    // Обработка одной команды; возвращает true, если соединение
+    // передано в очередь и будет закрыто после рендера
+    bool handle(int client, const std::string& line) {
+        std::istringstream in(line);
+        std::string command;
+        in >> command;
+        std::lock_guard<std::mutex> lock(mtx);
         
-        if (!hitObject) return Vec3();
-        
-        Vec3 hitPoint = ray.origin + ray.direction * closest;
-        Vec3 normal = hitObject->getNormal(hitPoint);
-        Vec3 color;
-        
-        // Прямое освещение
-        for (const auto& light : lights) {
-            Vec3 lightDir = (light - hitPoint).normalize();
-            Ray shadowRay(hitPoint + normal * EPSILON, lightDir);
-            bool inShadow = false;
-            
-            for (const auto& obj : objects) {
-                if (obj->intersect(shadowRay, t)) {
-                    inShadow = true;
-                    break;
+        // Соединение принято до SHUTDOWN, но прочитано после
+        if (stopping) {
+            reply(client, "FAILED - сервер завершает работу");
+            return false;
+        }
+        if (command == "RENDER") {
+            Request request;
+            std::string error;
+            if (!parseRender(in, request, error)) {
+                reply(client, "FAILED - " + error);
+                return false;
+            }
+            request.id = nextId++;
+            request.client = client;
+            pending.push(request);
+            queued[request.id] = false;
+            reply(client, "QUEUED " + std::to_string(request.id));
+            cv.notify_one();
+            return true;
+        }
+        if (command == "CANCEL") {
+            unsigned long id = 0;
+            in >> id;
+            if (id != 0 && id == runningId) {
+                running.cancel();
+                reply(client, "OK");
+            } else if (queued.count(id)) {
+                queued[id] = true;
+                reply(client, "OK");
+            } else {
+                reply(client, "UNKNOWN");
+            }
+            return false;
+        }
+        if (command == "STATUS") {
+            reply(client, "QUEUED " + std::to_string(pending.size()) + " RUNNING " +
+                          (runningId ? std::to_string(runningId) : std::string("-")));
+            return false;
+        }
+        if (command == "SHUTDOWN") {
+            stopping = true;
+            if (runningId) running.cancel();
+            reply(client, "OK");
+            cv.notify_one();
+            char wake = 1;
+            ssize_t written = ::write(wakeFds[1], &wake, 1);
+            (void)written;
+            return false;
+        }
+        reply(client, "FAILED - неизвестная команда");
+        return false;
+    }
+    
+    // Чтение и обработка команды соединения
+    void serve(int client, std::atomic<bool>& finished) {
+        // Клиент локальный, но зависший клиент не должен держать поток вечно
+        timeval timeout{2, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string line;
+        char c;
+        while (line.size() < 4096 && ::read(client, &c, 1) == 1 && c != '\n') {
+            line += c;
+        }
+        if (!handle(client, line)) {
+            ::close(client);
+        }
+        finished = true;
+    }
+    
+    // Поток выполнения задач: берёт задачу с наибольшим приоритетом
+    void dispatch() {
+        FrameBuffer frame;
+        sf::Image image;
+        for (;;) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return stopping || !pending.empty(); });
+                if (stopping) break;
+                request = pending.top();
+                pending.pop();
+                bool wasCancelled = queued[request.id];
+                queued.erase(request.id);
+                if (wasCancelled) {
+                    reply(request.client, "CANCELLED " + std::to_string(request.id));
+                    ::close(request.client);
+                    continue;
                 }
+                runningId = request.id;
+                running = renderer.render(scene, request.camera, request.settings, frame);
             }
             
-            if (!inShadow) {
-                float diff = std::max(0.0f, normal.dot(lightDir));
-                Vec3 reflection = (normal * (2.0f * normal.dot(lightDir)) - lightDir).normalize();
-                float spec = std::pow(std::max(0.0f, reflection.dot(-ray.direction)), 20);
-                
-                color = color + hitObject->material.color * 
-                        (hitObject->material.diffuse * diff + 
-                         hitObject->material.specular * spec);
+            auto start = std::chrono::steady_clock::now();
+            bool complete = running.wait();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::string id = std::to_string(request.id);
+            
+            if (!complete) {
+                reply(request.client, "CANCELLED " + id);
+            } else if (!saveFrame(frame, image, request.output)) {
+                reply(request.client, "FAILED " + id + " не удалось записать " + request.output);
+            } else {
+                reply(request.client, "DONE " + id + " " + std::to_string(seconds));
             }
+            std::cout << "Задача " << id << ": " << (complete ? "готово" : "отменено")
+                      << " за " << seconds << " с" << std::endl;
+            ::close(request.client);
+            
+            std::lock_guard<std::mutex> lock(mtx);
+            runningId = 0;
         }
         
-        // Глобальное освещение (Monte Carlo)
-        if (depth < settings.maxDepth) {
-            for (int i = 0; i < settings.samples; ++i) {
-                Vec3 randomDir = getRandomHemisphereDirection(normal);
-                Ray bounceRay(hitPoint + normal * EPSILON, randomDir);
-                color = color + trace(bounceRay, depth + 1) * hitObject->material.reflection * 
-                        (1.0f / settings.samples);
-            }
+        // Оставшиеся задачи при завершении сервера
+        std::lock_guard<std::mutex> lock(mtx);
+        while (!pending.empty()) {
+            reply(pending.top().client, "CANCELLED " + std::to_string(pending.top().id));
+            ::close(pending.top().client);
+            pending.pop();
         }
-        
-        return color;
     }
     
-    Vec3 getRandomHemisphereDirection(const Vec3& normal) {
-        float theta = 2 * M_PI * dis(gen);
-        float phi = std::acos(2 * dis(gen) - 1);
-        float x = std::sin(phi) * std::cos(theta);
-        float y = std::sin(phi) * std::sin(theta);
-        float z = std::cos(phi);
-        Vec3 dir(x, y, z);
+public:
+    RenderServer(const Scene& s, const RenderSettings& d) : scene(s), defaults(d) {}
+    
+    int run(const std::string& path) {
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (listener < 0 || path.size() >= sizeof(address.sun_path) || ::pipe(wakeFds) < 0) {
+            std::cerr << "Не удалось создать сокет " << path << std::endl;
+            if (listener >= 0) ::close(listener);
+            return -1;
+        }
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        ::unlink(path.c_str());
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            ::listen(listener, 16) < 0) {
+            std::cerr << "Не удалось открыть сокет " << path << std::endl;
+            ::close(listener);
+            ::close(wakeFds[0]);
+            ::close(wakeFds[1]);
+            return -1;
+        }
+        // Клиент может отключиться до ответа - запись в сокет не должна завершать сервер
+        std::signal(SIGPIPE, SIG_IGN);
+        std::cout << "Сервер рендера: " << path << ", потоков: " << renderer.threadCount() << std::endl;
         
-        if (dir.dot(normal) < 0) {
-            dir = dir * -1;
+        std::thread dispatcher(&RenderServer::dispatch, this);
+        std::list<Connection> connections;
+        pollfd fds[2] = {{listener, POLLIN, 0}, {wakeFds[0], POLLIN, 0}};
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (stopping) break;
+            }
+            if (::poll(fds, 2, -1) <= 0 || !(fds[0].revents & POLLIN)) continue;
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            
+            // Потоки завершённых соединений присоединяются при следующем приёме
+            for (auto it = connections.begin(); it != connections.end();) {
+                if (it->finished) {
+                    it->thread.join();
+                    it = connections.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            connections.emplace_back();
+            Connection& connection = connections.back();
+            connection.thread = std::thread(&RenderServer::serve, this, client, std::ref(connection.finished));
         }
         
-        return dir.normalize();
+        for (Connection& connection : connections) {
+            connection.thread.join();
+        }
+        dispatcher.join();
+        ::close(listener);
+        ::close(wakeFds[0]);
+        ::close(wakeFds[1]);
+        ::unlink(path.c_str());
+        return 0;
     }
 };
+#endif
 
-int main() {
+int main(int argc, char* argv[]) {
+    ViewerSettings settings;
+    settings.width = WIDTH;
+    settings.height = HEIGHT;
+    
+    // Параметры командной строки:
+    //   --animate [кадров] [префикс файлов] - рендер анимации без окна
+    //   --server <путь к сокету> - сервер рендера (см. RenderServer)
+    //   --instances N - добавить в сцену N копий сферы и куба
+    bool animate = false;
+    int frames = 48;
+    std::string prefix = "frame";
+    std::string socketPath;
+    int extraInstances = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            extraInstances = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--animate") == 0) {
+            animate = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') frames = std::max(1, std::atoi(argv[++i]));
+            if (i + 1 < argc && argv[i + 1][0] != '-') prefix = argv[++i];
+        }
+    }
+    
+    if (animate) {
+        return renderAnimation(settings, makeDemoAnimation(frames), prefix, extraInstances);
+    }
+    
+    if (!socketPath.empty()) {
+#ifndef _WIN32
+        Scene scene;
+        buildDemoScene(scene, extraInstances);
+        RenderServer server(scene, settings);
+        return server.run(socketPath);
+#else
+        std::cerr << "Серверный режим доступен только на POSIX-системах" << std::endl;
+        return -1;
+#endif
+    }
+    
     std::cout << "Ray Tracing - Global Illumination\n";
     std::cout << "Управление:\n";
     std::cout << "↑/↓ - Изменение глубины рекурсии (количество отражений)\n";
     std::cout << "←/→ - Изменение количества сэмплов (качество освещения)\n";
     std::cout << "A/Z - Изменение уровня антиалиасинга\n";
     std::cout << "P - Переключение режима предпросмотра\n";
-    std::cout << "ESC - Выход\n\n";
+    std::cout << "ESC - Выход\n";
+    std::cout << "Анимация: lab5 --animate [кадров] [префикс]\n";
+    std::cout << "Сервер рендера: lab5 --server <сокет>\n";
+    std::cout << "Большая сцена: lab5 --instances N\n\n";
     
     sf::RenderWindow window(sf::VideoMode(WIDTH, HEIGHT), "Ray Tracing - Global Illumination");
-    sf::Image image;
-    image.create(WIDTH, HEIGHT);
+    window.setFramerateLimit(30);
     sf::Texture texture;
-    sf::Sprite sprite;
+    texture.create(WIDTH, HEIGHT);
+    sf::Sprite sprite(texture);
     
-    RenderSettings settings;
-    Scene scene(settings);
-    Vec3 camera(0, 0, 1);
+    Scene scene;
+    buildDemoScene(scene, extraInstances);
+    Camera camera;
+    Renderer renderer;
     
-    // Генератор случайных чисел
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dis(0, 1);
+    // Кадр рендерится в фоне; готовые фрагменты копируются в display
+    // и показываются по мере готовности, окно при этом не блокируется
+    FrameBuffer frame;
+    FrameBuffer display;
+    display.resize(WIDTH, HEIGHT);
+    std::mutex displayMutex;
+    bool displayDirty = false;
+    std::atomic<int> lastPercent{-1};
+    RenderJob job;
     
-    std::atomic<int> progress{0};
-    const int total_pixels = WIDTH * HEIGHT;
+    RenderCallbacks callbacks;
+    callbacks.tile = [&](const FrameBuffer& source, const Tile& tile) {
+        std::lock_guard<std::mutex> lock(displayMutex);
+        for (int y = tile.y; y < tile.y + tile.height; ++y) {
+            size_t offset = (static_cast<size_t>(y) * source.width + tile.x) * 4;
+            std::memcpy(&display.pixels[offset], &source.pixels[offset], tile.width * 4);
+        }
+        displayDirty = true;
+    };
+    callbacks.progress = [&](float done) {
+        int percent = static_cast<int>(done * 100);
+        int previous = lastPercent.load();
+        if (percent > previous && lastPercent.compare_exchange_strong(previous, percent)) {
+            std::cout << "\rПрогресс: " << percent << "%" << std::flush;
+        }
+    };
     
-    // Функция рендеринга
+    // Функция рендеринга: незаконченный кадр отменяется и начинается новый
     auto renderScene = [&]() {
-        const int num_threads = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads;
-        std::mutex mtx;
-        
-        auto renderPart = [&](int start_y, int end_y) {
-            for (int y = start_y; y < end_y; ++y) {
-                for (int x = 0; x < WIDTH; ++x) {
-                    Vec3 finalColor;
-                    // Антиалиасинг через multiple sampling
-                    for(int aa = 0; aa < settings.antialiasing; aa++) {
-                        for(int ab = 0; ab < settings.antialiasing; ab++) {
-                            float rx = dis(gen) / settings.antialiasing;
-                            float ry = dis(gen) / settings.antialiasing;
-                            float fx = (2.0f * (x + (aa + rx)/settings.antialiasing) - WIDTH) / HEIGHT;
-                            float fy = (2.0f * (y + (ab + ry)/settings.antialiasing) - HEIGHT) / HEIGHT;
-                            Vec3 direction(fx, -fy, -1);
-                            
-                            Ray ray(camera, direction.normalize());
-                            finalColor = finalColor + scene.trace(ray, 0);
-                        }
-                    }
-                    finalColor = finalColor * (1.0f / (settings.antialiasing * settings.antialiasing));
-
-                    // Тональная компрессия (tone mapping) с улучшенной гамма-коррекцией
-                    const float gamma = 2.2f;
-                    finalColor = Vec3(
-                        std::pow(std::min(1.0f, finalColor.x), 1.0f/gamma),
-                        std::pow(std::min(1.0f, finalColor.y), 1.0f/gamma),
-                        std::pow(std::min(1.0f, finalColor.z), 1.0f/gamma)
-                    );
-
-                    std::lock_guard<std::mutex> lock(mtx);
-                    image.setPixel(x, y, 
-                        sf::Color(
-                            static_cast<sf::Uint8>(finalColor.x * 255),
-                            static_cast<sf::Uint8>(finalColor.y * 255),
-                            static_cast<sf::Uint8>(finalColor.z * 255)
-                        )
-                    );
-
-                    progress++;
-                    if (progress % (total_pixels / 100) == 0) {
-                        std::cout << "\rПрогресс: " << (progress * 100 / total_pixels) << "%" << std::flush;
-                    }
-                }
-            }
-        };
-        
-        // Разделяем работу между потоками
-        int rows_per_thread = HEIGHT / num_threads;
-        for (int i = 0; i < num_threads; ++i) {
-            int start_y = i * rows_per_thread;
-            int end_y = (i == num_threads - 1) ? HEIGHT : (i + 1) * rows_per_thread;
-            threads.emplace_back(renderPart, start_y, end_y);
-        }
-        
-        // Ждем завершения всех потоков
-        for (auto& thread : threads) {
-            thread.join();
+        if (job.valid()) {
+            job.cancel();
+            job.wait();
         }
-        
-        texture.loadFromImage(image);
-        sprite.setTexture(texture);
+        lastPercent = -1;
+        job = renderer.render(scene, camera, settings, frame, callbacks);
         settings.needsUpdate = false;
     };
     
@@ -434,10 +724,22 @@ int main() {
             renderScene();
         }
         
+        {
+            std::lock_guard<std::mutex> lock(displayMutex);
+            if (displayDirty) {
+                texture.update(display.pixels.data());
+                displayDirty = false;
+            }
+        }
+        
         window.clear();
         window.draw(sprite);
         window.display();
     }
     
+    if (job.valid()) {
+        job.cancel();
+        job.wait();
+    }
     return 0;
 }
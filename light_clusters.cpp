@@ -0,0 +1,227 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+// Прожекторов на одну задачу при расчёте их границ
+const size_t LIGHT_CHUNK = 64;
+
+} // namespace
+
+LightClusters::LightClusters(TaskPool& taskPool) : pool(taskPool) {}
+
+void LightClusters::configure(int newWidth, int newHeight, float fovY, float newNear, float newFar) {
+    width = std::max(1, newWidth);
+    height = std::max(1, newHeight);
+    columns = (width + TILE_PIXELS - 1) / TILE_PIXELS;
+    rows = (height + TILE_PIXELS - 1) / TILE_PIXELS;
+    tanHalfY = std::tan(radians(fovY) / 2);
+    tanHalfX = tanHalfY * width / height;
+    zNear = newNear;
+    zFar = newFar;
+    sliceScale = SLICES / std::log(zFar / zNear);
+
+    // Границы кластера по x и y берутся на ближней и дальней глубине слоя
+    boxes.resize(static_cast<size_t>(columns) * rows * SLICES);
+    for (int z = 0; z < SLICES; ++z) {
+        float depths[2] = {zNear * std::exp(z / sliceScale), zNear * std::exp((z + 1) / sliceScale)};
+        for (int y = 0; y < rows; ++y) {
+            float ndcY[2] = {2.0f * y * TILE_PIXELS / height - 1.0f,
+                             2.0f * std::min(height, (y + 1) * TILE_PIXELS) / height - 1.0f};
+            for (int x = 0; x < columns; ++x) {
+                float ndcX[2] = {2.0f * x * TILE_PIXELS / width - 1.0f,
+                                 2.0f * std::min(width, (x + 1) * TILE_PIXELS) / width - 1.0f};
+                ClusterBox& box = boxes[(static_cast<size_t>(z) * rows + y) * columns + x];
+                box.min[0] = std::min(ndcX[0] * depths[0], ndcX[0] * depths[1]) * tanHalfX;
+                box.max[0] = std::max(ndcX[1] * depths[0], ndcX[1] * depths[1]) * tanHalfX;
+                box.min[1] = std::min(ndcY[0] * depths[0], ndcY[0] * depths[1]) * tanHalfY;
+                box.max[1] = std::max(ndcY[1] * depths[0], ndcY[1] * depths[1]) * tanHalfY;
+                box.min[2] = -depths[1];
+                box.max[2] = -depths[0];
+                float squared = 0.0f;
+                for (int k = 0; k < 3; ++k) {
+                    box.center[k] = (box.min[k] + box.max[k]) * 0.5f;
+                    squared += (box.max[k] - box.center[k]) * (box.max[k] - box.center[k]);
+                }
+                box.radius = std::sqrt(squared);
+            }
+        }
+    }
+    rowLists.resize(static_cast<size_t>(rows) * SLICES);
+    ranges.assign(2 * boxes.size(), 0);
+}
+
+void LightClusters::boundLight(const SpotLightSource& light, LightBounds& out) const {
+    for (int k = 0; k < 3; ++k) {
+        out.position[k] = light.position[k];
+        out.direction[k] = light.direction[k];
+    }
+    float angle = radians(light.cutoff);
+    out.cosCutoff = std::cos(angle);
+    out.sinCutoff = std::sin(angle);
+    out.range = lightRange(light);
+    out.x0 = out.y0 = out.z0 = 0;
+    out.x1 = out.y1 = out.z1 = -1;
+    if (out.range <= 0.0f) return;
+
+    // Шар вокруг сектора шара с углом cutoff: для широкого конуса - вокруг
+    // основания, для узкого - через вершину и край основания
+    float offset;
+    if (out.cosCutoff < std::sqrt(0.5f)) {
+        offset = out.cosCutoff * out.range;
+        out.radius = out.sinCutoff * out.range;
+    }
+    else {
+        offset = out.range / (2 * out.cosCutoff);
+        out.radius = offset;
+    }
+    for (int k = 0; k < 3; ++k) out.center[k] = out.position[k] + out.direction[k] * offset;
+
+    // Слои по глубине шара
+    float nearest = -out.center[2] - out.radius;
+    float farthest = -out.center[2] + out.radius;
+    if (farthest <= zNear || nearest >= zFar) return;
+    auto sliceOf = [&](float depth) {
+        if (depth <= zNear) return 0;
+        return std::min(SLICES - 1, static_cast<int>(std::log(depth / zNear) * sliceScale));
+    };
+    out.z0 = sliceOf(nearest);
+    out.z1 = sliceOf(farthest);
+
+    // Столбцы и строки по проекции коробки шара. Если шар задевает ближнюю
+    // плоскость, проекция не ограничена и проверяются все
+    out.x0 = out.y0 = 0;
+    out.x1 = columns - 1;
+    out.y1 = rows - 1;
+    if (nearest > zNear) {
+        const float* c = out.center;
+        float r = out.radius;
+        float ndc[4] = {
+            std::min((c[0] - r) / nearest, (c[0] - r) / farthest) / tanHalfX,
+            std::max((c[0] + r) / nearest, (c[0] + r) / farthest) / tanHalfX,
+            std::min((c[1] - r) / nearest, (c[1] - r) / farthest) / tanHalfY,
+            std::max((c[1] + r) / nearest, (c[1] + r) / farthest) / tanHalfY,
+        };
+        if (ndc[0] > 1.0f || ndc[1] < -1.0f || ndc[2] > 1.0f || ndc[3] < -1.0f) {
+            out.z1 = -1;
+            return;
+        }
+        auto tileOf = [](float value, int pixels, int tiles) {
+            float pixel = (value + 1.0f) * 0.5f * pixels;
+            return std::max(0, std::min(tiles - 1, static_cast<int>(std::floor(pixel / TILE_PIXELS))));
+        };
+        out.x0 = tileOf(ndc[0], width, columns);
+        out.x1 = tileOf(ndc[1], width, columns);
+        out.y0 = tileOf(ndc[2], height, rows);
+        out.y1 = tileOf(ndc[3], height, rows);
+    }
+}
+
+void LightClusters::fillRow(int slice, int row, RowLists& lists) {
+    lists.indices.clear();
+    lists.candidates.clear();
+    lists.maxCount = 0;
+    lists.busy = 0;
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        const LightBounds& light = bounds[i];
+        if (slice >= light.z0 && slice <= light.z1 && row >= light.y0 && row <= light.y1) {
+            lists.candidates.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    size_t first = (static_cast<size_t>(slice) * rows + row) * columns;
+    for (int x = 0; x < columns; ++x) {
+        const ClusterBox& box = boxes[first + x];
+        uint32_t start = static_cast<uint32_t>(lists.indices.size());
+        for (uint32_t index : lists.candidates) {
+            const LightBounds& light = bounds[index];
+            if (x < light.x0 || x > light.x1) continue;
+
+            // Шар вокруг конуса против коробки
+            float squared = 0.0f;
+            for (int k = 0; k < 3; ++k) {
+                float d = std::max(box.min[k] - light.center[k], 0.0f) + std::max(light.center[k] - box.max[k], 0.0f);
+                squared += d * d;
+            }
+            if (squared > light.radius * light.radius) continue;
+
+            // Конус против шара кластера
+            if (!coneTouchesSphere(light.position, light.direction, light.cosCutoff, light.sinCutoff, light.range,
+                                   box.center, box.radius)) {
+                continue;
+            }
+
+            lists.indices.push_back(index);
+        }
+        uint32_t count = static_cast<uint32_t>(lists.indices.size()) - start;
+        ranges[2 * (first + x)] = start;
+        ranges[2 * (first + x) + 1] = count;
+        lists.maxCount = std::max(lists.maxCount, count);
+        if (count > 0) lists.busy++;
+    }
+}
+
+void LightClusters::boundLights(const std::vector<SpotLightSource>& lights) {
+    auto start = std::chrono::steady_clock::now();
+
+    bounds.resize(lights.size());
+    distances.resize(lights.size());
+    pool.parallelFor((lights.size() + LIGHT_CHUNK - 1) / LIGHT_CHUNK, [&](size_t chunk) {
+        size_t end = std::min(lights.size(), (chunk + 1) * LIGHT_CHUNK);
+        for (size_t i = chunk * LIGHT_CHUNK; i < end; ++i) {
+            boundLight(lights[i], bounds[i]);
+            distances[i] = bounds[i].range;
+        }
+    });
+
+    lastStats = LightClusterStats();
+    lastStats.lights = lights.size();
+    for (const LightBounds& light : bounds) {
+        if (light.z0 <= light.z1) lastStats.visibleLights++;
+    }
+    lastStats.buildMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool LightClusters::lightRect(size_t light, int rect[4]) const {
+    const LightBounds& bound = bounds[light];
+    if (bound.z0 > bound.z1) return false;
+    rect[0] = bound.x0 * TILE_PIXELS;
+    rect[1] = bound.y0 * TILE_PIXELS;
+    rect[2] = std::min(width, (bound.x1 + 1) * TILE_PIXELS) - rect[0];
+    rect[3] = std::min(height, (bound.y1 + 1) * TILE_PIXELS) - rect[1];
+    return true;
+}
+
+void LightClusters::build(const std::vector<SpotLightSource>& lights) {
+    auto start = std::chrono::steady_clock::now();
+    boundLights(lights);
+
+    // Каждая строка слоя заполняет свои кластеры со смещениями от начала
+    // своего списка; затем списки сдвигаются на место в общем массиве
+    pool.parallelFor(rowLists.size(), [&](size_t task) {
+        fillRow(static_cast<int>(task / rows), static_cast<int>(task % rows), rowLists[task]);
+    });
+    bases.resize(rowLists.size());
+    size_t total = 0;
+    for (size_t task = 0; task < rowLists.size(); ++task) {
+        bases[task] = total;
+        total += rowLists[task].indices.size();
+        lastStats.maxPerCluster = std::max(lastStats.maxPerCluster, rowLists[task].maxCount);
+        lastStats.busyClusters += rowLists[task].busy;
+    }
+    lightIndices.resize(total);
+    pool.parallelFor(rowLists.size(), [&](size_t task) {
+        const std::vector<uint32_t>& local = rowLists[task].indices;
+        std::copy(local.begin(), local.end(), lightIndices.begin() + bases[task]);
+        size_t first = task * columns;
+        for (int x = 0; x < columns; ++x) ranges[2 * (first + x)] += static_cast<uint32_t>(bases[task]);
+    });
+
+    lastStats.references = total;
+    lastStats.buildMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Раскладка прожекторов по кластерам пирамиды видимости (лабораторная
+// работа 4). Экран делится на квадраты по TILE_PIXELS пикселей, глубина -
+// на SLICES слоёв, толщина которых растёт с расстоянием (границы по
+// геометрической прогрессии от ближней плоскости к дальней). Каждому
+// кластеру достаётся список прожекторов, конус которых (в пределах
+// дальности света) может его задеть, и фрагмент проверяет только их.
+// Проверка: шар вокруг конуса против коробки кластера, затем сам конус
+// против шара вокруг кластера. Прожекторы и строки кластеров каждого слоя
+// обрабатываются на всех потоках пула; итоговые списки лежат подряд в
+// одном массиве, как их загружают в буфер видеокарты
+
+#include "lab4_scene.h"
+#include "task_pool.h"
+#include <cstdint>
+#include <vector>
+
+// Счётчики последней раскладки
+struct LightClusterStats {
+    size_t lights = 0;          // переданных в build
+    size_t visibleLights = 0;   // с шаром, задевающим пирамиду видимости
+    size_t references = 0;      // всего ссылок на прожекторы в списках
+    size_t busyClusters = 0;    // кластеров с непустым списком
+    uint32_t maxPerCluster = 0;
+    double buildMs = 0.0;
+};
+
+class LightClusters {
+public:
+    static const int TILE_PIXELS = 32;
+    static const int SLICES = 32;
+
+    explicit LightClusters(TaskPool& pool = TaskPool::shared());
+
+    // Размер кадра и перспектива, как у glFrustum с углом обзора fovY (градусы)
+    void configure(int width, int height, float fovY, float zNear, float zFar);
+
+    // Прожекторы в координатах вида (камера в начале, смотрит вдоль -Z)
+    void build(const std::vector<SpotLightSource>& lights);
+
+    // Только дальность и границы прожекторов на экране, без списков кластеров
+    void boundLights(const std::vector<SpotLightSource>& lights);
+
+    // Прямоугольник экрана (x, y снизу, ширина, высота в пикселях), вне
+    // которого прожектор light ничего не освещает, с точностью до квадратов
+    // кластеров; false - прожектор не виден
+    bool lightRect(size_t light, int rect[4]) const;
+
+    int columnCount() const { return columns; }
+    int rowCount() const { return rows; }
+    size_t clusterCount() const { return boxes.size(); }
+    float nearPlane() const { return zNear; }
+
+    // Номер слоя по расстоянию d от камеры: floor(log(d / near) * depthScale())
+    float depthScale() const { return sliceScale; }
+
+    // По два числа на кластер: начало списка в indices() и его длина.
+    // Кластер (столбец x, строка y снизу, слой z) имеет номер (z * rows + y) * columns + x
+    const std::vector<uint32_t>& clusters() const { return ranges; }
+    const std::vector<uint32_t>& indices() const { return lightIndices; }
+
+    // Дальность света каждого прожектора последней раскладки
+    const std::vector<float>& lightRanges() const { return distances; }
+
+    const LightClusterStats& stats() const { return lastStats; }
+
+private:
+    // Коробка кластера в координатах вида и описанный вокруг неё шар
+    struct ClusterBox {
+        float min[3], max[3];
+        float center[3];
+        float radius;
+    };
+
+    // Прожектор в координатах вида и диапазон кластеров, которые он может задеть
+    struct LightBounds {
+        float position[3], direction[3];
+        float cosCutoff, sinCutoff, range;
+        float center[3], radius;    // шар вокруг конуса
+        int x0, x1, y0, y1, z0, z1; // пустой диапазон - прожектор не виден
+    };
+
+    // Списки одной строки кластеров одного слоя
+    struct RowLists {
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> candidates;
+        uint32_t maxCount = 0;
+        size_t busy = 0;
+    };
+
+    TaskPool& pool;
+    int width = 1, height = 1;
+    int columns = 1, rows = 1;
+    float tanHalfX = 1.0f, tanHalfY = 1.0f;
+    float zNear = 0.1f, zFar = 100.0f;
+    float sliceScale = 1.0f;
+
+    std::vector<ClusterBox> boxes;
+    std::vector<LightBounds> bounds;
+    std::vector<RowLists> rowLists;     // slice * rows + row
+    std::vector<size_t> bases;          // начало списков строки в lightIndices
+    std::vector<uint32_t> ranges;
+    std::vector<uint32_t> lightIndices;
+    std::vector<float> distances;
+    LightClusterStats lastStats;
+
+    void boundLight(const SpotLightSource& light, LightBounds& out) const;
+    void fillRow(int slice, int row, RowLists& lists);
+};
@@ -0,0 +1,295 @@
+#include "line_raster.h"
+
+#include <SFML/Graphics/Image.hpp>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// Отрезков в одной части при раскладке по фрагментам; номер отрезка
+// внутри части помещается в uint16_t
+const size_t BIN_CHUNK = 1 << 16;
+
+// Фрагмент кадра [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+struct PixelLine {
+    float x0, y0, x1, y1;
+};
+
+inline float fpart(float x) {
+    return x - std::floor(x);
+}
+
+inline float rfpart(float x) {
+    return 1.0f - fpart(x);
+}
+
+inline int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// Запись пикселей одного фрагмента: всё, что за его пределами, отбрасывается
+struct TileWriter {
+    uint8_t* pixels;
+    int width;
+    Tile tile;
+    sf::Color color;
+    bool steep;  // оси поменяны местами: major - это y
+
+    void plot(int major, int minor, float coverage) {
+        int x = steep ? minor : major;
+        int y = steep ? major : minor;
+        if (x < tile.x0 || x >= tile.x1 || y < tile.y0 || y >= tile.y1) return;
+        float a = coverage * color.a / 255.0f;
+        if (a <= 0.0f) return;
+        uint8_t* p = pixels + 4 * (static_cast<size_t>(y) * width + x);
+        p[0] = static_cast<uint8_t>(p[0] + (color.r - p[0]) * a + 0.5f);
+        p[1] = static_cast<uint8_t>(p[1] + (color.g - p[1]) * a + 0.5f);
+        p[2] = static_cast<uint8_t>(p[2] + (color.b - p[2]) * a + 0.5f);
+        p[3] = static_cast<uint8_t>(p[3] + (255 - p[3]) * a + 0.5f);
+    }
+
+    // Диапазон по главной оси, в котором прямая minor = m0 + gradient * (major - major0)
+    // может задеть фрагмент; from и to сужаются
+    void limit(double m0, double gradient, int major0, int& from, int& to) const {
+        double lo = (steep ? tile.x0 : tile.y0) - 1;
+        double hi = steep ? tile.x1 : tile.y1;
+        if (gradient == 0) {
+            if (m0 < lo || m0 >= hi) to = from - 1;
+            return;
+        }
+        double a = major0 + (lo - m0) / gradient;
+        double b = major0 + (hi - m0) / gradient;
+        if (a > b) std::swap(a, b);
+        from = static_cast<int>(std::max<double>(from, std::floor(a)));
+        to = static_cast<int>(std::min<double>(to, std::ceil(b)));
+    }
+};
+
+// Алгоритм Ву с центрами пикселей в целых координатах. Промежуточные значения
+// считаются от первого конца, а не накоплением, поэтому пиксели одинаковы
+// в любом фрагменте
+void drawWu(PixelLine line, TileWriter& writer) {
+    float x0 = line.x0 - 0.5f, y0 = line.y0 - 0.5f;
+    float x1 = line.x1 - 0.5f, y1 = line.y1 - 0.5f;
+    writer.steep = std::fabs(y1 - y0) > std::fabs(x1 - x0);
+    if (writer.steep) {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+    if (x0 > x1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+    float dx = x1 - x0;
+    float gradient = dx == 0.0f ? 1.0f : (y1 - y0) / dx;
+
+    // Первый конец
+    float xend = std::round(x0);
+    float yend = y0 + gradient * (xend - x0);
+    float xgap = rfpart(x0 + 0.5f);
+    int xp1 = static_cast<int>(xend);
+    int yp1 = static_cast<int>(std::floor(yend));
+    writer.plot(xp1, yp1, rfpart(yend) * xgap);
+    writer.plot(xp1, yp1 + 1, fpart(yend) * xgap);
+    float yStart = yend;
+
+    // Второй конец
+    xend = std::round(x1);
+    yend = y1 + gradient * (xend - x1);
+    xgap = fpart(x1 + 0.5f);
+    int xp2 = static_cast<int>(xend);
+    int yp2 = static_cast<int>(std::floor(yend));
+    writer.plot(xp2, yp2, rfpart(yend) * xgap);
+    writer.plot(xp2, yp2 + 1, fpart(yend) * xgap);
+
+    // Середина: только та часть, что проходит через фрагмент
+    int from = std::max(xp1 + 1, writer.steep ? writer.tile.y0 : writer.tile.x0);
+    int to = std::min(xp2 - 1, (writer.steep ? writer.tile.y1 : writer.tile.x1) - 1);
+    writer.limit(yStart, gradient, xp1, from, to);
+    for (int x = from; x <= to; ++x) {
+        float y = yStart + gradient * (x - xp1);
+        int yi = static_cast<int>(std::floor(y));
+        writer.plot(x, yi, 1.0f - (y - yi));
+        writer.plot(x, yi + 1, y - yi);
+    }
+}
+
+// Алгоритм Брезенхема: y для любого x вычисляется сразу по формуле
+// y = y0 + floor((2 dy (x - x0) + dx) / (2 dx)), что даёт те же пиксели,
+// что и пошаговый вариант, но позволяет начать с границы фрагмента
+void drawBresenham(PixelLine line, TileWriter& writer) {
+    int64_t x0 = static_cast<int64_t>(std::floor(line.x0)), y0 = static_cast<int64_t>(std::floor(line.y0));
+    int64_t x1 = static_cast<int64_t>(std::floor(line.x1)), y1 = static_cast<int64_t>(std::floor(line.y1));
+    writer.steep = std::llabs(y1 - y0) > std::llabs(x1 - x0);
+    if (writer.steep) {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+    if (x0 > x1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+    int64_t dx = x1 - x0, dy = y1 - y0;
+    if (dx == 0) {
+        writer.plot(static_cast<int>(x0), static_cast<int>(y0), 1.0f);
+        return;
+    }
+
+    int from = static_cast<int>(std::max<int64_t>(x0, writer.steep ? writer.tile.y0 : writer.tile.x0));
+    int to = static_cast<int>(std::min<int64_t>(x1, (writer.steep ? writer.tile.y1 : writer.tile.x1) - 1));
+    writer.limit(static_cast<double>(y0), static_cast<double>(dy) / dx, static_cast<int>(x0), from, to);
+    for (int x = from; x <= to; ++x) {
+        int64_t y = y0 + floorDiv(2 * dy * (x - x0) + dx, 2 * dx);
+        writer.plot(x, static_cast<int>(y), 1.0f);
+    }
+}
+
+// Раскладка по фрагментам одной части отрезков: номера отрезков
+// внутри части, сгруппированные по фрагментам
+struct TileBins {
+    std::vector<uint32_t> start;
+    std::vector<uint16_t> items;
+};
+
+} // namespace
+
+LineCanvas::LineCanvas(int width, int height, sf::Color background)
+    : width(std::max(0, width)), height(std::max(0, height)) {
+    clear(background);
+}
+
+void LineCanvas::clear(sf::Color background) {
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        pixels[i] = background.r;
+        pixels[i + 1] = background.g;
+        pixels[i + 2] = background.b;
+        pixels[i + 3] = background.a;
+    }
+}
+
+sf::Color LineCanvas::getPixel(int x, int y) const {
+    const uint8_t* p = pixels.data() + 4 * (static_cast<size_t>(y) * width + x);
+    return sf::Color(p[0], p[1], p[2], p[3]);
+}
+
+uint64_t LineCanvas::checksum() const {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : pixels) {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool LineCanvas::saveToFile(const std::string& path) const {
+    sf::Image image;
+    image.create(static_cast<unsigned>(width), static_cast<unsigned>(height), pixels.data());
+    return image.saveToFile(path);
+}
+
+void LineCanvas::drawLines(const sf::Vertex* vertices, size_t count, const ClipRect& view,
+                           LineStyle style, TaskPool& pool) {
+    const size_t lines = count / 2;
+    if (lines == 0 || width == 0 || height == 0) return;
+
+    const int size = std::max(8, tileSize);
+    const int tilesX = (width + size - 1) / size;
+    const int tilesY = (height + size - 1) / size;
+    const size_t tiles = static_cast<size_t>(tilesX) * tilesY;
+    const float scaleX = width / (view.right - view.left);
+    const float scaleY = height / (view.bottom - view.top);
+
+    // Сглаженная линия выходит за геометрический отрезок меньше чем на
+    // 2 пикселя, поэтому фрагменты проверяются с таким запасом
+    const float margin = 2.0f;
+    const ClipRect canvas = {-2 * margin, -2 * margin, width + 2 * margin, height + 2 * margin};
+
+    // Отрезок в пикселях, обрезанный по кадру с запасом. Обрезка одинакова
+    // для всех фрагментов и не даёт координатам выйти за пределы int
+    auto toPixels = [&](size_t i, PixelLine& line) {
+        const sf::Vector2f& a = vertices[2 * i].position;
+        const sf::Vector2f& b = vertices[2 * i + 1].position;
+        line = {(a.x - view.left) * scaleX, (a.y - view.top) * scaleY,
+                (b.x - view.left) * scaleX, (b.y - view.top) * scaleY};
+        if (!std::isfinite(line.x0) || !std::isfinite(line.y0) ||
+            !std::isfinite(line.x1) || !std::isfinite(line.y1)) return false;
+        return clipLiangBarsky(canvas, line.x0, line.y0, line.x1, line.y1);
+    };
+
+    // Фрагменты, которые задевает отрезок
+    auto forTiles = [&](const PixelLine& line, auto&& visit) {
+        float left = std::max(0.0f, std::min(line.x0, line.x1) - margin);
+        float top = std::max(0.0f, std::min(line.y0, line.y1) - margin);
+        float right = std::max(line.x0, line.x1) + margin;
+        float bottom = std::max(line.y0, line.y1) + margin;
+        if (right < 0 || bottom < 0 || left >= width || top >= height) return;
+        int tx0 = static_cast<int>(left) / size;
+        int ty0 = static_cast<int>(top) / size;
+        int tx1 = std::min(tilesX - 1, static_cast<int>(std::min<float>(right, width - 1)) / size);
+        int ty1 = std::min(tilesY - 1, static_cast<int>(std::min<float>(bottom, height - 1)) / size);
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                if (tx0 != tx1 || ty0 != ty1) {
+                    ClipRect rect = {tx * size - margin, ty * size - margin,
+                                     (tx + 1) * size + margin, (ty + 1) * size + margin};
+                    float x0 = line.x0, y0 = line.y0, x1 = line.x1, y1 = line.y1;
+                    if (!clipLiangBarsky(rect, x0, y0, x1, y1)) continue;
+                }
+                visit(static_cast<size_t>(ty) * tilesX + tx);
+            }
+        }
+    };
+
+    // Раскладка по частям: подсчёт, смещения, заполнение
+    const size_t chunks = (lines + BIN_CHUNK - 1) / BIN_CHUNK;
+    std::vector<TileBins> bins(chunks);
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        TileBins& bin = bins[chunk];
+        size_t begin = chunk * BIN_CHUNK;
+        size_t end = std::min(lines, begin + BIN_CHUNK);
+        bin.start.assign(tiles + 1, 0);
+        PixelLine line;
+        for (size_t i = begin; i < end; ++i) {
+            if (!toPixels(i, line)) continue;
+            forTiles(line, [&](size_t tile) { bin.start[tile + 1]++; });
+        }
+        for (size_t tile = 0; tile < tiles; ++tile) {
+            bin.start[tile + 1] += bin.start[tile];
+        }
+        bin.items.resize(bin.start[tiles]);
+        std::vector<uint32_t> fill(bin.start.begin(), bin.start.end() - 1);
+        for (size_t i = begin; i < end; ++i) {
+            if (!toPixels(i, line)) continue;
+            forTiles(line, [&](size_t tile) {
+                bin.items[fill[tile]++] = static_cast<uint16_t>(i - begin);
+            });
+        }
+    });
+
+    // Фрагменты рисуются независимо, отрезки - в исходном порядке
+    pool.parallelFor(tiles, [&](size_t tile) {
+        int tx = static_cast<int>(tile % tilesX), ty = static_cast<int>(tile / tilesX);
+        TileWriter writer = {pixels.data(), width,
+                             {tx * size, ty * size, std::min(width, (tx + 1) * size), std::min(height, (ty + 1) * size)},
+                             sf::Color::White, false};
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            const TileBins& bin = bins[chunk];
+            for (uint32_t k = bin.start[tile]; k < bin.start[tile + 1]; ++k) {
+                size_t i = chunk * BIN_CHUNK + bin.items[k];
+                PixelLine line;
+                toPixels(i, line);
+                writer.color = vertices[2 * i].color;
+                if (style == LineStyle::Wu)
+                    drawWu(line, writer);
+                else
+                    drawBresenham(line, writer);
+            }
+        }
+    });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Программная растеризация отрезков в памяти (лабораторная работа 1), чтобы
+// отсечение и отрисовку можно было запускать и сравнивать без окна.
+// Кадр делится на квадратные фрагменты; сначала отрезки раскладываются по
+// фрагментам, которые они пересекают, затем каждый фрагмент рисуется одним
+// потоком без блокировок. Внутри фрагмента отрезки рисуются в исходном порядке,
+// а пиксели отрезка не зависят от того, через какой фрагмент он рисуется,
+// поэтому результат не зависит от числа потоков
+
+#include "clipping.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class LineStyle {
+    Bresenham,  // без сглаживания
+    Wu          // сглаживание Сяолиня Ву
+};
+
+class LineCanvas {
+public:
+    LineCanvas(int width, int height, sf::Color background = sf::Color::Black);
+
+    void clear(sf::Color background);
+
+    // Отрезки парами вершин, как для sf::Lines. view - область мировых
+    // координат, которая растягивается на весь кадр
+    void drawLines(const sf::Vertex* vertices, size_t count, const ClipRect& view,
+                   LineStyle style, TaskPool& pool = TaskPool::shared());
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const uint8_t* getPixels() const { return pixels.data(); }
+    sf::Color getPixel(int x, int y) const;
+
+    // Контрольная сумма пикселей (FNV-1a) для сравнения результатов
+    uint64_t checksum() const;
+
+    // Сохранение через sf::Image (PNG, BMP, TGA, JPG по расширению)
+    bool saveToFile(const std::string& path) const;
+
+    int tileSize = 64;
+
+private:
+    int width, height;
+    std::vector<uint8_t> pixels;  // RGBA построчно
+};
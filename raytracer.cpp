@@ -0,0 +1,324 @@
+#include "raytracer.h"
+
+// Пересечение луча с экземпляром: луч переводится в локальное пространство.
+// Направление нормализуется, поэтому t пересчитывается обратно делением
+// на длину локального направления
+bool Scene::intersectInstance(const Instance& inst, const Ray& ray, float& t,
+                              const Object*& primitive, bool anyHit) const {
+    Vec3 localDir = inst.transform.inverseVector(ray.direction);
+    float scale = localDir.length();
+    Ray localRay(inst.transform.inversePoint(ray.origin), localDir);
+    float tLocal;
+    if (!inst.geometry->intersect(localRay, tLocal, primitive, anyHit)) return false;
+    t = tLocal / scale;
+    return true;
+}
+
+bool Scene::intersect(const Ray& ray, Hit& hit) const {
+    hit.t = std::numeric_limits<float>::infinity();
+    return topLevel.traverse(ray, hit.t, false, [&](int i, float& tMax) {
+        float t;
+        const Object* primitive;
+        if (intersectInstance(instances[i], ray, t, primitive, false) && t < tMax) {
+            tMax = t;
+            hit.t = t;
+            hit.primitive = primitive;
+            hit.instance = &instances[i];
+            return true;
+        }
+        return false;
+    });
+}
+
+bool Scene::occluded(const Ray& ray) const {
+    return topLevel.traverse(ray, std::numeric_limits<float>::infinity(), true,
+        [&](int i, float&) {
+            float t;
+            const Object* primitive;
+            return intersectInstance(instances[i], ray, t, primitive, true);
+        });
+}
+
+Geometry* Scene::addGeometry() {
+    geometries.emplace_back(new Geometry());
+    return geometries.back().get();
+}
+
+void Scene::addInstance(const Geometry* geometry, const Transform& transform) {
+    instances.push_back({geometry, transform, transform.bounds(geometry->bounds())});
+}
+
+void Scene::setTransform(size_t i, const Transform& transform) {
+    instances[i].transform = transform;
+    instances[i].bounds = transform.bounds(instances[i].geometry->bounds());
+}
+
+void Scene::rebuild() {
+    instanceBounds.clear();
+    for (const auto& inst : instances) {
+        instanceBounds.push_back(inst.bounds);
+    }
+    topLevel.build(instanceBounds);
+}
+
+void Scene::refit() {
+    for (size_t i = 0; i < instances.size(); ++i) {
+        instanceBounds[i] = instances[i].bounds;
+    }
+    topLevel.refit(instanceBounds);
+}
+
+Vec3 Scene::trace(const Ray& ray, int depth, const RenderSettings& settings, Random& rng) const {
+    // Ранний выход для слабых лучей
+    if (depth > 2 && rng.next() > 0.5f) {
+        return Vec3();
+    }
+    
+    if (depth >= settings.maxDepth) return Vec3();
+    
+    // Находим ближайшее пересечение
+    Hit hit;
+    if (!intersect(ray, hit)) return Vec3();
+    
+    const Object* hitObject = hit.primitive;
+    const Transform& xf = hit.instance->transform;
+    Vec3 hitPoint = ray.origin + ray.direction * hit.t;
+    Vec3 normal = xf.normal(hitObject->getNormal(xf.inversePoint(hitPoint)));
+    Vec3 color;
+    
+    // Прямое освещение
+    for (const auto& light : lights) {
+        Vec3 lightDir = (light - hitPoint).normalize();
+        Ray shadowRay(hitPoint + normal * EPSILON, lightDir);
+        bool inShadow = occluded(shadowRay);
+        
+        if (!inShadow) {
+            float diff = std::max(0.0f, normal.dot(lightDir));
+            Vec3 reflection = (normal * (2.0f * normal.dot(lightDir)) - lightDir).normalize();
+            float spec = std::pow(std::max(0.0f, reflection.dot(-ray.direction)), 20);
+            
+            color = color + hitObject->material.color * 
+                    (hitObject->material.diffuse * diff + 
+                     hitObject->material.specular * spec);
+        }
+    }
+    
+    // Глобальное освещение (Monte Carlo)
+    if (depth < settings.maxDepth) {
+        for (int i = 0; i < settings.samples; ++i) {
+            Vec3 randomDir = getRandomHemisphereDirection(normal, rng);
+            Ray bounceRay(hitPoint + normal * EPSILON, randomDir);
+            color = color + trace(bounceRay, depth + 1, settings, rng) * hitObject->material.reflection * 
+                    (1.0f / settings.samples);
+        }
+    }
+    
+    return color;
+}
+
+Vec3 Scene::getRandomHemisphereDirection(const Vec3& normal, Random& rng) const {
+    float theta = 2 * PI * rng.next();
+    float phi = std::acos(2 * rng.next() - 1);
+    float x = std::sin(phi) * std::cos(theta);
+    float y = std::sin(phi) * std::sin(theta);
+    float z = std::cos(phi);
+    Vec3 dir(x, y, z);
+    
+    if (dir.dot(normal) < 0) {
+        dir = dir * -1;
+    }
+    
+    return dir.normalize();
+}
+
+void buildDemoScene(Scene& scene, int extraInstances) {
+    // Общая геометрия: единичные сфера и куб в локальных координатах
+    Geometry* sphere = scene.addGeometry();
+    sphere->add(new Sphere(Vec3(0, 0, 0), 1, 
+                Material(Vec3(1, 0.2f, 0.2f), 0.7f, 0.3f, 0.5f)));
+    sphere->build();
+    Geometry* cube = scene.addGeometry();
+    cube->add(new Cube(Vec3(-0.5f, -0.5f, -0.5f), Vec3(0.5f, 0.5f, 0.5f),
+              Material(Vec3(0.2f, 1, 0.2f), 0.7f, 0.3f, 0.5f)));
+    cube->build();
+    
+    // Добавляем объекты в сцену
+    scene.addInstance(sphere, Transform::make(Vec3(0, 0, -5)));
+    scene.addInstance(cube, Transform::make(Vec3(-1.5f, -1.5f, -6.5f)));
+    
+    // Дополнительное поле копий за основными объектами (проверка масштабируемости)
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(extraInstances))));
+    for (int i = 0; i < extraInstances; ++i) {
+        float x = (i % side - side * 0.5f) * 1.5f;
+        float z = -10.0f - (i / side) * 1.5f;
+        if (i % 2) {
+            scene.addInstance(cube, Transform::make(Vec3(x, -2.0f, z), Vec3(0, 30.0f * i, 0)));
+        } else {
+            scene.addInstance(sphere, Transform::make(Vec3(x, -2.0f, z), Vec3(), Vec3(0.5f, 0.5f, 0.5f)));
+        }
+    }
+    scene.rebuild();
+    
+    // Добавляем источники света
+    scene.addLight(Vec3(5, 5, 5));
+    scene.addLight(Vec3(-5, 5, 5));
+}
+
+// Состояние задачи, общее для рабочих потоков и владельца RenderJob
+struct RenderJobState {
+    const Scene* scene;
+    RenderSettings settings;
+    FrameBuffer* target;
+    RenderCallbacks callbacks;
+    Vec3 position, forward, right, up;
+    int tilesX = 0;
+    int tileCount = 0;
+    int nextTile = 0;                  // под мьютексом Renderer
+    std::atomic<int> doneTiles{0};
+    std::atomic<bool> cancelled{false};
+    std::promise<bool> promise;
+};
+
+void RenderJob::cancel() {
+    if (state) state->cancelled = true;
+}
+
+static void renderTile(RenderJobState& job, int index) {
+    const RenderSettings& settings = job.settings;
+    const int width = settings.width;
+    const int height = settings.height;
+    const int aa = settings.antialiasing;
+    Tile tile;
+    tile.x = (index % job.tilesX) * settings.tileSize;
+    tile.y = (index / job.tilesX) * settings.tileSize;
+    tile.width = std::min(settings.tileSize, width - tile.x);
+    tile.height = std::min(settings.tileSize, height - tile.y);
+    
+    // Генератор зависит только от зерна и номера фрагмента, поэтому
+    // результат не зависит от числа потоков и порядка обработки
+    std::seed_seq seq{settings.seed, static_cast<unsigned>(index)};
+    std::mt19937 seeder(seq);
+    Random rng(seeder());
+    
+    for (int y = tile.y; y < tile.y + tile.height; ++y) {
+        for (int x = tile.x; x < tile.x + tile.width; ++x) {
+            Vec3 finalColor;
+            // Антиалиасинг через multiple sampling
+            for (int sx = 0; sx < aa; sx++) {
+                for (int sy = 0; sy < aa; sy++) {
+                    float rx = rng.next() / aa;
+                    float ry = rng.next() / aa;
+                    float fx = (2.0f * (x + (sx + rx) / aa) - width) / height;
+                    float fy = (2.0f * (y + (sy + ry) / aa) - height) / height;
+                    Vec3 direction = job.right * fx + job.up * (-fy) + job.forward;
+                    
+                    Ray ray(job.position, direction.normalize());
+                    finalColor = finalColor + job.scene->trace(ray, 0, settings, rng);
+                }
+            }
+            finalColor = finalColor * (1.0f / (aa * aa));
+            
+            // Тональная компрессия (tone mapping) с улучшенной гамма-коррекцией
+            const float gamma = 2.2f;
+            uint8_t* pixel = &job.target->pixels[(static_cast<size_t>(y) * width + x) * 4];
+            pixel[0] = static_cast<uint8_t>(std::pow(std::min(1.0f, finalColor.x), 1.0f / gamma) * 255);
+            pixel[1] = static_cast<uint8_t>(std::pow(std::min(1.0f, finalColor.y), 1.0f / gamma) * 255);
+            pixel[2] = static_cast<uint8_t>(std::pow(std::min(1.0f, finalColor.z), 1.0f / gamma) * 255);
+            pixel[3] = 255;
+        }
+    }
+    
+    if (job.callbacks.tile) {
+        job.callbacks.tile(*job.target, tile);
+    }
+}
+
+Renderer::Renderer(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(&Renderer::workerLoop, this);
+    }
+}
+
+Renderer::~Renderer() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        // Незавершённые задачи отменяются, но доводятся до конца,
+        // чтобы их future получили результат
+        for (auto& job : jobs) {
+            job->cancelled = true;
+        }
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void Renderer::workerLoop() {
+    for (;;) {
+        std::shared_ptr<RenderJobState> job;
+        int tile;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+            job = jobs.front();
+            tile = job->nextTile++;
+            if (job->nextTile == job->tileCount) {
+                jobs.pop_front();
+            }
+        }
+        
+        if (!job->cancelled) {
+            renderTile(*job, tile);
+        }
+        
+        int done = ++job->doneTiles;
+        if (job->callbacks.progress && !job->cancelled) {
+            job->callbacks.progress(static_cast<float>(done) / job->tileCount);
+        }
+        if (done == job->tileCount) {
+            job->promise.set_value(!job->cancelled);
+        }
+    }
+}
+
+RenderJob Renderer::render(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+                           FrameBuffer& target, RenderCallbacks callbacks) {
+    auto job = std::make_shared<RenderJobState>();
+    job->scene = &scene;
+    job->settings = settings;
+    job->settings.antialiasing = std::max(1, settings.antialiasing);
+    job->settings.tileSize = std::max(1, settings.tileSize);
+    job->target = &target;
+    job->callbacks = std::move(callbacks);
+    
+    // Базис камеры
+    job->position = camera.position;
+    job->forward = (camera.target - camera.position).normalize();
+    job->right = job->forward.cross(Vec3(0, 1, 0)).normalize();
+    job->up = job->right.cross(job->forward);
+    
+    target.resize(settings.width, settings.height);
+    const int tileSize = job->settings.tileSize;
+    job->tilesX = (settings.width + tileSize - 1) / tileSize;
+    int tilesY = (settings.height + tileSize - 1) / tileSize;
+    job->tileCount = job->tilesX * tilesY;
+    
+    RenderJob handle(job, job->promise.get_future().share());
+    if (job->tileCount <= 0) {
+        job->promise.set_value(true);
+        return handle;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        jobs.push_back(job);
+    }
+    cv.notify_all();
+    return handle;
+}
@@ -0,0 +1,566 @@
+#pragma once
+
+// Библиотека трассировки лучей с глобальным освещением (из лабораторной работы 5).
+// Не зависит от SFML: сцена, настройки и результат - обычные структуры C++,
+// рендер выполняется пулом потоков Renderer и возвращает отменяемую задачу
+
+#include "cg_math.h"
+#include <vector>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+
+const float EPSILON = 0.0001f;
+
+// Параметры рендера одного кадра
+struct RenderSettings {
+    int width = 800;
+    int height = 600;
+    int maxDepth = 3;     // Уменьшаем глубину рекурсии
+    int samples = 4;      // Уменьшаем количество сэмплов
+    int antialiasing = 2; // Уменьшаем антиалиасинг
+    unsigned seed = 1;    // Зерно генератора: одинаковые настройки дают одинаковый кадр
+    int tileSize = 32;
+};
+
+// Луч
+struct Ray {
+    Vec3 origin;
+    Vec3 direction;
+    
+    Ray(const Vec3& o, const Vec3& d) : origin(o), direction(d.normalize()) {}
+};
+
+// Материал
+struct Material {
+    Vec3 color;
+    float diffuse;
+    float specular;
+    float reflection;
+    
+    Material(const Vec3& c = Vec3(1, 1, 1), float d = 0.7f, float s = 0.3f, float r = 0.5f)
+        : color(c), diffuse(d), specular(s), reflection(r) {}
+};
+
+// Ограничивающий параллелепипед
+struct AABB {
+    Vec3 min = Vec3(std::numeric_limits<float>::infinity(),
+                    std::numeric_limits<float>::infinity(),
+                    std::numeric_limits<float>::infinity());
+    Vec3 max = Vec3(-std::numeric_limits<float>::infinity(),
+                    -std::numeric_limits<float>::infinity(),
+                    -std::numeric_limits<float>::infinity());
+    
+    void expand(const Vec3& p) {
+        min = Vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+    void expand(const AABB& b) {
+        expand(b.min);
+        expand(b.max);
+    }
+    Vec3 center() const { return (min + max) * 0.5f; }
+    
+    // Пересечение луча с параллелепипедом на отрезке [EPSILON, tMax]
+    bool hit(const Vec3& origin, const Vec3& invDir, float tMax) const {
+        float t0 = EPSILON, t1 = tMax;
+        const float o[3] = {origin.x, origin.y, origin.z};
+        const float d[3] = {invDir.x, invDir.y, invDir.z};
+        const float lo[3] = {min.x, min.y, min.z};
+        const float hi[3] = {max.x, max.y, max.z};
+        for (int a = 0; a < 3; ++a) {
+            float tNear = (lo[a] - o[a]) * d[a];
+            float tFar = (hi[a] - o[a]) * d[a];
+            if (tNear > tFar) std::swap(tNear, tFar);
+            t0 = tNear > t0 ? tNear : t0;
+            t1 = tFar < t1 ? tFar : t1;
+            if (t0 > t1) return false;
+        }
+        return true;
+    }
+};
+
+// Аффинное преобразование: поворот и масштаб (3x3) плюс перенос,
+// вместе с обратным - лучи переводятся в локальное пространство геометрии
+struct Transform {
+    float m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+    float inv[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+    
+    // Перенос * поворот (углы Эйлера в градусах, порядок Z*Y*X) * масштаб
+    static Transform make(const Vec3& translation, const Vec3& rotation = Vec3(),
+                          const Vec3& scale = Vec3(1, 1, 1)) {
+        float cx = std::cos(radians(rotation.x)), sx = std::sin(radians(rotation.x));
+        float cy = std::cos(radians(rotation.y)), sy = std::sin(radians(rotation.y));
+        float cz = std::cos(radians(rotation.z)), sz = std::sin(radians(rotation.z));
+        const float r[3][3] = {
+            {cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx},
+            {sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx},
+            {-sy,     cy * sx,                cy * cx}
+        };
+        const float s[3] = {scale.x, scale.y, scale.z};
+        const float t[3] = {translation.x, translation.y, translation.z};
+        
+        Transform xf;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                xf.m[i][j] = r[i][j] * s[j];
+                // (R*S)^-1 = S^-1 * R^T
+                xf.inv[i][j] = r[j][i] / s[i];
+            }
+            xf.m[i][3] = t[i];
+        }
+        for (int i = 0; i < 3; ++i) {
+            xf.inv[i][3] = -(xf.inv[i][0] * t[0] + xf.inv[i][1] * t[1] + xf.inv[i][2] * t[2]);
+        }
+        return xf;
+    }
+    
+    Vec3 point(const Vec3& p) const {
+        return Vec3(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                    m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                    m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+    Vec3 inversePoint(const Vec3& p) const {
+        return Vec3(inv[0][0] * p.x + inv[0][1] * p.y + inv[0][2] * p.z + inv[0][3],
+                    inv[1][0] * p.x + inv[1][1] * p.y + inv[1][2] * p.z + inv[1][3],
+                    inv[2][0] * p.x + inv[2][1] * p.y + inv[2][2] * p.z + inv[2][3]);
+    }
+    Vec3 inverseVector(const Vec3& v) const {
+        return Vec3(inv[0][0] * v.x + inv[0][1] * v.y + inv[0][2] * v.z,
+                    inv[1][0] * v.x + inv[1][1] * v.y + inv[1][2] * v.z,
+                    inv[2][0] * v.x + inv[2][1] * v.y + inv[2][2] * v.z);
+    }
+    // Нормали преобразуются транспонированной обратной матрицей
+    Vec3 normal(const Vec3& n) const {
+        return Vec3(inv[0][0] * n.x + inv[1][0] * n.y + inv[2][0] * n.z,
+                    inv[0][1] * n.x + inv[1][1] * n.y + inv[2][1] * n.z,
+                    inv[0][2] * n.x + inv[1][2] * n.y + inv[2][2] * n.z).normalize();
+    }
+    AABB bounds(const AABB& local) const {
+        AABB box;
+        for (int i = 0; i < 8; ++i) {
+            box.expand(point(Vec3(i & 1 ? local.max.x : local.min.x,
+                                  i & 2 ? local.max.y : local.min.y,
+                                  i & 4 ? local.max.z : local.min.z)));
+        }
+        return box;
+    }
+};
+
+// Базовый класс для объектов сцены (геометрия в локальных координатах)
+class Object {
+public:
+    Material material;
+    
+    virtual bool intersect(const Ray& ray, float& t) const = 0;
+    virtual Vec3 getNormal(const Vec3& point) const = 0;
+    virtual AABB bounds() const = 0;
+    virtual ~Object() = default;
+};
+
+// Сфера
+class Sphere : public Object {
+    Vec3 center;
+    float radius;
+    
+public:
+    Sphere(const Vec3& c, float r, const Material& m) : center(c), radius(r) {
+        material = m;
+    }
+    
+    bool intersect(const Ray& ray, float& t) const override {
+        Vec3 oc = ray.origin - center;
+        float a = ray.direction.dot(ray.direction);
+        float b = 2.0f * oc.dot(ray.direction);
+        float c = oc.dot(oc) - radius * radius;
+        float discriminant = b * b - 4 * a * c;
+        
+        if (discriminant < 0) return false;
+        
+        float t0 = (-b - std::sqrt(discriminant)) / (2.0f * a);
+        float t1 = (-b + std::sqrt(discriminant)) / (2.0f * a);
+        
+        if (t0 > EPSILON) {
+            t = t0;
+            return true;
+        }
+        if (t1 > EPSILON) {
+            t = t1;
+            return true;
+        }
+        return false;
+    }
+    
+    Vec3 getNormal(const Vec3& point) const override {
+        return (point - center).normalize();
+    }
+    
+    AABB bounds() const override {
+        AABB box;
+        box.expand(center - Vec3(radius, radius, radius));
+        box.expand(center + Vec3(radius, radius, radius));
+        return box;
+    }
+};
+
+// Куб
+class Cube : public Object {
+    Vec3 min, max;
+    
+public:
+    Cube(const Vec3& min_point, const Vec3& max_point, const Material& m) 
+        : min(min_point), max(max_point) {
+        material = m;
+    }
+    
+    bool intersect(const Ray& ray, float& t) const override {
+        Vec3 tMin = (min - ray.origin) * Vec3(1.0f / ray.direction.x, 
+                                             1.0f / ray.direction.y, 
+                                             1.0f / ray.direction.z);
+        Vec3 tMax = (max - ray.origin) * Vec3(1.0f / ray.direction.x, 
+                                             1.0f / ray.direction.y, 
+                                             1.0f / ray.direction.z);
+        
+        Vec3 t1 = Vec3(std::min(tMin.x, tMax.x),
+                       std::min(tMin.y, tMax.y),
+                       std::min(tMin.z, tMax.z));
+        Vec3 t2 = Vec3(std::max(tMin.x, tMax.x),
+                       std::max(tMin.y, tMax.y),
+                       std::max(tMin.z, tMax.z));
+        
+        float tNear = std::max(std::max(t1.x, t1.y), t1.z);
+        float tFar = std::min(std::min(t2.x, t2.y), t2.z);
+        
+        if (tNear > tFar || tFar < EPSILON) return false;
+        
+        t = tNear > EPSILON ? tNear : tFar;
+        return true;
+    }
+    
+    Vec3 getNormal(const Vec3& point) const override {
+        float dx1 = std::abs(point.x - min.x);
+        float dx2 = std::abs(point.x - max.x);
+        float dy1 = std::abs(point.y - min.y);
+        float dy2 = std::abs(point.y - max.y);
+        float dz1 = std::abs(point.z - min.z);
+        float dz2 = std::abs(point.z - max.z);
+        
+        float minDist = std::min({dx1, dx2, dy1, dy2, dz1, dz2});
+        
+        if (minDist == dx1) return Vec3(-1, 0, 0);
+        if (minDist == dx2) return Vec3(1, 0, 0);
+        if (minDist == dy1) return Vec3(0, -1, 0);
+        if (minDist == dy2) return Vec3(0, 1, 0);
+        if (minDist == dz1) return Vec3(0, 0, -1);
+        return Vec3(0, 0, 1);
+    }
+    
+    AABB bounds() const override {
+        AABB box;
+        box.expand(min);
+        box.expand(max);
+        return box;
+    }
+};
+
+// Иерархия ограничивающих объёмов над набором элементов с известными AABB.
+// Одна реализация используется на обоих уровнях: нижний - над примитивами
+// геометрии, верхний - над экземплярами сцены
+class BVH {
+    struct Node {
+        AABB box;
+        int first = 0;  // лист: первый элемент в order; внутренний узел: индекс правого потомка
+        int count = 0;  // число элементов в листе (0 - внутренний узел)
+    };
+    
+    std::vector<Node> nodes;
+    std::vector<int> order;
+    
+    int build(std::vector<int>& items, int begin, int end,
+              const std::vector<AABB>& boxes, const std::vector<Vec3>& centers) {
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        AABB box, centerBox;
+        for (int i = begin; i < end; ++i) {
+            box.expand(boxes[items[i]]);
+            centerBox.expand(centers[items[i]]);
+        }
+        nodes[index].box = box;
+        
+        if (end - begin <= 2) {
+            nodes[index].first = begin;
+            nodes[index].count = end - begin;
+            return index;
+        }
+        
+        // Разбиение по медиане вдоль самой длинной оси центров
+        Vec3 extent = centerBox.max - centerBox.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        auto key = [&](int item) {
+            const Vec3& c = centers[item];
+            return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+        };
+        int mid = (begin + end) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                         [&](int a, int b) { return key(a) < key(b); });
+        
+        build(items, begin, mid, boxes, centers);
+        int right = build(items, mid, end, boxes, centers);
+        nodes[index].first = right;
+        return index;
+    }
+    
+public:
+    void build(const std::vector<AABB>& boxes) {
+        nodes.clear();
+        order.resize(boxes.size());
+        std::vector<Vec3> centers(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            order[i] = static_cast<int>(i);
+            centers[i] = boxes[i].center();
+        }
+        if (!boxes.empty()) {
+            nodes.reserve(2 * boxes.size());
+            build(order, 0, static_cast<int>(boxes.size()), boxes, centers);
+        }
+    }
+    
+    // Пересчёт границ узлов без изменения топологии. Потомки всегда
+    // расположены после родителя, поэтому достаточно обратного прохода
+    void refit(const std::vector<AABB>& boxes) {
+        for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+            Node& node = nodes[i];
+            AABB box;
+            if (node.count > 0) {
+                for (int k = 0; k < node.count; ++k) {
+                    box.expand(boxes[order[node.first + k]]);
+                }
+            } else {
+                box.expand(nodes[i + 1].box);
+                box.expand(nodes[node.first].box);
+            }
+            node.box = box;
+        }
+    }
+    
+    AABB bounds() const {
+        return nodes.empty() ? AABB() : nodes[0].box;
+    }
+    
+    // Обход: visit(item, tMax) проверяет элемент и может уменьшить tMax;
+    // если visit возвращает true при anyHit, обход прекращается
+    template <typename Visit>
+    bool traverse(const Ray& ray, float tMax, bool anyHit, Visit visit) const {
+        if (nodes.empty()) return false;
+        Vec3 invDir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        bool found = false;
+        
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (!node.box.hit(ray.origin, invDir, tMax)) continue;
+            if (node.count > 0) {
+                for (int k = 0; k < node.count; ++k) {
+                    if (visit(order[node.first + k], tMax)) {
+                        found = true;
+                        if (anyHit) return true;
+                    }
+                }
+            } else {
+                stack[top++] = node.first;
+                stack[top++] = static_cast<int>(&node - nodes.data()) + 1;
+            }
+        }
+        return found;
+    }
+};
+
+// Разделяемая геометрия: набор примитивов в локальных координатах
+// со своей BVH нижнего уровня
+class Geometry {
+    std::vector<std::unique_ptr<Object>> primitives;
+    BVH bvh;
+    
+public:
+    void add(Object* primitive) {
+        primitives.emplace_back(primitive);
+    }
+    
+    void build() {
+        std::vector<AABB> boxes;
+        for (const auto& primitive : primitives) {
+            boxes.push_back(primitive->bounds());
+        }
+        bvh.build(boxes);
+    }
+    
+    AABB bounds() const { return bvh.bounds(); }
+    
+    bool intersect(const Ray& ray, float& t, const Object*& hit, bool anyHit = false) const {
+        t = std::numeric_limits<float>::infinity();
+        return bvh.traverse(ray, t, anyHit, [&](int i, float& tMax) {
+            float tPrim;
+            if (primitives[i]->intersect(ray, tPrim) && tPrim < tMax) {
+                tMax = tPrim;
+                t = tPrim;
+                hit = primitives[i].get();
+                return true;
+            }
+            return false;
+        });
+    }
+};
+
+// Экземпляр геометрии в сцене со своим преобразованием
+struct Instance {
+    const Geometry* geometry;
+    Transform transform;
+    AABB bounds;
+};
+
+// Информация о ближайшем пересечении
+struct Hit {
+    float t;
+    const Object* primitive;
+    const Instance* instance;
+};
+
+// Генератор случайных чисел одного потока рендера
+struct Random {
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> dis;
+    
+    explicit Random(unsigned seed) : gen(seed), dis(0, 1) {}
+    float next() { return dis(gen); }
+};
+
+// Класс сцены. Во время рендера сцена только читается, поэтому один объект
+// можно рендерить из нескольких потоков и нескольких задач одновременно
+class Scene {
+    std::vector<std::unique_ptr<Geometry>> geometries;
+    std::vector<Instance> instances;
+    BVH topLevel;
+    std::vector<AABB> instanceBounds;
+    std::vector<Vec3> lights;
+    
+    bool intersectInstance(const Instance& inst, const Ray& ray, float& t,
+                           const Object*& primitive, bool anyHit) const;
+    bool intersect(const Ray& ray, Hit& hit) const;
+    bool occluded(const Ray& ray) const;
+    Vec3 getRandomHemisphereDirection(const Vec3& normal, Random& rng) const;
+    
+public:
+    Geometry* addGeometry();
+    void addInstance(const Geometry* geometry, const Transform& transform);
+    void addLight(const Vec3& position) { lights.push_back(position); }
+    
+    size_t instanceCount() const { return instances.size(); }
+    
+    // Перемещение экземпляра; после серии перемещений нужно вызвать refit()
+    void setTransform(size_t i, const Transform& transform);
+    
+    // Полная перестройка верхнего уровня (после добавления экземпляров)
+    void rebuild();
+    
+    // Обновление верхнего уровня после перемещения экземпляров;
+    // нижние уровни геометрий не затрагиваются
+    void refit();
+    
+    Vec3 trace(const Ray& ray, int depth, const RenderSettings& settings, Random& rng) const;
+};
+
+// Сцена лабораторной работы: сфера и куб, два источника света и
+// (по желанию) поле из extraInstances копий общей геометрии
+void buildDemoScene(Scene& scene, int extraInstances = 0);
+
+// Камера: позиция и точка, на которую она смотрит
+struct Camera {
+    Vec3 position = Vec3(0, 0, 1);
+    Vec3 target = Vec3(0, 0, 0);
+};
+
+// Результат рендера: RGBA, 8 бит на канал, строки сверху вниз
+struct FrameBuffer {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+    
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        pixels.resize(static_cast<size_t>(w) * h * 4);
+    }
+};
+
+// Прямоугольный фрагмент кадра
+struct Tile {
+    int x, y, width, height;
+};
+
+// Обратные вызовы вызываются из рабочих потоков, возможно одновременно
+struct RenderCallbacks {
+    std::function<void(float)> progress;                          // доля готовых фрагментов, 0..1
+    std::function<void(const FrameBuffer&, const Tile&)> tile;    // фрагмент записан в буфер
+};
+
+struct RenderJobState;
+
+// Задача рендера. wait()/get() возвращают true, если кадр готов полностью,
+// и false, если задача была отменена
+class RenderJob {
+    std::shared_ptr<RenderJobState> state;
+    std::shared_future<bool> result;
+    
+public:
+    RenderJob() = default;
+    RenderJob(std::shared_ptr<RenderJobState> s, std::shared_future<bool> f)
+        : state(std::move(s)), result(std::move(f)) {}
+    
+    void cancel();
+    bool valid() const { return result.valid(); }
+    bool ready() const {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    bool get() const { return result.get(); }
+    bool wait() const { return get(); }
+    const std::shared_future<bool>& future() const { return result; }
+};
+
+// Пул рабочих потоков, создаётся один раз и переиспользуется всеми задачами.
+// Кадр делится на фрагменты tileSize x tileSize, потоки разбирают их по
+// очереди; задачи выполняются в порядке поступления
+class Renderer {
+    std::vector<std::thread> workers;
+    std::deque<std::shared_ptr<RenderJobState>> jobs;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    
+    void workerLoop();
+    
+public:
+    explicit Renderer(int threads = 0);
+    ~Renderer();
+    
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+    
+    int threadCount() const { return static_cast<int>(workers.size()); }
+    
+    // Сцена, камера и буфер должны жить до завершения задачи;
+    // буфер приводится к размеру settings.width x settings.height
+    RenderJob render(const Scene& scene, const Camera& camera, const RenderSettings& settings,
+                     FrameBuffer& target, RenderCallbacks callbacks = RenderCallbacks());
+};
@@ -0,0 +1,230 @@
+#include "segment_file.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = "CGSEG01";
+
+// Разбор строки CSV: четыре числа через любые из разделителей
+bool parseCsvLine(const std::string& line, float values[4]) {
+    const char* p = line.c_str();
+    for (int k = 0; k < 4; ++k) {
+        while (*p == ',' || *p == ';' || *p == ' ' || *p == '\t') ++p;
+        char* end;
+        values[k] = std::strtof(p, &end);
+        if (end == p) return false;
+        p = end;
+    }
+    return true;
+}
+
+} // namespace
+
+bool SegmentFileWriter::open(const std::string& path, uint64_t count, std::string& error) {
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "не удалось создать " + path;
+        return false;
+    }
+    expected = count;
+    written = 0;
+    added = 0;
+    box = {0, 0, 0, 0};
+    for (auto& column : columns) {
+        column.clear();
+        column.reserve(BUFFER);
+    }
+
+    // Заголовок перезаписывается в close(), а последний байт задаёт размер файла
+    SegmentFileHeader header = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (count > 0) {
+        out.seekp(static_cast<std::streamoff>(sizeof(header) + 4 * sizeof(float) * count - 1));
+        out.put(0);
+    }
+    return static_cast<bool>(out);
+}
+
+void SegmentFileWriter::add(float x1, float y1, float x2, float y2) {
+    // Отрезки сверх объявленного числа не пишутся и не расширяют рамку;
+    // close() сообщит об их количестве
+    if (added++ >= expected) return;
+    if (added == 1) {
+        box = {std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2)};
+    }
+    box.left = std::min(box.left, std::min(x1, x2));
+    box.top = std::min(box.top, std::min(y1, y2));
+    box.right = std::max(box.right, std::max(x1, x2));
+    box.bottom = std::max(box.bottom, std::max(y1, y2));
+
+    columns[0].push_back(x1);
+    columns[1].push_back(y1);
+    columns[2].push_back(x2);
+    columns[3].push_back(y2);
+    if (columns[0].size() == BUFFER) flush();
+}
+
+void SegmentFileWriter::flush() {
+    size_t n = std::min<uint64_t>(columns[0].size(), expected - std::min(expected, written));
+    for (int k = 0; k < 4; ++k) {
+        uint64_t offset = sizeof(SegmentFileHeader) + sizeof(float) * (k * expected + written);
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(reinterpret_cast<const char*>(columns[k].data()),
+                  static_cast<std::streamsize>(n * sizeof(float)));
+        columns[k].clear();
+    }
+    written += n;
+}
+
+bool SegmentFileWriter::close(std::string& error) {
+    if (!out.is_open()) return true;
+    uint64_t total = added;
+    flush();
+
+    SegmentFileHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.count = expected;
+    header.bounds[0] = box.left;
+    header.bounds[1] = box.top;
+    header.bounds[2] = box.right;
+    header.bounds[3] = box.bottom;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+
+    if (out.fail()) {
+        error = "ошибка записи файла";
+        return false;
+    }
+    if (total != expected) {
+        error = "записано " + std::to_string(total) + " отрезков вместо " + std::to_string(expected);
+        return false;
+    }
+    return true;
+}
+
+bool writeSegmentFile(const std::string& path, const SegmentView& segments, std::string& error) {
+    SegmentFileWriter writer;
+    if (!writer.open(path, segments.count, error)) return false;
+    for (size_t i = 0; i < segments.count; ++i) {
+        writer.add(segments.x1[i], segments.y1[i], segments.x2[i], segments.y2[i]);
+    }
+    return writer.close(error);
+}
+
+bool importSegmentCsv(const std::string& csvPath, const std::string& segPath,
+                      uint64_t& imported, std::string& error) {
+    std::ifstream in(csvPath);
+    if (!in) {
+        error = "не удалось открыть " + csvPath;
+        return false;
+    }
+
+    std::string line;
+    float values[4];
+    uint64_t count = 0;
+    while (std::getline(in, line)) {
+        if (parseCsvLine(line, values)) count++;
+    }
+
+    in.clear();
+    in.seekg(0);
+    SegmentFileWriter writer;
+    if (!writer.open(segPath, count, error)) return false;
+    while (std::getline(in, line)) {
+        if (parseCsvLine(line, values)) {
+            writer.add(values[0], values[1], values[2], values[3]);
+        }
+    }
+    imported = count;
+    return writer.close(error);
+}
+
+bool MappedSegments::open(const std::string& path, std::string& error) {
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "не удалось открыть " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentFileHeader)) {
+        ::close(fd);
+        error = path + ": файл слишком короткий";
+        return false;
+    }
+    bytes = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "не удалось отобразить в память " + path;
+        return false;
+    }
+    // Отсечение проходит по файлу подряд: система читает страницы заранее
+    madvise(mapped, bytes, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapped);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        error = "не удалось открыть " + path;
+        return false;
+    }
+    storage.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(storage.data(), static_cast<std::streamsize>(storage.size()));
+    if (!in || storage.size() < sizeof(SegmentFileHeader)) {
+        storage.clear();
+        error = path + ": не удалось прочитать файл";
+        return false;
+    }
+    bytes = storage.size();
+    data = storage.data();
+#endif
+
+    SegmentFileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        close();
+        error = path + ": не файл отрезков *.seg";
+        return false;
+    }
+    if (header.count > (bytes - sizeof(header)) / (4 * sizeof(float))) {
+        close();
+        error = path + ": файл обрезан";
+        return false;
+    }
+    count = static_cast<size_t>(header.count);
+    box = {header.bounds[0], header.bounds[1], header.bounds[2], header.bounds[3]};
+    return true;
+}
+
+void MappedSegments::close() {
+    if (!data) return;
+#ifndef _WIN32
+    munmap(const_cast<char*>(data), bytes);
+#else
+    storage.clear();
+    storage.shrink_to_fit();
+#endif
+    data = nullptr;
+    bytes = 0;
+    count = 0;
+}
+
+SegmentView MappedSegments::view() const {
+    if (!data) return {nullptr, nullptr, nullptr, nullptr, 0};
+    const float* columns = reinterpret_cast<const float*>(data + sizeof(SegmentFileHeader));
+    return {columns, columns + count, columns + 2 * count, columns + 3 * count, count};
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+// Наборы отрезков на диске (лабораторная работа 1).
+// Двоичный формат *.seg: заголовок SegmentFileHeader (64 байта), затем четыре
+// массива float по count элементов - x1, y1, x2, y2. Массивы лежат в файле так
+// же, как в SegmentSoA, поэтому отображённый в память файл передаётся в
+// отсечение без копирования и без загрузки целиком в оперативную память
+
+#include "clipping.h"
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+struct SegmentFileHeader {
+    char magic[8];      // "CGSEG01"
+    uint64_t count;     // число отрезков
+    float bounds[4];    // описанный прямоугольник: left, top, right, bottom
+    uint8_t reserved[32];
+};
+
+static_assert(sizeof(SegmentFileHeader) == 64, "заголовок *.seg должен занимать 64 байта");
+
+// Запись файла по одному отрезку. Число отрезков задаётся заранее, каждый
+// столбец копится в своём буфере и дописывается на своё место в файле, так что
+// в памяти держатся только буферы. Описанный прямоугольник считается по ходу
+// записи и попадает в заголовок при close()
+class SegmentFileWriter {
+public:
+    bool open(const std::string& path, uint64_t count, std::string& error);
+    void add(float x1, float y1, float x2, float y2);
+    bool close(std::string& error);
+
+private:
+    static const size_t BUFFER = 1 << 16;
+
+    std::ofstream out;
+    uint64_t expected = 0;
+    uint64_t written = 0;   // отрезков, сброшенных в файл
+    uint64_t added = 0;     // отрезков, переданных в add(), включая лишние
+    std::vector<float> columns[4];
+    ClipRect box = {};
+
+    void flush();
+};
+
+// Запись набора, целиком находящегося в памяти
+bool writeSegmentFile(const std::string& path, const SegmentView& segments, std::string& error);
+
+// Импорт CSV: каждая строка "x1,y1,x2,y2" (разделители - запятая, точка
+// с запятой, пробел или табуляция). Строки, которые не разбираются как четыре
+// числа (заголовок, комментарии), пропускаются. Файл читается дважды: сначала
+// считаются строки, затем отрезки пишутся через SegmentFileWriter
+bool importSegmentCsv(const std::string& csvPath, const std::string& segPath,
+                      uint64_t& imported, std::string& error);
+
+// Файл *.seg, отображённый в память только для чтения. Страницы подгружаются
+// системой при обращении, поэтому размер набора ограничен адресным
+// пространством, а не объёмом памяти. На Windows файл читается в память целиком
+class MappedSegments {
+public:
+    MappedSegments() = default;
+    ~MappedSegments() { close(); }
+
+    MappedSegments(const MappedSegments&) = delete;
+    MappedSegments& operator=(const MappedSegments&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    bool isOpen() const { return data != nullptr; }
+    size_t size() const { return count; }
+    ClipRect bounds() const { return box; }
+    SegmentView view() const;
+
+private:
+    const char* data = nullptr;
+    size_t bytes = 0;
+    size_t count = 0;
+    ClipRect box = {};
+#ifdef _WIN32
+    std::vector<char> storage;
+#endif
+};
+
+// Случайные короткие отрезки lab1 --random N: начало равномерно в области
+// width x height, конец сдвинут не больше чем на 40 по каждой оси. Генератор
+// с постоянным зерном, так что lab1_render --random N и lab1_import --random N
+// дают один и тот же набор; lab1 добавляет те же N отрезков после пяти
+// встроенных. segments - SegmentSoA или SegmentFileWriter (всё, у чего
+// есть add(x1, y1, x2, y2)), так что большой набор пишется в файл без
+// загрузки в память
+template <typename Segments>
+void addRandomSegments(Segments& segments, uint64_t count, float width = 800, float height = 600) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> x(0, width);
+    std::uniform_real_distribution<float> y(0, height);
+    std::uniform_real_distribution<float> offset(-40, 40);
+    for (uint64_t i = 0; i < count; ++i) {
+        // Порядок вызовов генератора задан явно: порядок вычисления
+        // аргументов add не определён
+        float ax = x(gen);
+        float ay = y(gen);
+        float bx = ax + offset(gen);
+        float by = ay + offset(gen);
+        segments.add(ax, ay, bx, by);
+    }
+}
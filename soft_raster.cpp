@@ -0,0 +1,492 @@
+#include "soft_raster.h"
+#include "vertex_lighting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+// Треугольников в одной части при отсечении и раскладке. После отсечения
+// пятью плоскостями из треугольника получается не больше шести, так что
+// номер внутри части помещается в uint16_t
+const size_t TRIANGLE_CHUNK = 1 << 13;
+
+// Вершин в одной части при преобразовании
+const size_t VERTEX_CHUNK = 1 << 12;
+
+// Сторона блока, в котором функции рёбер считаются векторно
+const int BLOCK = 8;
+
+// Экранные координаты округляются до 1/16 пикселя. Тогда коэффициенты
+// рёбер - точные разности, а свободный член точно считается в double,
+// и у соседних треугольников функции общего ребра отличаются ровно знаком
+const float SUBPIXEL = 16.0f;
+
+// Треугольник отсекается не по краям кадра, а по полосе вокруг него:
+// |x| <= GUARD * w и |y| <= GUARD * w
+const float GUARD = 3.0f;
+
+// Плоскости, линейные по экрану: глубина, 1/w и цвет, умноженный на 1/w
+enum { PLANE_Z, PLANE_Q, PLANE_R, PLANE_G, PLANE_B, PLANE_COUNT };
+
+// Подготовленный треугольник. Функция ребра k: E = a*x + b*y + c, внутри
+// треугольника E > 0 (или E >= 0 для левых и верхних рёбер, чтобы пиксель на
+// общем ребре достался ровно одному треугольнику). Плоскость
+// f(x, y) = base + da * (x - x0) + db * (y - y0) от первой вершины
+struct TriangleSetup {
+    float a[3], b[3];
+    double c[3];
+    float threshold[3];
+    float x0, y0;
+    float planeBase[PLANE_COUNT], planeDx[PLANE_COUNT], planeDy[PLANE_COUNT];
+    int minX, minY, maxX, maxY;
+};
+
+// Треугольники и раскладка по фрагментам одной части
+struct ChunkBins {
+    std::vector<TriangleSetup> triangles;
+    std::vector<uint32_t> start;   // начало списка фрагмента, tiles + 1
+    std::vector<uint16_t> items;   // номера треугольников части
+};
+
+inline float snap(float value) {
+    return std::floor(value * SUBPIXEL + 0.5f) / SUBPIXEL;
+}
+
+inline SoftRasterVertex lerp(const SoftRasterVertex& a, const SoftRasterVertex& b, float t) {
+    return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t,
+            a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t};
+}
+
+// Расстояния до плоскостей отсечения: ближняя и четыре стороны полосы
+inline void clipDistances(const SoftRasterVertex& v, float d[5]) {
+    d[0] = v.z + v.w;
+    d[1] = GUARD * v.w - v.x;
+    d[2] = GUARD * v.w + v.x;
+    d[3] = GUARD * v.w - v.y;
+    d[4] = GUARD * v.w + v.y;
+}
+
+// Отсечение многоугольника (Сазерленд-Ходжмен). Новая вершина всегда
+// считается от внутреннего конца ребра к внешнему, поэтому на общем ребре
+// соседних треугольников она одна и та же
+int clipPolygon(SoftRasterVertex* polygon, int count, SoftRasterVertex* scratch) {
+    for (int plane = 0; plane < 5 && count > 0; ++plane) {
+        int out = 0;
+        for (int i = 0; i < count; ++i) {
+            const SoftRasterVertex& cur = polygon[i];
+            const SoftRasterVertex& next = polygon[(i + 1) % count];
+            float dc[5], dn[5];
+            clipDistances(cur, dc);
+            clipDistances(next, dn);
+            bool curIn = dc[plane] >= 0, nextIn = dn[plane] >= 0;
+            if (curIn) scratch[out++] = cur;
+            if (curIn && !nextIn)
+                scratch[out++] = lerp(cur, next, dc[plane] / (dc[plane] - dn[plane]));
+            else if (!curIn && nextIn)
+                scratch[out++] = lerp(next, cur, dn[plane] / (dn[plane] - dc[plane]));
+        }
+        std::copy(scratch, scratch + out, polygon);
+        count = out;
+    }
+    return count;
+}
+
+// Экранный треугольник (y вниз) -> функции рёбер и плоскости. Возвращает
+// false для вырожденных, задних (при cull) и не задевающих ни одного
+// центра пикселя треугольников
+bool setupTriangle(const SoftRasterVertex& v0, const SoftRasterVertex& v1, const SoftRasterVertex& v2,
+                   int width, int height, bool cull, TriangleSetup& t) {
+    const SoftRasterVertex* in[3] = {&v0, &v1, &v2};
+    float x[3], y[3], attributes[3][PLANE_COUNT];
+    for (int k = 0; k < 3; ++k) {
+        const SoftRasterVertex& v = *in[k];
+        float q = 1.0f / v.w;
+        x[k] = snap((v.x * q * 0.5f + 0.5f) * width);
+        y[k] = snap((0.5f - v.y * q * 0.5f) * height);
+        attributes[k][PLANE_Z] = v.z * q * 0.5f + 0.5f;
+        attributes[k][PLANE_Q] = q;
+        attributes[k][PLANE_R] = v.r * q;
+        attributes[k][PLANE_G] = v.g * q;
+        attributes[k][PLANE_B] = v.b * q;
+    }
+
+    // Лицевые грани в OpenGL обходятся против часовой стрелки; с осью y
+    // вниз у них отрицательная площадь
+    double area = (static_cast<double>(x[1]) - x[0]) * (static_cast<double>(y[2]) - y[0]) -
+                  (static_cast<double>(x[2]) - x[0]) * (static_cast<double>(y[1]) - y[0]);
+    if (area == 0 || (cull && area > 0)) return false;
+    int order[3] = {0, 1, 2};
+    if (area < 0) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    float minX = std::min({x[0], x[1], x[2]}), maxX = std::max({x[0], x[1], x[2]});
+    float minY = std::min({y[0], y[1], y[2]}), maxY = std::max({y[0], y[1], y[2]});
+    t.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f)));
+    t.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+    t.maxX = std::min(width - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+    t.maxY = std::min(height - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+    if (t.minX > t.maxX || t.minY > t.maxY) return false;
+
+    // Ребро k лежит напротив вершины k: от вершины k + 1 к вершине k + 2
+    for (int k = 0; k < 3; ++k) {
+        int i = order[(k + 1) % 3], j = order[(k + 2) % 3];
+        t.a[k] = y[i] - y[j];
+        t.b[k] = x[j] - x[i];
+        t.c[k] = static_cast<double>(x[i]) * y[j] - static_cast<double>(x[j]) * y[i];
+        bool topLeft = t.a[k] > 0 || (t.a[k] == 0 && t.b[k] > 0);
+        t.threshold[k] = topLeft ? 0.0f : std::numeric_limits<float>::denorm_min();
+    }
+
+    int first = order[0];
+    t.x0 = x[first];
+    t.y0 = y[first];
+    for (int p = 0; p < PLANE_COUNT; ++p) {
+        double da = 0, db = 0;
+        for (int k = 0; k < 3; ++k) {
+            da += static_cast<double>(attributes[order[k]][p]) * t.a[k];
+            db += static_cast<double>(attributes[order[k]][p]) * t.b[k];
+        }
+        t.planeBase[p] = attributes[first][p];
+        t.planeDx[p] = static_cast<float>(da / area);
+        t.planeDy[p] = static_cast<float>(db / area);
+    }
+    return true;
+}
+
+// Может ли треугольник покрыть центр пикселя в прямоугольнике центров
+// [x0, x1] x [y0, y1]. С запасом: лишний фрагмент или блок лишь проверяется
+// впустую, а пропущенный потерял бы пиксели
+bool mayCover(const TriangleSetup& t, double x0, double y0, double x1, double y1) {
+    for (int k = 0; k < 3; ++k) {
+        double maxEdge = t.c[k] + t.a[k] * (t.a[k] > 0 ? x1 : x0) + t.b[k] * (t.b[k] > 0 ? y1 : y0);
+        if (maxEdge < -0.01 * (std::fabs(t.a[k]) + std::fabs(t.b[k]))) return false;
+    }
+    return true;
+}
+
+inline uint32_t packColor(float r, float g, float b) {
+    auto channel = [](float c) {
+        return static_cast<uint32_t>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+    };
+    return channel(r) | channel(g) << 8 | channel(b) << 16 | 0xFF000000u;
+}
+
+// Блок 8x8 с левым верхним углом (bx, by). color и depth указывают на
+// этот угол в буферах со строкой stride
+void rasterBlock(const TriangleSetup& t, int bx, int by, uint32_t* color, float* depth, int stride) {
+    // Функции рёбер относительно угла блока: малые числа, и знак на общем
+    // ребре соседних треугольников по-прежнему противоположный
+    float edge[3];
+    for (int k = 0; k < 3; ++k) {
+        edge[k] = static_cast<float>(static_cast<double>(t.a[k]) * bx + static_cast<double>(t.b[k]) * by + t.c[k]);
+    }
+    float base[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; ++p) {
+        base[p] = t.planeBase[p] + t.planeDx[p] * (bx - t.x0) + t.planeDy[p] * (by - t.y0);
+    }
+
+#if defined(__AVX2__)
+    const __m256 dx = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    __m256 edgeX[3], threshold[3], planeX[PLANE_COUNT];
+    for (int k = 0; k < 3; ++k) {
+        edgeX[k] = _mm256_mul_ps(_mm256_set1_ps(t.a[k]), dx);
+        threshold[k] = _mm256_set1_ps(t.threshold[k]);
+    }
+    for (int p = 0; p < PLANE_COUNT; ++p) {
+        planeX[p] = _mm256_mul_ps(_mm256_set1_ps(t.planeDx[p]), dx);
+    }
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+    for (int row = 0; row < BLOCK; ++row) {
+        float dy = row + 0.5f;
+        __m256 inside = _mm256_cmp_ps(_mm256_add_ps(edgeX[0], _mm256_set1_ps(t.b[0] * dy + edge[0])), threshold[0], _CMP_GE_OQ);
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(edgeX[1], _mm256_set1_ps(t.b[1] * dy + edge[1])), threshold[1], _CMP_GE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(edgeX[2], _mm256_set1_ps(t.b[2] * dy + edge[2])), threshold[2], _CMP_GE_OQ));
+        if (_mm256_movemask_ps(inside) == 0) continue;
+
+        float* depthRow = depth + row * stride;
+        __m256 z = _mm256_add_ps(planeX[PLANE_Z], _mm256_set1_ps(base[PLANE_Z] + t.planeDy[PLANE_Z] * dy));
+        __m256 oldDepth = _mm256_loadu_ps(depthRow);
+        __m256 pass = _mm256_and_ps(inside, _mm256_cmp_ps(z, oldDepth, _CMP_LT_OQ));
+        if (_mm256_movemask_ps(pass) == 0) continue;
+        _mm256_storeu_ps(depthRow, _mm256_blendv_ps(oldDepth, z, pass));
+
+        __m256 q = _mm256_add_ps(planeX[PLANE_Q], _mm256_set1_ps(base[PLANE_Q] + t.planeDy[PLANE_Q] * dy));
+        __m256 w = _mm256_div_ps(one, q);
+        __m256i packed = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+        for (int p = PLANE_R; p <= PLANE_B; ++p) {
+            __m256 c = _mm256_mul_ps(_mm256_add_ps(planeX[p], _mm256_set1_ps(base[p] + t.planeDy[p] * dy)), w);
+            c = _mm256_min_ps(_mm256_max_ps(c, zero), one);
+            __m256i channel = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, scale), half));
+            packed = _mm256_or_si256(packed, _mm256_sllv_epi32(channel, _mm256_set1_epi32(8 * (p - PLANE_R))));
+        }
+        __m256i* colorRow = reinterpret_cast<__m256i*>(color + row * stride);
+        __m256i oldColor = _mm256_loadu_si256(colorRow);
+        _mm256_storeu_si256(colorRow, _mm256_blendv_epi8(oldColor, packed, _mm256_castps_si256(pass)));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    for (int part = 0; part < BLOCK; part += 4) {
+        const __m128 dx = _mm_setr_ps(part + 0.5f, part + 1.5f, part + 2.5f, part + 3.5f);
+        __m128 edgeX[3], threshold[3], planeX[PLANE_COUNT];
+        for (int k = 0; k < 3; ++k) {
+            edgeX[k] = _mm_mul_ps(_mm_set1_ps(t.a[k]), dx);
+            threshold[k] = _mm_set1_ps(t.threshold[k]);
+        }
+        for (int p = 0; p < PLANE_COUNT; ++p) {
+            planeX[p] = _mm_mul_ps(_mm_set1_ps(t.planeDx[p]), dx);
+        }
+        for (int row = 0; row < BLOCK; ++row) {
+            float dy = row + 0.5f;
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(edgeX[0], _mm_set1_ps(t.b[0] * dy + edge[0])), threshold[0]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(edgeX[1], _mm_set1_ps(t.b[1] * dy + edge[1])), threshold[1]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(edgeX[2], _mm_set1_ps(t.b[2] * dy + edge[2])), threshold[2]));
+            if (_mm_movemask_ps(inside) == 0) continue;
+
+            float* depthRow = depth + row * stride + part;
+            __m128 z = _mm_add_ps(planeX[PLANE_Z], _mm_set1_ps(base[PLANE_Z] + t.planeDy[PLANE_Z] * dy));
+            __m128 oldDepth = _mm_loadu_ps(depthRow);
+            __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, oldDepth));
+            if (_mm_movemask_ps(pass) == 0) continue;
+            _mm_storeu_ps(depthRow, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldDepth)));
+
+            __m128 q = _mm_add_ps(planeX[PLANE_Q], _mm_set1_ps(base[PLANE_Q] + t.planeDy[PLANE_Q] * dy));
+            __m128 w = _mm_div_ps(one, q);
+            __m128i packed = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+            for (int p = PLANE_R; p <= PLANE_B; ++p) {
+                __m128 c = _mm_mul_ps(_mm_add_ps(planeX[p], _mm_set1_ps(base[p] + t.planeDy[p] * dy)), w);
+                c = _mm_min_ps(_mm_max_ps(c, zero), one);
+                __m128i channel = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, scale), half));
+                packed = _mm_or_si128(packed, _mm_sll_epi32(channel, _mm_cvtsi32_si128(8 * (p - PLANE_R))));
+            }
+            __m128i* colorRow = reinterpret_cast<__m128i*>(color + row * stride + part);
+            __m128i mask = _mm_castps_si128(pass);
+            __m128i oldColor = _mm_loadu_si128(colorRow);
+            _mm_storeu_si128(colorRow, _mm_or_si128(_mm_and_si128(mask, packed), _mm_andnot_si128(mask, oldColor)));
+        }
+    }
+#else
+    for (int row = 0; row < BLOCK; ++row) {
+        float dy = row + 0.5f;
+        float rowEdge[3], rowBase[PLANE_COUNT];
+        for (int k = 0; k < 3; ++k) rowEdge[k] = t.b[k] * dy + edge[k];
+        for (int p = 0; p < PLANE_COUNT; ++p) rowBase[p] = base[p] + t.planeDy[p] * dy;
+        for (int column = 0; column < BLOCK; ++column) {
+            float dx = column + 0.5f;
+            if (t.a[0] * dx + rowEdge[0] < t.threshold[0] || t.a[1] * dx + rowEdge[1] < t.threshold[1] ||
+                t.a[2] * dx + rowEdge[2] < t.threshold[2]) continue;
+            float z = t.planeDx[PLANE_Z] * dx + rowBase[PLANE_Z];
+            float& stored = depth[row * stride + column];
+            if (!(z < stored)) continue;
+            stored = z;
+            float w = 1.0f / (t.planeDx[PLANE_Q] * dx + rowBase[PLANE_Q]);
+            color[row * stride + column] = packColor((t.planeDx[PLANE_R] * dx + rowBase[PLANE_R]) * w,
+                                                     (t.planeDx[PLANE_G] * dx + rowBase[PLANE_G]) * w,
+                                                     (t.planeDx[PLANE_B] * dx + rowBase[PLANE_B]) * w);
+        }
+    }
+#endif
+}
+
+} // namespace
+
+SoftRasterizer::SoftRasterizer(int threads) : pool(threads) {
+}
+
+void SoftRasterizer::resize(int newWidth, int newHeight) {
+    width = std::max(0, newWidth);
+    height = std::max(0, newHeight);
+    stride = (width + BLOCK - 1) / BLOCK * BLOCK;
+    rows = (height + BLOCK - 1) / BLOCK * BLOCK;
+    color.assign(static_cast<size_t>(stride) * rows, 0xFF000000u);
+    depth.assign(static_cast<size_t>(stride) * rows, 1.0f);
+    pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+}
+
+void SoftRasterizer::clear(const float background[4]) {
+    std::fill(color.begin(), color.end(), packColor(background[0], background[1], background[2]));
+    std::fill(depth.begin(), depth.end(), 1.0f);
+    vertices.clear();
+    indices.clear();
+    frameStats = SoftRasterStats();
+}
+
+void SoftRasterizer::setProjection(const Mat4& newProjection) {
+    projection = newProjection;
+}
+
+void SoftRasterizer::setLights(const LightSource newLights[2], const float newSceneAmbient[4], const Mat4& newView) {
+    lights[0] = newLights[0];
+    lights[1] = newLights[1];
+    std::copy(newSceneAmbient, newSceneAmbient + 4, sceneAmbient);
+    view = newView;
+}
+
+void SoftRasterizer::draw(const MeshData& mesh, const Mat4& modelView, const Material& material) {
+    const LightingSetup setup = makeLightingSetup(lights, sceneAmbient, view, modelView, material);
+    const float* m = setup.modelView;
+    const float* nm = setup.normalMatrix;
+    const float* p = projection.m;
+
+    const size_t first = vertices.size();
+    const size_t count = mesh.vertices.size();
+    vertices.resize(first + count);
+    pool.parallelFor((count + VERTEX_CHUNK - 1) / VERTEX_CHUNK, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * VERTEX_CHUNK);
+        for (size_t i = chunk * VERTEX_CHUNK; i < end; ++i) {
+            const float* v = mesh.vertices[i].position;
+            const float* n = mesh.vertices[i].normal;
+            float eye[3], normal[3], color[3];
+            for (int row = 0; row < 3; ++row) {
+                eye[row] = m[row] * v[0] + m[4 + row] * v[1] + m[8 + row] * v[2] + m[12 + row];
+                normal[row] = nm[row] * n[0] + nm[3 + row] * n[1] + nm[6 + row] * n[2];
+            }
+            // Нормали нормируются, как при GL_NORMALIZE
+            float inverse = 1.0f / std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            for (float& c : normal) c *= inverse;
+            shadeVertex(setup, eye, normal, color);
+
+            SoftRasterVertex& out = vertices[first + i];
+            out.x = p[0] * eye[0] + p[8] * eye[2];
+            out.y = p[5] * eye[1] + p[9] * eye[2];
+            out.z = p[10] * eye[2] + p[14];
+            out.w = -eye[2];
+            out.r = color[0];
+            out.g = color[1];
+            out.b = color[2];
+        }
+    });
+
+    indices.reserve(indices.size() + mesh.indices.size());
+    for (uint32_t index : mesh.indices) indices.push_back(static_cast<uint32_t>(first + index));
+    frameStats.triangles += mesh.indices.size() / 3;
+}
+
+void SoftRasterizer::finish() {
+    const size_t triangles = indices.size() / 3;
+    const int size = std::max(BLOCK, (tileSize + BLOCK - 1) / BLOCK * BLOCK);
+    const int tilesX = (width + size - 1) / size;
+    const int tilesY = (height + size - 1) / size;
+    const size_t tiles = static_cast<size_t>(tilesX) * tilesY;
+
+    // Отсечение, подготовка и раскладка по частям: подсчёт, смещения, заполнение
+    const size_t chunks = (triangles + TRIANGLE_CHUNK - 1) / TRIANGLE_CHUNK;
+    std::vector<ChunkBins> bins(chunks);
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        ChunkBins& bin = bins[chunk];
+        size_t end = std::min(triangles, (chunk + 1) * TRIANGLE_CHUNK);
+        SoftRasterVertex polygon[8], scratch[8];
+        for (size_t i = chunk * TRIANGLE_CHUNK; i < end; ++i) {
+            const SoftRasterVertex* v[3] = {&vertices[indices[3 * i]], &vertices[indices[3 * i + 1]],
+                                            &vertices[indices[3 * i + 2]]};
+            // Целиком за одной из плоскостей - отбрасывается, целиком внутри
+            // полосы - не отсекается
+            int outside[6] = {}, inside = 0;
+            for (const SoftRasterVertex* vertex : v) {
+                float d[5];
+                clipDistances(*vertex, d);
+                bool all = true;
+                for (int plane = 0; plane < 5; ++plane) {
+                    if (d[plane] < 0) {
+                        outside[plane]++;
+                        all = false;
+                    }
+                }
+                if (vertex->z > vertex->w) outside[5]++;
+                inside += all;
+            }
+            if (std::max({outside[0], outside[1], outside[2], outside[3], outside[4], outside[5]}) == 3) continue;
+
+            TriangleSetup setup;
+            if (inside == 3) {
+                if (setupTriangle(*v[0], *v[1], *v[2], width, height, cullBackFaces, setup))
+                    bin.triangles.push_back(setup);
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) polygon[k] = *v[k];
+            int count = clipPolygon(polygon, 3, scratch);
+            for (int k = 2; k < count; ++k) {
+                if (setupTriangle(polygon[0], polygon[k - 1], polygon[k], width, height, cullBackFaces, setup))
+                    bin.triangles.push_back(setup);
+            }
+        }
+
+        // Фрагменты, центры пикселей которых может задеть треугольник
+        auto forTiles = [&](const TriangleSetup& t, auto&& visit) {
+            int tx0 = t.minX / size, tx1 = t.maxX / size;
+            int ty0 = t.minY / size, ty1 = t.maxY / size;
+            for (int ty = ty0; ty <= ty1; ++ty) {
+                for (int tx = tx0; tx <= tx1; ++tx) {
+                    if ((tx0 != tx1 || ty0 != ty1) &&
+                        !mayCover(t, tx * size + 0.5, ty * size + 0.5, (tx + 1) * size - 0.5, (ty + 1) * size - 0.5))
+                        continue;
+                    visit(static_cast<size_t>(ty) * tilesX + tx);
+                }
+            }
+        };
+        bin.start.assign(tiles + 1, 0);
+        for (const TriangleSetup& t : bin.triangles) {
+            forTiles(t, [&](size_t tile) { bin.start[tile + 1]++; });
+        }
+        for (size_t tile = 0; tile < tiles; ++tile) {
+            bin.start[tile + 1] += bin.start[tile];
+        }
+        bin.items.resize(bin.start[tiles]);
+        std::vector<uint32_t> fill(bin.start.begin(), bin.start.end() - 1);
+        for (size_t k = 0; k < bin.triangles.size(); ++k) {
+            forTiles(bin.triangles[k], [&](size_t tile) {
+                bin.items[fill[tile]++] = static_cast<uint16_t>(k);
+            });
+        }
+    });
+    for (const ChunkBins& bin : bins) {
+        frameStats.rasterized += bin.triangles.size();
+        frameStats.binned += bin.items.size();
+    }
+
+    // Фрагменты рисуются независимо, треугольники - в исходном порядке.
+    // Блоки выровнены по сетке 8x8 всего кадра, а не фрагмента
+    pool.parallelFor(tiles, [&](size_t tile) {
+        int tx = static_cast<int>(tile % tilesX), ty = static_cast<int>(tile / tilesX);
+        int x0 = tx * size, y0 = ty * size;
+        int x1 = std::min(width, x0 + size) - 1, y1 = std::min(height, y0 + size) - 1;
+        for (const ChunkBins& bin : bins) {
+            for (uint32_t k = bin.start[tile]; k < bin.start[tile + 1]; ++k) {
+                const TriangleSetup& t = bin.triangles[bin.items[k]];
+                int bx0 = std::max(x0, t.minX) / BLOCK * BLOCK, bx1 = std::min(x1, t.maxX);
+                int by0 = std::max(y0, t.minY) / BLOCK * BLOCK, by1 = std::min(y1, t.maxY);
+                for (int by = by0; by <= by1; by += BLOCK) {
+                    for (int bx = bx0; bx <= bx1; bx += BLOCK) {
+                        if (!mayCover(t, bx + 0.5, by + 0.5, bx + BLOCK - 0.5, by + BLOCK - 0.5)) continue;
+                        size_t offset = static_cast<size_t>(by) * stride + bx;
+                        rasterBlock(t, bx, by, &color[offset], &depth[offset], stride);
+                    }
+                }
+            }
+        }
+    });
+
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(&pixels[static_cast<size_t>(y) * width * 4], &color[static_cast<size_t>(y) * stride],
+                    static_cast<size_t>(width) * 4);
+    }
+}
+
+uint64_t SoftRasterizer::checksum() const {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : pixels) {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// Программная растеризация треугольников для сцены лабораторной работы 2:
+// тот же кадр, что рисует OpenGL в окне, но без окна и без видеокарты.
+// Повторяет фиксированный конвейер lab2: вершины переводятся в координаты
+// вида и проецируются перспективной матрицей, освещение двумя источниками
+// (Фонг-Блинн, бесконечно удалённый наблюдатель) считается в вершинах и
+// интерполируется по треугольнику с учётом перспективы, видимость - по
+// буферу глубины (GL_LESS).
+// Кадр делится на квадратные фрагменты; треугольники раскладываются по
+// фрагментам, которые они задевают, и каждый фрагмент растеризуется одним
+// потоком без блокировок, блоками 8x8 пикселей. Функции рёбер и глубина
+// считаются сразу для строки блока (AVX2 - 8 пикселей, SSE2 - дважды по 4).
+// Внутри фрагмента треугольники рисуются в исходном порядке, а пиксель
+// треугольника не зависит от того, через какой фрагмент он рисуется,
+// поэтому кадр не зависит от числа потоков и размера фрагментов
+
+#include "lab2_scene.h"
+#include "task_pool.h"
+#include <cstdint>
+#include <vector>
+
+// Вершина после преобразования: координаты отсечения и освещённый цвет
+struct SoftRasterVertex {
+    float x, y, z, w;
+    float r, g, b;
+};
+
+// Счётчики последнего кадра
+struct SoftRasterStats {
+    size_t triangles = 0;   // переданных в draw
+    size_t rasterized = 0;  // после отсечения и отбрасывания задних граней
+    size_t binned = 0;      // ссылок на треугольники из фрагментов
+};
+
+class SoftRasterizer {
+public:
+    // threads - общее число потоков с учётом вызывающего, 0 - по числу ядер
+    explicit SoftRasterizer(int threads = 0);
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+    SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+    int threadCount() const { return pool.threadCount(); }
+
+    void resize(int width, int height);
+
+    // Начало кадра: фон, глубина 1, треугольники прошлого кадра забываются
+    void clear(const float background[4]);
+
+    // Перспективная проекция вида frustum() или perspective() из cg_math.h:
+    // берутся только её ненулевые элементы
+    void setProjection(const Mat4& projection);
+
+    // Источники в мировых координатах; как glLightfv(GL_POSITION) при
+    // загруженной видовой матрице, они переводятся в координаты вида
+    void setLights(const LightSource lights[2], const float sceneAmbient[4], const Mat4& view);
+
+    // Сетка с матрицей модель-вид и материалом. Вершины сразу преобразуются
+    // и освещаются, треугольники копятся до finish()
+    void draw(const MeshData& mesh, const Mat4& modelView, const Material& material);
+
+    // Отсечение, раскладка треугольников кадра по фрагментам и растеризация
+    void finish();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // RGBA построчно сверху вниз, после finish()
+    const uint8_t* getPixels() const { return pixels.data(); }
+
+    // Контрольная сумма пикселей (FNV-1a) для сравнения результатов
+    uint64_t checksum() const;
+
+    const SoftRasterStats& stats() const { return frameStats; }
+
+    int tileSize = 64;          // сторона фрагмента, округляется до кратной 8
+    bool cullBackFaces = true;  // грани, повёрнутые от камеры, не рисуются
+
+private:
+    TaskPool pool;
+
+    int width = 0, height = 0;
+    int stride = 0, rows = 0;       // размеры буферов, кратные 8
+    std::vector<uint32_t> color;    // stride x rows, RGBA в порядке байтов
+    std::vector<float> depth;
+    std::vector<uint8_t> pixels;    // width x height
+
+    Mat4 projection = {};
+    Mat4 view = {};
+    LightSource lights[2] = {};
+    float sceneAmbient[4] = {};
+
+    std::vector<SoftRasterVertex> vertices;  // вершины всех сеток кадра
+    std::vector<uint32_t> indices;           // по три на треугольник
+    SoftRasterStats frameStats;
+};
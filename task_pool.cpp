@@ -0,0 +1,94 @@
+#include "task_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+struct TaskPoolBatch {
+    const std::function<void(size_t)>* run;
+    size_t count;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mtx;
+    std::condition_variable finished;
+
+    // Разбор номеров; возвращается, когда свободных не осталось
+    void work() {
+        for (;;) {
+            size_t i = next++;
+            if (i >= count) return;
+            (*run)(i);
+            if (++done == count) {
+                std::lock_guard<std::mutex> lock(mtx);
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+TaskPool::TaskPool(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(&TaskPool::workerLoop, this);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+TaskPool& TaskPool::shared() {
+    static TaskPool pool;
+    return pool;
+}
+
+void TaskPool::workerLoop() {
+    // Последняя взятая задача держится, пока не придёт следующая,
+    // чтобы не взять одну задачу дважды
+    std::shared_ptr<TaskPoolBatch> last;
+    for (;;) {
+        std::shared_ptr<TaskPoolBatch> batch;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return stopping || (current && current != last); });
+            if (stopping) return;
+            batch = current;
+        }
+        batch->work();
+        last = std::move(batch);
+    }
+}
+
+void TaskPool::parallelFor(size_t count, const std::function<void(size_t)>& run) {
+    std::lock_guard<std::mutex> call(callMtx);
+    if (count == 0) return;
+    if (workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) run(i);
+        return;
+    }
+
+    auto batch = std::make_shared<TaskPoolBatch>();
+    batch->run = &run;
+    batch->count = count;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        current = batch;
+    }
+    cv.notify_all();
+    batch->work();
+    {
+        std::unique_lock<std::mutex> lock(batch->mtx);
+        batch->finished.wait(lock, [&] { return batch->done == count; });
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current == batch) current.reset();
+}
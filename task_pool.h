@@ -0,0 +1,45 @@
+#pragma once
+
+// Пул потоков для отсечения и растеризации отрезков (лабораторная работа 1),
+// программной растеризации и освещения (лабораторная работа 2) и раскладки
+// прожекторов по кластерам (лабораторная работа 4).
+// Задача - вызов run(i) для i из [0, count); потоки пула и вызывающий поток
+// разбирают номера по очереди, вызов возвращается, когда выполнены все.
+// Вызовы из разных потоков выполняются по одному
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TaskPoolBatch;
+
+class TaskPool {
+public:
+    // threads - общее число потоков с учётом вызывающего, 0 - по числу ядер
+    explicit TaskPool(int threads = 0);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // Общий пул по числу ядер
+    static TaskPool& shared();
+
+    int threadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& run);
+
+private:
+    std::vector<std::thread> workers;
+    std::shared_ptr<TaskPoolBatch> current;
+    std::mutex mtx;
+    std::mutex callMtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void workerLoop();
+};
@@ -0,0 +1,277 @@
+#include "vertex_lighting.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+// Вершин в одной части при освещении на пуле
+const size_t LIGHTING_CHUNK = 1 << 14;
+
+inline uint32_t toByte(float c) {
+    return static_cast<uint32_t>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+#if defined(__AVX2__)
+// x в степени exponent возведением в квадрат: показатель блеска постоянен
+// для всей сетки, а векторного pow нет
+inline __m256 powInteger(__m256 x, int exponent) {
+    __m256 result = _mm256_set1_ps(1.0f);
+    while (exponent > 0) {
+        if (exponent & 1) result = _mm256_mul_ps(result, x);
+        x = _mm256_mul_ps(x, x);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+inline __m256 dot3(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+inline __m128 powInteger(__m128 x, int exponent) {
+    __m128 result = _mm_set1_ps(1.0f);
+    while (exponent > 0) {
+        if (exponent & 1) result = _mm_mul_ps(result, x);
+        x = _mm_mul_ps(x, x);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+#endif
+
+} // namespace
+
+LightingMesh toLightingMesh(const MeshData& mesh) {
+    LightingMesh out;
+    size_t count = mesh.vertices.size();
+    out.px.resize(count);
+    out.py.resize(count);
+    out.pz.resize(count);
+    out.nx.resize(count);
+    out.ny.resize(count);
+    out.nz.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const MeshVertex& v = mesh.vertices[i];
+        out.px[i] = v.position[0];
+        out.py[i] = v.position[1];
+        out.pz[i] = v.position[2];
+        out.nx[i] = v.normal[0];
+        out.ny[i] = v.normal[1];
+        out.nz[i] = v.normal[2];
+    }
+    return out;
+}
+
+LightingSetup makeLightingSetup(const LightSource lights[2], const float sceneAmbient[4],
+                                const Mat4& view, const Mat4& modelView, const Material& material) {
+    LightingSetup setup;
+    const float* m = modelView.m;
+    std::copy(m, m + 16, setup.modelView);
+
+    // Столбцы обратной транспонированной матрицы - попарные векторные
+    // произведения столбцов; на определитель не делим, нормали всё равно
+    // нормируются, нужен только его знак
+    Vec3 c0 = {m[0], m[1], m[2]}, c1 = {m[4], m[5], m[6]}, c2 = {m[8], m[9], m[10]};
+    Vec3 columns[3] = {cross(c1, c2), cross(c2, c0), cross(c0, c1)};
+    float sign = dot(c0, columns[0]) < 0 ? -1.0f : 1.0f;
+    for (int k = 0; k < 3; ++k) {
+        setup.normalMatrix[3 * k] = columns[k].x * sign;
+        setup.normalMatrix[3 * k + 1] = columns[k].y * sign;
+        setup.normalMatrix[3 * k + 2] = columns[k].z * sign;
+    }
+
+    for (int light = 0; light < 2; ++light) {
+        const float* p = lights[light].position;
+        for (int row = 0; row < 3; ++row) {
+            setup.lightPosition[light][row] =
+                view.m[row] * p[0] + view.m[4 + row] * p[1] + view.m[8 + row] * p[2] + view.m[12 + row] * p[3];
+        }
+    }
+    for (int k = 0; k < 3; ++k) {
+        setup.emitted[k] = sceneAmbient[k] * material.ambient[k];
+        for (int light = 0; light < 2; ++light) {
+            setup.emitted[k] += lights[light].ambient[k] * material.ambient[k];
+            setup.diffuse[light][k] = lights[light].diffuse[k] * material.diffuse[k];
+            setup.specular[light][k] = lights[light].specular[k] * material.specular[k];
+        }
+    }
+    setup.shininess = material.shininess;
+    setup.alpha = material.diffuse[3];
+    return setup;
+}
+
+void shadeVertex(const LightingSetup& setup, const float eye[3], const float normal[3], float color[3]) {
+    Vec3 n = {normal[0], normal[1], normal[2]};
+    for (int k = 0; k < 3; ++k) color[k] = setup.emitted[k];
+    for (int light = 0; light < 2; ++light) {
+        const float* lp = setup.lightPosition[light];
+        Vec3 toLight = normalize(Vec3{lp[0] - eye[0], lp[1] - eye[1], lp[2] - eye[2]});
+        float diffuse = std::max(dot(n, toLight), 0.0f);
+        float specular = 0.0f;
+        if (diffuse > 0.0f) {
+            Vec3 halfway = normalize(toLight + Vec3{0.0f, 0.0f, 1.0f});
+            specular = std::pow(std::max(dot(n, halfway), 0.0f), setup.shininess);
+        }
+        for (int k = 0; k < 3; ++k) {
+            color[k] += setup.diffuse[light][k] * diffuse + setup.specular[light][k] * specular;
+        }
+    }
+    for (int k = 0; k < 3; ++k) color[k] = std::min(color[k], 1.0f);
+}
+
+void lightVertices(const LightingMesh& mesh, const LightingSetup& setup,
+                   size_t begin, size_t end, uint32_t* colors) {
+    const float* m = setup.modelView;
+    const float* nm = setup.normalMatrix;
+    const uint32_t alpha = toByte(setup.alpha) << 24;
+    size_t i = begin;
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    // Дробная часть показателя блеска (у материалов lab2 её нет) считается
+    // обычным pow для каждой вершины
+    const int whole = static_cast<int>(setup.shininess);
+    const float fraction = setup.shininess - whole;
+#endif
+
+#if defined(__AVX2__)
+    __m256 matrix[12], normalMatrix[9];
+    for (int k = 0; k < 12; ++k) matrix[k] = _mm256_set1_ps(m[k + k / 3]);
+    for (int k = 0; k < 9; ++k) normalMatrix[k] = _mm256_set1_ps(nm[k]);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+    for (; i + 8 <= end; i += 8) {
+        __m256 px = _mm256_loadu_ps(&mesh.px[i]), py = _mm256_loadu_ps(&mesh.py[i]), pz = _mm256_loadu_ps(&mesh.pz[i]);
+        __m256 nx = _mm256_loadu_ps(&mesh.nx[i]), ny = _mm256_loadu_ps(&mesh.ny[i]), nz = _mm256_loadu_ps(&mesh.nz[i]);
+
+        // matrix[k] - элемент (k % 3, k / 3), четвёртый столбец - сдвиг
+        __m256 eye[3], normal[3];
+        for (int row = 0; row < 3; ++row) {
+            eye[row] = _mm256_add_ps(dot3(matrix[row], matrix[3 + row], matrix[6 + row], px, py, pz), matrix[9 + row]);
+            normal[row] = dot3(normalMatrix[row], normalMatrix[3 + row], normalMatrix[6 + row], nx, ny, nz);
+        }
+        __m256 inverse = _mm256_div_ps(one, _mm256_sqrt_ps(dot3(normal[0], normal[1], normal[2], normal[0], normal[1], normal[2])));
+        for (__m256& c : normal) c = _mm256_mul_ps(c, inverse);
+
+        __m256 color[3];
+        for (int k = 0; k < 3; ++k) color[k] = _mm256_set1_ps(setup.emitted[k]);
+        for (int light = 0; light < 2; ++light) {
+            __m256 l[3];
+            for (int k = 0; k < 3; ++k) l[k] = _mm256_sub_ps(_mm256_set1_ps(setup.lightPosition[light][k]), eye[k]);
+            inverse = _mm256_div_ps(one, _mm256_sqrt_ps(dot3(l[0], l[1], l[2], l[0], l[1], l[2])));
+            for (__m256& c : l) c = _mm256_mul_ps(c, inverse);
+            __m256 diffuse = _mm256_max_ps(dot3(normal[0], normal[1], normal[2], l[0], l[1], l[2]), zero);
+
+            __m256 hz = _mm256_add_ps(l[2], one);
+            inverse = _mm256_div_ps(one, _mm256_sqrt_ps(dot3(l[0], l[1], hz, l[0], l[1], hz)));
+            __m256 facing = _mm256_max_ps(_mm256_mul_ps(dot3(normal[0], normal[1], normal[2], l[0], l[1], hz), inverse), zero);
+            __m256 specular = powInteger(facing, whole);
+            if (fraction > 0.0f) {
+                alignas(32) float lanes[8], powers[8];
+                _mm256_store_ps(lanes, facing);
+                for (int k = 0; k < 8; ++k) powers[k] = std::pow(lanes[k], fraction);
+                specular = _mm256_mul_ps(specular, _mm256_load_ps(powers));
+            }
+            // Блик только у освещённой стороны
+            specular = _mm256_and_ps(specular, _mm256_cmp_ps(diffuse, zero, _CMP_GT_OQ));
+
+            for (int k = 0; k < 3; ++k) {
+                color[k] = _mm256_add_ps(color[k], _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(setup.diffuse[light][k]), diffuse),
+                                                                 _mm256_mul_ps(_mm256_set1_ps(setup.specular[light][k]), specular)));
+            }
+        }
+
+        __m256i packed = _mm256_set1_epi32(static_cast<int>(alpha));
+        for (int k = 0; k < 3; ++k) {
+            __m256 c = _mm256_min_ps(_mm256_max_ps(color[k], zero), one);
+            __m256i channel = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, scale), half));
+            packed = _mm256_or_si256(packed, _mm256_sllv_epi32(channel, _mm256_set1_epi32(8 * k)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i), packed);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128 matrix[12], normalMatrix[9];
+    for (int k = 0; k < 12; ++k) matrix[k] = _mm_set1_ps(m[k + k / 3]);
+    for (int k = 0; k < 9; ++k) normalMatrix[k] = _mm_set1_ps(nm[k]);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= end; i += 4) {
+        __m128 px = _mm_loadu_ps(&mesh.px[i]), py = _mm_loadu_ps(&mesh.py[i]), pz = _mm_loadu_ps(&mesh.pz[i]);
+        __m128 nx = _mm_loadu_ps(&mesh.nx[i]), ny = _mm_loadu_ps(&mesh.ny[i]), nz = _mm_loadu_ps(&mesh.nz[i]);
+
+        __m128 eye[3], normal[3];
+        for (int row = 0; row < 3; ++row) {
+            eye[row] = _mm_add_ps(dot3(matrix[row], matrix[3 + row], matrix[6 + row], px, py, pz), matrix[9 + row]);
+            normal[row] = dot3(normalMatrix[row], normalMatrix[3 + row], normalMatrix[6 + row], nx, ny, nz);
+        }
+        __m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(dot3(normal[0], normal[1], normal[2], normal[0], normal[1], normal[2])));
+        for (__m128& c : normal) c = _mm_mul_ps(c, inverse);
+
+        __m128 color[3];
+        for (int k = 0; k < 3; ++k) color[k] = _mm_set1_ps(setup.emitted[k]);
+        for (int light = 0; light < 2; ++light) {
+            __m128 l[3];
+            for (int k = 0; k < 3; ++k) l[k] = _mm_sub_ps(_mm_set1_ps(setup.lightPosition[light][k]), eye[k]);
+            inverse = _mm_div_ps(one, _mm_sqrt_ps(dot3(l[0], l[1], l[2], l[0], l[1], l[2])));
+            for (__m128& c : l) c = _mm_mul_ps(c, inverse);
+            __m128 diffuse = _mm_max_ps(dot3(normal[0], normal[1], normal[2], l[0], l[1], l[2]), zero);
+
+            __m128 hz = _mm_add_ps(l[2], one);
+            inverse = _mm_div_ps(one, _mm_sqrt_ps(dot3(l[0], l[1], hz, l[0], l[1], hz)));
+            __m128 facing = _mm_max_ps(_mm_mul_ps(dot3(normal[0], normal[1], normal[2], l[0], l[1], hz), inverse), zero);
+            __m128 specular = powInteger(facing, whole);
+            if (fraction > 0.0f) {
+                alignas(16) float lanes[4], powers[4];
+                _mm_store_ps(lanes, facing);
+                for (int k = 0; k < 4; ++k) powers[k] = std::pow(lanes[k], fraction);
+                specular = _mm_mul_ps(specular, _mm_load_ps(powers));
+            }
+            specular = _mm_and_ps(specular, _mm_cmpgt_ps(diffuse, zero));
+
+            for (int k = 0; k < 3; ++k) {
+                color[k] = _mm_add_ps(color[k], _mm_add_ps(_mm_mul_ps(_mm_set1_ps(setup.diffuse[light][k]), diffuse),
+                                                           _mm_mul_ps(_mm_set1_ps(setup.specular[light][k]), specular)));
+            }
+        }
+
+        __m128i packed = _mm_set1_epi32(static_cast<int>(alpha));
+        for (int k = 0; k < 3; ++k) {
+            __m128 c = _mm_min_ps(_mm_max_ps(color[k], zero), one);
+            __m128i channel = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, scale), half));
+            packed = _mm_or_si128(packed, _mm_sll_epi32(channel, _mm_cvtsi32_si128(8 * k)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(colors + i), packed);
+    }
+#endif
+
+    // Остаток (и вся сетка без векторных команд)
+    for (; i < end; ++i) {
+        float eye[3], normal[3], color[3];
+        for (int row = 0; row < 3; ++row) {
+            eye[row] = m[row] * mesh.px[i] + m[4 + row] * mesh.py[i] + m[8 + row] * mesh.pz[i] + m[12 + row];
+            normal[row] = nm[row] * mesh.nx[i] + nm[3 + row] * mesh.ny[i] + nm[6 + row] * mesh.nz[i];
+        }
+        float inverse = 1.0f / std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (float& c : normal) c *= inverse;
+        shadeVertex(setup, eye, normal, color);
+        colors[i] = toByte(color[0]) | toByte(color[1]) << 8 | toByte(color[2]) << 16 | alpha;
+    }
+}
+
+void lightVertices(const LightingMesh& mesh, const LightingSetup& setup,
+                   std::vector<uint32_t>& colors, TaskPool& pool) {
+    const size_t count = mesh.size();
+    colors.resize(count);
+    pool.parallelFor((count + LIGHTING_CHUNK - 1) / LIGHTING_CHUNK, [&](size_t chunk) {
+        size_t begin = chunk * LIGHTING_CHUNK;
+        lightVertices(mesh, setup, begin, std::min(count, begin + LIGHTING_CHUNK), colors.data());
+    });
+}
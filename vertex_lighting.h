@@ -0,0 +1,55 @@
+#pragma once
+
+// Освещение вершин на процессоре (лабораторная работа 2): то же, что
+// фиксированный конвейер OpenGL считает по glLightfv/glMaterialfv, но без
+// него - фоновая, рассеянная и зеркальная (Фонг-Блинн, бесконечно
+// удалённый наблюдатель) составляющие от двух точечных источников.
+// Результат - цвет RGBA на вершину, который загружается в буфер цветов
+// и рисуется без освещения OpenGL.
+// Большие сетки хранятся по компонентам (SoA), так что восемь (AVX2) или
+// четыре (SSE2) вершины считаются одной командой; части сетки
+// освещаются на всех потоках пула
+
+#include "lab2_scene.h"
+#include "task_pool.h"
+#include <cstdint>
+#include <vector>
+
+// Вершины сетки по компонентам: положения и нормали отдельными массивами
+struct LightingMesh {
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+
+    size_t size() const { return px.size(); }
+};
+
+LightingMesh toLightingMesh(const MeshData& mesh);
+
+// Всё, что нужно для освещения вершин одной сетки: матрица модель-вид,
+// матрица нормалей, источники в координатах вида и произведения их цветов
+// на цвета материала
+struct LightingSetup {
+    float modelView[16];
+    float normalMatrix[9];      // по столбцам, обратная транспонированная
+    float lightPosition[2][3];
+    float emitted[3];           // фоновое освещение сцены и источников
+    float diffuse[2][3];
+    float specular[2][3];
+    float shininess;
+    float alpha;                // прозрачность рассеянного цвета материала
+};
+
+// Источники в мировых координатах переводятся в координаты вида матрицей view
+LightingSetup makeLightingSetup(const LightSource lights[2], const float sceneAmbient[4],
+                                const Mat4& view, const Mat4& modelView, const Material& material);
+
+// Цвет одной вершины по её положению и единичной нормали в координатах вида
+void shadeVertex(const LightingSetup& setup, const float eye[3], const float normal[3], float color[3]);
+
+// Вершины [begin, end) -> colors[begin, end) (RGBA, по байту на канал)
+void lightVertices(const LightingMesh& mesh, const LightingSetup& setup,
+                   size_t begin, size_t end, uint32_t* colors);
+
+// Вся сетка частями на потоках пула; colors приводится к размеру сетки
+void lightVertices(const LightingMesh& mesh, const LightingSetup& setup,
+                   std::vector<uint32_t>& colors, TaskPool& pool = TaskPool::shared());